@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file cgroup.h
+ * \brief cgroup v2 cpuset partition management.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_CGROUP_H
+#define RTVSUTILS_CGROUP_H
+
+#include <unistd.h>
+
+/**
+ * \enum cpuset_partition_type
+ * \brief Type of a cpuset partition (cpuset.cpus.partition).
+ */
+enum cpuset_partition_type
+{
+  /**
+   * \brief Not a partition or invalid partition.
+   */
+  CPUSET_PARTITION_INVALID = -1,
+
+  /**
+   * \brief Regular member of the parent partition.
+   */
+  CPUSET_PARTITION_MEMBER,
+
+  /**
+   * \brief Partition root, CPUs are load balanced inside the partition.
+   */
+  CPUSET_PARTITION_ROOT,
+
+  /**
+   * \brief Isolated partition, CPUs are removed from the scheduler load
+   * balancing domains.
+   */
+  CPUSET_PARTITION_ISOLATED,
+};
+
+/**
+ * \brief Sets the mount point of the cgroup v2 hierarchy.
+ *
+ * Default is "/sys/fs/cgroup". It can be changed to point to a fake tree for
+ * testing purposes.
+ * \param root path of the cgroup v2 hierarchy.
+ * \return 0 if success, negative value otherwise.
+ * \note This function is not thread-safe, call it before any other cgroup
+ * function.
+ */
+int cgroup_set_root(const char* root);
+
+/**
+ * \brief Returns the mount point of the cgroup v2 hierarchy.
+ * \return path of the cgroup v2 hierarchy.
+ */
+const char* cgroup_get_root(void);
+
+/**
+ * \brief Creates a cpuset partition.
+ *
+ * The cgroup is created under the cgroup root (name can contain
+ * intermediate directories that must already exist), the cpuset controller is
+ * enabled in the parent and the CPUs are assigned before switching the
+ * partition type.
+ * \param name name of the cgroup relative to the cgroup root.
+ * \param cpus array of CPU index (first CPU is 0, second is 1, ...).
+ * \param cpus_size size of the array.
+ * \param type type of partition.
+ * \param threaded if not 0, the cgroup is switched to threaded mode so that
+ * individual threads can be moved with cpuset_partition_move_thread().
+ * \return 0 if success, negative value otherwise.
+ * \note If the kernel refuses the partition (it reports it as invalid), the
+ * cgroup is removed and errno is set to EINVAL.
+ */
+int cpuset_partition_create(const char* name, const int* cpus,
+    size_t cpus_size, enum cpuset_partition_type type, int threaded);
+
+/**
+ * \brief Returns the type of a cpuset partition.
+ * \param name name of the cgroup relative to the cgroup root.
+ * \return type of the partition, CPUSET_PARTITION_INVALID if the kernel
+ * reports it as invalid or in case of error.
+ */
+enum cpuset_partition_type cpuset_partition_get_type(const char* name);
+
+/**
+ * \brief Moves a process (and all its threads) into a cpuset partition.
+ * \param name name of the cgroup relative to the cgroup root.
+ * \param pid PID of the process, 0 for the calling process.
+ * \return 0 if success, negative value otherwise.
+ */
+int cpuset_partition_move_process(const char* name, pid_t pid);
+
+/**
+ * \brief Moves a single thread into a threaded cpuset partition.
+ * \param name name of the cgroup relative to the cgroup root.
+ * \param tid kernel thread ID (gettid()), 0 for the calling thread.
+ * \return 0 if success, negative value otherwise.
+ * \note Partition must be created with threaded parameter set and the thread
+ * must belong to the threaded subtree of the parent.
+ */
+int cpuset_partition_move_thread(const char* name, pid_t tid);
+
+/**
+ * \brief Tears down a cpuset partition.
+ *
+ * Tasks still in the partition are moved back to the parent cgroup before
+ * the cgroup is removed.
+ * \param name name of the cgroup relative to the cgroup root.
+ * \return 0 if success, negative value otherwise.
+ */
+int cpuset_partition_destroy(const char* name);
+
+#endif /* RTVSUTILS_CGROUP_H */
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file cpuidle.h
+ * \brief CPU idle states and PM QoS latency control.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_CPUIDLE_H
+#define RTVSUTILS_CPUIDLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * \brief Maximum size of an idle state name (including NULL character).
+ */
+#define CPUIDLE_NAME_SIZE 32
+
+/**
+ * \brief Maximum size of an idle state description (including NULL
+ * character).
+ */
+#define CPUIDLE_DESC_SIZE 64
+
+/**
+ * \struct cpuidle_state
+ * \brief Idle state (C-state) of a CPU.
+ */
+struct cpuidle_state
+{
+  /**
+   * \brief Index of the state (stateN).
+   */
+  unsigned int index;
+
+  /**
+   * \brief Name of the state (i.e. "C6").
+   */
+  char name[CPUIDLE_NAME_SIZE];
+
+  /**
+   * \brief Description of the state.
+   */
+  char desc[CPUIDLE_DESC_SIZE];
+
+  /**
+   * \brief Exit latency in microseconds.
+   */
+  unsigned long latency;
+
+  /**
+   * \brief Target residency in microseconds.
+   */
+  unsigned long residency;
+
+  /**
+   * \brief If the state is disabled.
+   */
+  int disabled;
+};
+
+/**
+ * \brief Sets the system-wide CPU wakeup latency constraint.
+ *
+ * /dev/cpu_dma_latency is kept open with the requested value until
+ * pm_qos_release() is called or the process exits. Calling it again updates
+ * the value.
+ * \param latency maximum wakeup latency in microseconds (0 keeps all CPUs
+ * out of idle states).
+ * \return 0 if success, negative value otherwise.
+ */
+int pm_qos_set_latency(int32_t latency);
+
+/**
+ * \brief Returns the current system-wide CPU wakeup latency constraint.
+ * \return latency in microseconds (aggregated value of all requests),
+ * negative value otherwise.
+ */
+int32_t pm_qos_get_latency(void);
+
+/**
+ * \brief Releases the system-wide CPU wakeup latency constraint.
+ * \return 0 if success, negative value otherwise.
+ */
+int pm_qos_release(void);
+
+/**
+ * \brief Sets the wakeup latency constraint of a single CPU.
+ *
+ * Only the given CPU avoids idle states with a higher exit latency, other
+ * CPUs (i.e. housekeeping ones) can still enter deep idle states.
+ * \param cpu CPU id.
+ * \param latency maximum wakeup latency in microseconds, negative value to
+ * remove the constraint.
+ * \return 0 if success, negative value otherwise.
+ */
+int cpuidle_set_resume_latency(unsigned int cpu, long latency);
+
+/**
+ * \brief Returns the idle states of a CPU.
+ * \param cpu CPU id.
+ * \param states array that will receive the states (can be NULL to only
+ * count them).
+ * \param size size of the array.
+ * \return number of states, negative value otherwise.
+ */
+int cpuidle_get_states(unsigned int cpu, struct cpuidle_state* states,
+    size_t size);
+
+/**
+ * \brief Disables or enables an idle state of a CPU.
+ * \param cpu CPU id.
+ * \param state index of the state.
+ * \param disabled 1 to disable the state, 0 to enable it.
+ * \return 0 if success, negative value otherwise.
+ */
+int cpuidle_set_state_disabled(unsigned int cpu, unsigned int state,
+    int disabled);
+
+/**
+ * \brief Disables the idle states of a CPU whose exit latency is above a
+ * limit.
+ *
+ * Other states are left untouched, so a state disabled by the administrator
+ * stays disabled. tuning_restore() re-enables the states disabled here.
+ * \param cpu CPU id.
+ * \param latency maximum exit latency in microseconds.
+ * \return number of states above the limit, negative value otherwise.
+ */
+int cpuidle_limit_latency(unsigned int cpu, unsigned long latency);
+
+#endif /* RTVSUTILS_CPUIDLE_H */
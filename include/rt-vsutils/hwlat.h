@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file hwlat.h
+ * \brief Hardware/firmware latency (SMI) detector.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_HWLAT_H
+#define RTVSUTILS_HWLAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "rtutils.h"
+
+/**
+ * \struct hwlat_config
+ * \brief Configuration of the detector.
+ */
+struct hwlat_config
+{
+  /**
+   * \brief Array of CPU index to test, one detector thread per CPU.
+   */
+  const int* cpus;
+
+  /**
+   * \brief Size of the CPU array.
+   */
+  size_t cpus_size;
+
+  /**
+   * \brief SCHED_FIFO priority of the detector threads.
+   */
+  unsigned int priority;
+
+  /**
+   * \brief Gaps above this value in nanoseconds are recorded.
+   */
+  uint64_t threshold;
+
+  /**
+   * \brief Duration of a detection window in nanoseconds.
+   */
+  uint64_t window;
+
+  /**
+   * \brief Busy part of each window in nanoseconds (duty cycle is
+   * width / window), the rest of the window the thread sleeps.
+   */
+  uint64_t width;
+};
+
+/**
+ * \struct hwlat_stats
+ * \brief Results of a detector thread.
+ */
+struct hwlat_stats
+{
+  /**
+   * \brief CPU id.
+   */
+  int cpu;
+
+  /**
+   * \brief If not 0, the thread is pinned on its CPU (results may come from
+   * another CPU otherwise).
+   */
+  int pinned;
+
+  /**
+   * \brief If not 0, the thread runs with SCHED_FIFO priority (results are
+   * not reliable otherwise).
+   */
+  int rt;
+
+  /**
+   * \brief Number of clock reads.
+   */
+  uint64_t samples;
+
+  /**
+   * \brief Number of gaps above the threshold.
+   */
+  uint64_t gaps;
+
+  /**
+   * \brief Maximum gap in nanoseconds.
+   */
+  uint64_t max;
+};
+
+/**
+ * \brief Opaque detector.
+ */
+struct hwlat;
+
+/**
+ * \brief Starts the detector threads.
+ *
+ * Each thread is pinned to its CPU with SCHED_FIFO priority and busy-reads
+ * the TSC (see tsc_init()) during width nanoseconds of each window.
+ * Interrupts are left enabled, so a gap between two consecutive reads
+ * greater than the threshold is caused by something that preempted the
+ * CPU: SMI, hypervisor, or an interrupt on a non-isolated CPU.
+ * \param config configuration of the detector.
+ * \return detector or NULL if failure.
+ * \note RT throttling (rt_set_throttling()) can limit the busy part of a
+ * window.
+ */
+struct hwlat* hwlat_start(const struct hwlat_config* config);
+
+/**
+ * \brief Stops the detector threads and releases resources.
+ * \param hwlat the detector.
+ */
+void hwlat_stop(struct hwlat* hwlat);
+
+/**
+ * \brief Returns the results of a detector thread.
+ * \param hwlat the detector.
+ * \param index index of the CPU in the configuration array.
+ * \param stats pointer that will receive the results.
+ * \return 0 if success, negative value otherwise.
+ */
+int hwlat_get_stats(const struct hwlat* hwlat, size_t index,
+    struct hwlat_stats* stats);
+
+/**
+ * \brief Returns the histogram of the gaps above the threshold of a
+ * detector thread.
+ * \param hwlat the detector.
+ * \param index index of the CPU in the configuration array.
+ * \return histogram (values in nanoseconds) or NULL if failure.
+ */
+const struct rt_hist* hwlat_get_hist(const struct hwlat* hwlat,
+    size_t index);
+
+#endif /* RTVSUTILS_HWLAT_H */
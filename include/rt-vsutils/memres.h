@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file memres.h
+ * \brief Locked-memory residency verification and locked file mappings.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_MEMRES_H
+#define RTVSUTILS_MEMRES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * \brief Maximum length of a mapping path.
+ */
+#define MEM_PATH_SIZE 256
+
+/**
+ * \brief Mapping is writable (private copy, never written back).
+ */
+#define MEM_MAP_WRITE 0x01
+
+/**
+ * \brief Copy the file in huge pages (hugetlb if reserved, transparent
+ * huge pages otherwise).
+ */
+#define MEM_MAP_HUGE 0x02
+
+/**
+ * \struct mem_range
+ * \brief Mapping of the process.
+ */
+struct mem_range
+{
+  /**
+   * \brief First address.
+   */
+  uintptr_t start;
+
+  /**
+   * \brief Last address (excluded).
+   */
+  uintptr_t end;
+
+  /**
+   * \brief Permissions (i.e. "r-xp").
+   */
+  char perms[5];
+
+  /**
+   * \brief File or name of the mapping, empty if anonymous.
+   */
+  char path[MEM_PATH_SIZE];
+
+  /**
+   * \brief Locked bytes.
+   */
+  size_t locked;
+
+  /**
+   * \brief Resident bytes (mincore()).
+   */
+  size_t resident;
+};
+
+/**
+ * \struct mem_residency
+ * \brief Summary of a scan.
+ */
+struct mem_residency
+{
+  /**
+   * \brief Number of mappings checked.
+   */
+  size_t mappings;
+
+  /**
+   * \brief Total size of the mappings checked.
+   */
+  size_t size;
+
+  /**
+   * \brief Locked bytes.
+   */
+  size_t locked;
+
+  /**
+   * \brief Resident bytes.
+   */
+  size_t resident;
+
+  /**
+   * \brief Number of mappings not fully locked.
+   */
+  size_t unlocked_ranges;
+
+  /**
+   * \brief Number of mappings not fully resident.
+   */
+  size_t nonresident_ranges;
+};
+
+/**
+ * \struct mem_map
+ * \brief Locked mapping of a file.
+ */
+struct mem_map
+{
+  /**
+   * \brief Address of the data.
+   */
+  void* addr;
+
+  /**
+   * \brief Size of the file.
+   */
+  size_t size;
+
+  /**
+   * \brief Length of the mapping.
+   */
+  size_t length;
+
+  /**
+   * \brief 1 if backed by hugetlb pages, 0 otherwise.
+   */
+  int hugetlb;
+};
+
+/**
+ * \brief Checks that every mapping of the process is locked and resident.
+ *
+ * Mappings that cannot be locked (PROT_NONE guards, vDSO, I/O and PFN
+ * mappings) are skipped. Hugetlb mappings are never marked locked by the
+ * kernel but cannot be swapped out, they are counted as locked and resident.
+ * \param report summary, may be NULL.
+ * \param callback called for each mapping not fully locked or resident,
+ * may be NULL.
+ * \param data data of the callback.
+ * \return number of mappings not fully locked or resident, negative value
+ * if failure.
+ * \note It allocates and reads /proc, do not call it from a real-time
+ * cycle.
+ */
+int mem_residency_scan(struct mem_residency* report,
+    void (*callback)(const struct mem_range* range, void* data), void* data);
+
+/**
+ * \brief Maps a file (read-only unless MEM_MAP_WRITE), pre-faulted and
+ * locked.
+ *
+ * Unlike MAP_LOCKED alone, failing to lock the pages is an error.
+ * \param map mapping.
+ * \param path path of the file.
+ * \param flags MEM_MAP_WRITE and/or MEM_MAP_HUGE, 0 for a plain mapping.
+ * \return 0 if success, negative value otherwise (errno is set to EPERM or
+ * ENOMEM if memory cannot be locked).
+ */
+int mem_map_file(struct mem_map* map, const char* path, unsigned int flags);
+
+/**
+ * \brief Unmaps a file mapped by mem_map_file().
+ * \param map mapping.
+ */
+void mem_unmap_file(struct mem_map* map);
+
+#endif /* RTVSUTILS_MEMRES_H */
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file offload.h
+ * \brief Deferred-work queue from real-time threads to helper threads.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_OFFLOAD_H
+#define RTVSUTILS_OFFLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * \brief Maximum size of the payload copied with a job.
+ */
+#define OFFLOAD_PAYLOAD_SIZE 48
+
+/**
+ * \brief Job executed by a helper thread.
+ * \param payload copy of the payload given to offload_post().
+ */
+typedef void (*offload_fcn)(void* payload);
+
+/**
+ * \struct offload_config
+ * \brief Configuration of the queue.
+ */
+struct offload_config
+{
+  /**
+   * \brief Number of jobs that can be pending (power of two).
+   */
+  size_t capacity;
+
+  /**
+   * \brief Number of helper threads (SCHED_OTHER).
+   */
+  unsigned int helpers;
+
+  /**
+   * \brief Nice value of the helper threads.
+   */
+  int nice;
+
+  /**
+   * \brief Array of CPU index the helpers run on, NULL for all.
+   */
+  const int* cpus;
+
+  /**
+   * \brief Size of the CPU array.
+   */
+  size_t cpus_size;
+
+  /**
+   * \brief Maximum number of jobs a helper runs per wakeup, 0 for no limit.
+   */
+  unsigned int batch;
+};
+
+/**
+ * \struct offload_stats
+ * \brief Statistics of the queue.
+ */
+struct offload_stats
+{
+  /**
+   * \brief Number of jobs queued.
+   */
+  uint64_t posted;
+
+  /**
+   * \brief Number of jobs executed.
+   */
+  uint64_t executed;
+
+  /**
+   * \brief Number of jobs refused because the queue was full.
+   */
+  uint64_t rejected;
+
+  /**
+   * \brief Number of batches run by the helpers.
+   */
+  uint64_t batches;
+
+  /**
+   * \brief Highest number of pending jobs seen by offload_post().
+   */
+  uint64_t max_depth;
+};
+
+/**
+ * \struct offload
+ * \brief Opaque queue.
+ */
+struct offload;
+
+/**
+ * \brief Allocates the queue and starts the helper threads.
+ *
+ * All memory is allocated and touched here, offload_post() does not
+ * allocate. Helpers are SCHED_OTHER threads whatever the policy of the
+ * caller, creation fails if one of them cannot get its CPUs or nice value.
+ * \param config configuration.
+ * \return queue or NULL if failure (errno is set).
+ */
+struct offload* offload_create(const struct offload_config* config);
+
+/**
+ * \brief Runs the pending jobs, stops the helpers and frees the queue.
+ * \param offload queue.
+ */
+void offload_destroy(struct offload* offload);
+
+/**
+ * \brief Queues a job (lock-free, callable from real-time threads).
+ * \param offload queue.
+ * \param fcn function run by a helper.
+ * \param payload data copied with the job, may be NULL.
+ * \param size size of payload (at most OFFLOAD_PAYLOAD_SIZE).
+ * \return 0 if success, negative value otherwise (errno is set to EAGAIN if
+ * queue is full).
+ */
+int offload_post(struct offload* offload, offload_fcn fcn, const void* payload,
+    size_t size);
+
+/**
+ * \brief Waits until the jobs queued before the call are executed.
+ *
+ * With several helpers, jobs may complete out of order and the function
+ * returns once as many jobs as were queued have been executed.
+ * \param offload queue.
+ */
+void offload_flush(struct offload* offload);
+
+/**
+ * \brief Returns the statistics of the queue.
+ * \param offload queue.
+ * \param stats statistics.
+ */
+void offload_get_stats(const struct offload* offload,
+    struct offload_stats* stats);
+
+#endif /* RTVSUTILS_OFFLOAD_H */
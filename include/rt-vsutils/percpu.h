@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file percpu.h
+ * \brief Fast current CPU lookup (rseq) and per-CPU data structures.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_PERCPU_H
+#define RTVSUTILS_PERCPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/**
+ * \brief Pointer to the cpu_id field of the rseq area of the current thread.
+ *
+ * NULL if rseq is not registered (yet) for the thread.
+ * \note Internal, use percpu_get_cpu().
+ */
+extern _Thread_local const volatile uint32_t* percpu_cpu_id;
+
+/**
+ * \struct percpu_counter
+ * \brief Counter sharded per CPU.
+ */
+struct percpu_counter
+{
+  /**
+   * \brief Number of CPUs (slots).
+   */
+  size_t nb_cpus;
+
+  /**
+   * \brief Slots, one cache line per CPU and a last overflow one.
+   */
+  struct percpu_counter_slot* slots;
+};
+
+/**
+ * \struct percpu_buffer
+ * \brief Per-CPU LIFO buffers of pointers.
+ */
+struct percpu_buffer
+{
+  /**
+   * \brief Number of CPUs (slots).
+   */
+  size_t nb_cpus;
+
+  /**
+   * \brief Slots, one cache line per CPU and a last overflow one.
+   */
+  struct percpu_buffer_slot* slots;
+};
+
+/**
+ * \brief Registers the rseq area for the calling thread.
+ *
+ * If the C library already registered rseq (glibc >= 2.35), its area is
+ * used. It is called implicitly by the first percpu_get_cpu() of a thread,
+ * but it can be called in the beginning of a real-time thread to avoid the
+ * extra cost on first call.
+ * \return 0 if rseq is available, negative value if the fallback
+ * (sched_getcpu() via vDSO) will be used.
+ */
+int percpu_thread_init(void);
+
+/**
+ * \brief Returns the CPU identifier of the current thread using the slow
+ * path.
+ * \return ID of CPU, negative value otherwise.
+ * \note Internal, use percpu_get_cpu().
+ */
+int percpu_get_cpu_slow(void);
+
+/**
+ * \brief Returns the CPU identifier of the current thread at the time of call.
+ *
+ * The value is read from the rseq area kept up-to-date by the kernel, no
+ * system call or vDSO call is done.
+ * \return ID of CPU, negative value otherwise.
+ */
+static inline int percpu_get_cpu(void)
+{
+  const volatile uint32_t* cpu_id = percpu_cpu_id;
+
+  if(cpu_id)
+  {
+    int32_t cpu = (int32_t)*cpu_id;
+
+    if(cpu >= 0)
+    {
+      return cpu;
+    }
+  }
+
+  return percpu_get_cpu_slow();
+}
+
+/**
+ * \brief Initializes a per-CPU counter.
+ * \param counter counter to initialize.
+ * \return 0 if success, negative value otherwise.
+ */
+int percpu_counter_init(struct percpu_counter* counter);
+
+/**
+ * \brief Releases resources of a per-CPU counter.
+ * \param counter counter to destroy.
+ */
+void percpu_counter_destroy(struct percpu_counter* counter);
+
+/**
+ * \brief Adds a value to the slot of the current CPU.
+ *
+ * With rseq, it is a restartable sequence without atomic instruction on the
+ * slot of the CPU. Otherwise (or for a CPU beyond the ones known at init,
+ * i.e. hotplug) it is a relaxed atomic addition on an overflow slot that is
+ * never updated by restartable sequences. It does nothing on a destroyed
+ * counter.
+ * \param counter the counter.
+ * \param value value to add.
+ */
+void percpu_counter_add(struct percpu_counter* counter, long value);
+
+/**
+ * \brief Returns the sum of all the per-CPU slots and the overflow slot.
+ * \param counter the counter.
+ * \return sum of the counter.
+ */
+long percpu_counter_sum(const struct percpu_counter* counter);
+
+/**
+ * \brief Returns the value of the slot of a specific CPU.
+ * \param counter the counter.
+ * \param cpu CPU index.
+ * \return value of the slot (0 if cpu is out of range).
+ * \note Additions done without rseq are only counted by
+ * percpu_counter_sum().
+ */
+long percpu_counter_get(const struct percpu_counter* counter, size_t cpu);
+
+/**
+ * \brief Initializes per-CPU buffers.
+ * \param buffer buffer to initialize.
+ * \param capacity number of pointers per CPU.
+ * \return 0 if success, negative value otherwise.
+ */
+int percpu_buffer_init(struct percpu_buffer* buffer, size_t capacity);
+
+/**
+ * \brief Releases resources of per-CPU buffers.
+ * \param buffer buffer to destroy.
+ */
+void percpu_buffer_destroy(struct percpu_buffer* buffer);
+
+/**
+ * \brief Pushes a pointer in the buffer of the current CPU.
+ *
+ * Without rseq (or for a CPU beyond the ones known at init), the pointer
+ * goes in an overflow buffer protected by a priority-inheritance mutex.
+ * \param buffer the buffer.
+ * \param item pointer to push.
+ * \return 0 if success, negative value if the buffer of the CPU is full.
+ */
+int percpu_buffer_push(struct percpu_buffer* buffer, void* item);
+
+/**
+ * \brief Pops the last pointer pushed in the buffer of the current CPU.
+ *
+ * If the buffer of the CPU is empty, the overflow buffer is tried.
+ * \param buffer the buffer.
+ * \return pointer or NULL if the buffer of the CPU is empty.
+ * \note To drain the buffer of a specific CPU, pin the thread on that CPU
+ * (thread_set_affinity()) and pop.
+ */
+void* percpu_buffer_pop(struct percpu_buffer* buffer);
+
+#endif /* RTVSUTILS_PERCPU_H */
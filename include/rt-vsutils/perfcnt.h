@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file perfcnt.h
+ * \brief Per-thread performance counters.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_PERFCNT_H
+#define RTVSUTILS_PERFCNT_H
+
+#include <stdint.h>
+
+#include <unistd.h>
+
+/**
+ * \enum perfcnt_event
+ * \brief Counted events.
+ */
+enum perfcnt_event
+{
+  /**
+   * \brief CPU cycles (task clock in nanoseconds for the software fallback).
+   */
+  PERFCNT_CYCLES = 0,
+
+  /**
+   * \brief Retired instructions.
+   */
+  PERFCNT_INSTRUCTIONS,
+
+  /**
+   * \brief Last level cache misses.
+   */
+  PERFCNT_LLC_MISSES,
+
+  /**
+   * \brief Mispredicted branches.
+   */
+  PERFCNT_BRANCH_MISSES,
+
+  /**
+   * \brief Context switches.
+   */
+  PERFCNT_CONTEXT_SWITCHES,
+
+  /**
+   * \brief Number of events.
+   */
+  PERFCNT_NB,
+};
+
+/**
+ * \struct perfcnt_values
+ * \brief Values of the counters.
+ */
+struct perfcnt_values
+{
+  /**
+   * \brief Values indexed by enum perfcnt_event.
+   */
+  uint64_t values[PERFCNT_NB];
+
+  /**
+   * \brief Bitmask of valid values (1 << event).
+   */
+  uint32_t valid;
+
+  /**
+   * \brief Time the group was enabled in nanoseconds.
+   */
+  uint64_t time_enabled;
+
+  /**
+   * \brief Time the group was on the PMU in nanoseconds, lower than
+   * time_enabled if the group was multiplexed with other events.
+   */
+  uint64_t time_running;
+};
+
+/**
+ * \struct perfcnt
+ * \brief Group of counters of a thread.
+ */
+struct perfcnt
+{
+  /**
+   * \brief Descriptors indexed by enum perfcnt_event (-1 if not opened).
+   */
+  int fds[PERFCNT_NB];
+
+  /**
+   * \brief Position of the events in the group read.
+   */
+  int index[PERFCNT_NB];
+
+  /**
+   * \brief Number of events in the group.
+   */
+  int nb;
+
+  /**
+   * \brief Bitmask of opened events (1 << event).
+   */
+  uint32_t valid;
+
+  /**
+   * \brief If not 0, hardware PMU is not available and PERFCNT_CYCLES counts
+   * the task clock in nanoseconds.
+   */
+  int software;
+};
+
+/**
+ * \brief Opens the counters of a thread.
+ *
+ * All events are in the same group so they are scheduled and read together.
+ * Events the hardware (or the VM) does not provide are skipped: cycles are
+ * then replaced by the task clock and context switches are always counted
+ * in software.
+ * \param pc counters.
+ * \param tid kernel thread ID, 0 for the calling thread.
+ * \return 0 if at least one event is opened, negative value otherwise.
+ * \note Kernel time is counted if perf_event_paranoid allows it, otherwise
+ * only user space is counted.
+ */
+int perfcnt_open(struct perfcnt* pc, pid_t tid);
+
+/**
+ * \brief Closes the counters.
+ * \param pc counters.
+ */
+void perfcnt_close(struct perfcnt* pc);
+
+/**
+ * \brief Reads all the counters with a single system call.
+ *
+ * Values are the raw counts over time_running, use perfcnt_delta() to get
+ * scaled values.
+ * \param pc counters.
+ * \param values pointer that will receive the values.
+ * \return 0 if success, negative value otherwise.
+ */
+int perfcnt_read(struct perfcnt* pc, struct perfcnt_values* values);
+
+/**
+ * \brief Computes the difference of two reads.
+ *
+ * If the group was multiplexed during the interval, values are scaled by
+ * time enabled / time running. If it did not run at all, no value is valid.
+ * \param before first read.
+ * \param after second read.
+ * \param delta pointer that will receive after - before.
+ */
+void perfcnt_delta(const struct perfcnt_values* before,
+    const struct perfcnt_values* after, struct perfcnt_values* delta);
+
+/**
+ * \brief Returns the name of an event.
+ * \param event event.
+ * \return name of the event.
+ */
+const char* perfcnt_event_name(enum perfcnt_event event);
+
+#endif /* RTVSUTILS_PERFCNT_H */
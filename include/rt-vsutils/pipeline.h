@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file pipeline.h
+ * \brief Periodic multi-stage pipeline with one real-time thread per stage.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_PIPELINE_H
+#define RTVSUTILS_PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "rtutils.h"
+
+/**
+ * \brief Function of the source or of a stage.
+ * \param frame frame (frame_size bytes).
+ * \param seq sequence number of the frame.
+ * \param data data of the source or stage.
+ */
+typedef void (*pipeline_fcn)(void* frame, uint64_t seq, void* data);
+
+/**
+ * \struct pipeline_stage
+ * \brief Configuration of a stage.
+ */
+struct pipeline_stage
+{
+  /**
+   * \brief Function run on each frame.
+   */
+  pipeline_fcn fcn;
+
+  /**
+   * \brief Data passed to the function.
+   */
+  void* data;
+
+  /**
+   * \brief CPU the stage thread is pinned on.
+   */
+  int cpu;
+
+  /**
+   * \brief Scheduling policy and priority of the stage thread.
+   */
+  struct rt_prio priority;
+};
+
+/**
+ * \struct pipeline_config
+ * \brief Configuration of the pipeline.
+ */
+struct pipeline_config
+{
+  /**
+   * \brief Stages, in order.
+   */
+  const struct pipeline_stage* stages;
+
+  /**
+   * \brief Number of stages.
+   */
+  size_t nb_stages;
+
+  /**
+   * \brief Size of a frame.
+   */
+  size_t frame_size;
+
+  /**
+   * \brief Number of frames in flight (power of two).
+   */
+  size_t nb_frames;
+
+  /**
+   * \brief Period of the source in nanoseconds.
+   */
+  unsigned long period;
+
+  /**
+   * \brief Source: fills a new frame each period.
+   */
+  struct pipeline_stage source;
+};
+
+/**
+ * \enum pipeline_hist
+ * \brief Histograms of a stage.
+ */
+enum pipeline_hist
+{
+  /**
+   * \brief Time spent by frames in the input queue.
+   */
+  PIPELINE_HIST_WAIT = 0,
+
+  /**
+   * \brief Execution time of the stage function.
+   */
+  PIPELINE_HIST_EXEC,
+};
+
+/**
+ * \struct pipeline_stats
+ * \brief Statistics of a stage.
+ */
+struct pipeline_stats
+{
+  /**
+   * \brief Number of frames processed.
+   */
+  uint64_t frames;
+
+  /**
+   * \brief Number of frames in the input queue.
+   */
+  uint64_t depth;
+
+  /**
+   * \brief Highest number of frames seen in the input queue.
+   */
+  uint64_t max_depth;
+};
+
+/**
+ * \struct pipeline
+ * \brief Opaque pipeline.
+ */
+struct pipeline;
+
+/**
+ * \brief Allocates frames and queues, then starts stages and source.
+ *
+ * Stage i processes frame n while stage i - 1 processes frame n + 1.
+ * Returns once every thread is pinned and runs with its priority.
+ * \param config configuration.
+ * \return pipeline or NULL if failure (errno is set).
+ * \note Timestamps use tsc_now_ns(), call tsc_init() first to get the
+ * low-overhead clock.
+ */
+struct pipeline* pipeline_start(const struct pipeline_config* config);
+
+/**
+ * \brief Stops the source, lets the stages finish the frames in flight and
+ * frees the pipeline.
+ * \param pipeline pipeline.
+ */
+void pipeline_stop(struct pipeline* pipeline);
+
+/**
+ * \brief Returns the statistics of a stage.
+ * \param pipeline pipeline.
+ * \param stage index of the stage.
+ * \param stats statistics.
+ * \return 0 if success, negative value otherwise.
+ */
+int pipeline_get_stats(const struct pipeline* pipeline, size_t stage,
+    struct pipeline_stats* stats);
+
+/**
+ * \brief Returns a histogram of a stage.
+ * \param pipeline pipeline.
+ * \param stage index of the stage.
+ * \param type histogram type.
+ * \return histogram (values in nanoseconds) or NULL if failure.
+ */
+const struct rt_hist* pipeline_get_hist(const struct pipeline* pipeline,
+    size_t stage, enum pipeline_hist type);
+
+/**
+ * \brief Returns the histogram of end-to-end latency (from the start of
+ * the source to the end of the last stage).
+ * \param pipeline pipeline.
+ * \return histogram (values in nanoseconds).
+ */
+const struct rt_hist* pipeline_get_latency_hist(
+    const struct pipeline* pipeline);
+
+/**
+ * \brief Returns the histogram of the wakeup latency of the source.
+ * \param pipeline pipeline.
+ * \return histogram (values in nanoseconds).
+ */
+const struct rt_hist* pipeline_get_source_hist(
+    const struct pipeline* pipeline);
+
+/**
+ * \brief Returns number of periods skipped because no frame was free.
+ * \param pipeline pipeline.
+ * \return number of dropped frames.
+ */
+uint64_t pipeline_get_dropped(const struct pipeline* pipeline);
+
+#endif /* RTVSUTILS_PIPELINE_H */
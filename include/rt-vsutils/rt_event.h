@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file rt_event.h
+ * \brief Futex-based events and priority-inheritance mutex.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_RT_EVENT_H
+#define RTVSUTILS_RT_EVENT_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/**
+ * \struct rt_event
+ * \brief Auto-reset event.
+ *
+ * A signal wakes one waiter, which consumes it. A signal without waiter is
+ * kept until the next wait.
+ */
+struct rt_event
+{
+  /**
+   * \brief Futex word: 1 if signaled, 0 otherwise.
+   */
+  _Atomic uint32_t state;
+
+  /**
+   * \brief Number of waiters in (or about to enter) the kernel.
+   */
+  _Atomic uint32_t waiters;
+
+  /**
+   * \brief If not 0, event can be used between processes (shared memory).
+   */
+  int shared;
+
+  /**
+   * \brief Number of polls before sleeping in the kernel.
+   */
+  unsigned int spin;
+};
+
+/**
+ * \struct rt_pi_mutex
+ * \brief Priority-inheritance mutex.
+ *
+ * While a thread holds the mutex, it runs with the priority of the highest
+ * priority thread waiting for it.
+ */
+struct rt_pi_mutex
+{
+  /**
+   * \brief Futex word: TID of the owner (0 if unlocked) and kernel flags.
+   */
+  _Atomic uint32_t owner;
+
+  /**
+   * \brief If not 0, mutex can be used between processes (shared memory).
+   */
+  int shared;
+};
+
+/**
+ * \brief Initializes an event.
+ * \param event event.
+ * \param shared if not 0, event can be placed in shared memory and used
+ * between processes.
+ * \param spin number of polls before sleeping in the kernel (0 to sleep
+ * directly). Spinning avoids the wakeup latency when the signal comes soon,
+ * only use it if the waiter has a CPU for itself.
+ * \return 0 if success, negative value otherwise.
+ */
+int rt_event_init(struct rt_event* event, int shared, unsigned int spin);
+
+/**
+ * \brief Signals an event.
+ *
+ * The futex system call is only made if a thread sleeps on the event.
+ * \param event event.
+ * \return 0 if success, negative value otherwise.
+ * \note This function is async-signal-safe.
+ */
+int rt_event_signal(struct rt_event* event);
+
+/**
+ * \brief Waits for an event.
+ * \param event event.
+ * \return 0 if success, negative value otherwise.
+ */
+int rt_event_wait(struct rt_event* event);
+
+/**
+ * \brief Waits for an event until a deadline.
+ * \param event event.
+ * \param abstime absolute deadline on CLOCK_MONOTONIC.
+ * \return 0 if success, negative value otherwise (errno is set to ETIMEDOUT
+ * if deadline is reached).
+ */
+int rt_event_timedwait(struct rt_event* event, const struct timespec* abstime);
+
+/**
+ * \brief Consumes an event if it is signaled, without waiting.
+ * \param event event.
+ * \return 0 if event was signaled, negative value otherwise (errno is set to
+ * EAGAIN).
+ */
+int rt_event_trywait(struct rt_event* event);
+
+/**
+ * \brief Initializes a priority-inheritance mutex.
+ * \param mutex mutex.
+ * \param shared if not 0, mutex can be placed in shared memory and used
+ * between processes.
+ * \return 0 if success, negative value otherwise.
+ */
+int rt_pi_mutex_init(struct rt_pi_mutex* mutex, int shared);
+
+/**
+ * \brief Locks a priority-inheritance mutex.
+ *
+ * Uncontended lock is a single atomic operation, the kernel (FUTEX_LOCK_PI)
+ * is only involved under contention.
+ * \param mutex mutex.
+ * \return 0 if success, negative value otherwise.
+ */
+int rt_pi_mutex_lock(struct rt_pi_mutex* mutex);
+
+/**
+ * \brief Tries to lock a priority-inheritance mutex without waiting.
+ * \param mutex mutex.
+ * \return 0 if success, negative value otherwise (errno is set to EBUSY).
+ */
+int rt_pi_mutex_trylock(struct rt_pi_mutex* mutex);
+
+/**
+ * \brief Unlocks a priority-inheritance mutex.
+ * \param mutex mutex.
+ * \return 0 if success, negative value otherwise (errno is set to EPERM if
+ * the calling thread is not the owner).
+ */
+int rt_pi_mutex_unlock(struct rt_pi_mutex* mutex);
+
+#endif /* RTVSUTILS_RT_EVENT_H */
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file rt_pool.h
+ * \brief Real-time worker thread pool with priority levels and work
+ * stealing.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_RT_POOL_H
+#define RTVSUTILS_RT_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "rtutils.h"
+#include "rt_event.h"
+
+/**
+ * \brief Number of priority levels, 0 is the most urgent.
+ */
+#define RT_POOL_LEVELS 3
+
+/**
+ * \struct rt_pool_group
+ * \brief Set of tasks that can be waited for.
+ */
+struct rt_pool_group
+{
+  /**
+   * \brief Number of tasks submitted and not completed, the most
+   * significant bit is set while a thread sleeps on it.
+   *
+   * The completion of the last task is the last access of the worker to
+   * the group, so the group can be released once the wait returns.
+   */
+  _Atomic uint32_t pending;
+};
+
+/**
+ * \struct rt_pool_task
+ * \brief Task, allocated by the caller and valid until it has run.
+ */
+struct rt_pool_task
+{
+  /**
+   * \brief Function to run.
+   */
+  void (*fcn)(void*);
+
+  /**
+   * \brief Argument of the function.
+   */
+  void* data;
+
+  /**
+   * \brief Group of the task (set by rt_pool_submit()).
+   */
+  struct rt_pool_group* group;
+};
+
+/**
+ * \struct rt_pool_config
+ * \brief Configuration of the pool.
+ */
+struct rt_pool_config
+{
+  /**
+   * \brief Array of CPU index, one worker pinned on each CPU.
+   */
+  const int* cpus;
+
+  /**
+   * \brief Size of the CPU array.
+   */
+  size_t cpus_size;
+
+  /**
+   * \brief Steal domain of each worker (same size as cpus), a worker only
+   * steals from workers of its domain. NULL for a single domain.
+   */
+  const int* domains;
+
+  /**
+   * \brief Scheduling policy and priority of the workers.
+   */
+  struct rt_prio priority;
+
+  /**
+   * \brief Number of tasks per queue and level (power of two).
+   */
+  size_t capacity;
+
+  /**
+   * \brief Number of empty polls before an idle worker sleeps.
+   */
+  unsigned int spin;
+};
+
+/**
+ * \struct rt_pool_stats
+ * \brief Statistics of a worker.
+ */
+struct rt_pool_stats
+{
+  /**
+   * \brief CPU id.
+   */
+  int cpu;
+
+  /**
+   * \brief Number of tasks run.
+   */
+  uint64_t executed;
+
+  /**
+   * \brief Number of tasks taken from another worker.
+   */
+  uint64_t stolen;
+
+  /**
+   * \brief Number of times the worker went to sleep.
+   */
+  uint64_t sleeps;
+};
+
+/**
+ * \struct rt_pool
+ * \brief Opaque pool.
+ */
+struct rt_pool;
+
+/**
+ * \brief Creates the pool.
+ *
+ * Returns once every worker is pinned and runs with the configured
+ * priority.
+ * \param config configuration.
+ * \return pool or NULL if failure (errno is set to the error of the worker
+ * setup, i.e. EPERM).
+ */
+struct rt_pool* rt_pool_create(const struct rt_pool_config* config);
+
+/**
+ * \brief Stops the workers and frees the pool.
+ *
+ * Tasks still queued are not run, wait for their groups first.
+ * \param pool pool.
+ */
+void rt_pool_destroy(struct rt_pool* pool);
+
+/**
+ * \brief Returns number of workers.
+ * \param pool pool.
+ * \return number of workers.
+ */
+size_t rt_pool_get_size(const struct rt_pool* pool);
+
+/**
+ * \brief Submits a task.
+ *
+ * From a worker, the task goes to its own deque where idle workers of the
+ * domain can steal it. From another thread, it goes to the injection queue
+ * shared by all workers.
+ * \param pool pool.
+ * \param task task (fcn and data set).
+ * \param level priority level (0 to RT_POOL_LEVELS - 1).
+ * \param group group of the task, may be NULL.
+ * \return 0 if success, negative value otherwise (errno is set to EAGAIN if
+ * queue is full).
+ */
+int rt_pool_submit(struct rt_pool* pool, struct rt_pool_task* task,
+    unsigned int level, struct rt_pool_group* group);
+
+/**
+ * \brief Initializes a group.
+ * \param group group.
+ * \return 0 if success, negative value otherwise.
+ */
+int rt_pool_group_init(struct rt_pool_group* group);
+
+/**
+ * \brief Waits until all tasks of a group are completed.
+ *
+ * A worker waiting for a group runs queued tasks instead of sleeping.
+ * \param pool pool.
+ * \param group group.
+ * \return 0 if success, negative value otherwise.
+ */
+int rt_pool_group_wait(struct rt_pool* pool, struct rt_pool_group* group);
+
+/**
+ * \brief Returns statistics of a worker.
+ * \param pool pool.
+ * \param index index of the worker (as in the CPU array).
+ * \param stats statistics.
+ * \return 0 if success, negative value otherwise.
+ */
+int rt_pool_get_stats(const struct rt_pool* pool, size_t index,
+    struct rt_pool_stats* stats);
+
+#endif /* RTVSUTILS_RT_POOL_H */
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file rt_profile.h
+ * \brief Declarative real-time profile of the threads of an application.
+ * \author Sebastien Vincent
+ * \date 2017
+ *
+ * A profile is an INI-like file with one section per named thread:
+ * \code
+ * # control loop
+ * [control]
+ * policy = fifo        # other, batch, idle, fifo, rr or deadline
+ * priority = 80        # fifo and rr only
+ * cpus = 2-3           # kernel list format
+ * memlock = 65536      # stack size to lock
+ * governor = performance # any governor available for the CPUs
+ * util_min = 1024      # utilization clamping (0 to 1024)
+ *
+ * [planner]
+ * policy = deadline
+ * runtime = 200000     # nanoseconds
+ * deadline = 1000000
+ * period = 1000000
+ *
+ * [logger]
+ * policy = other
+ * nice = 10
+ * \endcode
+ *
+ * Deadline threads cannot have cpus (nor governor): the kernel refuses
+ * SCHED_DEADLINE for an affinity smaller than the root domain. Run them in a
+ * cpuset partition instead (see cgroup.h).
+ */
+
+#ifndef RTVSUTILS_RT_PROFILE_H
+#define RTVSUTILS_RT_PROFILE_H
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include "rtutils.h"
+#include "thread_registry.h"
+
+/**
+ * \brief Maximum number of CPUs in a thread profile.
+ */
+#define RT_PROFILE_MAX_CPUS 256
+
+/**
+ * \brief Policy (and priority or deadline parameters) is set.
+ */
+#define RT_PROFILE_POLICY 0x01
+
+/**
+ * \brief CPU list is set.
+ */
+#define RT_PROFILE_CPUS 0x02
+
+/**
+ * \brief Nice value is set.
+ */
+#define RT_PROFILE_NICE 0x04
+
+/**
+ * \brief Memory-lock size is set.
+ */
+#define RT_PROFILE_MEMLOCK 0x08
+
+/**
+ * \brief Governor is set.
+ */
+#define RT_PROFILE_GOVERNOR 0x10
+
+/**
+ * \brief Utilization clamping is set.
+ */
+#define RT_PROFILE_UCLAMP 0x20
+
+/**
+ * \struct rt_profile_thread
+ * \brief Profile of a named thread.
+ */
+struct rt_profile_thread
+{
+  /**
+   * \brief Name of the thread.
+   */
+  char name[THREAD_REGISTRY_NAME_SIZE];
+
+  /**
+   * \brief Fields set in the profile (RT_PROFILE_* flags).
+   */
+  int flags;
+
+  /**
+   * \brief Scheduling policy and priority.
+   */
+  struct rt_prio priority;
+
+  /**
+   * \brief Runtime in nanoseconds (SCHED_DEADLINE).
+   */
+  uint64_t runtime;
+
+  /**
+   * \brief Relative deadline in nanoseconds (SCHED_DEADLINE).
+   */
+  uint64_t deadline;
+
+  /**
+   * \brief Period in nanoseconds (SCHED_DEADLINE).
+   */
+  uint64_t period;
+
+  /**
+   * \brief CPU indexes.
+   */
+  int cpus[RT_PROFILE_MAX_CPUS];
+
+  /**
+   * \brief Number of CPU indexes.
+   */
+  size_t cpus_size;
+
+  /**
+   * \brief Nice value.
+   */
+  int nice;
+
+  /**
+   * \brief Stack size to lock with mem_lock_reserve().
+   */
+  size_t memlock;
+
+  /**
+   * \brief Governor of the CPUs of the thread.
+   */
+  char governor[CPUFREQ_NAME_SIZE];
+
+  /**
+   * \brief Utilization clamping.
+   */
+  struct rt_uclamp uclamp;
+};
+
+/**
+ * \struct rt_profile
+ * \brief Profile of the threads of an application.
+ */
+struct rt_profile
+{
+  /**
+   * \brief Thread profiles.
+   */
+  struct rt_profile_thread* threads;
+
+  /**
+   * \brief Number of thread profiles.
+   */
+  size_t nb_threads;
+
+  /**
+   * \brief Line of the first error found while loading (0 if none).
+   */
+  unsigned int error_line;
+};
+
+/**
+ * \brief Loads and validates a profile file.
+ * \param path path of the file.
+ * \param profile profile to fill, release it with rt_profile_free().
+ * \return 0 if success, negative value otherwise (errno is set to EINVAL and
+ * error_line to the faulty line if file is invalid).
+ */
+int rt_profile_load(const char* path, struct rt_profile* profile);
+
+/**
+ * \brief Releases a profile.
+ * \param profile profile to release.
+ */
+void rt_profile_free(struct rt_profile* profile);
+
+/**
+ * \brief Returns the profile of a thread.
+ * \param profile the profile.
+ * \param name name of the thread.
+ * \return thread profile or NULL if not found.
+ */
+const struct rt_profile_thread* rt_profile_get(
+    const struct rt_profile* profile, const char* name);
+
+/**
+ * \brief Applies the profile of a thread to the calling thread.
+ *
+ * The thread is registered with its name (thread_registry_add()), then the
+ * settings are applied in this order: governor of its CPUs, affinity,
+ * memory lock, scheduling policy with utilization clamping and nice value,
+ * so that a real-time thread is pinned before it is raised.
+ * \param profile the profile.
+ * \param name name of the thread.
+ * \return 0 if success, negative value otherwise.
+ */
+int rt_profile_apply_self(const struct rt_profile* profile, const char* name);
+
+/**
+ * \brief Applies the profile to all the threads registered with a name of
+ * the profile.
+ *
+ * Same order as rt_profile_apply_self() but the memory lock is skipped as
+ * stack can only be reserved by the thread itself.
+ * \param profile the profile.
+ * \return number of threads updated, negative value if at least one thread
+ * failed to be updated.
+ */
+int rt_profile_apply_registered(const struct rt_profile* profile);
+
+#endif /* RTVSUTILS_RT_PROFILE_H */
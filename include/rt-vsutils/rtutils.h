@@ -24,9 +24,15 @@
 #ifndef RTVSUTILS_RTUTILS_H
 #define RTVSUTILS_RTUTILS_H
 
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
 #include <unistd.h>
 #include <pthread.h>
 
+#include "perfcnt.h"
+
 /**
  * \enum cpufreq_governor
  * \param Enumeration of different CPU frequency change governor.
@@ -65,8 +71,28 @@ enum cpufreq_governor
      * Similar as CPUFREQ_ONDEMAND but less change.
      */
     CPUFREQ_CONSERVATIVE,
+
+    /**
+     * \brief Scheduler driven mode.
+     *
+     * Frequency follows the utilization tracked by the scheduler (see
+     * utilization clamping).
+     */
+    CPUFREQ_SCHEDUTIL,
+
+    /**
+     * \brief Userspace mode.
+     *
+     * CPUs runs at the frequency set by cpufreq_set_frequency().
+     */
+    CPUFREQ_USERSPACE,
 };
 
+/**
+ * \brief Maximum size of a governor name (including NULL character).
+ */
+#define CPUFREQ_NAME_SIZE 16
+
 /**
  * \struct rt_prio
  * \brief Real-time priority information.
@@ -86,13 +112,205 @@ struct rt_prio
     unsigned int priority;
 };
 
+/**
+ * \brief Maximum utilization clamp value (capacity of the biggest CPU).
+ */
+#define RT_UCLAMP_MAX 1024
+
+/**
+ * \struct rt_uclamp
+ * \brief Utilization clamping information.
+ *
+ * With the schedutil governor, the frequency selected for a CPU depends on
+ * the utilization of its tasks. A minimum clamp boosts the frequency for a
+ * task whatever its real utilization is.
+ */
+struct rt_uclamp
+{
+  /**
+   * \brief Minimum utilization (range from 0 to RT_UCLAMP_MAX).
+   */
+  unsigned int util_min;
+
+  /**
+   * \brief Maximum utilization (range from 0 to RT_UCLAMP_MAX).
+   */
+  unsigned int util_max;
+};
+
+/**
+ * \struct rt_throttling_status
+ * \brief Status of the RT throttling.
+ */
+struct rt_throttling_status
+{
+  /**
+   * \brief If not 0, kernel has logged that RT throttling was activated
+   * since boot.
+   */
+  int logged;
+
+  /**
+   * \brief Number of RT runqueues currently throttled, -1 if scheduler
+   * debug statistics are not available.
+   */
+  int throttled;
+};
+
+/**
+ * \brief Number of bits of the sub-buckets of the latency histogram.
+ *
+ * Each power of two range is split in 2^RT_HIST_SUB_BITS linear buckets so
+ * the relative error of a recorded value is below 1/32 (3.1%).
+ */
+#define RT_HIST_SUB_BITS 5
+
+/**
+ * \brief Number of buckets of the latency histogram (full 64-bit range).
+ */
+#define RT_HIST_BUCKETS ((64 - RT_HIST_SUB_BITS + 1) << RT_HIST_SUB_BITS)
+
+/**
+ * \struct rt_hist
+ * \brief Log-linear latency histogram.
+ *
+ * Values below 32 have their own bucket, then each power of two range
+ * [2^n, 2^(n+1)[ is split in 32 buckets of the same width. Bucket
+ * boundaries are fixed so histograms of different threads or processes can
+ * be merged and compared.
+ */
+struct rt_hist
+{
+  /**
+   * \brief Counts of the buckets.
+   */
+  _Atomic uint64_t counts[RT_HIST_BUCKETS];
+
+  /**
+   * \brief Number of recorded values.
+   */
+  _Atomic uint64_t total;
+
+  /**
+   * \brief Sum of recorded values.
+   */
+  _Atomic uint64_t sum;
+
+  /**
+   * \brief Minimum recorded value.
+   */
+  _Atomic uint64_t min;
+
+  /**
+   * \brief Maximum recorded value.
+   */
+  _Atomic uint64_t max;
+};
+
+/**
+ * \struct periodic_cycle_stats
+ * \brief Statistics of one cycle of a periodic task.
+ */
+struct periodic_cycle_stats
+{
+  /**
+   * \brief Cycle number (starts at 0).
+   */
+  unsigned long long cycle;
+
+  /**
+   * \brief Wakeup latency in nanoseconds.
+   */
+  uint64_t latency;
+
+  /**
+   * \brief Execution time of the task in nanoseconds.
+   */
+  uint64_t exec_time;
+
+  /**
+   * \brief Performance counters deltas during the execution of the task
+   * (valid is 0 if counters are not enabled or not available).
+   */
+  struct perfcnt_values perf;
+};
+
+struct watchdog_heartbeat;
+
+/**
+ * \struct periodic_task_attr
+ * \brief Optional attributes of a periodic task.
+ */
+struct periodic_task_attr
+{
+  /**
+   * \brief Histogram of the wakeup latency in nanoseconds (difference
+   * between the expected and effective wakeup time), can be NULL.
+   */
+  struct rt_hist* wakeup_hist;
+
+  /**
+   * \brief Histogram of the execution time of the task in nanoseconds, can
+   * be NULL.
+   */
+  struct rt_hist* exec_hist;
+
+  /**
+   * \brief If not 0, cycle start/end and overrun markers are written in the
+   * ftrace buffer (trace_open() must be called before).
+   */
+  int trace;
+
+  /**
+   * \brief If not 0, ftrace recording is stopped (trace_stop()) the first
+   * time the wakeup latency exceeds this value in nanoseconds.
+   */
+  unsigned long trace_stop_latency;
+
+  /**
+   * \brief If not 0, performance counters (see perfcnt_open()) of the
+   * thread are read around each call of the task.
+   */
+  int perf;
+
+  /**
+   * \brief Function called after each cycle with its statistics, can be
+   * NULL.
+   * \param stats statistics of the cycle.
+   * \param data data of the task.
+   */
+  void (*cycle_stats)(const struct periodic_cycle_stats* stats, void* data);
+
+  /**
+   * \brief Heartbeat fed after each call of the task (see
+   * watchdog_register()), can be NULL.
+   */
+  struct watchdog_heartbeat* heartbeat;
+
+  /**
+   * \brief If not 0, number of bytes of stack painted before the first
+   * cycle (see stack_probe_init()).
+   */
+  size_t stack_paint;
+
+  /**
+   * \brief Receives the stack high-water mark in bytes when the task is
+   * canceled (requires stack_paint), can be NULL.
+   */
+  size_t* stack_peak;
+};
+
 /**
  * \brief Lock and reserve memory for stack.
  *
  * It is generally used in the beginning of the program to avoid
  * non-deterministic time during fault-page for allocation.
+ * Without CAP_IPC_LOCK, the soft RLIMIT_MEMLOCK is raised to the hard limit
+ * first.
  * \param stack_size Size of the stack.
- * \return 0 if success, negative value otherwise.
+ * \return 0 if success, negative value otherwise (errno is set to EPERM if
+ * memory cannot be locked at all, ENOMEM if the limit is too low, or by
+ * setrlimit() if the soft limit cannot be raised).
  */
 int mem_lock_reserve(size_t stack_size);
 
@@ -100,9 +318,70 @@ int mem_lock_reserve(size_t stack_size);
  * \brief Disable the percent of time reserved for time-sharing processes on 
  * GNU/Linux systems.
  * \return 0 if success, negative value otherwise.
+ * \note Previous value is recorded and restored by tuning_restore().
  */
 int rt_disable_watchdog(void);
 
+/**
+ * \brief Sets the time budget of real-time tasks on GNU/Linux systems.
+ *
+ * Real-time tasks can use runtime_us of each period_us, the remaining time
+ * is left to time-sharing processes. Values are written in an order that
+ * keeps runtime lower than period during the change.
+ * \param runtime_us runtime in microseconds, -1 to disable throttling.
+ * \param period_us period in microseconds.
+ * \return 0 if success, negative value otherwise.
+ * \note Previous values are recorded and restored by tuning_restore().
+ */
+int rt_set_throttling(long runtime_us, long period_us);
+
+/**
+ * \brief Gets the time budget of real-time tasks.
+ * \param runtime_us pointer that will receive runtime in microseconds (-1 if
+ * throttling is disabled).
+ * \param period_us pointer that will receive period in microseconds.
+ * \return 0 if success, negative value otherwise.
+ */
+int rt_get_throttling(long* runtime_us, long* period_us);
+
+/**
+ * \brief Sets the time budget of real-time tasks of a cgroup.
+ *
+ * It requires the cgroup v1 cpu controller with RT group scheduling
+ * (cpu.rt_runtime_us). The sum of runtimes of the children cannot exceed
+ * the runtime of the parent.
+ * \param path path of the cgroup directory (i.e. "/sys/fs/cgroup/cpu/rt").
+ * \param runtime_us runtime in microseconds.
+ * \param period_us period in microseconds.
+ * \return 0 if success, negative value otherwise (errno is set to ENOENT
+ * if RT group scheduling is not available).
+ * \note Previous values are recorded and restored by tuning_restore().
+ */
+int rt_cgroup_set_throttling(const char* path, long runtime_us,
+    long period_us);
+
+/**
+ * \brief Gets the time budget of real-time tasks of a cgroup.
+ * \param path path of the cgroup directory.
+ * \param runtime_us pointer that will receive runtime in microseconds.
+ * \param period_us pointer that will receive period in microseconds.
+ * \return 0 if success, negative value otherwise.
+ */
+int rt_cgroup_get_throttling(const char* path, long* runtime_us,
+    long* period_us);
+
+/**
+ * \brief Detects if RT throttling kicked in.
+ *
+ * Kernel log (/dev/kmsg) is searched for the "RT throttling activated"
+ * message and the rt_throttled fields of the scheduler debug statistics
+ * (debugfs or /proc/sched_debug) are counted.
+ * \param status pointer that will receive the status.
+ * \return 0 if success, negative value if none of the sources can be read.
+ * \note Kernel logs the message only once per boot.
+ */
+int rt_get_throttling_status(struct rt_throttling_status* status);
+
 /**
  * \brief Returns the CPU identifier of the current process at the time of call.
  * \return ID of CPU, negative value otherwise.
@@ -178,6 +457,8 @@ int process_get_priority(pid_t pid);
  * \return 0 if success, negative value otherwise.
  * \note if thread is running with real-time priority (FIFO, round-robin), this
  * function will failed.
+ * \note if th is not the calling thread, it has to be registered with
+ * thread_registry_add() (see thread_registry.h).
  */
 int thread_set_priority(pthread_t th, int priority);
 
@@ -188,14 +469,28 @@ int thread_set_priority(pthread_t th, int priority);
  * \note if thread is running with real-time priority (FIFO, round-robin), this
  * function will failed.
  * \note if returns -1, check if errno is set to seee if it is an error or not.
+ * \note if th is not the calling thread, it has to be registered with
+ * thread_registry_add() (see thread_registry.h).
  */
 int thread_get_priority(pthread_t th);
 
+/**
+ * \brief Initializes attributes of a time-sharing (SCHED_OTHER) thread.
+ *
+ * The thread does not inherit the policy of its creator, so that a helper
+ * created by a real-time thread can then change its nice value.
+ * \param attr attributes to initialize, destroy with pthread_attr_destroy().
+ * \return 0 if success, negative value otherwise.
+ */
+int thread_attr_init_timesharing(pthread_attr_t* attr);
+
 /**
  * \brief Sets real-time priority of a process.
  * \param pid PID of the process to change priority.
  * \param priority real-time priority information.
- * \return 0 if success, negative value otherwise.
+ * \return 0 if success, negative value otherwise (errno is set to EPERM
+ * if the priority exceeds RLIMIT_RTPRIO without CAP_SYS_NICE).
+ * \note Soft RLIMIT_RTPRIO is raised up to the hard limit if needed.
  */
 int process_set_rt_priority(pid_t pid, struct rt_prio* priority);
 
@@ -211,7 +506,9 @@ int process_get_rt_priority(pid_t pid, struct rt_prio* priority);
  * \brief Sets real-time priority of a thread.
  * \param th identifier of the thread to change priority.
  * \param priority real-time priority information.
- * \return 0 if success, negative value otherwise.
+ * \return 0 if success, negative value otherwise (errno is set to EPERM
+ * if the priority exceeds RLIMIT_RTPRIO without CAP_SYS_NICE).
+ * \note Soft RLIMIT_RTPRIO is raised up to the hard limit if needed.
  */
 int thread_set_rt_priority(pthread_t th, struct rt_prio* priority);
 
@@ -223,6 +520,54 @@ int thread_set_rt_priority(pthread_t th, struct rt_prio* priority);
  */
 int thread_get_rt_priority(pthread_t th, struct rt_prio* priority);
 
+/**
+ * \brief Sets utilization clamping (and optionally real-time priority) of a
+ * process.
+ *
+ * Policy, priority and clamps are changed atomically with one
+ * sched_setattr() call. The nice value is kept for time-sharing policies.
+ * \param pid PID of the process.
+ * \param priority real-time priority information, NULL to keep current
+ * policy and priority.
+ * \param uclamp utilization clamping information.
+ * \return 0 if success, negative value otherwise.
+ * \note Requires Linux 5.3 with CONFIG_UCLAMP_TASK.
+ */
+int process_set_uclamp(pid_t pid, struct rt_prio* priority,
+    struct rt_uclamp* uclamp);
+
+/**
+ * \brief Returns utilization clamping of a process.
+ * \param pid PID of the process.
+ * \param uclamp utilization clamping information.
+ * \return 0 if success, negative value otherwise.
+ */
+int process_get_uclamp(pid_t pid, struct rt_uclamp* uclamp);
+
+/**
+ * \brief Sets utilization clamping (and optionally real-time priority) of a
+ * thread.
+ * \param th identifier of the thread.
+ * \param priority real-time priority information, NULL to keep current
+ * policy and priority.
+ * \param uclamp utilization clamping information.
+ * \return 0 if success, negative value otherwise.
+ * \note if th is not the calling thread, it has to be registered with
+ * thread_registry_add() (see thread_registry.h).
+ */
+int thread_set_uclamp(pthread_t th, struct rt_prio* priority,
+    struct rt_uclamp* uclamp);
+
+/**
+ * \brief Returns utilization clamping of a thread.
+ * \param th identifier of the thread.
+ * \param uclamp utilization clamping information.
+ * \return 0 if success, negative value otherwise.
+ * \note if th is not the calling thread, it has to be registered with
+ * thread_registry_add() (see thread_registry.h).
+ */
+int thread_get_uclamp(pthread_t th, struct rt_uclamp* uclamp);
+
 /**
  * \brief Change CPU frequency for all CPUs.
  * \param mode governor to use.
@@ -241,10 +586,115 @@ int cpufreq_set_governor(enum cpufreq_governor mode, unsigned int cpu);
 /**
  * \brief Returns CPU frequency mode.
  * \param cpu CPU id to apply the governor.
- * \return governor used.
+ * \return governor used, CPUFREQ_OTHER if it is not part of the enumeration
+ * (use cpufreq_get_governor_name()) or in case of error.
  */
 enum cpufreq_governor cpufreq_get_governor(unsigned int cpu);
 
+/**
+ * \brief Change CPU frequency governor by name for a specific CPU.
+ * \param name name of the governor (see cpufreq_get_available_governors()).
+ * \param cpu CPU id to apply the governor.
+ * \return 0 if success, negative value otherwise.
+ * \note All the CPUs of the policy group of cpu are changed.
+ */
+int cpufreq_set_governor_name(const char* name, unsigned int cpu);
+
+/**
+ * \brief Returns the name of the CPU frequency governor of a CPU.
+ * \param cpu CPU id.
+ * \param name buffer that will receive the name.
+ * \param size size of the buffer.
+ * \return 0 if success, negative value otherwise.
+ */
+int cpufreq_get_governor_name(unsigned int cpu, char* name, size_t size);
+
+/**
+ * \brief Returns the governors available for a CPU.
+ * \param cpu CPU id.
+ * \param names array that will receive the names (can be NULL to only
+ * count them).
+ * \param size size of the array.
+ * \return number of governors, negative value otherwise.
+ */
+int cpufreq_get_available_governors(unsigned int cpu,
+    char names[][CPUFREQ_NAME_SIZE], size_t size);
+
+/**
+ * \brief Returns the frequencies available for a CPU.
+ * \param cpu CPU id.
+ * \param freqs array that will receive the frequencies in kHz (can be NULL
+ * to only count them).
+ * \param size size of the array.
+ * \return number of frequencies, negative value otherwise.
+ * \note Some drivers (i.e. intel_pstate) do not provide the list, any value
+ * between cpufreq_get_hw_limits() can be used with them.
+ */
+int cpufreq_get_available_frequencies(unsigned int cpu, unsigned long* freqs,
+    size_t size);
+
+/**
+ * \brief Returns the hardware frequency limits of a CPU.
+ * \param cpu CPU id.
+ * \param min pointer that will receive the minimum frequency in kHz.
+ * \param max pointer that will receive the maximum frequency in kHz.
+ * \return 0 if success, negative value otherwise.
+ */
+int cpufreq_get_hw_limits(unsigned int cpu, unsigned long* min,
+    unsigned long* max);
+
+/**
+ * \brief Returns the frequency limits of the governor of a CPU.
+ * \param cpu CPU id.
+ * \param min pointer that will receive the minimum frequency in kHz.
+ * \param max pointer that will receive the maximum frequency in kHz.
+ * \return 0 if success, negative value otherwise.
+ */
+int cpufreq_get_limits(unsigned int cpu, unsigned long* min,
+    unsigned long* max);
+
+/**
+ * \brief Sets the frequency limits of the governor of a CPU.
+ *
+ * Limits are written in an order that never leaves min above max.
+ * \param cpu CPU id.
+ * \param min minimum frequency in kHz.
+ * \param max maximum frequency in kHz.
+ * \return 0 if success, negative value otherwise.
+ * \note All the CPUs of the policy group of cpu are changed.
+ */
+int cpufreq_set_limits(unsigned int cpu, unsigned long min,
+    unsigned long max);
+
+/**
+ * \brief Pins a CPU at a fixed frequency.
+ *
+ * The userspace governor is used if available, otherwise both limits are set
+ * to the frequency.
+ * \param cpu CPU id.
+ * \param freq frequency in kHz.
+ * \return 0 if success, negative value otherwise.
+ * \note All the CPUs of the policy group of cpu are changed.
+ */
+int cpufreq_set_frequency(unsigned int cpu, unsigned long freq);
+
+/**
+ * \brief Returns the current frequency of a CPU.
+ * \param cpu CPU id.
+ * \return frequency in kHz, 0 in case of error.
+ */
+unsigned long cpufreq_get_frequency(unsigned int cpu);
+
+/**
+ * \brief Returns the CPUs sharing the same frequency policy as a CPU.
+ * \param cpu CPU id.
+ * \param cpus array that will receive the CPU indexes (can be NULL to only
+ * count them).
+ * \param cpus_size size of the array.
+ * \return number of CPUs in the policy group, negative value otherwise.
+ */
+int cpufreq_get_policy_cpus(unsigned int cpu, int* cpus, size_t cpus_size);
+
 /**
  * \brief Launch a specific task periodically.
  * \param fcn function to call periodically.
@@ -256,5 +706,121 @@ enum cpufreq_governor cpufreq_get_governor(unsigned int cpu);
  */
 int thread_periodic_task(void (*fcn)(void*), void* data, unsigned long period);
 
+/**
+ * \brief Launch a specific task periodically with optional attributes.
+ * \param fcn function to call periodically.
+ * \param data data to pass to the function.
+ * \param period period in nanoseconds.
+ * \param attr attributes, can be NULL.
+ * \return 0 if thread is successfully launched, -1 otherwise.
+ * \note This function is blocking the thread, use pthread_cancel to quit.
+ * \note This function is blocking signals for the current thread.
+ * \note Timestamps use tsc_now_ns(), call tsc_init() first to get the
+ * low-overhead clock.
+ */
+int thread_periodic_task_attr(void (*fcn)(void*), void* data,
+    unsigned long period, const struct periodic_task_attr* attr);
+
+/**
+ * \brief Initializes (or resets) a latency histogram.
+ * \param hist histogram.
+ */
+void rt_hist_init(struct rt_hist* hist);
+
+/**
+ * \brief Returns the index of the bucket of a value.
+ * \param value value.
+ * \return index of the bucket.
+ */
+size_t rt_hist_bucket_index(uint64_t value);
+
+/**
+ * \brief Returns the lowest value of a bucket.
+ * \param index index of the bucket.
+ * \return lowest value of the bucket.
+ */
+uint64_t rt_hist_bucket_lower(size_t index);
+
+/**
+ * \brief Returns the highest value of a bucket.
+ * \param index index of the bucket.
+ * \return highest value of the bucket.
+ */
+uint64_t rt_hist_bucket_upper(size_t index);
+
+/**
+ * \brief Records a value in a histogram owned by the calling thread.
+ *
+ * It is wait-free, other threads can read the histogram concurrently.
+ * \param hist histogram.
+ * \param value value to record.
+ * \note Only one thread can record in the histogram, use
+ * rt_hist_record_shared() otherwise.
+ */
+void rt_hist_record(struct rt_hist* hist, uint64_t value);
+
+/**
+ * \brief Records a value in a histogram shared by several threads.
+ * \param hist histogram.
+ * \param value value to record.
+ */
+void rt_hist_record_shared(struct rt_hist* hist, uint64_t value);
+
+/**
+ * \brief Adds the values of a histogram into another one.
+ * \param dst destination histogram.
+ * \param src source histogram.
+ * \note dst must not be recorded concurrently.
+ */
+void rt_hist_merge(struct rt_hist* dst, const struct rt_hist* src);
+
+/**
+ * \brief Returns the number of recorded values.
+ * \param hist histogram.
+ * \return number of values.
+ */
+uint64_t rt_hist_get_count(const struct rt_hist* hist);
+
+/**
+ * \brief Returns the minimum recorded value.
+ * \param hist histogram.
+ * \return minimum value, 0 if histogram is empty.
+ */
+uint64_t rt_hist_get_min(const struct rt_hist* hist);
+
+/**
+ * \brief Returns the maximum recorded value.
+ * \param hist histogram.
+ * \return maximum value.
+ */
+uint64_t rt_hist_get_max(const struct rt_hist* hist);
+
+/**
+ * \brief Returns the mean of the recorded values.
+ * \param hist histogram.
+ * \return mean value, 0 if histogram is empty.
+ */
+double rt_hist_get_mean(const struct rt_hist* hist);
+
+/**
+ * \brief Returns a percentile of the recorded values.
+ * \param hist histogram.
+ * \param percentile percentile (0.0 to 100.0, i.e. 99.99).
+ * \return highest value of the bucket containing the percentile (bounded
+ * by the maximum), 0 if histogram is empty.
+ */
+uint64_t rt_hist_get_percentile(const struct rt_hist* hist,
+    double percentile);
+
+/**
+ * \brief Exports the non-empty buckets of a histogram.
+ *
+ * Output is CSV with one "lower,upper,count" line per bucket.
+ * \param hist histogram.
+ * \param f output stream.
+ * \return 0 if success, negative value otherwise.
+ */
+int rt_hist_export(const struct rt_hist* hist, FILE* f);
+
 #endif /* RTVSUTILS_RTUTILS_H */
 
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file shm_ring.h
+ * \brief Lock-free shared-memory message ring between processes.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_SHM_RING_H
+#define RTVSUTILS_SHM_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+/**
+ * \brief Several producers (default is a single producer).
+ */
+#define SHM_RING_MPSC 0x01
+
+/**
+ * \brief Consumer can sleep until a message is committed (futex wakeup).
+ */
+#define SHM_RING_WAKEUP 0x02
+
+/**
+ * \struct shm_ring
+ * \brief Mapping of a ring in a process.
+ */
+struct shm_ring
+{
+  /**
+   * \brief Shared header (followed by the slots).
+   */
+  struct shm_ring_header* header;
+
+  /**
+   * \brief First slot.
+   */
+  unsigned char* slots;
+
+  /**
+   * \brief Size of the mapping.
+   */
+  size_t map_size;
+
+  /**
+   * \brief Size of a slot.
+   */
+  size_t slot_size;
+
+  /**
+   * \brief Size of a message.
+   */
+  size_t msg_size;
+
+  /**
+   * \brief Number of slots minus one.
+   */
+  uint64_t mask;
+
+  /**
+   * \brief Flags of the ring (SHM_RING_*).
+   */
+  unsigned int flags;
+
+  /**
+   * \brief Descriptor of the shared memory.
+   */
+  int fd;
+};
+
+/**
+ * \brief Creates a ring and maps it.
+ *
+ * The memory is pre-faulted and locked so that no page fault occurs on the
+ * real-time path.
+ * \param ring ring.
+ * \param name POSIX shared memory name (i.e. "/ctrl"), NULL for an anonymous
+ * memfd whose descriptor is passed to the other process (fork or
+ * SCM_RIGHTS).
+ * \param msg_size size of a message.
+ * \param capacity number of messages (power of two).
+ * \param flags SHM_RING_MPSC and/or SHM_RING_WAKEUP, 0 for a single
+ * producer without wakeup.
+ * \return 0 if success, negative value otherwise.
+ */
+int shm_ring_create(struct shm_ring* ring, const char* name, size_t msg_size,
+    size_t capacity, unsigned int flags);
+
+/**
+ * \brief Maps an existing named ring.
+ * \param ring ring.
+ * \param name POSIX shared memory name.
+ * \return 0 if success, negative value otherwise.
+ */
+int shm_ring_open(struct shm_ring* ring, const char* name);
+
+/**
+ * \brief Maps an existing ring from its descriptor.
+ * \param ring ring.
+ * \param fd descriptor (shm_ring_get_fd() of the creator), it is
+ * duplicated.
+ * \return 0 if success, negative value otherwise.
+ */
+int shm_ring_open_fd(struct shm_ring* ring, int fd);
+
+/**
+ * \brief Returns the descriptor of the shared memory.
+ * \param ring ring.
+ * \return descriptor.
+ */
+int shm_ring_get_fd(const struct shm_ring* ring);
+
+/**
+ * \brief Unmaps a ring.
+ * \param ring ring.
+ */
+void shm_ring_close(struct shm_ring* ring);
+
+/**
+ * \brief Removes the name of a named ring.
+ * \param name POSIX shared memory name.
+ * \return 0 if success, negative value otherwise.
+ */
+int shm_ring_unlink(const char* name);
+
+/**
+ * \brief Reserves a message slot (producer).
+ *
+ * The message is written in place then published with shm_ring_commit().
+ * \param ring ring.
+ * \return pointer to the message or NULL if ring is full (errno is set to
+ * EAGAIN).
+ */
+void* shm_ring_reserve(struct shm_ring* ring);
+
+/**
+ * \brief Publishes a reserved message (producer).
+ * \param ring ring.
+ * \param msg message returned by shm_ring_reserve().
+ * \return 0 if success, negative value otherwise.
+ */
+int shm_ring_commit(struct shm_ring* ring, void* msg);
+
+/**
+ * \brief Copies and publishes a message (producer).
+ * \param ring ring.
+ * \param msg message.
+ * \param size size of the message (at most the message size of the ring).
+ * \return 0 if success, negative value otherwise (errno is set to EAGAIN if
+ * ring is full).
+ */
+int shm_ring_send(struct shm_ring* ring, const void* msg, size_t size);
+
+/**
+ * \brief Returns the oldest message without removing it (consumer).
+ * \param ring ring.
+ * \return pointer to the message or NULL if ring is empty.
+ */
+const void* shm_ring_peek(struct shm_ring* ring);
+
+/**
+ * \brief Frees the message returned by shm_ring_peek() (consumer).
+ * \param ring ring.
+ */
+void shm_ring_release(struct shm_ring* ring);
+
+/**
+ * \brief Copies and removes the oldest message (consumer).
+ * \param ring ring.
+ * \param msg buffer that will receive the message.
+ * \param size size of the buffer.
+ * \return 0 if success, negative value otherwise (errno is set to EAGAIN if
+ * ring is empty).
+ */
+int shm_ring_receive(struct shm_ring* ring, void* msg, size_t size);
+
+/**
+ * \brief Waits until a message is available (consumer).
+ * \param ring ring created with SHM_RING_WAKEUP.
+ * \param abstime absolute deadline on CLOCK_MONOTONIC, NULL to wait
+ * forever.
+ * \return 0 if a message is available, negative value otherwise (errno is
+ * set to ETIMEDOUT if deadline is reached).
+ */
+int shm_ring_wait(struct shm_ring* ring, const struct timespec* abstime);
+
+#endif /* RTVSUTILS_SHM_RING_H */
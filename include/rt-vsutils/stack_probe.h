@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file stack_probe.h
+ * \brief Stack high-water mark measurement.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_STACK_PROBE_H
+#define RTVSUTILS_STACK_PROBE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * \brief Bytes left unpainted below the caller of stack_probe_init().
+ */
+#define STACK_PROBE_MARGIN 512
+
+/**
+ * \struct stack_probe
+ * \brief Painted area of a thread stack.
+ */
+struct stack_probe
+{
+  /**
+   * \brief Lowest painted address.
+   */
+  uintptr_t low;
+
+  /**
+   * \brief Highest painted address (excluded).
+   */
+  uintptr_t high;
+
+  /**
+   * \brief Top of the stack (highest address, excluded).
+   */
+  uintptr_t end;
+};
+
+/**
+ * \brief Paints the free part of the calling thread stack with a pattern.
+ *
+ * Call it before the work to measure, typically at thread start. Painting
+ * also pre-faults the pages, like mem_lock_reserve().
+ * \param probe probe.
+ * \param size number of bytes to paint below the caller, 0 for the whole
+ * stack (avoid for the main thread, its stack size is the rlimit).
+ * \return 0 if success, negative value otherwise.
+ */
+int stack_probe_init(struct stack_probe* probe, size_t size);
+
+/**
+ * \brief Returns the highest stack usage since stack_probe_init().
+ *
+ * Can be called from any thread of the process.
+ * \param probe probe.
+ * \return bytes used from the top of the stack, a value equal to
+ * stack_probe_get_capacity() means the painted area was exhausted.
+ */
+size_t stack_probe_get_peak(const struct stack_probe* probe);
+
+/**
+ * \brief Returns the largest usage the probe can measure.
+ * \param probe probe.
+ * \return bytes from the top of the stack to the lowest painted address.
+ */
+size_t stack_probe_get_capacity(const struct stack_probe* probe);
+
+#endif /* RTVSUTILS_STACK_PROBE_H */
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file sysinfo.h
+ * \brief Queries of the system real-time configuration.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_SYSINFO_H
+#define RTVSUTILS_SYSINFO_H
+
+#include <stddef.h>
+
+#include <sys/resource.h>
+
+/**
+ * \enum sysinfo_preempt
+ * \brief Preemption model of the kernel.
+ */
+enum sysinfo_preempt
+{
+  /**
+   * \brief Unknown model.
+   */
+  SYSINFO_PREEMPT_UNKNOWN = -1,
+
+  /**
+   * \brief No forced preemption (server) or voluntary preemption.
+   */
+  SYSINFO_PREEMPT_NONE,
+
+  /**
+   * \brief Preemptible kernel (low-latency desktop).
+   */
+  SYSINFO_PREEMPT_FULL,
+
+  /**
+   * \brief Fully preemptible kernel (PREEMPT_RT).
+   */
+  SYSINFO_PREEMPT_RT,
+};
+
+/**
+ * \struct rt_caps
+ * \brief Real-time capabilities of the running kernel and process.
+ */
+struct rt_caps
+{
+  /**
+   * \brief Preemption model.
+   */
+  enum sysinfo_preempt preempt;
+
+  /**
+   * \brief Tick rate in Hz (CONFIG_HZ), 0 if unknown.
+   */
+  long tick_rate;
+
+  /**
+   * \brief Current clocksource (empty if unknown).
+   */
+  char clocksource[32];
+
+  /**
+   * \brief If not 0, SCHED_DEADLINE is available.
+   */
+  int deadline;
+
+  /**
+   * \brief If not 0, utilization clamping is available.
+   */
+  int uclamp;
+
+  /**
+   * \brief If not 0, restartable sequences are available.
+   */
+  int rseq;
+
+  /**
+   * \brief If not 0, process has CAP_SYS_NICE (any RT priority).
+   */
+  int cap_sys_nice;
+
+  /**
+   * \brief If not 0, process has CAP_IPC_LOCK (unlimited memory lock).
+   */
+  int cap_ipc_lock;
+
+  /**
+   * \brief Maximum RT priority allowed by RLIMIT_RTPRIO (hard limit, the
+   * soft limit can be raised up to it).
+   */
+  rlim_t rtprio_max;
+
+  /**
+   * \brief Maximum locked memory allowed by RLIMIT_MEMLOCK (hard limit).
+   */
+  rlim_t memlock_max;
+};
+
+/**
+ * \brief Returns the real-time capabilities.
+ *
+ * Capabilities are queried on first call only, the result is cached.
+ * \return capabilities (never NULL).
+ */
+const struct rt_caps* rt_caps_get(void);
+
+/**
+ * \brief Returns the CPUs isolated from the scheduler (isolcpus= or
+ * isolated cpuset partitions).
+ * \param cpus array that will receive the CPU indexes (can be NULL to only
+ * count them).
+ * \param cpus_size size of the array.
+ * \return number of isolated CPUs, negative value otherwise.
+ */
+int sysinfo_get_isolated_cpus(int* cpus, size_t cpus_size);
+
+/**
+ * \brief Returns the adaptive-tick CPUs (nohz_full=).
+ * \param cpus array that will receive the CPU indexes (can be NULL to only
+ * count them).
+ * \param cpus_size size of the array.
+ * \return number of nohz_full CPUs, negative value otherwise.
+ */
+int sysinfo_get_nohz_full_cpus(int* cpus, size_t cpus_size);
+
+/**
+ * \brief Counts the interrupts that can be delivered to some CPUs.
+ *
+ * The affinity of each IRQ of /proc/irq is compared to the CPUs. IRQs
+ * whose affinity cannot be changed (per-CPU interrupts) are not listed
+ * there.
+ * \param cpus array of CPU index.
+ * \param cpus_size size of the array.
+ * \return number of IRQs, negative value otherwise.
+ */
+int sysinfo_count_irqs_on_cpus(const int* cpus, size_t cpus_size);
+
+/**
+ * \brief Returns if simultaneous multithreading (hyper-threading) is active.
+ * \return 1 if active, 0 if not active, negative value if unknown.
+ */
+int sysinfo_get_smt_active(void);
+
+/**
+ * \brief Returns the current clocksource of the kernel.
+ * \param name buffer that will receive the name (i.e. "tsc").
+ * \param size size of the buffer.
+ * \return 0 if success, negative value otherwise.
+ */
+int sysinfo_get_clocksource(char* name, size_t size);
+
+/**
+ * \brief Returns the preemption model of the running kernel.
+ * \return preemption model.
+ */
+enum sysinfo_preempt sysinfo_get_preempt(void);
+
+/**
+ * \brief Formats an array of CPU (or memory node) indexes in the kernel list
+ * format (i.e. "0-3,6,8-9").
+ * \param cpus array of indexes, negative values are ignored.
+ * \param cpus_size size of the array.
+ * \param buf buffer that will receive the NULL-terminated list.
+ * \param size size of the buffer.
+ * \return 0 if success, -1 otherwise.
+ */
+int cpulist_format(const int* cpus, size_t cpus_size, char* buf, size_t size);
+
+/**
+ * \brief Parses a list in the kernel list format (i.e. "0-3,6,8-9").
+ * \param str string to parse.
+ * \param cpus array that will receive the indexes (can be NULL to only count
+ * them).
+ * \param cpus_size size of the array.
+ * \return number of indexes in the list if success, -1 otherwise.
+ */
+int cpulist_parse(const char* str, int* cpus, size_t cpus_size);
+
+#endif /* RTVSUTILS_SYSINFO_H */
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file telemetry.h
+ * \brief Background frequency and thermal telemetry sampler.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_TELEMETRY_H
+#define RTVSUTILS_TELEMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * \struct telemetry_sample
+ * \brief Frequency and thermal state of a CPU at a given time.
+ */
+struct telemetry_sample
+{
+  /**
+   * \brief Timestamp in nanoseconds (CLOCK_MONOTONIC, same clock as
+   * thread_periodic_task()).
+   */
+  uint64_t timestamp;
+
+  /**
+   * \brief Sequence number of the sample.
+   */
+  uint64_t seq;
+
+  /**
+   * \brief CPU id.
+   */
+  unsigned int cpu;
+
+  /**
+   * \brief Current frequency in kHz (0 if not available).
+   */
+  unsigned long freq;
+
+  /**
+   * \brief Number of core thermal throttling events (0 if not available).
+   */
+  unsigned long core_throttle_count;
+
+  /**
+   * \brief Number of package thermal throttling events (0 if not
+   * available).
+   */
+  unsigned long package_throttle_count;
+
+  /**
+   * \brief Package temperature in millidegree Celsius (0 if not available).
+   */
+  long temperature;
+};
+
+/**
+ * \struct telemetry_config
+ * \brief Configuration of the sampler.
+ */
+struct telemetry_config
+{
+  /**
+   * \brief Array of CPU index to sample.
+   */
+  const int* cpus;
+
+  /**
+   * \brief Size of the CPU array.
+   */
+  size_t cpus_size;
+
+  /**
+   * \brief Sampling period in nanoseconds.
+   */
+  unsigned long period;
+
+  /**
+   * \brief Number of samples kept in the ring buffer.
+   */
+  size_t capacity;
+};
+
+/**
+ * \brief Opaque sampler.
+ */
+struct telemetry;
+
+/**
+ * \brief Starts a sampler thread.
+ *
+ * Files are opened once and re-read with pread() at each period. The thread
+ * runs with the lowest time-sharing priority (nice 19), whatever the policy
+ * of the caller.
+ * \param config configuration of the sampler.
+ * \return sampler or NULL if failure (errno is set).
+ */
+struct telemetry* telemetry_start(const struct telemetry_config* config);
+
+/**
+ * \brief Stops a sampler thread and releases its resources.
+ * \param telemetry the sampler.
+ */
+void telemetry_stop(struct telemetry* telemetry);
+
+/**
+ * \brief Reads the samples recorded since a sequence number.
+ * \param telemetry the sampler.
+ * \param seq sequence number of the next sample to read, updated with the
+ * sequence number following the last sample read (start with 0).
+ * \param samples array that will receive the samples.
+ * \param size size of the array.
+ * \return number of samples read.
+ * \note If samples were overwritten since seq, reading restarts at the
+ * oldest sample in the ring buffer.
+ */
+size_t telemetry_read(struct telemetry* telemetry, uint64_t* seq,
+    struct telemetry_sample* samples, size_t size);
+
+/**
+ * \brief Returns the samples recorded in a time window.
+ *
+ * It is used to correlate a latency spike measured at a given time with the
+ * frequency and thermal state around it.
+ *
+ * Like telemetry_read(), it never blocks: the ring buffer is read without
+ * lock, so it can be called from a real-time thread (i.e. a cycle_stats
+ * callback).
+ * \param telemetry the sampler.
+ * \param from start of the window in nanoseconds (CLOCK_MONOTONIC).
+ * \param to end of the window in nanoseconds (CLOCK_MONOTONIC).
+ * \param samples array that will receive the samples.
+ * \param size size of the array.
+ * \return number of samples stored.
+ */
+size_t telemetry_find(struct telemetry* telemetry, uint64_t from, uint64_t to,
+    struct telemetry_sample* samples, size_t size);
+
+#endif /* RTVSUTILS_TELEMETRY_H */
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file thread_registry.h
+ * \brief Registry of threads and remote per-thread operations.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_THREAD_REGISTRY_H
+#define RTVSUTILS_THREAD_REGISTRY_H
+
+#include <unistd.h>
+#include <pthread.h>
+
+#include "rtutils.h"
+
+/**
+ * \brief Maximum size of a thread name (including NULL character).
+ */
+#define THREAD_REGISTRY_NAME_SIZE 32
+
+/**
+ * \brief Maximum number of registered threads.
+ */
+#define THREAD_REGISTRY_MAX 256
+
+/**
+ * \brief Apply time-sharing priority (nice value).
+ */
+#define THREAD_SETTINGS_PRIORITY 0x01
+
+/**
+ * \brief Apply real-time policy and priority.
+ */
+#define THREAD_SETTINGS_RT_PRIORITY 0x02
+
+/**
+ * \brief Apply affinity.
+ */
+#define THREAD_SETTINGS_AFFINITY 0x04
+
+/**
+ * \brief Apply timer slack.
+ */
+#define THREAD_SETTINGS_TIMER_SLACK 0x08
+
+/**
+ * \struct thread_info
+ * \brief Information about a registered thread.
+ */
+struct thread_info
+{
+  /**
+   * \brief POSIX thread identifier.
+   */
+  pthread_t th;
+
+  /**
+   * \brief Kernel thread identifier.
+   */
+  pid_t tid;
+
+  /**
+   * \brief Name of the thread.
+   */
+  char name[THREAD_REGISTRY_NAME_SIZE];
+};
+
+/**
+ * \struct thread_settings
+ * \brief Settings to apply to several threads at once.
+ */
+struct thread_settings
+{
+  /**
+   * \brief Settings to apply (THREAD_SETTINGS_* flags).
+   */
+  int flags;
+
+  /**
+   * \brief Time-sharing priority (range from -20 to 19).
+   */
+  int priority;
+
+  /**
+   * \brief Real-time priority information.
+   */
+  struct rt_prio rt_priority;
+
+  /**
+   * \brief Array of CPU index.
+   */
+  const int* cpus;
+
+  /**
+   * \brief Size of the CPU array.
+   */
+  size_t cpus_size;
+
+  /**
+   * \brief Timer slack in nanoseconds.
+   */
+  unsigned long timer_slack;
+};
+
+/**
+ * \brief Registers the calling thread.
+ *
+ * The thread is removed from the registry automatically when it exits. The
+ * name is also set as the system name of the thread (truncated to 15
+ * characters).
+ * \param name name of the thread.
+ * \return 0 if success, negative value otherwise.
+ */
+int thread_registry_add(const char* name);
+
+/**
+ * \brief Removes a thread from the registry.
+ * \param th ID of the thread.
+ * \return 0 if success, negative value otherwise.
+ */
+int thread_registry_remove(pthread_t th);
+
+/**
+ * \brief Returns the kernel thread identifier of a thread.
+ * \param th ID of the thread.
+ * \return kernel thread identifier, negative value if the thread is not the
+ * calling thread and is not registered.
+ */
+pid_t thread_registry_get_tid(pthread_t th);
+
+/**
+ * \brief Looks up a registered thread by name.
+ * \param name name of the thread.
+ * \param info pointer that will receive the thread information.
+ * \return 0 if found, negative value otherwise.
+ */
+int thread_registry_find(const char* name, struct thread_info* info);
+
+/**
+ * \brief Lists the registered threads.
+ * \param infos array that will receive the thread information (can be NULL
+ * to only count them).
+ * \param size size of the array.
+ * \return number of threads stored, negative value otherwise.
+ */
+int thread_registry_list(struct thread_info* infos, size_t size);
+
+/**
+ * \brief Applies settings to all the registered threads whose name matches
+ * a pattern.
+ *
+ * For each thread, affinity is set before priorities so that a thread is
+ * never raised on a CPU it is not supposed to run on. The policy is set
+ * before the nice value, which is rejected (EINVAL) with a real-time policy.
+ * \param pattern shell wildcard pattern (see fnmatch(3)).
+ * \param settings settings to apply.
+ * \return number of threads updated, negative value if at least one thread
+ * failed to be updated.
+ */
+int thread_registry_apply(const char* pattern,
+    const struct thread_settings* settings);
+
+/**
+ * \brief Sets time-sharing priority of a kernel thread.
+ * \param tid kernel thread identifier.
+ * \param priority priority to set (range from -20 to 19).
+ * \return 0 if success, negative value otherwise.
+ */
+int task_set_priority(pid_t tid, int priority);
+
+/**
+ * \brief Returns time-sharing priority of a kernel thread.
+ * \param tid kernel thread identifier.
+ * \return priority of the thread.
+ * \note if returns -1, check if errno is set to see if it is an error or not.
+ */
+int task_get_priority(pid_t tid);
+
+/**
+ * \brief Sets real-time priority of a kernel thread.
+ * \param tid kernel thread identifier.
+ * \param priority real-time priority information.
+ * \return 0 if success, negative value otherwise.
+ */
+int task_set_rt_priority(pid_t tid, struct rt_prio* priority);
+
+/**
+ * \brief Returns real-time priority of a kernel thread.
+ * \param tid kernel thread identifier.
+ * \param priority real-time priority information.
+ * \return 0 if success, negative value otherwise.
+ */
+int task_get_rt_priority(pid_t tid, struct rt_prio* priority);
+
+/**
+ * \brief Sets the affinity of a kernel thread.
+ * \param tid kernel thread identifier.
+ * \param cpus array of CPU index (first CPU is 0, second is 1, ...).
+ * \param cpus_size size of the array.
+ * \return 0 if success, negative value otherwise.
+ */
+int task_set_affinity(pid_t tid, const int* cpus, size_t cpus_size);
+
+/**
+ * \brief Sets the timer slack of a kernel thread.
+ * \param tid kernel thread identifier.
+ * \param slack timer slack in nanoseconds (0 resets it to the default).
+ * \return 0 if success, negative value otherwise.
+ * \note Changing another thread requires /proc/[tid]/timerslack_ns (Linux
+ * 4.6).
+ */
+int task_set_timer_slack(pid_t tid, unsigned long slack);
+
+/**
+ * \brief Returns the timer slack of a kernel thread.
+ * \param tid kernel thread identifier.
+ * \param slack pointer that will receive the timer slack in nanoseconds.
+ * \return 0 if success, negative value otherwise.
+ */
+int task_get_timer_slack(pid_t tid, unsigned long* slack);
+
+#endif /* RTVSUTILS_THREAD_REGISTRY_H */
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file trace.h
+ * \brief ftrace trace_marker integration.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_TRACE_H
+#define RTVSUTILS_TRACE_H
+
+/**
+ * \brief Maximum size of a marker (longer markers are truncated).
+ */
+#define TRACE_MARKER_SIZE 256
+
+/**
+ * \brief Opens the ftrace trace_marker and tracing_on files.
+ *
+ * tracefs is searched in /sys/kernel/tracing then /sys/kernel/debug/tracing.
+ * Descriptors are kept open so that writing a marker is a single write()
+ * system call.
+ * \return 0 if success, negative value otherwise.
+ * \note Call it before starting the real-time threads.
+ */
+int trace_open(void);
+
+/**
+ * \brief Closes the ftrace files.
+ */
+void trace_close(void);
+
+/**
+ * \brief Returns if the ftrace files are opened.
+ * \return 1 if opened, 0 otherwise.
+ */
+int trace_is_open(void);
+
+/**
+ * \brief Writes a marker in the ftrace buffer.
+ * \param fmt printf-like format.
+ * \return 0 if success, negative value otherwise.
+ */
+int trace_marker(const char* fmt, ...)
+  __attribute__((format(printf, 1, 2)));
+
+/**
+ * \brief Writes the beginning marker of a user-defined span.
+ * \param name name of the span.
+ * \return 0 if success, negative value otherwise.
+ */
+int trace_span_begin(const char* name);
+
+/**
+ * \brief Writes the end marker of a user-defined span.
+ * \param name name of the span.
+ * \return 0 if success, negative value otherwise.
+ */
+int trace_span_end(const char* name);
+
+/**
+ * \brief Starts recording in the ftrace buffer (tracing_on).
+ * \return 0 if success, negative value otherwise.
+ */
+int trace_start(void);
+
+/**
+ * \brief Stops recording in the ftrace buffer (tracing_on).
+ *
+ * The buffer keeps the events that led to the stop and can be read later
+ * from the trace file.
+ * \return 0 if success, negative value otherwise.
+ */
+int trace_stop(void);
+
+#endif /* RTVSUTILS_TRACE_H */
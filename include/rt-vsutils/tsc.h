@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file tsc.h
+ * \brief Calibrated TSC timestamp clock.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_TSC_H
+#define RTVSUTILS_TSC_H
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * \struct tsc_clock
+ * \brief Conversion parameters of the TSC clock.
+ *
+ * Nanoseconds are computed as base_ns + ((ticks - base_ticks) * mult) >>
+ * shift. When the TSC is not usable, ticks are CLOCK_MONOTONIC nanoseconds
+ * and conversion is the identity.
+ * \note Internal, use the tsc_* functions.
+ */
+struct tsc_clock
+{
+  /**
+   * \brief If not 0, ticks are read from the TSC.
+   */
+  int usable;
+
+  /**
+   * \brief Multiplier of the fixed-point conversion.
+   */
+  uint64_t mult;
+
+  /**
+   * \brief Shift of the fixed-point conversion.
+   */
+  uint32_t shift;
+
+  /**
+   * \brief Ticks at calibration.
+   */
+  uint64_t base_ticks;
+
+  /**
+   * \brief CLOCK_MONOTONIC nanoseconds at calibration.
+   */
+  uint64_t base_ns;
+
+  /**
+   * \brief Frequency of the ticks in Hz.
+   */
+  uint64_t frequency;
+};
+
+/**
+ * \brief Conversion parameters, set by tsc_init().
+ * \note Internal, use the tsc_* functions.
+ */
+extern struct tsc_clock tsc_clock;
+
+/**
+ * \brief 128-bit unsigned integer used for the conversion.
+ */
+__extension__ typedef unsigned __int128 tsc_uint128;
+
+/**
+ * \brief Checks, calibrates and enables the TSC clock.
+ *
+ * The TSC is used only if it is invariant (constant rate in all P/C-states),
+ * the kernel still considers it as a valid clocksource and it is
+ * synchronized across the CPUs the calling thread can run on. Otherwise the
+ * tsc_* functions fall back to clock_gettime(CLOCK_MONOTONIC).
+ * \param calibration_ms calibration duration in milliseconds, 0 for the
+ * default (20 ms).
+ * \return 0 if the TSC is used, negative value if the fallback is used.
+ * \note Call it once in the beginning of the program, before starting the
+ * real-time threads: the calling thread is migrated on each CPU during the
+ * synchronization check.
+ */
+int tsc_init(unsigned int calibration_ms);
+
+/**
+ * \brief Returns if the TSC is used.
+ * \return 1 if the TSC is used, 0 if the fallback is used.
+ */
+static inline int tsc_is_usable(void)
+{
+  return tsc_clock.usable;
+}
+
+/**
+ * \brief Returns the frequency of the ticks.
+ * \return frequency in Hz (1000000000 for the fallback).
+ */
+static inline uint64_t tsc_get_frequency(void)
+{
+  return tsc_clock.frequency;
+}
+
+/**
+ * \brief Reads the current ticks.
+ *
+ * The instruction is not serializing: it can be executed before previous
+ * instructions complete, which is fine to timestamp the stages of a loop.
+ * \return ticks.
+ */
+static inline uint64_t tsc_read(void)
+{
+  struct timespec ts;
+
+#if defined(__x86_64__) || defined(__i386__)
+  if(tsc_clock.usable)
+  {
+    return __builtin_ia32_rdtsc();
+  }
+#endif
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * \brief Converts a number of ticks to nanoseconds.
+ * \param ticks number of ticks (i.e. difference of two tsc_read()).
+ * \return nanoseconds.
+ */
+static inline uint64_t tsc_to_ns(uint64_t ticks)
+{
+  return (uint64_t)(((tsc_uint128)ticks * tsc_clock.mult) >>
+      tsc_clock.shift);
+}
+
+/**
+ * \brief Returns current time in nanoseconds.
+ * \return CLOCK_MONOTONIC-based time in nanoseconds.
+ */
+static inline uint64_t tsc_now_ns(void)
+{
+  return tsc_clock.base_ns + tsc_to_ns(tsc_read() - tsc_clock.base_ticks);
+}
+
+#endif /* RTVSUTILS_TSC_H */
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file tuning.h
+ * \brief Snapshot and restore of the system knobs changed by the library.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_TUNING_H
+#define RTVSUTILS_TUNING_H
+
+#include <stddef.h>
+
+/**
+ * \brief Default path of the persisted state file.
+ */
+#define TUNING_STATE_FILE "/run/rt-vsutils.state"
+
+/**
+ * \brief Maximum number of recorded knobs.
+ */
+#define TUNING_MAX 256
+
+/**
+ * \brief Records the current value of a system knob before it is changed.
+ *
+ * Only the first value recorded for a path is kept so that restore goes back
+ * to the state before the first change. All the functions of the library
+ * changing a system-wide setting (RT throttling, governors, frequency
+ * limits, idle states, ...) call it.
+ * \param path path of the knob (sysfs or procfs file).
+ * \return 0 if success, negative value otherwise.
+ */
+int tuning_record(const char* path);
+
+/**
+ * \brief Sets the file where the recorded values are persisted.
+ *
+ * The file is rewritten each time a new knob is recorded so that
+ * tuning_restore_file() (or the rtrestore command) can undo the tuning
+ * after a crash.
+ * \param path path of the file, NULL for TUNING_STATE_FILE.
+ * \return 0 if success, negative value otherwise.
+ */
+int tuning_set_state_file(const char* path);
+
+/**
+ * \brief Returns the number of recorded knobs.
+ * \return number of recorded knobs.
+ */
+size_t tuning_count(void);
+
+/**
+ * \brief Restores all the recorded knobs, in reverse order of recording.
+ *
+ * A knob refused by the kernel is retried after the others so that
+ * dependent knobs (i.e. RT runtime and period) are restored whatever the
+ * direction of the change. Recorded values are forgotten and the state file
+ * is removed.
+ * \return 0 if success, negative value if at least one knob failed to be
+ * restored.
+ * \note This function is async-signal-safe.
+ */
+int tuning_restore(void);
+
+/**
+ * \brief Restores the knobs persisted in a state file.
+ *
+ * The file is removed if all knobs are restored.
+ * \param path path of the file, NULL for TUNING_STATE_FILE.
+ * \return 0 if success, negative value otherwise.
+ */
+int tuning_restore_file(const char* path);
+
+/**
+ * \brief Restores the recorded knobs automatically on normal exit and on
+ * fatal signals.
+ *
+ * Handlers are installed for SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGSEGV,
+ * SIGBUS, SIGILL, SIGFPE and SIGABRT if the application did not install its
+ * own. After restore, the signal is raised again with default action.
+ * \return 0 if success, negative value otherwise.
+ */
+int tuning_install_handlers(void);
+
+#endif /* RTVSUTILS_TUNING_H */
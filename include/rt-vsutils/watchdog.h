@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file watchdog.h
+ * \brief Software watchdog for stalled real-time tasks.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_WATCHDOG_H
+#define RTVSUTILS_WATCHDOG_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include <unistd.h>
+
+#include "rtutils.h"
+
+/**
+ * \brief Maximum number of monitored tasks.
+ */
+#define WATCHDOG_MAX_TASKS 64
+
+/**
+ * \brief Maximum length of a task name.
+ */
+#define WATCHDOG_NAME_SIZE 32
+
+/**
+ * \brief Action: log diagnostics of the task on stderr and in ftrace.
+ */
+#define WATCHDOG_DUMP 0x01
+
+/**
+ * \brief Action: call the callback of the task.
+ */
+#define WATCHDOG_CALLBACK 0x02
+
+/**
+ * \brief Action: move the task to SCHED_OTHER.
+ */
+#define WATCHDOG_DEMOTE 0x04
+
+/**
+ * \brief Action: abort the process (tuning_install_handlers() restores the
+ * system settings).
+ */
+#define WATCHDOG_ABORT 0x08
+
+/**
+ * \struct watchdog_heartbeat
+ * \brief Heartbeat of a monitored task.
+ */
+struct watchdog_heartbeat
+{
+  /**
+   * \brief Number of beats, only written by the task (own cache line).
+   */
+  _Alignas(64) _Atomic uint64_t beats;
+
+  /**
+   * \brief If not 0, slot is in use.
+   */
+  atomic_int active;
+
+  /**
+   * \brief Name of the task.
+   */
+  char name[WATCHDOG_NAME_SIZE];
+
+  /**
+   * \brief TID of the task.
+   */
+  pid_t tid;
+
+  /**
+   * \brief Stall duration that triggers the actions in nanoseconds.
+   */
+  uint64_t timeout;
+
+  /**
+   * \brief Actions (WATCHDOG_*).
+   */
+  unsigned int actions;
+
+  /**
+   * \brief Callback for WATCHDOG_CALLBACK.
+   *
+   * Called by the supervisor thread without its lock held, so it may
+   * register or unregister tasks.
+   * \param heartbeat the heartbeat of the stalled task.
+   * \param stalled time since last beat in nanoseconds.
+   * \param data data of the callback.
+   */
+  void (*callback)(const struct watchdog_heartbeat* heartbeat,
+      uint64_t stalled, void* data);
+
+  /**
+   * \brief Data of the callback.
+   */
+  void* data;
+
+  /**
+   * \brief Beats seen at last check (supervisor).
+   */
+  uint64_t last_beats;
+
+  /**
+   * \brief Time of last beat change seen (supervisor).
+   */
+  uint64_t last_change;
+
+  /**
+   * \brief If not 0, actions already ran for the current stall
+   * (supervisor).
+   */
+  int tripped;
+
+  /**
+   * \brief Number of stalls detected.
+   */
+  _Atomic uint64_t stalls;
+};
+
+/**
+ * \struct watchdog_config
+ * \brief Configuration of the supervisor.
+ */
+struct watchdog_config
+{
+  /**
+   * \brief Housekeeping CPU of the supervisor, -1 for no pinning.
+   */
+  int cpu;
+
+  /**
+   * \brief Scheduling policy and priority of the supervisor, it should be
+   * above the monitored tasks.
+   */
+  struct rt_prio priority;
+
+  /**
+   * \brief Interval between two checks in nanoseconds.
+   */
+  unsigned long interval;
+};
+
+/**
+ * \struct watchdog
+ * \brief Opaque supervisor.
+ */
+struct watchdog;
+
+/**
+ * \brief Starts the supervisor thread.
+ * \param config configuration.
+ * \return supervisor or NULL if failure (errno is set).
+ */
+struct watchdog* watchdog_start(const struct watchdog_config* config);
+
+/**
+ * \brief Stops the supervisor thread and frees it.
+ * \param watchdog supervisor.
+ */
+void watchdog_stop(struct watchdog* watchdog);
+
+/**
+ * \brief Registers the calling thread.
+ * \param watchdog supervisor.
+ * \param name name of the task.
+ * \param period expected time between two beats in nanoseconds.
+ * \param misses number of consecutive beats missed that is a stall.
+ * \param actions actions on stall (WATCHDOG_*).
+ * \param callback callback for WATCHDOG_CALLBACK, may be NULL.
+ * \param data data of the callback.
+ * \return heartbeat to feed or NULL if failure (errno is set to ENOSPC if
+ * too many tasks are registered).
+ */
+struct watchdog_heartbeat* watchdog_register(struct watchdog* watchdog,
+    const char* name, unsigned long period, unsigned int misses,
+    unsigned int actions,
+    void (*callback)(const struct watchdog_heartbeat*, uint64_t, void*),
+    void* data);
+
+/**
+ * \brief Stops monitoring a task.
+ * \param watchdog supervisor.
+ * \param heartbeat heartbeat returned by watchdog_register().
+ */
+void watchdog_unregister(struct watchdog* watchdog,
+    struct watchdog_heartbeat* heartbeat);
+
+/**
+ * \brief Returns number of stalls detected for a task.
+ * \param heartbeat heartbeat.
+ * \return number of stalls.
+ */
+uint64_t watchdog_get_stalls(const struct watchdog_heartbeat* heartbeat);
+
+/**
+ * \brief Feeds the heartbeat (from the monitored task only).
+ *
+ * Costs a relaxed load and store, no read-modify-write.
+ * \param heartbeat heartbeat.
+ */
+static inline void watchdog_feed(struct watchdog_heartbeat* heartbeat)
+{
+  atomic_store_explicit(&heartbeat->beats,
+      atomic_load_explicit(&heartbeat->beats, memory_order_relaxed) + 1,
+      memory_order_relaxed);
+}
+
+#endif /* RTVSUTILS_WATCHDOG_H */
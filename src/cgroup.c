@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file cgroup.c
+ * \brief cgroup v2 cpuset partition management.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "cgroup.h"
+#include "sysfs.h"
+
+/**
+ * \brief Mount point of the cgroup v2 hierarchy.
+ */
+static char cgroup_root[PATH_MAX] = "/sys/fs/cgroup";
+
+/**
+ * \brief Builds the path of a cgroup file.
+ * \param buf buffer that will receive the path.
+ * \param size size of the buffer.
+ * \param name name of the cgroup relative to the cgroup root.
+ * \param file name of the file in the cgroup, can be NULL for the cgroup
+ * directory itself.
+ * \return 0 if success, -1 otherwise.
+ */
+static int cgroup_path(char* buf, size_t size, const char* name,
+    const char* file)
+{
+  int ret = 0;
+
+  if(!name || name[0] == 0x00 || strstr(name, ".."))
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  ret = snprintf(buf, size, "%s/%s%s%s", cgroup_root, name, file ? "/" : "",
+      file ? file : "");
+
+  if(ret < 0 || (size_t)ret >= size)
+  {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Builds the path of a file in the parent of a cgroup.
+ * \param buf buffer that will receive the path.
+ * \param size size of the buffer.
+ * \param name name of the cgroup relative to the cgroup root.
+ * \param file name of the file in the parent cgroup.
+ * \return 0 if success, -1 otherwise.
+ */
+static int cgroup_parent_path(char* buf, size_t size, const char* name,
+    const char* file)
+{
+  char dir[PATH_MAX];
+  char* slash = NULL;
+  int ret = 0;
+
+  if(cgroup_path(dir, sizeof(dir), name, NULL) != 0)
+  {
+    return -1;
+  }
+
+  slash = strrchr(dir, '/');
+  *slash = 0x00;
+
+  ret = snprintf(buf, size, "%s/%s", dir, file);
+  if(ret < 0 || (size_t)ret >= size)
+  {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Moves all the tasks listed in a cgroup file to the parent cgroup.
+ * \param name name of the cgroup relative to the cgroup root.
+ * \param file "cgroup.procs" or "cgroup.threads".
+ * \return 0 if success, -1 otherwise.
+ */
+static int cgroup_move_to_parent(const char* name, const char* file)
+{
+  char path[PATH_MAX];
+  char parent[PATH_MAX];
+  FILE* f = NULL;
+  long id = 0;
+  int ret = 0;
+
+  if(cgroup_path(path, sizeof(path), name, file) != 0 ||
+      cgroup_parent_path(parent, sizeof(parent), name, file) != 0)
+  {
+    return -1;
+  }
+
+  f = fopen(path, "r");
+  if(!f)
+  {
+    return -1;
+  }
+
+  while(fscanf(f, "%ld", &id) == 1)
+  {
+    /* task may have exited meanwhile */
+    if(sysfs_write_long(parent, id) != 0 && errno != ESRCH)
+    {
+      ret = -1;
+    }
+  }
+
+  fclose(f);
+  return ret;
+}
+
+int cgroup_set_root(const char* root)
+{
+  size_t len = 0;
+
+  if(!root)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  len = strlen(root);
+  if(len == 0 || len >= sizeof(cgroup_root))
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  memcpy(cgroup_root, root, len + 1);
+
+  /* remove trailing slashes */
+  while(len > 1 && cgroup_root[len - 1] == '/')
+  {
+    cgroup_root[--len] = 0x00;
+  }
+
+  return 0;
+}
+
+const char* cgroup_get_root(void)
+{
+  return cgroup_root;
+}
+
+int cpuset_partition_create(const char* name, const int* cpus,
+    size_t cpus_size, enum cpuset_partition_type type, int threaded)
+{
+  char path[PATH_MAX];
+  char list[1024];
+  const char* type_str = NULL;
+  int created = 0;
+
+  switch(type)
+  {
+    case CPUSET_PARTITION_MEMBER:
+      type_str = "member";
+      break;
+    case CPUSET_PARTITION_ROOT:
+      type_str = "root";
+      break;
+    case CPUSET_PARTITION_ISOLATED:
+      type_str = "isolated";
+      break;
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+
+  if(!cpus || cpus_size == 0 ||
+      cpulist_format(cpus, cpus_size, list, sizeof(list)) != 0 ||
+      list[0] == 0x00)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* enable cpuset controller for the children of the parent */
+  if(cgroup_parent_path(path, sizeof(path), name,
+        "cgroup.subtree_control") != 0)
+  {
+    return -1;
+  }
+
+  if(sysfs_write_str(path, "+cpuset") != 0)
+  {
+    return -1;
+  }
+
+  if(cgroup_path(path, sizeof(path), name, NULL) != 0)
+  {
+    return -1;
+  }
+
+  if(mkdir(path, 0755) == 0)
+  {
+    created = 1;
+  }
+  else if(errno != EEXIST)
+  {
+    return -1;
+  }
+
+  if(threaded)
+  {
+    if(cgroup_path(path, sizeof(path), name, "cgroup.type") != 0 ||
+        sysfs_write_str(path, "threaded") != 0)
+    {
+      goto error;
+    }
+  }
+
+  if(cgroup_path(path, sizeof(path), name, "cpuset.cpus") != 0 ||
+      sysfs_write_str(path, list) != 0)
+  {
+    goto error;
+  }
+
+  if(cgroup_path(path, sizeof(path), name, "cpuset.cpus.partition") != 0 ||
+      sysfs_write_str(path, type_str) != 0)
+  {
+    goto error;
+  }
+
+  /* kernel accepts the write but can flag the partition as invalid */
+  if(cpuset_partition_get_type(name) != type)
+  {
+    errno = EINVAL;
+    goto error;
+  }
+
+  return 0;
+
+error:
+  if(created)
+  {
+    int err = errno;
+
+    cgroup_path(path, sizeof(path), name, NULL);
+    rmdir(path);
+    errno = err;
+  }
+  return -1;
+}
+
+enum cpuset_partition_type cpuset_partition_get_type(const char* name)
+{
+  char path[PATH_MAX];
+  char value[256];
+
+  if(cgroup_path(path, sizeof(path), name, "cpuset.cpus.partition") != 0 ||
+      sysfs_read_str(path, value, sizeof(value)) == -1)
+  {
+    return CPUSET_PARTITION_INVALID;
+  }
+
+  /* invalid partitions are reported as "root invalid (reason)" */
+  if(strstr(value, "invalid"))
+  {
+    return CPUSET_PARTITION_INVALID;
+  }
+  else if(!strcmp(value, "member"))
+  {
+    return CPUSET_PARTITION_MEMBER;
+  }
+  else if(!strcmp(value, "root"))
+  {
+    return CPUSET_PARTITION_ROOT;
+  }
+  else if(!strcmp(value, "isolated"))
+  {
+    return CPUSET_PARTITION_ISOLATED;
+  }
+
+  return CPUSET_PARTITION_INVALID;
+}
+
+int cpuset_partition_move_process(const char* name, pid_t pid)
+{
+  char path[PATH_MAX];
+
+  if(pid < 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(cgroup_path(path, sizeof(path), name, "cgroup.procs") != 0)
+  {
+    return -1;
+  }
+
+  return sysfs_write_long(path, pid);
+}
+
+int cpuset_partition_move_thread(const char* name, pid_t tid)
+{
+  char path[PATH_MAX];
+
+  if(tid < 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(cgroup_path(path, sizeof(path), name, "cgroup.threads") != 0)
+  {
+    return -1;
+  }
+
+  return sysfs_write_long(path, tid);
+}
+
+int cpuset_partition_destroy(const char* name)
+{
+  char path[PATH_MAX];
+  char value[64];
+
+  if(cgroup_path(path, sizeof(path), name, "cgroup.type") != 0)
+  {
+    return -1;
+  }
+
+  /* threads of a threaded cgroup have to be moved one by one */
+  if(sysfs_read_str(path, value, sizeof(value)) > 0 &&
+      !strcmp(value, "threaded"))
+  {
+    if(cgroup_move_to_parent(name, "cgroup.threads") != 0)
+    {
+      return -1;
+    }
+  }
+  else if(cgroup_move_to_parent(name, "cgroup.procs") != 0)
+  {
+    return -1;
+  }
+
+  /* give CPUs back to the parent before removal */
+  if(cgroup_path(path, sizeof(path), name, "cpuset.cpus.partition") == 0)
+  {
+    sysfs_write_str(path, "member");
+  }
+
+  if(cgroup_path(path, sizeof(path), name, NULL) != 0)
+  {
+    return -1;
+  }
+
+  return rmdir(path);
+}
@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file cpuidle.c
+ * \brief CPU idle states and PM QoS latency control.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "cpuidle.h"
+#include "sysfs.h"
+#include "tuning.h"
+
+/**
+ * \brief Path of the PM QoS CPU latency device.
+ */
+static const char* const PM_QOS_PATH = "/dev/cpu_dma_latency";
+
+/**
+ * \brief Path of the idle state files of a CPU via /sys.
+ */
+static const char* const CPUIDLE_STATE_PATH =
+  "/sys/devices/system/cpu/cpu%u/cpuidle/state%u/%s";
+
+/**
+ * \brief Path of the resume latency constraint of a CPU via /sys.
+ */
+static const char* const CPUIDLE_RESUME_LATENCY_PATH =
+  "/sys/devices/system/cpu/cpu%u/power/pm_qos_resume_latency_us";
+
+/**
+ * \brief Descriptor of /dev/cpu_dma_latency (request is active while open).
+ */
+static int pm_qos_fd = -1;
+
+/**
+ * \brief Mutex to protect the descriptor.
+ */
+static pthread_mutex_t pm_qos_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * \brief Builds the path of a file of an idle state.
+ * \param buf buffer that will receive the path.
+ * \param size size of the buffer.
+ * \param cpu CPU id.
+ * \param state index of the state.
+ * \param file name of the file.
+ */
+static void cpuidle_path(char* buf, size_t size, unsigned int cpu,
+    unsigned int state, const char* file)
+{
+  snprintf(buf, size, CPUIDLE_STATE_PATH, cpu, state, file);
+  buf[size - 1] = 0x00;
+}
+
+int pm_qos_set_latency(int32_t latency)
+{
+  ssize_t ret = 0;
+
+  if(latency < 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pthread_mutex_lock(&pm_qos_mutex);
+
+  if(pm_qos_fd == -1)
+  {
+    pm_qos_fd = open(PM_QOS_PATH, O_RDWR | O_CLOEXEC);
+
+    if(pm_qos_fd == -1)
+    {
+      pthread_mutex_unlock(&pm_qos_mutex);
+      return -1;
+    }
+  }
+
+  /* binary 32-bit value, each write updates the request of the descriptor */
+  ret = write(pm_qos_fd, &latency, sizeof(latency));
+
+  pthread_mutex_unlock(&pm_qos_mutex);
+
+  return ret == (ssize_t)sizeof(latency) ? 0 : -1;
+}
+
+int32_t pm_qos_get_latency(void)
+{
+  int32_t latency = 0;
+  ssize_t ret = 0;
+  int fd = open(PM_QOS_PATH, O_RDONLY | O_CLOEXEC);
+
+  if(fd == -1)
+  {
+    return -1;
+  }
+
+  /* read returns the aggregated value, the request the kernel adds on open
+   * has the default value (no constraint) and is removed on close
+   */
+  ret = read(fd, &latency, sizeof(latency));
+  close(fd);
+
+  if(ret != (ssize_t)sizeof(latency))
+  {
+    return -1;
+  }
+
+  return latency;
+}
+
+int pm_qos_release(void)
+{
+  int ret = 0;
+
+  pthread_mutex_lock(&pm_qos_mutex);
+
+  if(pm_qos_fd != -1)
+  {
+    ret = close(pm_qos_fd);
+    pm_qos_fd = -1;
+  }
+
+  pthread_mutex_unlock(&pm_qos_mutex);
+
+  return ret;
+}
+
+int cpuidle_set_resume_latency(unsigned int cpu, long latency)
+{
+  char path[256];
+
+  snprintf(path, sizeof(path), CPUIDLE_RESUME_LATENCY_PATH, cpu);
+
+  if(tuning_record(path) != 0)
+  {
+    return -1;
+  }
+
+  if(latency < 0)
+  {
+    return sysfs_write_str(path, "n/a");
+  }
+
+  return sysfs_write_long(path, latency);
+}
+
+int cpuidle_get_states(unsigned int cpu, struct cpuidle_state* states,
+    size_t size)
+{
+  char path[256];
+  int nb = 0;
+
+  for(unsigned int i = 0 ; ; i++)
+  {
+    struct cpuidle_state state;
+    long value = 0;
+
+    memset(&state, 0x00, sizeof(struct cpuidle_state));
+    state.index = i;
+
+    cpuidle_path(path, sizeof(path), cpu, i, "name");
+    if(sysfs_read_str(path, state.name, sizeof(state.name)) == -1)
+    {
+      /* no more state */
+      if(errno == ENOENT)
+      {
+        break;
+      }
+      return -1;
+    }
+
+    cpuidle_path(path, sizeof(path), cpu, i, "desc");
+    sysfs_read_str(path, state.desc, sizeof(state.desc));
+
+    cpuidle_path(path, sizeof(path), cpu, i, "latency");
+    if(sysfs_read_long(path, &value) != 0)
+    {
+      return -1;
+    }
+    state.latency = (unsigned long)value;
+
+    cpuidle_path(path, sizeof(path), cpu, i, "residency");
+    if(sysfs_read_long(path, &value) == 0)
+    {
+      state.residency = (unsigned long)value;
+    }
+
+    cpuidle_path(path, sizeof(path), cpu, i, "disable");
+    if(sysfs_read_long(path, &value) == 0)
+    {
+      state.disabled = value != 0;
+    }
+
+    if(states)
+    {
+      if((size_t)nb >= size)
+      {
+        break;
+      }
+      states[nb] = state;
+    }
+    nb++;
+  }
+
+  /* no cpuidle driver */
+  if(nb == 0)
+  {
+    errno = ENOENT;
+    return -1;
+  }
+
+  return nb;
+}
+
+int cpuidle_set_state_disabled(unsigned int cpu, unsigned int state,
+    int disabled)
+{
+  char path[256];
+
+  cpuidle_path(path, sizeof(path), cpu, state, "disable");
+
+  if(tuning_record(path) != 0)
+  {
+    return -1;
+  }
+
+  return sysfs_write_str(path, disabled ? "1" : "0");
+}
+
+int cpuidle_limit_latency(unsigned int cpu, unsigned long latency)
+{
+  struct cpuidle_state states[32];
+  int nb = cpuidle_get_states(cpu, states, 32);
+  int disabled = 0;
+
+  if(nb == -1)
+  {
+    return -1;
+  }
+
+  for(int i = 0 ; i < nb ; i++)
+  {
+    /* states within the limit are left as is, admin may have disabled them */
+    if(states[i].latency <= latency)
+    {
+      continue;
+    }
+
+    if(!states[i].disabled &&
+        cpuidle_set_state_disabled(cpu, states[i].index, 1) != 0)
+    {
+      return -1;
+    }
+
+    disabled++;
+  }
+
+  return disabled;
+}
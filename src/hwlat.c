@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file hwlat.c
+ * \brief Hardware/firmware latency (SMI) detector.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <errno.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "hwlat.h"
+#include "tsc.h"
+
+/**
+ * \struct hwlat_thread
+ * \brief Detector thread of a CPU.
+ */
+struct hwlat_thread
+{
+  /**
+   * \brief The detector.
+   */
+  struct hwlat* hwlat;
+
+  /**
+   * \brief Thread.
+   */
+  pthread_t th;
+
+  /**
+   * \brief If not 0, thread is launched.
+   */
+  int launched;
+
+  /**
+   * \brief CPU id.
+   */
+  int cpu;
+
+  /**
+   * \brief If not 0, thread is pinned on its CPU.
+   */
+  atomic_int pinned;
+
+  /**
+   * \brief If not 0, thread runs with SCHED_FIFO priority.
+   */
+  atomic_int rt;
+
+  /**
+   * \brief Number of clock reads.
+   */
+  _Atomic uint64_t samples;
+
+  /**
+   * \brief Number of gaps above the threshold.
+   */
+  _Atomic uint64_t gaps;
+
+  /**
+   * \brief Histogram of the gaps above the threshold.
+   */
+  struct rt_hist hist;
+};
+
+/**
+ * \struct hwlat
+ * \brief Detector.
+ */
+struct hwlat
+{
+  /**
+   * \brief Configuration.
+   */
+  struct hwlat_config config;
+
+  /**
+   * \brief Detector threads.
+   */
+  struct hwlat_thread* threads;
+
+  /**
+   * \brief Stop flag.
+   */
+  atomic_int stop;
+};
+
+/**
+ * \brief Busy-reads the clock during a window.
+ * \param thread the detector thread.
+ * \param width duration in nanoseconds.
+ */
+static void hwlat_sample(struct hwlat_thread* thread, uint64_t width)
+{
+  uint64_t threshold = thread->hwlat->config.threshold;
+  uint64_t start = tsc_read();
+  uint64_t last = start;
+  uint64_t samples = 0;
+
+  for(;;)
+  {
+    uint64_t t1 = tsc_read();
+    uint64_t t2 = tsc_read();
+    /* gap inside a sample and between two samples */
+    uint64_t inner = tsc_to_ns(t2 - t1);
+    uint64_t outer = tsc_to_ns(t1 - last);
+    uint64_t gap = inner > outer ? inner : outer;
+
+    samples++;
+    last = t2;
+
+    if(gap > threshold)
+    {
+      rt_hist_record(&thread->hist, gap);
+      atomic_fetch_add_explicit(&thread->gaps, 1, memory_order_relaxed);
+    }
+
+    if(tsc_to_ns(t2 - start) >= width)
+    {
+      break;
+    }
+  }
+
+  atomic_fetch_add_explicit(&thread->samples, samples, memory_order_relaxed);
+}
+
+/**
+ * \brief Detector thread.
+ * \param data the detector thread.
+ * \return NULL.
+ */
+static void* hwlat_thread(void* data)
+{
+  struct hwlat_thread* thread = data;
+  struct hwlat* hwlat = thread->hwlat;
+  struct rt_prio prio;
+  struct timespec next;
+
+  atomic_store(&thread->pinned, thread_set_affinity(pthread_self(),
+        &thread->cpu, 1) == 0);
+
+  prio.policy = SCHED_FIFO;
+  prio.priority = hwlat->config.priority;
+  atomic_store(&thread->rt, thread_set_rt_priority(pthread_self(), &prio) ==
+      0);
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  while(!atomic_load(&hwlat->stop))
+  {
+    hwlat_sample(thread, hwlat->config.width);
+
+    /* sleep the rest of the window so the CPU is not starved */
+    next.tv_sec += hwlat->config.window / 1000000000;
+    next.tv_nsec += hwlat->config.window % 1000000000;
+    if(next.tv_nsec >= 1000000000)
+    {
+      next.tv_sec++;
+      next.tv_nsec -= 1000000000;
+    }
+
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+
+  return NULL;
+}
+
+struct hwlat* hwlat_start(const struct hwlat_config* config)
+{
+  struct hwlat* hwlat = NULL;
+
+  if(!config || !config->cpus || config->cpus_size == 0 ||
+      config->window == 0 || config->width == 0 ||
+      config->width >= config->window)
+  {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  hwlat = calloc(1, sizeof(struct hwlat));
+  if(!hwlat)
+  {
+    return NULL;
+  }
+
+  hwlat->threads = calloc(config->cpus_size, sizeof(struct hwlat_thread));
+  if(!hwlat->threads)
+  {
+    free(hwlat);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  hwlat->config = *config;
+  hwlat->config.cpus = NULL;
+  atomic_init(&hwlat->stop, 0);
+
+  for(size_t i = 0 ; i < config->cpus_size ; i++)
+  {
+    struct hwlat_thread* thread = &hwlat->threads[i];
+
+    thread->hwlat = hwlat;
+    thread->cpu = config->cpus[i];
+    atomic_init(&thread->pinned, 0);
+    atomic_init(&thread->rt, 0);
+    atomic_init(&thread->samples, 0);
+    atomic_init(&thread->gaps, 0);
+    rt_hist_init(&thread->hist);
+  }
+
+  for(size_t i = 0 ; i < config->cpus_size ; i++)
+  {
+    struct hwlat_thread* thread = &hwlat->threads[i];
+
+    if(pthread_create(&thread->th, NULL, hwlat_thread, thread) != 0)
+    {
+      hwlat_stop(hwlat);
+      errno = EAGAIN;
+      return NULL;
+    }
+    thread->launched = 1;
+  }
+
+  return hwlat;
+}
+
+void hwlat_stop(struct hwlat* hwlat)
+{
+  if(!hwlat)
+  {
+    return;
+  }
+
+  atomic_store(&hwlat->stop, 1);
+
+  for(size_t i = 0 ; i < hwlat->config.cpus_size ; i++)
+  {
+    if(hwlat->threads[i].launched)
+    {
+      pthread_join(hwlat->threads[i].th, NULL);
+    }
+  }
+
+  free(hwlat->threads);
+  free(hwlat);
+}
+
+int hwlat_get_stats(const struct hwlat* hwlat, size_t index,
+    struct hwlat_stats* stats)
+{
+  const struct hwlat_thread* thread = NULL;
+
+  if(!hwlat || !stats || index >= hwlat->config.cpus_size)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  thread = &hwlat->threads[index];
+  stats->cpu = thread->cpu;
+  stats->pinned = atomic_load(&thread->pinned);
+  stats->rt = atomic_load(&thread->rt);
+  stats->samples = atomic_load(&thread->samples);
+  stats->gaps = atomic_load(&thread->gaps);
+  stats->max = rt_hist_get_max(&thread->hist);
+
+  return 0;
+}
+
+const struct rt_hist* hwlat_get_hist(const struct hwlat* hwlat,
+    size_t index)
+{
+  if(!hwlat || index >= hwlat->config.cpus_size)
+  {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  return &hwlat->threads[index].hist;
+}
@@ -0,0 +1,431 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file memres.c
+ * \brief Locked-memory residency verification and locked file mappings.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "memres.h"
+
+/**
+ * \brief Number of pages checked per mincore() call.
+ */
+#define MEM_MINCORE_PAGES 4096
+
+/**
+ * \brief Default huge page size.
+ */
+#define MEM_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/**
+ * \brief VmFlags of mappings that mlock() ignores (I/O, PFN, mixed map,
+ * do not expand such as vDSO).
+ */
+static const char* MEM_UNLOCKABLE_FLAGS[] = {" io", " pf", " mm", " de"};
+
+/**
+ * \brief VmFlags of hugetlb mappings.
+ */
+static const char* MEM_HUGETLB_FLAG = " ht";
+
+/**
+ * \brief Counts resident bytes of a range.
+ * \param start first address (page aligned).
+ * \param end last address (excluded).
+ * \return resident bytes.
+ */
+static size_t mem_count_resident(uintptr_t start, uintptr_t end)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  unsigned char vec[MEM_MINCORE_PAGES];
+  size_t resident = 0;
+
+  while(start < end)
+  {
+    size_t nb = (end - start) / page;
+
+    if(nb > MEM_MINCORE_PAGES)
+    {
+      nb = MEM_MINCORE_PAGES;
+    }
+
+    if(mincore((void*)start, nb * page, vec) == 0)
+    {
+      for(size_t i = 0 ; i < nb ; i++)
+      {
+        resident += (vec[i] & 1) ? page : 0;
+      }
+    }
+
+    start += nb * page;
+  }
+
+  return resident;
+}
+
+/**
+ * \brief Accounts a parsed mapping.
+ * \param range mapping.
+ * \param skip if not 0, mapping is ignored.
+ * \param hugetlb if not 0, mapping is backed by hugetlb pages.
+ * \param report summary.
+ * \param callback callback for problems, may be NULL.
+ * \param data data of the callback.
+ * \return 1 if mapping is not fully locked or resident, 0 otherwise.
+ */
+static int mem_account(struct mem_range* range, int skip, int hugetlb,
+    struct mem_residency* report,
+    void (*callback)(const struct mem_range*, void*), void* data)
+{
+  size_t size = range->end - range->start;
+  int bad = 0;
+
+  if(skip)
+  {
+    return 0;
+  }
+
+  if(hugetlb)
+  {
+    /* kernel never sets VM_LOCKED on hugetlb (Locked is always 0) but its
+     * pages cannot be swapped out
+     */
+    range->locked = size;
+    range->resident = size;
+  }
+  else
+  {
+    range->resident = mem_count_resident(range->start, range->end);
+  }
+
+  report->mappings++;
+  report->size += size;
+  report->locked += range->locked;
+  report->resident += range->resident;
+
+  if(range->locked < size)
+  {
+    report->unlocked_ranges++;
+    bad = 1;
+  }
+
+  if(range->resident < size)
+  {
+    report->nonresident_ranges++;
+    bad = 1;
+  }
+
+  if(bad && callback)
+  {
+    callback(range, data);
+  }
+
+  return bad;
+}
+
+int mem_residency_scan(struct mem_residency* report,
+    void (*callback)(const struct mem_range* range, void* data), void* data)
+{
+  struct mem_residency summary;
+  struct mem_range range;
+  char line[512];
+  FILE* f = fopen("/proc/self/smaps", "r");
+  int in_range = 0;
+  int skip = 0;
+  int hugetlb = 0;
+  int nb = 0;
+
+  if(!f)
+  {
+    return -1;
+  }
+
+  memset(&summary, 0x00, sizeof(struct mem_residency));
+  memset(&range, 0x00, sizeof(struct mem_range));
+
+  while(fgets(line, sizeof(line), f))
+  {
+    unsigned long start = 0;
+    unsigned long end = 0;
+    unsigned long kb = 0;
+    int pos = 0;
+
+    if(sscanf(line, "%lx-%lx %4s %*s %*s %*s %n", &start, &end, range.perms,
+          &pos) == 3 && pos > 0)
+    {
+      /* new mapping, previous one is complete */
+      if(in_range)
+      {
+        nb += mem_account(&range, skip, hugetlb, &summary, callback, data);
+      }
+
+      range.start = start;
+      range.end = end;
+      range.locked = 0;
+      range.resident = 0;
+      snprintf(range.path, sizeof(range.path), "%s", line + pos);
+      range.path[strcspn(range.path, "\n")] = '\0';
+      in_range = 1;
+      hugetlb = 0;
+
+      /* guard areas are never accessed, vsyscall is outside mincore */
+      skip = (strncmp(range.perms, "---", 3) == 0) ||
+        (strcmp(range.path, "[vsyscall]") == 0);
+    }
+    else if(sscanf(line, "Locked: %lu kB", &kb) == 1)
+    {
+      range.locked = kb * 1024;
+    }
+    else if(strncmp(line, "VmFlags:", 8) == 0)
+    {
+      /* hugetlb mappings are also "do not expand" but are locked */
+      hugetlb = strstr(line + 8, MEM_HUGETLB_FLAG) != NULL;
+
+      for(size_t i = 0 ; !hugetlb && i < sizeof(MEM_UNLOCKABLE_FLAGS) /
+          sizeof(MEM_UNLOCKABLE_FLAGS[0]) ; i++)
+      {
+        if(strstr(line + 8, MEM_UNLOCKABLE_FLAGS[i]))
+        {
+          skip = 1;
+        }
+      }
+    }
+  }
+
+  if(in_range)
+  {
+    nb += mem_account(&range, skip, hugetlb, &summary, callback, data);
+  }
+
+  fclose(f);
+
+  if(report)
+  {
+    *report = summary;
+  }
+
+  return nb;
+}
+
+/**
+ * \brief Returns the size of hugetlb pages.
+ * \return size in bytes.
+ */
+static size_t mem_huge_page_size(void)
+{
+  char line[128];
+  unsigned long kb = 0;
+  FILE* f = fopen("/proc/meminfo", "r");
+
+  if(!f)
+  {
+    return MEM_HUGE_PAGE_SIZE;
+  }
+
+  while(fgets(line, sizeof(line), f))
+  {
+    if(sscanf(line, "Hugepagesize: %lu kB", &kb) == 1)
+    {
+      break;
+    }
+  }
+
+  fclose(f);
+  return kb ? kb * 1024 : MEM_HUGE_PAGE_SIZE;
+}
+
+/**
+ * \brief Maps anonymous memory in huge pages.
+ *
+ * Tries hugetlb first, then a huge page aligned mapping with
+ * MADV_HUGEPAGE.
+ * \param map mapping with size set.
+ * \return 0 if success, -1 otherwise.
+ */
+static int mem_map_huge(struct mem_map* map)
+{
+  size_t huge = mem_huge_page_size();
+  size_t length = (map->size + huge - 1) & ~(huge - 1);
+  uintptr_t addr = 0;
+  uintptr_t aligned = 0;
+  void* p = NULL;
+
+  p = mmap(NULL, length, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+  if(p != MAP_FAILED)
+  {
+    map->addr = p;
+    map->length = length;
+    map->hugetlb = 1;
+    return 0;
+  }
+
+  /* no reserved hugetlb pages: over-allocate to align on a huge page */
+  p = mmap(NULL, length + huge, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(p == MAP_FAILED)
+  {
+    return -1;
+  }
+
+  addr = (uintptr_t)p;
+  aligned = (addr + huge - 1) & ~(uintptr_t)(huge - 1);
+
+  if(aligned > addr)
+  {
+    munmap(p, aligned - addr);
+  }
+  munmap((void*)(aligned + length), addr + huge - aligned);
+
+  /* best effort, transparent huge pages may be disabled */
+  madvise((void*)aligned, length, MADV_HUGEPAGE);
+
+  map->addr = (void*)aligned;
+  map->length = length;
+  map->hugetlb = 0;
+  return 0;
+}
+
+int mem_map_file(struct mem_map* map, const char* path, unsigned int flags)
+{
+  int prot = PROT_READ | ((flags & MEM_MAP_WRITE) ? PROT_WRITE : 0);
+  struct stat st;
+  int fd = -1;
+
+  memset(map, 0x00, sizeof(struct mem_map));
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd == -1)
+  {
+    return -1;
+  }
+
+  if(fstat(fd, &st) != 0)
+  {
+    int err = errno;
+
+    close(fd);
+    errno = err;
+    return -1;
+  }
+
+  if(st.st_size == 0)
+  {
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+
+  map->size = st.st_size;
+
+  if(flags & MEM_MAP_HUGE)
+  {
+    size_t done = 0;
+
+    if(mem_map_huge(map) != 0)
+    {
+      int err = errno;
+
+      close(fd);
+      errno = err;
+      return -1;
+    }
+
+    /* copy of the file, page cache eviction cannot fault it */
+    while(done < map->size)
+    {
+      ssize_t ret = pread(fd, (char*)map->addr + done, map->size - done,
+          done);
+
+      if(ret <= 0)
+      {
+        int err = (ret == 0) ? EIO : errno;
+
+        if(ret < 0 && err == EINTR)
+        {
+          continue;
+        }
+
+        close(fd);
+        mem_unmap_file(map);
+        errno = err;
+        return -1;
+      }
+
+      done += ret;
+    }
+
+    if(!(flags & MEM_MAP_WRITE))
+    {
+      mprotect(map->addr, map->length, PROT_READ);
+    }
+  }
+  else
+  {
+    void* p = mmap(NULL, map->size, prot,
+        MAP_PRIVATE | MAP_POPULATE | MAP_LOCKED, fd, 0);
+
+    if(p == MAP_FAILED)
+    {
+      int err = errno;
+
+      close(fd);
+      errno = err;
+      return -1;
+    }
+
+    map->addr = p;
+    map->length = map->size;
+  }
+
+  close(fd);
+
+  /* MAP_LOCKED does not report failures, mlock() does */
+  if(mlock(map->addr, map->length) != 0)
+  {
+    int err = errno;
+
+    mem_unmap_file(map);
+    errno = err;
+    return -1;
+  }
+
+  return 0;
+}
+
+void mem_unmap_file(struct mem_map* map)
+{
+  if(map->addr)
+  {
+    munmap(map->addr, map->length);
+    map->addr = NULL;
+  }
+}
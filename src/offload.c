@@ -0,0 +1,467 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file offload.c
+ * \brief Deferred-work queue from real-time threads to helper threads.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "offload.h"
+#include "rtutils.h"
+#include "rt_event.h"
+#include "rt_sync.h"
+
+/**
+ * \struct offload_slot
+ * \brief Job in the queue, one cache line.
+ */
+struct offload_slot
+{
+  /**
+   * \brief Sequence number: position when free, position + 1 when full.
+   */
+  _Alignas(RT_CACHE_LINE) _Atomic uint64_t seq;
+
+  /**
+   * \brief Function to run.
+   */
+  offload_fcn fcn;
+
+  /**
+   * \brief Copy of the payload.
+   */
+  _Alignas(16) unsigned char payload[OFFLOAD_PAYLOAD_SIZE];
+};
+
+/**
+ * \struct offload
+ * \brief Queue and its helper threads.
+ */
+struct offload
+{
+  /**
+   * \brief Next position to fill (posting threads).
+   */
+  _Alignas(RT_CACHE_LINE) _Atomic uint64_t head;
+
+  /**
+   * \brief Number of jobs queued.
+   */
+  _Atomic uint64_t posted;
+
+  /**
+   * \brief Number of jobs refused.
+   */
+  _Atomic uint64_t rejected;
+
+  /**
+   * \brief Highest number of pending jobs.
+   */
+  _Atomic uint64_t max_depth;
+
+  /**
+   * \brief Next position to run (helpers).
+   */
+  _Alignas(RT_CACHE_LINE) _Atomic uint64_t tail;
+
+  /**
+   * \brief Number of jobs executed.
+   */
+  _Atomic uint64_t executed;
+
+  /**
+   * \brief Number of batches.
+   */
+  _Atomic uint64_t batches;
+
+  /**
+   * \brief Wakes the helpers.
+   */
+  _Alignas(RT_CACHE_LINE) struct rt_event event;
+
+  /**
+   * \brief If not 0, helpers exit once queue is empty.
+   */
+  atomic_int stop;
+
+  /**
+   * \brief Slots.
+   */
+  struct offload_slot* slots;
+
+  /**
+   * \brief Slots seen as a sequence ring.
+   */
+  struct rt_ring ring;
+
+  /**
+   * \brief Configuration (cpus points to a copy).
+   */
+  struct offload_config config;
+
+  /**
+   * \brief Helper threads.
+   */
+  pthread_t* threads;
+
+  /**
+   * \brief Number of helper threads launched.
+   */
+  unsigned int launched;
+
+  /**
+   * \brief Number of helper threads that finished their setup.
+   */
+  atomic_uint ready;
+
+  /**
+   * \brief First setup error (errno value) of a helper, 0 if none.
+   */
+  atomic_int error;
+
+  /**
+   * \brief Signaled by helpers after setup.
+   */
+  struct rt_event ready_event;
+};
+
+/**
+ * \brief Runs queued jobs.
+ * \param offload queue.
+ * \param max maximum number of jobs, 0 for no limit.
+ * \return number of jobs run.
+ */
+static unsigned int offload_run(struct offload* offload, unsigned int max)
+{
+  unsigned int nb = 0;
+
+  while(max == 0 || nb < max)
+  {
+    _Alignas(16) unsigned char payload[OFFLOAD_PAYLOAD_SIZE];
+    uint64_t pos = 0;
+    struct offload_slot* slot = rt_ring_take(&offload->ring, &offload->tail,
+        1, &pos);
+    offload_fcn fcn = NULL;
+
+    if(!slot)
+    {
+      /* empty */
+      break;
+    }
+
+    /* free the slot before running the job */
+    fcn = slot->fcn;
+    memcpy(payload, slot->payload, sizeof(payload));
+    rt_ring_free(&offload->ring, slot, pos);
+
+    fcn(payload);
+    atomic_fetch_add_explicit(&offload->executed, 1, memory_order_release);
+    nb++;
+  }
+
+  return nb;
+}
+
+/**
+ * \brief Helper thread.
+ * \param data the queue.
+ * \return NULL.
+ */
+static void* offload_thread(void* data)
+{
+  struct offload* offload = data;
+  unsigned int batch = offload->config.batch;
+  int error = 0;
+  int expected = 0;
+
+  if(offload->config.cpus)
+  {
+    error = thread_set_affinity(pthread_self(), (int*)offload->config.cpus,
+        offload->config.cpus_size);
+  }
+
+  if(error == 0 &&
+      thread_set_priority(pthread_self(), offload->config.nice) != 0)
+  {
+    error = errno;
+  }
+
+  if(error != 0)
+  {
+    atomic_compare_exchange_strong(&offload->error, &expected, error);
+  }
+
+  atomic_fetch_add(&offload->ready, 1);
+  rt_event_signal(&offload->ready_event);
+
+  if(error != 0)
+  {
+    return NULL;
+  }
+
+  for(;;)
+  {
+    unsigned int nb = offload_run(offload, batch);
+
+    if(nb > 0)
+    {
+      atomic_fetch_add_explicit(&offload->batches, 1, memory_order_relaxed);
+
+      if(nb == batch)
+      {
+        /* more work is likely pending, let another helper take it */
+        rt_event_signal(&offload->event);
+      }
+      continue;
+    }
+
+    if(atomic_load(&offload->stop))
+    {
+      break;
+    }
+
+    rt_event_wait(&offload->event);
+  }
+
+  /* signals do not stack, pass the stop request to the next helper */
+  rt_event_signal(&offload->event);
+  return NULL;
+}
+
+struct offload* offload_create(const struct offload_config* config)
+{
+  struct offload* offload = NULL;
+  pthread_attr_t attr;
+  int* cpus = NULL;
+  size_t size = 0;
+  int error = 0;
+
+  if(!config || config->capacity < 2 || config->helpers == 0 ||
+      (config->capacity & (config->capacity - 1)) != 0 ||
+      config->capacity > SIZE_MAX / sizeof(struct offload_slot) ||
+      (config->cpus && config->cpus_size == 0))
+  {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  offload = aligned_alloc(RT_CACHE_LINE, sizeof(struct offload));
+  if(!offload)
+  {
+    return NULL;
+  }
+  memset(offload, 0x00, sizeof(struct offload));
+
+  size = config->capacity * sizeof(struct offload_slot);
+  offload->slots = aligned_alloc(RT_CACHE_LINE, size);
+  offload->threads = calloc(config->helpers, sizeof(pthread_t));
+  if(config->cpus)
+  {
+    cpus = malloc(config->cpus_size * sizeof(int));
+  }
+
+  if(!offload->slots || !offload->threads || (config->cpus && !cpus))
+  {
+    free(cpus);
+    free(offload->threads);
+    free(offload->slots);
+    free(offload);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  /* touch every page now, not on the real-time path */
+  memset(offload->slots, 0x00, size);
+  offload->ring.slots = (unsigned char*)offload->slots;
+  offload->ring.slot_size = sizeof(struct offload_slot);
+  offload->ring.mask = config->capacity - 1;
+
+  for(size_t i = 0 ; i < config->capacity ; i++)
+  {
+    atomic_init(&offload->slots[i].seq, i);
+  }
+
+  offload->config = *config;
+  if(cpus)
+  {
+    memcpy(cpus, config->cpus, config->cpus_size * sizeof(int));
+    offload->config.cpus = cpus;
+  }
+
+  atomic_init(&offload->head, 0);
+  atomic_init(&offload->tail, 0);
+  atomic_init(&offload->posted, 0);
+  atomic_init(&offload->rejected, 0);
+  atomic_init(&offload->max_depth, 0);
+  atomic_init(&offload->executed, 0);
+  atomic_init(&offload->batches, 0);
+  atomic_init(&offload->stop, 0);
+  atomic_init(&offload->ready, 0);
+  atomic_init(&offload->error, 0);
+  rt_event_init(&offload->event, 0, 0);
+  rt_event_init(&offload->ready_event, 0, 0);
+
+  if(thread_attr_init_timesharing(&attr) != 0)
+  {
+    offload_destroy(offload);
+    return NULL;
+  }
+
+  for(unsigned int i = 0 ; i < config->helpers ; i++)
+  {
+    if(pthread_create(&offload->threads[i], &attr, offload_thread,
+          offload) != 0)
+    {
+      error = EAGAIN;
+      break;
+    }
+    offload->launched++;
+  }
+  pthread_attr_destroy(&attr);
+
+  /* a helper that could not get its CPU or nice value fails the queue */
+  while(atomic_load(&offload->ready) < offload->launched)
+  {
+    rt_event_wait(&offload->ready_event);
+  }
+
+  if(error == 0)
+  {
+    error = atomic_load(&offload->error);
+  }
+
+  if(error != 0)
+  {
+    offload_destroy(offload);
+    errno = error;
+    return NULL;
+  }
+
+  return offload;
+}
+
+void offload_destroy(struct offload* offload)
+{
+  if(!offload)
+  {
+    return;
+  }
+
+  atomic_store(&offload->stop, 1);
+  rt_event_signal(&offload->event);
+
+  for(unsigned int i = 0 ; i < offload->launched ; i++)
+  {
+    pthread_join(offload->threads[i], NULL);
+  }
+
+  free((int*)offload->config.cpus);
+  free(offload->threads);
+  free(offload->slots);
+  free(offload);
+}
+
+int offload_post(struct offload* offload, offload_fcn fcn, const void* payload,
+    size_t size)
+{
+  uint64_t pos = 0;
+  int64_t depth = 0;
+  uint64_t max = 0;
+  struct offload_slot* slot = NULL;
+
+  if(!fcn || (size > 0 && !payload))
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(size > OFFLOAD_PAYLOAD_SIZE)
+  {
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  slot = rt_ring_reserve(&offload->ring, &offload->head, 1, &pos);
+  if(!slot)
+  {
+    atomic_fetch_add_explicit(&offload->rejected, 1, memory_order_relaxed);
+    errno = EAGAIN;
+    return -1;
+  }
+
+  slot->fcn = fcn;
+  if(size > 0)
+  {
+    memcpy(slot->payload, payload, size);
+  }
+  rt_ring_commit(slot);
+  atomic_fetch_add_explicit(&offload->posted, 1, memory_order_relaxed);
+
+  /* backpressure: pending jobs including this one, tail may already be
+   * past pos if helpers ran jobs of later producers
+   */
+  depth = (int64_t)(pos + 1 -
+      atomic_load_explicit(&offload->tail, memory_order_relaxed));
+  if(depth < 0)
+  {
+    depth = 0;
+  }
+
+  max = atomic_load_explicit(&offload->max_depth, memory_order_relaxed);
+  while((uint64_t)depth > max &&
+      !atomic_compare_exchange_weak_explicit(&offload->max_depth, &max,
+        (uint64_t)depth,
+        memory_order_relaxed, memory_order_relaxed))
+  {
+  }
+
+  return rt_event_signal(&offload->event);
+}
+
+void offload_flush(struct offload* offload)
+{
+  uint64_t target = atomic_load(&offload->posted);
+  struct timespec delay = {.tv_sec = 0, .tv_nsec = 100000};
+
+  while(atomic_load_explicit(&offload->executed, memory_order_acquire) <
+      target)
+  {
+    nanosleep(&delay, NULL);
+  }
+}
+
+void offload_get_stats(const struct offload* offload,
+    struct offload_stats* stats)
+{
+  stats->posted = atomic_load(&offload->posted);
+  stats->executed = atomic_load(&offload->executed);
+  stats->rejected = atomic_load(&offload->rejected);
+  stats->batches = atomic_load(&offload->batches);
+  stats->max_depth = atomic_load(&offload->max_depth);
+}
@@ -0,0 +1,608 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file percpu.c
+ * \brief Fast current CPU lookup (rseq) and per-CPU data structures.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <syscall.h>
+#include <linux/rseq.h>
+
+#include "percpu.h"
+#include "rt_event.h"
+#include "rt_sync.h"
+
+#if defined(__x86_64__) && defined(SYS_rseq)
+/**
+ * \brief Restartable sequences are implemented for this architecture.
+ */
+#define PERCPU_RSEQ 1
+#else
+#define PERCPU_RSEQ 0
+#endif
+
+/**
+ * \brief Signature preceding the abort handlers (same as glibc on x86).
+ */
+#define PERCPU_RSEQ_SIG 0x53053053
+
+/**
+ * \brief Size of the original rseq ABI structure.
+ */
+#define PERCPU_RSEQ_SIZE 32
+
+/**
+ * \brief Offset of the rseq area from the thread pointer (glibc >= 2.35).
+ */
+extern const ptrdiff_t __rseq_offset __attribute__((weak));
+
+/**
+ * \brief Size of the rseq area registered by glibc, 0 if not registered.
+ */
+extern const unsigned int __rseq_size __attribute__((weak));
+
+/**
+ * \struct percpu_counter_slot
+ * \brief Slot of a per-CPU counter.
+ */
+struct percpu_counter_slot
+{
+  /**
+   * \brief Value of the slot.
+   */
+  _Alignas(RT_CACHE_LINE) _Atomic long value;
+};
+
+/**
+ * \struct percpu_buffer_slot
+ * \brief Slot of a per-CPU buffer.
+ */
+struct percpu_buffer_slot
+{
+  /**
+   * \brief Number of pointers in the array.
+   */
+  _Alignas(RT_CACHE_LINE) _Atomic intptr_t offset;
+
+  /**
+   * \brief Capacity of the array.
+   */
+  intptr_t capacity;
+
+  /**
+   * \brief Pointers.
+   */
+  void** array;
+
+  /**
+   * \brief Lock of the overflow slot, per-CPU slots are only updated in
+   * restartable sequences.
+   */
+  struct rt_pi_mutex lock;
+};
+
+_Thread_local const volatile uint32_t* percpu_cpu_id = NULL;
+
+/**
+ * \brief rseq area of the thread if not registered by the C library.
+ */
+static _Thread_local struct rseq percpu_rseq_area;
+
+/**
+ * \brief rseq area in use for the thread (NULL if not available).
+ */
+static _Thread_local struct rseq* percpu_rseq = NULL;
+
+/**
+ * \brief If rseq registration has been attempted for the thread.
+ */
+static _Thread_local int percpu_init_done = 0;
+
+#if PERCPU_RSEQ
+
+#define PERCPU_STR_1(x) #x
+#define PERCPU_STR(x) PERCPU_STR_1(x)
+
+/*
+ * Critical section descriptor (struct rseq_cs), the store of its address in
+ * rseq_cs (offset 8 of struct rseq), the check of cpu_id (offset 4) and the
+ * abort handler preceded by the signature (ud1 with the signature as
+ * displacement, so it is never executed).
+ */
+#define PERCPU_RSEQ_TABLE(label, start_ip, post_commit_ip, abort_ip) \
+  ".pushsection __rseq_cs, \"aw\"\n\t" \
+  ".balign 32\n\t" \
+  PERCPU_STR(label) ":\n\t" \
+  ".long 0x0, 0x0\n\t" \
+  ".quad " PERCPU_STR(start_ip) ", (" PERCPU_STR(post_commit_ip) " - " \
+  PERCPU_STR(start_ip) "), " PERCPU_STR(abort_ip) "\n\t" \
+  ".popsection\n\t"
+
+#define PERCPU_RSEQ_START(label, cs_label) \
+  "leaq " PERCPU_STR(cs_label) "(%%rip), %%rax\n\t" \
+  "movq %%rax, 8(%[rseq_abi])\n\t" \
+  PERCPU_STR(label) ":\n\t" \
+  "cmpl %[cpu_id], 4(%[rseq_abi])\n\t" \
+  "jnz 4f\n\t"
+
+#define PERCPU_RSEQ_ABORT(label, abort_label) \
+  ".pushsection __rseq_failure, \"ax\"\n\t" \
+  ".byte 0x0f, 0xb9, 0x3d\n\t" \
+  ".long " PERCPU_STR(PERCPU_RSEQ_SIG) "\n\t" \
+  PERCPU_STR(label) ":\n\t" \
+  "jmp %l[" PERCPU_STR(abort_label) "]\n\t" \
+  ".popsection\n\t"
+
+/**
+ * \brief Adds a value to a per-CPU variable in a restartable sequence.
+ * \param rs rseq area of the thread.
+ * \param v variable of the CPU.
+ * \param count value to add.
+ * \param cpu CPU of the variable.
+ * \return 0 if success, 1 if the sequence was aborted (retry).
+ */
+static inline int percpu_rseq_add(struct rseq* rs, _Atomic long* v,
+    long count, int cpu)
+{
+  __asm__ __volatile__ goto(
+    PERCPU_RSEQ_TABLE(3, 1f, 2f, 4f)
+    PERCPU_RSEQ_START(1, 3b)
+    "addq %[count], (%[v])\n\t"
+    "2:\n\t"
+    PERCPU_RSEQ_ABORT(4, restart)
+    :
+    : [cpu_id] "r" (cpu), [rseq_abi] "r" (rs), [v] "r" (v),
+      [count] "r" (count)
+    : "memory", "cc", "rax"
+    : restart);
+
+  return 0;
+
+restart:
+  return 1;
+}
+
+/**
+ * \brief Pushes a pointer in a per-CPU array in a restartable sequence.
+ * \param rs rseq area of the thread.
+ * \param slot slot of the CPU.
+ * \param item pointer to push.
+ * \param cpu CPU of the slot.
+ * \return 0 if success, 1 if the sequence was aborted (retry), -1 if full.
+ */
+static inline int percpu_rseq_push(struct rseq* rs,
+    struct percpu_buffer_slot* slot, void* item, int cpu)
+{
+  __asm__ __volatile__ goto(
+    PERCPU_RSEQ_TABLE(3, 1f, 2f, 4f)
+    PERCPU_RSEQ_START(1, 3b)
+    "movq (%[offset]), %%rcx\n\t"
+    "cmpq %[capacity], %%rcx\n\t"
+    "jae %l[full]\n\t"
+    "movq %[item], (%[array], %%rcx, 8)\n\t"
+    "incq %%rcx\n\t"
+    /* commit */
+    "movq %%rcx, (%[offset])\n\t"
+    "2:\n\t"
+    PERCPU_RSEQ_ABORT(4, restart)
+    :
+    : [cpu_id] "r" (cpu), [rseq_abi] "r" (rs), [offset] "r" (&slot->offset),
+      [capacity] "r" (slot->capacity), [array] "r" (slot->array),
+      [item] "r" (item)
+    : "memory", "cc", "rax", "rcx"
+    : restart, full);
+
+  return 0;
+
+restart:
+  return 1;
+
+full:
+  return -1;
+}
+
+/**
+ * \brief Pops a pointer from a per-CPU array in a restartable sequence.
+ * \param rs rseq area of the thread.
+ * \param slot slot of the CPU.
+ * \param item pointer that will receive the item.
+ * \param cpu CPU of the slot.
+ * \return 0 if success, 1 if the sequence was aborted (retry), -1 if empty.
+ */
+static inline int percpu_rseq_pop(struct rseq* rs,
+    struct percpu_buffer_slot* slot, void** item, int cpu)
+{
+  __asm__ __volatile__ goto(
+    PERCPU_RSEQ_TABLE(3, 1f, 2f, 4f)
+    PERCPU_RSEQ_START(1, 3b)
+    "movq (%[offset]), %%rcx\n\t"
+    "testq %%rcx, %%rcx\n\t"
+    "jz %l[empty]\n\t"
+    "decq %%rcx\n\t"
+    "movq (%[array], %%rcx, 8), %%rax\n\t"
+    "movq %%rax, (%[item])\n\t"
+    /* commit */
+    "movq %%rcx, (%[offset])\n\t"
+    "2:\n\t"
+    PERCPU_RSEQ_ABORT(4, restart)
+    :
+    : [cpu_id] "r" (cpu), [rseq_abi] "r" (rs), [offset] "r" (&slot->offset),
+      [array] "r" (slot->array), [item] "r" (item)
+    : "memory", "cc", "rax", "rcx"
+    : restart, empty);
+
+  return 0;
+
+restart:
+  return 1;
+
+empty:
+  return -1;
+}
+
+#endif /* PERCPU_RSEQ */
+
+/**
+ * \brief Returns the number of per-CPU slots to allocate.
+ * \return number of CPUs configured in the system.
+ */
+static size_t percpu_nb_cpus(void)
+{
+  long nb = sysconf(_SC_NPROCESSORS_CONF);
+
+  return nb > 0 ? (size_t)nb : 1;
+}
+
+int percpu_thread_init(void)
+{
+  percpu_init_done = 1;
+
+  if(percpu_rseq)
+  {
+    return 0;
+  }
+
+#if PERCPU_RSEQ
+  if(&__rseq_size && &__rseq_offset && __rseq_size > 0)
+  {
+    /* already registered by glibc */
+    percpu_rseq = (struct rseq*)((char*)__builtin_thread_pointer() +
+        __rseq_offset);
+  }
+  else if(syscall(SYS_rseq, &percpu_rseq_area, PERCPU_RSEQ_SIZE, 0,
+        PERCPU_RSEQ_SIG) == 0)
+  {
+    percpu_rseq = &percpu_rseq_area;
+  }
+  else
+  {
+    return -1;
+  }
+
+  percpu_cpu_id = (const volatile uint32_t*)&percpu_rseq->cpu_id;
+  return 0;
+#else
+  (void)percpu_rseq_area;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+int percpu_get_cpu_slow(void)
+{
+  if(!percpu_init_done)
+  {
+    percpu_thread_init();
+
+    if(percpu_cpu_id && (int32_t)*percpu_cpu_id >= 0)
+    {
+      return (int32_t)*percpu_cpu_id;
+    }
+  }
+
+  return sched_getcpu();
+}
+
+int percpu_counter_init(struct percpu_counter* counter)
+{
+  size_t size = 0;
+
+  if(!counter)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* last slot is the overflow one */
+  counter->nb_cpus = percpu_nb_cpus();
+  size = (counter->nb_cpus + 1) * sizeof(struct percpu_counter_slot);
+  counter->slots = aligned_alloc(RT_CACHE_LINE, size);
+
+  if(!counter->slots)
+  {
+    return -1;
+  }
+
+  for(size_t i = 0 ; i <= counter->nb_cpus ; i++)
+  {
+    atomic_init(&counter->slots[i].value, 0);
+  }
+
+  return 0;
+}
+
+void percpu_counter_destroy(struct percpu_counter* counter)
+{
+  if(counter)
+  {
+    free(counter->slots);
+    counter->slots = NULL;
+    counter->nb_cpus = 0;
+  }
+}
+
+void percpu_counter_add(struct percpu_counter* counter, long value)
+{
+  /* destroyed counter */
+  if(counter->nb_cpus == 0)
+  {
+    return;
+  }
+
+#if PERCPU_RSEQ
+  if(percpu_rseq || (!percpu_init_done && percpu_thread_init() == 0))
+  {
+    for(;;)
+    {
+      int cpu = percpu_get_cpu();
+
+      /* error or CPU beyond the configured ones (hotplug), no own slot */
+      if(cpu < 0 || (size_t)cpu >= counter->nb_cpus)
+      {
+        break;
+      }
+
+      /* retry only if the sequence was aborted (preemption, migration) */
+      if(percpu_rseq_add(percpu_rseq, &counter->slots[cpu].value, value,
+            cpu) == 0)
+      {
+        return;
+      }
+    }
+  }
+#endif
+
+  /* per-CPU slots are updated without lock prefix, never share them */
+  atomic_fetch_add_explicit(&counter->slots[counter->nb_cpus].value, value,
+      memory_order_relaxed);
+}
+
+long percpu_counter_sum(const struct percpu_counter* counter)
+{
+  long sum = 0;
+
+  if(counter->nb_cpus == 0)
+  {
+    return 0;
+  }
+
+  for(size_t i = 0 ; i <= counter->nb_cpus ; i++)
+  {
+    sum += atomic_load_explicit(&counter->slots[i].value,
+        memory_order_relaxed);
+  }
+
+  return sum;
+}
+
+long percpu_counter_get(const struct percpu_counter* counter, size_t cpu)
+{
+  if(cpu >= counter->nb_cpus)
+  {
+    return 0;
+  }
+
+  return atomic_load_explicit(&counter->slots[cpu].value,
+      memory_order_relaxed);
+}
+
+int percpu_buffer_init(struct percpu_buffer* buffer, size_t capacity)
+{
+  size_t size = 0;
+
+  if(!buffer || capacity == 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* last slot is the overflow one */
+  buffer->nb_cpus = percpu_nb_cpus();
+  size = (buffer->nb_cpus + 1) * sizeof(struct percpu_buffer_slot);
+  buffer->slots = aligned_alloc(RT_CACHE_LINE, size);
+
+  if(!buffer->slots)
+  {
+    return -1;
+  }
+  memset(buffer->slots, 0x00, size);
+
+  for(size_t i = 0 ; i <= buffer->nb_cpus ; i++)
+  {
+    struct percpu_buffer_slot* slot = &buffer->slots[i];
+
+    atomic_init(&slot->offset, 0);
+    rt_pi_mutex_init(&slot->lock, 0);
+    slot->capacity = (intptr_t)capacity;
+    slot->array = calloc(capacity, sizeof(void*));
+
+    if(!slot->array)
+    {
+      percpu_buffer_destroy(buffer);
+      errno = ENOMEM;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+void percpu_buffer_destroy(struct percpu_buffer* buffer)
+{
+  if(!buffer || !buffer->slots)
+  {
+    return;
+  }
+
+  for(size_t i = 0 ; i <= buffer->nb_cpus ; i++)
+  {
+    free(buffer->slots[i].array);
+  }
+
+  free(buffer->slots);
+  buffer->slots = NULL;
+  buffer->nb_cpus = 0;
+}
+
+int percpu_buffer_push(struct percpu_buffer* buffer, void* item)
+{
+  struct percpu_buffer_slot* slot = NULL;
+  intptr_t offset = 0;
+  int ret = 0;
+
+  /* destroyed buffer */
+  if(buffer->nb_cpus == 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+#if PERCPU_RSEQ
+  if(percpu_rseq || (!percpu_init_done && percpu_thread_init() == 0))
+  {
+    for(;;)
+    {
+      int cpu = percpu_get_cpu();
+
+      /* error or CPU beyond the configured ones (hotplug), no own slot */
+      if(cpu < 0 || (size_t)cpu >= buffer->nb_cpus)
+      {
+        break;
+      }
+
+      ret = percpu_rseq_push(percpu_rseq, &buffer->slots[cpu], item, cpu);
+      if(ret != 1)
+      {
+        if(ret == -1)
+        {
+          errno = ENOBUFS;
+        }
+        return ret;
+      }
+    }
+  }
+#endif
+
+  /* contending threads may share a CPU, a spinning lock could livelock */
+  slot = &buffer->slots[buffer->nb_cpus];
+  rt_pi_mutex_lock(&slot->lock);
+
+  offset = atomic_load_explicit(&slot->offset, memory_order_relaxed);
+  if(offset < slot->capacity)
+  {
+    slot->array[offset] = item;
+    atomic_store_explicit(&slot->offset, offset + 1, memory_order_relaxed);
+  }
+  else
+  {
+    errno = ENOBUFS;
+    ret = -1;
+  }
+
+  rt_pi_mutex_unlock(&slot->lock);
+  return ret;
+}
+
+void* percpu_buffer_pop(struct percpu_buffer* buffer)
+{
+  struct percpu_buffer_slot* slot = NULL;
+  intptr_t offset = 0;
+  void* item = NULL;
+
+  /* destroyed buffer */
+  if(buffer->nb_cpus == 0)
+  {
+    return NULL;
+  }
+
+#if PERCPU_RSEQ
+  if(percpu_rseq || (!percpu_init_done && percpu_thread_init() == 0))
+  {
+    for(;;)
+    {
+      int cpu = percpu_get_cpu();
+      int ret = 0;
+
+      if(cpu < 0 || (size_t)cpu >= buffer->nb_cpus)
+      {
+        break;
+      }
+
+      ret = percpu_rseq_pop(percpu_rseq, &buffer->slots[cpu], &item, cpu);
+      if(ret == 0)
+      {
+        return item;
+      }
+      else if(ret == -1)
+      {
+        /* CPU buffer is empty, look in the overflow one */
+        break;
+      }
+    }
+  }
+#endif
+
+  slot = &buffer->slots[buffer->nb_cpus];
+
+  /* avoid the lock in the common case of an empty overflow buffer */
+  if(atomic_load_explicit(&slot->offset, memory_order_relaxed) == 0)
+  {
+    return NULL;
+  }
+
+  rt_pi_mutex_lock(&slot->lock);
+
+  offset = atomic_load_explicit(&slot->offset, memory_order_relaxed);
+  if(offset > 0)
+  {
+    item = slot->array[offset - 1];
+    atomic_store_explicit(&slot->offset, offset - 1, memory_order_relaxed);
+  }
+
+  rt_pi_mutex_unlock(&slot->lock);
+  return item;
+}
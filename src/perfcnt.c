@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file perfcnt.c
+ * \brief Per-thread performance counters.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfcnt.h"
+
+/**
+ * \brief Names of the events.
+ */
+static const char* const PERFCNT_NAMES[] =
+{
+  "cycles",
+  "instructions",
+  "llc-misses",
+  "branch-misses",
+  "context-switches",
+};
+
+/**
+ * \brief Opens an event.
+ * \param type type of event (PERF_TYPE_*).
+ * \param config event configuration.
+ * \param tid kernel thread ID.
+ * \param group_fd descriptor of the group leader, -1 for the leader.
+ * \return descriptor if success, -1 otherwise.
+ */
+static int perfcnt_open_event(uint32_t type, uint64_t config, pid_t tid,
+    int group_fd)
+{
+  struct perf_event_attr attr;
+  int fd = -1;
+
+  memset(&attr, 0x00, sizeof(struct perf_event_attr));
+  attr.size = sizeof(struct perf_event_attr);
+  attr.type = type;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+    PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.exclude_hv = 1;
+  attr.disabled = group_fd == -1 ? 1 : 0;
+
+  fd = syscall(SYS_perf_event_open, &attr, tid, -1, group_fd, 0);
+  if(fd == -1 && errno == EACCES)
+  {
+    /* restricted by perf_event_paranoid, user space only */
+    attr.exclude_kernel = 1;
+    fd = syscall(SYS_perf_event_open, &attr, tid, -1, group_fd, 0);
+  }
+
+  return fd;
+}
+
+int perfcnt_open(struct perfcnt* pc, pid_t tid)
+{
+  static const uint64_t hw[] =
+  {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+  };
+  int leader = -1;
+
+  if(!pc)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  memset(pc, 0x00, sizeof(struct perfcnt));
+  for(int i = 0 ; i < PERFCNT_NB ; i++)
+  {
+    pc->fds[i] = -1;
+    pc->index[i] = -1;
+  }
+
+  for(int i = 0 ; i < PERFCNT_NB ; i++)
+  {
+    int fd = -1;
+
+    if(i == PERFCNT_CONTEXT_SWITCHES)
+    {
+      fd = perfcnt_open_event(PERF_TYPE_SOFTWARE,
+          PERF_COUNT_SW_CONTEXT_SWITCHES, tid, leader);
+    }
+    else
+    {
+      fd = perfcnt_open_event(PERF_TYPE_HARDWARE, hw[i], tid, leader);
+
+      /* no PMU (i.e. VM), count task clock instead of cycles */
+      if(fd == -1 && i == PERFCNT_CYCLES)
+      {
+        fd = perfcnt_open_event(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK,
+            tid, leader);
+        pc->software = fd != -1;
+      }
+    }
+
+    if(fd == -1)
+    {
+      continue;
+    }
+
+    if(leader == -1)
+    {
+      leader = fd;
+    }
+
+    pc->fds[i] = fd;
+    pc->index[i] = pc->nb++;
+    pc->valid |= 1 << i;
+  }
+
+  if(leader == -1)
+  {
+    return -1;
+  }
+
+  ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  if(ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) != 0)
+  {
+    perfcnt_close(pc);
+    return -1;
+  }
+
+  return 0;
+}
+
+void perfcnt_close(struct perfcnt* pc)
+{
+  /* members first, leader is the lowest opened event */
+  for(int i = PERFCNT_NB - 1 ; i >= 0 ; i--)
+  {
+    if(pc->fds[i] != -1)
+    {
+      close(pc->fds[i]);
+      pc->fds[i] = -1;
+    }
+  }
+
+  pc->nb = 0;
+  pc->valid = 0;
+}
+
+int perfcnt_read(struct perfcnt* pc, struct perfcnt_values* values)
+{
+  uint64_t buf[PERFCNT_NB + 3];
+  ssize_t size = 0;
+  int leader = -1;
+  ssize_t ret = 0;
+
+  memset(values, 0x00, sizeof(struct perfcnt_values));
+
+  for(int i = 0 ; i < PERFCNT_NB ; i++)
+  {
+    if(pc->index[i] == 0)
+    {
+      leader = pc->fds[i];
+      break;
+    }
+  }
+
+  if(leader == -1)
+  {
+    errno = EBADF;
+    return -1;
+  }
+
+  /* number of events, time enabled, time running then the values */
+  size = sizeof(uint64_t) * (pc->nb + 3);
+  ret = read(leader, buf, size);
+  if(ret == -1)
+  {
+    return -1;
+  }
+  else if(ret != size || buf[0] != (uint64_t)pc->nb)
+  {
+    errno = EIO;
+    return -1;
+  }
+
+  for(int i = 0 ; i < PERFCNT_NB ; i++)
+  {
+    if(pc->index[i] != -1)
+    {
+      values->values[i] = buf[pc->index[i] + 3];
+    }
+  }
+
+  values->time_enabled = buf[1];
+  values->time_running = buf[2];
+
+  values->valid = pc->valid;
+  return 0;
+}
+
+void perfcnt_delta(const struct perfcnt_values* before,
+    const struct perfcnt_values* after, struct perfcnt_values* delta)
+{
+  delta->valid = before->valid & after->valid;
+  delta->time_enabled = after->time_enabled - before->time_enabled;
+  delta->time_running = after->time_running - before->time_running;
+
+  if(delta->time_running == 0 && delta->time_enabled > 0)
+  {
+    /* group never got the PMU during the interval */
+    delta->valid = 0;
+  }
+
+  for(int i = 0 ; i < PERFCNT_NB ; i++)
+  {
+    uint64_t value = (delta->valid & (1 << i)) ?
+      after->values[i] - before->values[i] : 0;
+
+    if(delta->time_running < delta->time_enabled && value > 0)
+    {
+      /* multiplexed, extrapolate to the whole interval */
+      value = (uint64_t)((double)value * delta->time_enabled /
+          delta->time_running);
+    }
+
+    delta->values[i] = value;
+  }
+}
+
+const char* perfcnt_event_name(enum perfcnt_event event)
+{
+  if(event < 0 || event >= PERFCNT_NB)
+  {
+    return "unknown";
+  }
+
+  return PERFCNT_NAMES[event];
+}
@@ -0,0 +1,649 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file pipeline.c
+ * \brief Periodic multi-stage pipeline with one real-time thread per stage.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+
+#include <pthread.h>
+
+#include "pipeline.h"
+#include "shm_ring.h"
+#include "rt_event.h"
+#include "tsc.h"
+#include "rt_sync.h"
+
+/**
+ * \struct pipeline_frame
+ * \brief Header of a frame, the payload follows.
+ */
+struct pipeline_frame
+{
+  /**
+   * \brief Sequence number.
+   */
+  uint64_t seq;
+
+  /**
+   * \brief Time the source started the frame.
+   */
+  uint64_t start;
+
+  /**
+   * \brief Time the frame was queued for the current stage.
+   */
+  uint64_t queued;
+};
+
+/**
+ * \brief Offset of the payload in a frame (keeps maximum alignment).
+ */
+#define PIPELINE_PAYLOAD_OFFSET \
+  ((sizeof(struct pipeline_frame) + 15) & ~(size_t)15)
+
+/**
+ * \struct pipeline_thread
+ * \brief Thread of a stage or of the source.
+ */
+struct pipeline_thread
+{
+  /**
+   * \brief The pipeline.
+   */
+  struct pipeline* pipeline;
+
+  /**
+   * \brief Configuration.
+   */
+  struct pipeline_stage stage;
+
+  /**
+   * \brief Index of the stage.
+   */
+  size_t index;
+
+  /**
+   * \brief Input queue of the stage.
+   */
+  struct shm_ring in;
+
+  /**
+   * \brief Number of frames in the input queue.
+   */
+  _Atomic uint64_t depth;
+
+  /**
+   * \brief Highest number of frames in the input queue.
+   */
+  _Atomic uint64_t max_depth;
+
+  /**
+   * \brief Number of frames processed.
+   */
+  _Atomic uint64_t frames;
+
+  /**
+   * \brief Time spent in the input queue.
+   */
+  struct rt_hist wait_hist;
+
+  /**
+   * \brief Execution time.
+   */
+  struct rt_hist exec_hist;
+
+  /**
+   * \brief Thread.
+   */
+  pthread_t th;
+
+  /**
+   * \brief If not 0, thread is launched.
+   */
+  int launched;
+
+  /**
+   * \brief errno of the setup of the thread, 0 if success.
+   */
+  int error;
+};
+
+/**
+ * \struct pipeline
+ * \brief Pipeline.
+ */
+struct pipeline
+{
+  /**
+   * \brief Configuration (without stage array).
+   */
+  struct pipeline_config config;
+
+  /**
+   * \brief Stage threads.
+   */
+  struct pipeline_thread* stages;
+
+  /**
+   * \brief Source thread (its input queue holds the free frames).
+   */
+  struct pipeline_thread source;
+
+  /**
+   * \brief Frames.
+   */
+  unsigned char* frames;
+
+  /**
+   * \brief Size of a frame with its header.
+   */
+  size_t frame_stride;
+
+  /**
+   * \brief Next sequence number.
+   */
+  uint64_t seq;
+
+  /**
+   * \brief Periods without free frame.
+   */
+  _Atomic uint64_t dropped;
+
+  /**
+   * \brief End-to-end latency.
+   */
+  struct rt_hist latency_hist;
+
+  /**
+   * \brief Wakeup latency of the source.
+   */
+  struct rt_hist source_hist;
+
+  /**
+   * \brief Number of threads that completed their setup.
+   */
+  _Atomic size_t ready;
+
+  /**
+   * \brief Signaled by threads after setup.
+   */
+  struct rt_event ready_event;
+};
+
+/**
+ * \brief Queues a frame for a stage.
+ * \param thread stage.
+ * \param frame frame, NULL to stop the stage.
+ */
+static void pipeline_push(struct pipeline_thread* thread,
+    struct pipeline_frame* frame)
+{
+  uint64_t depth = atomic_fetch_add_explicit(&thread->depth, 1,
+      memory_order_relaxed) + 1;
+  uint64_t max = atomic_load_explicit(&thread->max_depth,
+      memory_order_relaxed);
+
+  while(depth > max &&
+      !atomic_compare_exchange_weak_explicit(&thread->max_depth, &max, depth,
+        memory_order_relaxed, memory_order_relaxed))
+  {
+  }
+
+  if(frame)
+  {
+    frame->queued = tsc_now_ns();
+  }
+
+  /* queue holds more slots than frames, it cannot be full */
+  shm_ring_send(&thread->in, &frame, sizeof(frame));
+}
+
+/**
+ * \brief Pins the thread and sets its priority, then reports it.
+ * \param thread thread.
+ * \return 0 if success, -1 otherwise.
+ */
+static int pipeline_setup(struct pipeline_thread* thread)
+{
+  struct pipeline* pipeline = thread->pipeline;
+  int ret = thread_set_affinity(pthread_self(), &thread->stage.cpu, 1);
+
+  if(ret != 0)
+  {
+    thread->error = ret;
+  }
+  else if(thread_set_rt_priority(pthread_self(), &thread->stage.priority) !=
+      0)
+  {
+    thread->error = errno;
+  }
+
+  atomic_fetch_add(&pipeline->ready, 1);
+  rt_event_signal(&pipeline->ready_event);
+  return thread->error ? -1 : 0;
+}
+
+/**
+ * \brief Stage thread.
+ * \param data the stage.
+ * \return NULL.
+ */
+static void* pipeline_stage_thread(void* data)
+{
+  struct pipeline_thread* thread = data;
+  struct pipeline* pipeline = thread->pipeline;
+  int last = (thread->index == pipeline->config.nb_stages - 1);
+  struct pipeline_thread* next = last ? &pipeline->source :
+    &pipeline->stages[thread->index + 1];
+
+  /* on setup failure the source is not started, so the only request to
+   * come is the stop one that still has to be passed on
+   */
+  pipeline_setup(thread);
+
+  for(;;)
+  {
+    struct pipeline_frame* frame = NULL;
+    uint64_t start = 0;
+    uint64_t end = 0;
+
+    while(shm_ring_receive(&thread->in, &frame, sizeof(frame)) != 0)
+    {
+      shm_ring_wait(&thread->in, NULL);
+    }
+    atomic_fetch_sub_explicit(&thread->depth, 1, memory_order_relaxed);
+
+    if(!frame)
+    {
+      /* frames queued before the stop request are done, pass it on */
+      if(!last)
+      {
+        pipeline_push(next, NULL);
+      }
+      break;
+    }
+
+    start = tsc_now_ns();
+    rt_hist_record(&thread->wait_hist, start - frame->queued);
+
+    thread->stage.fcn((unsigned char*)frame + PIPELINE_PAYLOAD_OFFSET,
+        frame->seq, thread->stage.data);
+
+    end = tsc_now_ns();
+    rt_hist_record(&thread->exec_hist, end - start);
+
+    if(last)
+    {
+      rt_hist_record(&pipeline->latency_hist, end - frame->start);
+    }
+    atomic_fetch_add_explicit(&thread->frames, 1, memory_order_release);
+
+    pipeline_push(next, frame);
+  }
+
+  return NULL;
+}
+
+/**
+ * \brief Cycle of the source.
+ * \param data the pipeline.
+ */
+static void pipeline_source_cycle(void* data)
+{
+  struct pipeline* pipeline = data;
+  struct pipeline_thread* thread = &pipeline->source;
+  struct pipeline_frame* frame = NULL;
+
+  if(shm_ring_receive(&thread->in, &frame, sizeof(frame)) != 0)
+  {
+    /* all frames are in flight, the stages are too slow */
+    atomic_fetch_add_explicit(&pipeline->dropped, 1, memory_order_relaxed);
+    return;
+  }
+  atomic_fetch_sub_explicit(&thread->depth, 1, memory_order_relaxed);
+
+  frame->seq = pipeline->seq++;
+  frame->start = tsc_now_ns();
+
+  thread->stage.fcn((unsigned char*)frame + PIPELINE_PAYLOAD_OFFSET,
+      frame->seq, thread->stage.data);
+
+  rt_hist_record(&thread->exec_hist, tsc_now_ns() - frame->start);
+  atomic_fetch_add_explicit(&thread->frames, 1, memory_order_relaxed);
+
+  pipeline_push(&pipeline->stages[0], frame);
+}
+
+/**
+ * \brief Source thread.
+ * \param data the pipeline.
+ * \return NULL.
+ */
+static void* pipeline_source_thread(void* data)
+{
+  struct pipeline* pipeline = data;
+  struct periodic_task_attr attr;
+
+  if(pipeline_setup(&pipeline->source) != 0)
+  {
+    return NULL;
+  }
+
+  memset(&attr, 0x00, sizeof(struct periodic_task_attr));
+  attr.wakeup_hist = &pipeline->source_hist;
+
+  thread_periodic_task_attr(pipeline_source_cycle, pipeline,
+      pipeline->config.period, &attr);
+  return NULL;
+}
+
+/**
+ * \brief Initializes a thread and its input queue.
+ * \param pipeline pipeline.
+ * \param thread thread.
+ * \param stage configuration.
+ * \param index index of the stage.
+ * \return 0 if success, -1 otherwise.
+ */
+static int pipeline_thread_init(struct pipeline* pipeline,
+    struct pipeline_thread* thread, const struct pipeline_stage* stage,
+    size_t index)
+{
+  thread->pipeline = pipeline;
+  thread->stage = *stage;
+  thread->index = index;
+  thread->in.fd = -1;
+  atomic_init(&thread->depth, 0);
+  atomic_init(&thread->max_depth, 0);
+  atomic_init(&thread->frames, 0);
+  rt_hist_init(&thread->wait_hist);
+  rt_hist_init(&thread->exec_hist);
+
+  /* room for every frame and the stop request, the source polls its
+   * queue */
+  return shm_ring_create(&thread->in, NULL, sizeof(void*),
+      2 * pipeline->config.nb_frames,
+      index < pipeline->config.nb_stages ? SHM_RING_WAKEUP : 0);
+}
+
+/**
+ * \brief Stops the threads and frees the pipeline.
+ *
+ * Stop request goes through the first ring only, each stage passes it on
+ * after the frames in flight so that every ring keeps a single producer.
+ * \param pipeline pipeline.
+ */
+static void pipeline_free(struct pipeline* pipeline)
+{
+  if(pipeline->source.launched)
+  {
+    pthread_cancel(pipeline->source.th);
+    pthread_join(pipeline->source.th, NULL);
+  }
+
+  /* source is stopped, main thread is now the producer of the first ring */
+  if(pipeline->stages && pipeline->stages[0].in.header)
+  {
+    pipeline_push(&pipeline->stages[0], NULL);
+  }
+
+  for(size_t i = 0 ; pipeline->stages && i < pipeline->config.nb_stages ;
+      i++)
+  {
+    if(pipeline->stages[i].launched)
+    {
+      pthread_join(pipeline->stages[i].th, NULL);
+    }
+    shm_ring_close(&pipeline->stages[i].in);
+  }
+
+  if(pipeline->source.in.header)
+  {
+    shm_ring_close(&pipeline->source.in);
+  }
+
+  free(pipeline->frames);
+  free(pipeline->stages);
+  free(pipeline);
+}
+
+/**
+ * \brief Waits for the setup of launched threads.
+ * \param pipeline pipeline.
+ * \param nb number of threads launched.
+ * \param threads threads.
+ * \param nb_threads number of threads to check.
+ * \return 0 if every thread is set up, errno of the first failure
+ * otherwise.
+ */
+static int pipeline_wait_ready(struct pipeline* pipeline, size_t nb,
+    const struct pipeline_thread* threads, size_t nb_threads)
+{
+  while(atomic_load(&pipeline->ready) < nb)
+  {
+    rt_event_wait(&pipeline->ready_event);
+  }
+
+  for(size_t i = 0 ; i < nb_threads ; i++)
+  {
+    if(threads[i].error)
+    {
+      return threads[i].error;
+    }
+  }
+
+  return 0;
+}
+
+struct pipeline* pipeline_start(const struct pipeline_config* config)
+{
+  struct pipeline* pipeline = NULL;
+  size_t nb = 0;
+  int error = 0;
+
+  if(!config || !config->stages || config->nb_stages == 0 ||
+      !config->source.fcn || config->period == 0 || config->nb_frames < 2 ||
+      (config->nb_frames & (config->nb_frames - 1)) != 0)
+  {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  for(size_t i = 0 ; i < config->nb_stages ; i++)
+  {
+    if(!config->stages[i].fcn)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+  }
+
+  pipeline = calloc(1, sizeof(struct pipeline));
+  if(!pipeline)
+  {
+    return NULL;
+  }
+
+  pipeline->config = *config;
+  pipeline->config.stages = NULL;
+  pipeline->source.in.fd = -1;
+  pipeline->frame_stride = (PIPELINE_PAYLOAD_OFFSET + config->frame_size +
+      RT_CACHE_LINE - 1) & ~(size_t)(RT_CACHE_LINE - 1);
+  atomic_init(&pipeline->dropped, 0);
+  atomic_init(&pipeline->ready, 0);
+  rt_event_init(&pipeline->ready_event, 0, 0);
+  rt_hist_init(&pipeline->latency_hist);
+  rt_hist_init(&pipeline->source_hist);
+
+  pipeline->stages = calloc(config->nb_stages,
+      sizeof(struct pipeline_thread));
+  pipeline->frames = aligned_alloc(RT_CACHE_LINE,
+      config->nb_frames * pipeline->frame_stride);
+
+  for(size_t i = 0 ; pipeline->stages && i < config->nb_stages ; i++)
+  {
+    pipeline->stages[i].in.fd = -1;
+  }
+
+  if(!pipeline->stages || !pipeline->frames)
+  {
+    pipeline_free(pipeline);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  /* touch every frame now, not in the stages */
+  memset(pipeline->frames, 0x00, config->nb_frames * pipeline->frame_stride);
+
+  if(pipeline_thread_init(pipeline, &pipeline->source, &config->source,
+        config->nb_stages) != 0)
+  {
+    error = errno;
+  }
+
+  for(size_t i = 0 ; error == 0 && i < config->nb_stages ; i++)
+  {
+    if(pipeline_thread_init(pipeline, &pipeline->stages[i],
+          &config->stages[i], i) != 0)
+    {
+      error = errno;
+    }
+  }
+
+  for(size_t i = 0 ; error == 0 && i < config->nb_frames ; i++)
+  {
+    pipeline_push(&pipeline->source, (struct pipeline_frame*)
+        (pipeline->frames + i * pipeline->frame_stride));
+  }
+  atomic_store(&pipeline->source.max_depth, 0);
+
+  for(size_t i = 0 ; error == 0 && i < config->nb_stages ; i++)
+  {
+    if(pthread_create(&pipeline->stages[i].th, NULL, pipeline_stage_thread,
+          &pipeline->stages[i]) != 0)
+    {
+      error = EAGAIN;
+      break;
+    }
+    pipeline->stages[i].launched = 1;
+    nb++;
+  }
+
+  if(error == 0)
+  {
+    error = pipeline_wait_ready(pipeline, nb, pipeline->stages,
+        config->nb_stages);
+  }
+
+  /* source starts once stages are ready */
+  if(error == 0)
+  {
+    if(pthread_create(&pipeline->source.th, NULL, pipeline_source_thread,
+          pipeline) != 0)
+    {
+      error = EAGAIN;
+    }
+    else
+    {
+      pipeline->source.launched = 1;
+      error = pipeline_wait_ready(pipeline, nb + 1, &pipeline->source, 1);
+    }
+  }
+
+  if(error != 0)
+  {
+    pipeline_free(pipeline);
+    errno = error;
+    return NULL;
+  }
+
+  return pipeline;
+}
+
+void pipeline_stop(struct pipeline* pipeline)
+{
+  if(!pipeline)
+  {
+    return;
+  }
+
+  pipeline_free(pipeline);
+}
+
+int pipeline_get_stats(const struct pipeline* pipeline, size_t stage,
+    struct pipeline_stats* stats)
+{
+  const struct pipeline_thread* thread = NULL;
+
+  if(!pipeline || !stats || stage >= pipeline->config.nb_stages)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  thread = &pipeline->stages[stage];
+  stats->frames = atomic_load(&thread->frames);
+  stats->depth = atomic_load(&thread->depth);
+  stats->max_depth = atomic_load(&thread->max_depth);
+  return 0;
+}
+
+const struct rt_hist* pipeline_get_hist(const struct pipeline* pipeline,
+    size_t stage, enum pipeline_hist type)
+{
+  if(!pipeline || stage >= pipeline->config.nb_stages)
+  {
+    return NULL;
+  }
+
+  switch(type)
+  {
+    case PIPELINE_HIST_WAIT:
+      return &pipeline->stages[stage].wait_hist;
+    case PIPELINE_HIST_EXEC:
+      return &pipeline->stages[stage].exec_hist;
+    default:
+      return NULL;
+  }
+}
+
+const struct rt_hist* pipeline_get_latency_hist(
+    const struct pipeline* pipeline)
+{
+  return &pipeline->latency_hist;
+}
+
+const struct rt_hist* pipeline_get_source_hist(
+    const struct pipeline* pipeline)
+{
+  return &pipeline->source_hist;
+}
+
+uint64_t pipeline_get_dropped(const struct pipeline* pipeline)
+{
+  return atomic_load(&pipeline->dropped);
+}
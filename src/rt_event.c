@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file rt_event.c
+ * \brief Futex-based events and priority-inheritance mutex.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "rt_event.h"
+#include "rt_sync.h"
+
+/**
+ * \brief TID of the calling thread (0 until first use).
+ */
+static _Thread_local uint32_t rt_event_tid = 0;
+
+/**
+ * \brief Guard of the fork handler registration.
+ */
+static pthread_once_t rt_event_once = PTHREAD_ONCE_INIT;
+
+/**
+ * \brief Forgets the cached TID in the child process.
+ */
+static void rt_event_atfork_child(void)
+{
+  rt_event_tid = 0;
+}
+
+/**
+ * \brief Registers the fork handler.
+ */
+static void rt_event_register_atfork(void)
+{
+  pthread_atfork(NULL, NULL, rt_event_atfork_child);
+}
+
+long rt_futex(_Atomic uint32_t* uaddr, int op, uint32_t val,
+    const struct timespec* timeout, uint32_t val3)
+{
+  return syscall(SYS_futex, (uint32_t*)uaddr, op, val, timeout, NULL, val3);
+}
+
+/**
+ * \brief Returns the TID of the calling thread.
+ * \return TID.
+ */
+static uint32_t rt_event_gettid(void)
+{
+  if(rt_event_tid == 0)
+  {
+    /* thread calling fork() has another TID in the child */
+    pthread_once(&rt_event_once, rt_event_register_atfork);
+    rt_event_tid = (uint32_t)syscall(SYS_gettid);
+  }
+
+  return rt_event_tid;
+}
+
+/**
+ * \brief Consumes the event if it is signaled.
+ * \param event event.
+ * \return 1 if consumed, 0 otherwise.
+ */
+static int rt_event_consume(struct rt_event* event)
+{
+  uint32_t expected = 1;
+
+  return atomic_load_explicit(&event->state, memory_order_relaxed) == 1 &&
+    atomic_compare_exchange_strong(&event->state, &expected, 0);
+}
+
+int rt_event_init(struct rt_event* event, int shared, unsigned int spin)
+{
+  if(!event)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  atomic_init(&event->state, 0);
+  atomic_init(&event->waiters, 0);
+  event->shared = shared;
+  event->spin = spin;
+
+  return 0;
+}
+
+int rt_event_signal(struct rt_event* event)
+{
+  int op = FUTEX_WAKE | (event->shared ? 0 : FUTEX_PRIVATE_FLAG);
+
+  /* waiter registers itself before checking the state, so either it sees
+   * the signal or we see it
+   */
+  if(atomic_exchange(&event->state, 1) == 0 &&
+      atomic_load(&event->waiters) > 0)
+  {
+    if(rt_futex(&event->state, op, 1, NULL, 0) == -1)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int rt_event_timedwait(struct rt_event* event, const struct timespec* abstime)
+{
+  /* FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC timeout */
+  int op = FUTEX_WAIT_BITSET | (event->shared ? 0 : FUTEX_PRIVATE_FLAG);
+  int ret = 0;
+
+  for(unsigned int i = 0 ; i < event->spin ; i++)
+  {
+    if(rt_event_consume(event))
+    {
+      return 0;
+    }
+    rt_relax();
+  }
+
+  atomic_fetch_add(&event->waiters, 1);
+
+  while(!rt_event_consume(event))
+  {
+    if(rt_futex(&event->state, op, 0, abstime, FUTEX_BITSET_MATCH_ANY) == -1 &&
+        errno != EAGAIN && errno != EINTR)
+    {
+      ret = -1;
+      break;
+    }
+  }
+
+  atomic_fetch_sub(&event->waiters, 1);
+
+  return ret;
+}
+
+int rt_event_wait(struct rt_event* event)
+{
+  return rt_event_timedwait(event, NULL);
+}
+
+int rt_event_trywait(struct rt_event* event)
+{
+  if(!rt_event_consume(event))
+  {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  return 0;
+}
+
+int rt_pi_mutex_init(struct rt_pi_mutex* mutex, int shared)
+{
+  if(!mutex)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  atomic_init(&mutex->owner, 0);
+  mutex->shared = shared;
+
+  return 0;
+}
+
+int rt_pi_mutex_lock(struct rt_pi_mutex* mutex)
+{
+  int op = FUTEX_LOCK_PI | (mutex->shared ? 0 : FUTEX_PRIVATE_FLAG);
+  uint32_t expected = 0;
+
+  if(atomic_compare_exchange_strong(&mutex->owner, &expected,
+        rt_event_gettid()))
+  {
+    return 0;
+  }
+
+  /* kernel queues the thread and boosts the owner */
+  while(rt_futex(&mutex->owner, op, 0, NULL, 0) == -1)
+  {
+    if(errno != EINTR)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int rt_pi_mutex_trylock(struct rt_pi_mutex* mutex)
+{
+  uint32_t expected = 0;
+
+  if(!atomic_compare_exchange_strong(&mutex->owner, &expected,
+        rt_event_gettid()))
+  {
+    errno = EBUSY;
+    return -1;
+  }
+
+  return 0;
+}
+
+int rt_pi_mutex_unlock(struct rt_pi_mutex* mutex)
+{
+  int op = FUTEX_UNLOCK_PI | (mutex->shared ? 0 : FUTEX_PRIVATE_FLAG);
+  uint32_t expected = rt_event_gettid();
+
+  if((atomic_load(&mutex->owner) & FUTEX_TID_MASK) != expected)
+  {
+    errno = EPERM;
+    return -1;
+  }
+
+  /* waiters set FUTEX_WAITERS, kernel hands the lock over */
+  if(atomic_compare_exchange_strong(&mutex->owner, &expected, 0))
+  {
+    return 0;
+  }
+
+  return rt_futex(&mutex->owner, op, 0, NULL, 0) == -1 ? -1 : 0;
+}
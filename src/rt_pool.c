@@ -0,0 +1,878 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file rt_pool.c
+ * \brief Real-time worker thread pool with priority levels and work
+ * stealing.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <linux/futex.h>
+
+#include "rt_pool.h"
+#include "rt_sync.h"
+
+/**
+ * \brief Bit of rt_pool_group::pending set while a thread sleeps on it.
+ */
+#define RT_POOL_GROUP_WAITER 0x80000000u
+
+/**
+ * \struct rt_pool_deque
+ * \brief Chase-Lev deque: the owner pushes and takes at bottom, thieves
+ * steal at top.
+ */
+struct rt_pool_deque
+{
+  /**
+   * \brief Next index to steal.
+   */
+  _Alignas(RT_CACHE_LINE) _Atomic int64_t top;
+
+  /**
+   * \brief Next index to push.
+   */
+  _Alignas(RT_CACHE_LINE) _Atomic int64_t bottom;
+
+  /**
+   * \brief Tasks.
+   */
+  _Atomic(struct rt_pool_task*)* buffer;
+
+  /**
+   * \brief Capacity minus one.
+   */
+  int64_t mask;
+};
+
+/**
+ * \struct rt_pool_slot
+ * \brief Slot of the injection queue.
+ */
+struct rt_pool_slot
+{
+  /**
+   * \brief Sequence number: position when free, position + 1 when full.
+   */
+  _Atomic uint64_t seq;
+
+  /**
+   * \brief Task.
+   */
+  struct rt_pool_task* task;
+};
+
+/**
+ * \struct rt_pool_inject
+ * \brief Bounded MPMC queue for tasks submitted from outside the pool.
+ */
+struct rt_pool_inject
+{
+  /**
+   * \brief Next position to fill.
+   */
+  _Alignas(RT_CACHE_LINE) _Atomic uint64_t head;
+
+  /**
+   * \brief Next position to take.
+   */
+  _Alignas(RT_CACHE_LINE) _Atomic uint64_t tail;
+
+  /**
+   * \brief Slots.
+   */
+  struct rt_pool_slot* slots;
+
+  /**
+   * \brief Slots seen as a sequence ring.
+   */
+  struct rt_ring ring;
+};
+
+/**
+ * \struct rt_pool_worker
+ * \brief Worker thread.
+ */
+struct rt_pool_worker
+{
+  /**
+   * \brief Deque of each level.
+   */
+  struct rt_pool_deque deques[RT_POOL_LEVELS];
+
+  /**
+   * \brief 1 if the worker sleeps or is about to.
+   */
+  _Alignas(RT_CACHE_LINE) atomic_int idle;
+
+  /**
+   * \brief Wakes the worker.
+   */
+  struct rt_event event;
+
+  /**
+   * \brief Number of tasks run.
+   */
+  _Atomic uint64_t executed;
+
+  /**
+   * \brief Number of tasks stolen.
+   */
+  _Atomic uint64_t stolen;
+
+  /**
+   * \brief Number of sleeps.
+   */
+  _Atomic uint64_t sleeps;
+
+  /**
+   * \brief The pool.
+   */
+  struct rt_pool* pool;
+
+  /**
+   * \brief Thread.
+   */
+  pthread_t th;
+
+  /**
+   * \brief Index in the pool.
+   */
+  size_t index;
+
+  /**
+   * \brief CPU id.
+   */
+  int cpu;
+
+  /**
+   * \brief Steal domain.
+   */
+  int domain;
+
+  /**
+   * \brief If not 0, thread is launched.
+   */
+  int launched;
+
+  /**
+   * \brief errno of the setup of the thread, 0 if success.
+   */
+  int error;
+};
+
+/**
+ * \struct rt_pool
+ * \brief Pool.
+ */
+struct rt_pool
+{
+  /**
+   * \brief Injection queue of each level.
+   */
+  struct rt_pool_inject inject[RT_POOL_LEVELS];
+
+  /**
+   * \brief Workers.
+   */
+  struct rt_pool_worker* workers;
+
+  /**
+   * \brief Number of workers.
+   */
+  size_t nb;
+
+  /**
+   * \brief Configuration (without arrays).
+   */
+  struct rt_pool_config config;
+
+  /**
+   * \brief If not 0, workers exit.
+   */
+  atomic_int stop;
+
+  /**
+   * \brief Number of workers that completed their setup.
+   */
+  _Atomic size_t ready;
+
+  /**
+   * \brief Signaled by workers after setup.
+   */
+  struct rt_event ready_event;
+};
+
+/**
+ * \brief Worker of the calling thread, NULL if not a worker.
+ */
+static _Thread_local struct rt_pool_worker* rt_pool_self = NULL;
+
+/**
+ * \brief Pushes a task at the bottom of a deque (owner only).
+ * \param deque deque.
+ * \param task task.
+ * \return 0 if success, -1 if deque is full.
+ */
+static int rt_pool_deque_push(struct rt_pool_deque* deque,
+    struct rt_pool_task* task)
+{
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+
+  if(b - t > deque->mask)
+  {
+    return -1;
+  }
+
+  atomic_store_explicit(&deque->buffer[b & deque->mask], task,
+      memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+  return 0;
+}
+
+/**
+ * \brief Takes the task at the bottom of a deque (owner only).
+ * \param deque deque.
+ * \return task or NULL if deque is empty.
+ */
+static struct rt_pool_task* rt_pool_deque_take(struct rt_pool_deque* deque)
+{
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+  int64_t t = 0;
+  struct rt_pool_task* task = NULL;
+
+  atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+  if(t <= b)
+  {
+    task = atomic_load_explicit(&deque->buffer[b & deque->mask],
+        memory_order_relaxed);
+
+    if(t == b)
+    {
+      /* last task, race with thieves */
+      if(!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed))
+      {
+        task = NULL;
+      }
+      atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    }
+  }
+  else
+  {
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+  }
+
+  return task;
+}
+
+/**
+ * \brief Steals the task at the top of a deque.
+ * \param deque deque.
+ * \return task or NULL if deque is empty or another thief won.
+ */
+static struct rt_pool_task* rt_pool_deque_steal(struct rt_pool_deque* deque)
+{
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+  int64_t b = 0;
+  struct rt_pool_task* task = NULL;
+
+  atomic_thread_fence(memory_order_seq_cst);
+  b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+  if(t >= b)
+  {
+    return NULL;
+  }
+
+  task = atomic_load_explicit(&deque->buffer[t & deque->mask],
+      memory_order_relaxed);
+
+  if(!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+        memory_order_seq_cst, memory_order_relaxed))
+  {
+    return NULL;
+  }
+
+  return task;
+}
+
+/**
+ * \brief Pushes a task in an injection queue.
+ * \param inject queue.
+ * \param task task.
+ * \return 0 if success, -1 if queue is full.
+ */
+static int rt_pool_inject_push(struct rt_pool_inject* inject,
+    struct rt_pool_task* task)
+{
+  uint64_t pos = 0;
+  struct rt_pool_slot* slot = rt_ring_reserve(&inject->ring, &inject->head,
+      1, &pos);
+
+  if(!slot)
+  {
+    return -1;
+  }
+
+  slot->task = task;
+  rt_ring_commit(slot);
+  return 0;
+}
+
+/**
+ * \brief Takes a task from an injection queue.
+ * \param inject queue.
+ * \return task or NULL if queue is empty.
+ */
+static struct rt_pool_task* rt_pool_inject_pop(struct rt_pool_inject* inject)
+{
+  uint64_t pos = 0;
+  struct rt_pool_slot* slot = rt_ring_take(&inject->ring, &inject->tail, 1,
+      &pos);
+  struct rt_pool_task* task = NULL;
+
+  if(!slot)
+  {
+    return NULL;
+  }
+
+  task = slot->task;
+  rt_ring_free(&inject->ring, slot, pos);
+  return task;
+}
+
+/**
+ * \brief Finds the most urgent task for a worker.
+ *
+ * For each level: own deque, then injection queue, then the deques of the
+ * other workers of the domain.
+ * \param worker worker.
+ * \return task or NULL if none.
+ */
+static struct rt_pool_task* rt_pool_find(struct rt_pool_worker* worker)
+{
+  struct rt_pool* pool = worker->pool;
+
+  for(unsigned int level = 0 ; level < RT_POOL_LEVELS ; level++)
+  {
+    struct rt_pool_task* task = rt_pool_deque_take(&worker->deques[level]);
+
+    if(!task)
+    {
+      task = rt_pool_inject_pop(&pool->inject[level]);
+    }
+
+    for(size_t i = 1 ; !task && i < pool->nb ; i++)
+    {
+      /* start after self so that thieves spread over victims */
+      struct rt_pool_worker* victim =
+        &pool->workers[(worker->index + i) % pool->nb];
+
+      if(victim->domain != worker->domain)
+      {
+        continue;
+      }
+
+      task = rt_pool_deque_steal(&victim->deques[level]);
+      if(task)
+      {
+        atomic_fetch_add_explicit(&worker->stolen, 1, memory_order_relaxed);
+      }
+    }
+
+    if(task)
+    {
+      return task;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * \brief Completes one task of a group.
+ *
+ * The decrement is the last access to the group, the wake only uses its
+ * address: the waiter may release the group as soon as it sees 0.
+ * \param group group.
+ */
+static void rt_pool_group_done(struct rt_pool_group* group)
+{
+  _Atomic uint32_t* addr = &group->pending;
+
+  if(atomic_fetch_sub_explicit(addr, 1, memory_order_acq_rel) ==
+      (RT_POOL_GROUP_WAITER | 1))
+  {
+    /* spurious wake of a reused address is harmless for futex waiters */
+    rt_futex(addr, FUTEX_WAKE_PRIVATE, 1, NULL, 0);
+  }
+}
+
+/**
+ * \brief Runs a task and completes its group.
+ * \param worker worker.
+ * \param task task.
+ */
+static void rt_pool_run(struct rt_pool_worker* worker,
+    struct rt_pool_task* task)
+{
+  struct rt_pool_group* group = task->group;
+
+  /* task may be reused by its function, group is read before */
+  task->fcn(task->data);
+  atomic_fetch_add_explicit(&worker->executed, 1, memory_order_relaxed);
+
+  if(group)
+  {
+    rt_pool_group_done(group);
+  }
+}
+
+/**
+ * \brief Wakes an idle worker.
+ * \param pool pool.
+ * \param domain only wake a worker of this domain, -1 for any.
+ */
+static void rt_pool_wake(struct rt_pool* pool, int domain)
+{
+  /* pairs with the fence of a worker going to sleep */
+  atomic_thread_fence(memory_order_seq_cst);
+
+  for(size_t i = 0 ; i < pool->nb ; i++)
+  {
+    struct rt_pool_worker* worker = &pool->workers[i];
+
+    if(domain != -1 && worker->domain != domain)
+    {
+      continue;
+    }
+
+    if(atomic_load_explicit(&worker->idle, memory_order_relaxed) &&
+        atomic_exchange(&worker->idle, 0))
+    {
+      rt_event_signal(&worker->event);
+      return;
+    }
+  }
+}
+
+/**
+ * \brief Worker thread.
+ * \param data the worker.
+ * \return NULL.
+ */
+static void* rt_pool_thread(void* data)
+{
+  struct rt_pool_worker* worker = data;
+  struct rt_pool* pool = worker->pool;
+  unsigned int spins = 0;
+  int ret = 0;
+
+  rt_pool_self = worker;
+
+  ret = thread_set_affinity(pthread_self(), &worker->cpu, 1);
+  if(ret != 0)
+  {
+    worker->error = ret;
+  }
+  else if(thread_set_rt_priority(pthread_self(), &pool->config.priority) != 0)
+  {
+    worker->error = errno;
+  }
+
+  atomic_fetch_add(&pool->ready, 1);
+  rt_event_signal(&pool->ready_event);
+
+  while(!atomic_load_explicit(&pool->stop, memory_order_relaxed))
+  {
+    struct rt_pool_task* task = rt_pool_find(worker);
+
+    if(task)
+    {
+      rt_pool_run(worker, task);
+      spins = 0;
+      continue;
+    }
+
+    if(spins < pool->config.spin)
+    {
+      spins++;
+      rt_relax();
+      continue;
+    }
+
+    /* announce sleep, then look again: a submitter either sees the flag
+     * or its task is found here */
+    atomic_store(&worker->idle, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    task = rt_pool_find(worker);
+    if(task)
+    {
+      atomic_store(&worker->idle, 0);
+      rt_pool_run(worker, task);
+      spins = 0;
+      continue;
+    }
+
+    if(atomic_load(&pool->stop))
+    {
+      break;
+    }
+
+    atomic_fetch_add_explicit(&worker->sleeps, 1, memory_order_relaxed);
+    rt_event_wait(&worker->event);
+    atomic_store(&worker->idle, 0);
+    spins = 0;
+  }
+
+  return NULL;
+}
+
+/**
+ * \brief Allocates and initializes the queues.
+ * \param pool pool with nb and config set.
+ * \return 0 if success, -1 otherwise.
+ */
+static int rt_pool_alloc(struct rt_pool* pool)
+{
+  size_t capacity = pool->config.capacity;
+
+  for(unsigned int level = 0 ; level < RT_POOL_LEVELS ; level++)
+  {
+    struct rt_pool_inject* inject = &pool->inject[level];
+
+    inject->slots = calloc(capacity, sizeof(struct rt_pool_slot));
+    if(!inject->slots)
+    {
+      return -1;
+    }
+
+    inject->ring.slots = (unsigned char*)inject->slots;
+    inject->ring.slot_size = sizeof(struct rt_pool_slot);
+    inject->ring.mask = capacity - 1;
+    atomic_init(&inject->head, 0);
+    atomic_init(&inject->tail, 0);
+
+    for(size_t i = 0 ; i < capacity ; i++)
+    {
+      atomic_init(&inject->slots[i].seq, i);
+    }
+
+    for(size_t i = 0 ; i < pool->nb ; i++)
+    {
+      struct rt_pool_deque* deque = &pool->workers[i].deques[level];
+
+      /* calloc touches nothing, memset does */
+      deque->buffer = malloc(capacity * sizeof(deque->buffer[0]));
+      if(!deque->buffer)
+      {
+        return -1;
+      }
+
+      memset(deque->buffer, 0x00, capacity * sizeof(deque->buffer[0]));
+      deque->mask = capacity - 1;
+      atomic_init(&deque->top, 0);
+      atomic_init(&deque->bottom, 0);
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Frees the queues and the pool.
+ * \param pool pool.
+ */
+static void rt_pool_free(struct rt_pool* pool)
+{
+  for(unsigned int level = 0 ; level < RT_POOL_LEVELS ; level++)
+  {
+    free(pool->inject[level].slots);
+
+    for(size_t i = 0 ; pool->workers && i < pool->nb ; i++)
+    {
+      free(pool->workers[i].deques[level].buffer);
+    }
+  }
+
+  free(pool->workers);
+  free(pool);
+}
+
+struct rt_pool* rt_pool_create(const struct rt_pool_config* config)
+{
+  struct rt_pool* pool = NULL;
+  int error = 0;
+
+  if(!config || !config->cpus || config->cpus_size == 0 ||
+      config->capacity < 2 ||
+      (config->capacity & (config->capacity - 1)) != 0)
+  {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  pool = aligned_alloc(RT_CACHE_LINE, sizeof(struct rt_pool));
+  if(!pool)
+  {
+    return NULL;
+  }
+  memset(pool, 0x00, sizeof(struct rt_pool));
+
+  pool->nb = config->cpus_size;
+  pool->config = *config;
+  pool->config.cpus = NULL;
+  pool->config.domains = NULL;
+  atomic_init(&pool->stop, 0);
+  atomic_init(&pool->ready, 0);
+  rt_event_init(&pool->ready_event, 0, 0);
+
+  pool->workers = aligned_alloc(RT_CACHE_LINE,
+      pool->nb * sizeof(struct rt_pool_worker));
+  if(pool->workers)
+  {
+    memset(pool->workers, 0x00, pool->nb * sizeof(struct rt_pool_worker));
+  }
+
+  if(!pool->workers || rt_pool_alloc(pool) != 0)
+  {
+    rt_pool_free(pool);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  for(size_t i = 0 ; i < pool->nb ; i++)
+  {
+    struct rt_pool_worker* worker = &pool->workers[i];
+
+    worker->pool = pool;
+    worker->index = i;
+    worker->cpu = config->cpus[i];
+    worker->domain = config->domains ? config->domains[i] : 0;
+    atomic_init(&worker->idle, 0);
+    atomic_init(&worker->executed, 0);
+    atomic_init(&worker->stolen, 0);
+    atomic_init(&worker->sleeps, 0);
+    rt_event_init(&worker->event, 0, 0);
+  }
+
+  for(size_t i = 0 ; i < pool->nb ; i++)
+  {
+    if(pthread_create(&pool->workers[i].th, NULL, rt_pool_thread,
+          &pool->workers[i]) != 0)
+    {
+      error = EAGAIN;
+      break;
+    }
+    pool->workers[i].launched = 1;
+  }
+
+  if(error == 0)
+  {
+    /* a worker that could not get its CPU or priority fails the pool */
+    while(atomic_load(&pool->ready) < pool->nb)
+    {
+      rt_event_wait(&pool->ready_event);
+    }
+
+    for(size_t i = 0 ; i < pool->nb && error == 0 ; i++)
+    {
+      error = pool->workers[i].error;
+    }
+  }
+
+  if(error != 0)
+  {
+    rt_pool_destroy(pool);
+    errno = error;
+    return NULL;
+  }
+
+  return pool;
+}
+
+void rt_pool_destroy(struct rt_pool* pool)
+{
+  if(!pool)
+  {
+    return;
+  }
+
+  atomic_store(&pool->stop, 1);
+
+  for(size_t i = 0 ; i < pool->nb ; i++)
+  {
+    rt_event_signal(&pool->workers[i].event);
+  }
+
+  for(size_t i = 0 ; i < pool->nb ; i++)
+  {
+    if(pool->workers[i].launched)
+    {
+      pthread_join(pool->workers[i].th, NULL);
+    }
+  }
+
+  rt_pool_free(pool);
+}
+
+size_t rt_pool_get_size(const struct rt_pool* pool)
+{
+  return pool->nb;
+}
+
+int rt_pool_submit(struct rt_pool* pool, struct rt_pool_task* task,
+    unsigned int level, struct rt_pool_group* group)
+{
+  struct rt_pool_worker* self = rt_pool_self;
+  int ret = -1;
+
+  if(!task || !task->fcn || level >= RT_POOL_LEVELS)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  task->group = group;
+  if(group)
+  {
+    atomic_fetch_add_explicit(&group->pending, 1, memory_order_relaxed);
+  }
+
+  if(self && self->pool == pool)
+  {
+    ret = rt_pool_deque_push(&self->deques[level], task);
+    if(ret == 0)
+    {
+      rt_pool_wake(pool, self->domain);
+      return 0;
+    }
+  }
+
+  ret = rt_pool_inject_push(&pool->inject[level], task);
+  if(ret != 0)
+  {
+    if(group)
+    {
+      rt_pool_group_done(group);
+    }
+    errno = EAGAIN;
+    return -1;
+  }
+
+  rt_pool_wake(pool, -1);
+  return 0;
+}
+
+int rt_pool_group_init(struct rt_pool_group* group)
+{
+  atomic_init(&group->pending, 0);
+  return 0;
+}
+
+int rt_pool_group_wait(struct rt_pool* pool, struct rt_pool_group* group)
+{
+  struct rt_pool_worker* self = rt_pool_self;
+
+  if(self && self->pool == pool)
+  {
+    /* sleeping here could deadlock the pool, help instead */
+    while((atomic_load_explicit(&group->pending, memory_order_acquire) &
+          ~RT_POOL_GROUP_WAITER) != 0)
+    {
+      struct rt_pool_task* task = rt_pool_find(self);
+
+      if(task)
+      {
+        rt_pool_run(self, task);
+      }
+      else
+      {
+        rt_relax();
+      }
+    }
+
+    return 0;
+  }
+
+  for(;;)
+  {
+    uint32_t value = atomic_load_explicit(&group->pending,
+        memory_order_acquire);
+
+    if((value & ~RT_POOL_GROUP_WAITER) == 0)
+    {
+      break;
+    }
+
+    if(!(value & RT_POOL_GROUP_WAITER))
+    {
+      /* announce the sleep so that the last completion wakes us */
+      atomic_compare_exchange_weak_explicit(&group->pending, &value,
+          value | RT_POOL_GROUP_WAITER, memory_order_acq_rel,
+          memory_order_acquire);
+      continue;
+    }
+
+    if(rt_futex(&group->pending, FUTEX_WAIT_PRIVATE, value, NULL, 0) == -1 &&
+        errno != EAGAIN && errno != EINTR)
+    {
+      return -1;
+    }
+  }
+
+  /* no worker touches the group anymore, clear the flag for reuse */
+  atomic_fetch_and_explicit(&group->pending, ~RT_POOL_GROUP_WAITER,
+      memory_order_relaxed);
+  return 0;
+}
+
+int rt_pool_get_stats(const struct rt_pool* pool, size_t index,
+    struct rt_pool_stats* stats)
+{
+  const struct rt_pool_worker* worker = NULL;
+
+  if(!pool || !stats || index >= pool->nb)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  worker = &pool->workers[index];
+  stats->cpu = worker->cpu;
+  stats->executed = atomic_load(&worker->executed);
+  stats->stolen = atomic_load(&worker->stolen);
+  stats->sleeps = atomic_load(&worker->sleeps);
+  return 0;
+}
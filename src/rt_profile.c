@@ -0,0 +1,690 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file rt_profile.c
+ * \brief Declarative real-time profile of the threads of an application.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <sched.h>
+#include <errno.h>
+
+#include "rt_profile.h"
+#include "sysfs.h"
+#include "sched_attr.h"
+
+/**
+ * \brief Minimum runtime accepted by the kernel for SCHED_DEADLINE (1024 ns).
+ */
+#define RT_PROFILE_DL_MIN_RUNTIME 1024
+
+/**
+ * \struct rt_profile_policy_name
+ * \brief Association between a policy and its name in the profile.
+ */
+struct rt_profile_policy_name
+{
+  /**
+   * \brief Name.
+   */
+  const char* name;
+
+  /**
+   * \brief Policy.
+   */
+  int policy;
+};
+
+/**
+ * \brief Known policies.
+ */
+static const struct rt_profile_policy_name rt_profile_policies[] =
+{
+  {"other", SCHED_OTHER},
+  {"batch", SCHED_BATCH},
+  {"idle", SCHED_IDLE},
+  {"fifo", SCHED_FIFO},
+  {"rr", SCHED_RR},
+  {"deadline", SCHED_DEADLINE},
+  {NULL, 0},
+};
+
+/**
+ * \brief Removes leading and trailing spaces of a string.
+ * \param str string to trim.
+ * \return pointer on the first non-space character.
+ */
+static char* rt_profile_trim(char* str)
+{
+  size_t len = 0;
+
+  while(isspace((unsigned char)*str))
+  {
+    str++;
+  }
+
+  len = strlen(str);
+  while(len > 0 && isspace((unsigned char)str[len - 1]))
+  {
+    str[--len] = 0x00;
+  }
+
+  return str;
+}
+
+/**
+ * \brief Parses an unsigned integer value.
+ * \param str string to parse.
+ * \param value pointer that will receive the value.
+ * \return 0 if success, -1 otherwise.
+ */
+static int rt_profile_parse_u64(const char* str, uint64_t* value)
+{
+  char* end = NULL;
+  unsigned long long ret = 0;
+
+  if(*str == '-')
+  {
+    return -1;
+  }
+
+  errno = 0;
+  ret = strtoull(str, &end, 0);
+  if(errno != 0 || end == str || *end != 0x00)
+  {
+    return -1;
+  }
+
+  *value = ret;
+  return 0;
+}
+
+/**
+ * \brief Parses a signed integer value.
+ * \param str string to parse.
+ * \param value pointer that will receive the value.
+ * \return 0 if success, -1 otherwise.
+ */
+static int rt_profile_parse_int(const char* str, int* value)
+{
+  char* end = NULL;
+  long ret = 0;
+
+  errno = 0;
+  ret = strtol(str, &end, 0);
+  if(errno != 0 || end == str || *end != 0x00 || ret < -2147483647L ||
+      ret > 2147483647L)
+  {
+    return -1;
+  }
+
+  *value = (int)ret;
+  return 0;
+}
+
+/**
+ * \brief Parses a "key = value" line of a thread section.
+ * \param thread thread profile to fill.
+ * \param key the key.
+ * \param value the value.
+ * \return 0 if success, -1 otherwise.
+ */
+static int rt_profile_parse_key(struct rt_profile_thread* thread,
+    const char* key, const char* value)
+{
+  uint64_t u64 = 0;
+  int ret = 0;
+
+  if(!strcmp(key, "policy"))
+  {
+    for(size_t i = 0 ; rt_profile_policies[i].name ; i++)
+    {
+      if(!strcasecmp(value, rt_profile_policies[i].name))
+      {
+        thread->priority.policy = rt_profile_policies[i].policy;
+        thread->flags |= RT_PROFILE_POLICY;
+        return 0;
+      }
+    }
+    return -1;
+  }
+  else if(!strcmp(key, "priority"))
+  {
+    if(rt_profile_parse_u64(value, &u64) != 0 || u64 > 99)
+    {
+      return -1;
+    }
+    thread->priority.priority = (unsigned int)u64;
+  }
+  else if(!strcmp(key, "runtime"))
+  {
+    ret = rt_profile_parse_u64(value, &thread->runtime);
+  }
+  else if(!strcmp(key, "deadline"))
+  {
+    ret = rt_profile_parse_u64(value, &thread->deadline);
+  }
+  else if(!strcmp(key, "period"))
+  {
+    ret = rt_profile_parse_u64(value, &thread->period);
+  }
+  else if(!strcmp(key, "cpus"))
+  {
+    int nb = cpulist_parse(value, thread->cpus, RT_PROFILE_MAX_CPUS);
+
+    if(nb <= 0)
+    {
+      return -1;
+    }
+    thread->cpus_size = (size_t)nb;
+    thread->flags |= RT_PROFILE_CPUS;
+  }
+  else if(!strcmp(key, "nice"))
+  {
+    ret = rt_profile_parse_int(value, &thread->nice);
+    thread->flags |= RT_PROFILE_NICE;
+  }
+  else if(!strcmp(key, "memlock"))
+  {
+    if(rt_profile_parse_u64(value, &u64) != 0 || u64 == 0)
+    {
+      return -1;
+    }
+    thread->memlock = (size_t)u64;
+    thread->flags |= RT_PROFILE_MEMLOCK;
+  }
+  else if(!strcmp(key, "util_min") || !strcmp(key, "util_max"))
+  {
+    if(rt_profile_parse_u64(value, &u64) != 0 || u64 > RT_UCLAMP_MAX)
+    {
+      return -1;
+    }
+
+    if(!strcmp(key, "util_min"))
+    {
+      thread->uclamp.util_min = (unsigned int)u64;
+    }
+    else
+    {
+      thread->uclamp.util_max = (unsigned int)u64;
+    }
+    thread->flags |= RT_PROFILE_UCLAMP;
+  }
+  else if(!strcmp(key, "governor"))
+  {
+    if(value[0] == 0x00 || strlen(value) >= CPUFREQ_NAME_SIZE)
+    {
+      return -1;
+    }
+    strcpy(thread->governor, value);
+    thread->flags |= RT_PROFILE_GOVERNOR;
+  }
+  else
+  {
+    /* unknown key */
+    return -1;
+  }
+
+  return ret;
+}
+
+/**
+ * \brief Validates the profile of a thread.
+ * \param thread thread profile.
+ * \return 0 if valid, -1 otherwise.
+ */
+static int rt_profile_validate(const struct rt_profile_thread* thread)
+{
+  long nb_cpus = sysconf(_SC_NPROCESSORS_CONF);
+  int policy = thread->priority.policy;
+  int rt = 0;
+
+  if(thread->flags & RT_PROFILE_POLICY)
+  {
+    rt = policy == SCHED_FIFO || policy == SCHED_RR ||
+      policy == SCHED_DEADLINE;
+
+    if(policy == SCHED_FIFO || policy == SCHED_RR)
+    {
+      if((int)thread->priority.priority < sched_get_priority_min(policy) ||
+          (int)thread->priority.priority > sched_get_priority_max(policy))
+      {
+        return -1;
+      }
+    }
+    else if(thread->priority.priority != 0)
+    {
+      return -1;
+    }
+
+    if(policy == SCHED_DEADLINE)
+    {
+      /* runtime <= deadline <= period */
+      if(thread->runtime < RT_PROFILE_DL_MIN_RUNTIME ||
+          thread->deadline < thread->runtime ||
+          (thread->period && thread->period < thread->deadline))
+      {
+        return -1;
+      }
+
+      /* kernel refuses SCHED_DEADLINE with an affinity smaller than the
+       * root domain, a cpuset partition is needed instead
+       */
+      if(thread->flags & RT_PROFILE_CPUS)
+      {
+        return -1;
+      }
+    }
+    else if(thread->runtime || thread->deadline || thread->period)
+    {
+      return -1;
+    }
+  }
+  else if(thread->priority.priority || thread->runtime || thread->deadline ||
+      thread->period)
+  {
+    /* parameters without policy */
+    return -1;
+  }
+
+  if(thread->flags & RT_PROFILE_NICE)
+  {
+    if(rt || thread->nice < -20 || thread->nice > 19)
+    {
+      return -1;
+    }
+  }
+
+  for(size_t i = 0 ; i < thread->cpus_size ; i++)
+  {
+    if(thread->cpus[i] >= nb_cpus)
+    {
+      return -1;
+    }
+  }
+
+  if((thread->flags & RT_PROFILE_UCLAMP) &&
+      thread->uclamp.util_min > thread->uclamp.util_max)
+  {
+    return -1;
+  }
+
+  /* governor is applied on the CPUs of the thread */
+  if(thread->flags & RT_PROFILE_GOVERNOR)
+  {
+    if(!(thread->flags & RT_PROFILE_CPUS))
+    {
+      return -1;
+    }
+
+    for(size_t i = 0 ; i < thread->cpus_size ; i++)
+    {
+      char names[16][CPUFREQ_NAME_SIZE];
+      int nb = cpufreq_get_available_governors(thread->cpus[i], names, 16);
+      int found = 0;
+
+      /* without cpufreq support the error is reported when applied */
+      if(nb == -1)
+      {
+        continue;
+      }
+
+      for(int j = 0 ; j < nb && !found ; j++)
+      {
+        found = !strcmp(names[j], thread->governor);
+      }
+
+      if(!found)
+      {
+        return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Sets scheduling policy of a kernel thread.
+ * \param thread thread profile.
+ * \param tid kernel thread identifier.
+ * \return 0 if success, negative value otherwise.
+ */
+static int rt_profile_set_policy(const struct rt_profile_thread* thread,
+    pid_t tid)
+{
+  struct rt_prio prio = thread->priority;
+
+  /* policy and clamps are set with the same system call */
+  if(thread->flags & RT_PROFILE_UCLAMP)
+  {
+    struct rt_uclamp uclamp = thread->uclamp;
+
+    if(!(thread->flags & RT_PROFILE_POLICY))
+    {
+      return process_set_uclamp(tid, NULL, &uclamp);
+    }
+    else if(prio.policy != SCHED_DEADLINE)
+    {
+      return process_set_uclamp(tid, &prio, &uclamp);
+    }
+  }
+
+  if(prio.policy == SCHED_DEADLINE)
+  {
+    struct rt_sched_attr attr;
+
+    memset(&attr, 0x00, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.sched_policy = SCHED_DEADLINE;
+    attr.sched_runtime = thread->runtime;
+    attr.sched_deadline = thread->deadline;
+    attr.sched_period = thread->period;
+
+    if(thread->flags & RT_PROFILE_UCLAMP)
+    {
+      attr.sched_flags = RT_SCHED_FLAG_UTIL_CLAMP_MIN |
+        RT_SCHED_FLAG_UTIL_CLAMP_MAX;
+      attr.sched_util_min = thread->uclamp.util_min;
+      attr.sched_util_max = thread->uclamp.util_max;
+    }
+
+    return rt_sched_setattr(tid, &attr);
+  }
+
+  return process_set_rt_priority(tid, &prio);
+}
+
+/**
+ * \brief Applies the profile of a thread.
+ * \param thread thread profile.
+ * \param tid kernel thread identifier.
+ * \param self if the thread is the calling thread.
+ * \return 0 if success, negative value otherwise.
+ */
+static int rt_profile_apply_thread(const struct rt_profile_thread* thread,
+    pid_t tid, int self)
+{
+  if(thread->flags & RT_PROFILE_GOVERNOR)
+  {
+    for(size_t i = 0 ; i < thread->cpus_size ; i++)
+    {
+      if(cpufreq_set_governor_name(thread->governor, thread->cpus[i]) != 0)
+      {
+        return -1;
+      }
+    }
+  }
+
+  /* pin before raising priority */
+  if(thread->flags & RT_PROFILE_CPUS)
+  {
+    if(self)
+    {
+      int ret = thread_set_affinity(pthread_self(), (int*)thread->cpus,
+          thread->cpus_size);
+
+      if(ret != 0)
+      {
+        errno = ret;
+        return -1;
+      }
+    }
+    else if(task_set_affinity(tid, thread->cpus, thread->cpus_size) != 0)
+    {
+      return -1;
+    }
+  }
+
+  if(self && (thread->flags & RT_PROFILE_MEMLOCK))
+  {
+    if(mem_lock_reserve(thread->memlock) != 0)
+    {
+      return -1;
+    }
+  }
+
+  if(thread->flags & (RT_PROFILE_POLICY | RT_PROFILE_UCLAMP))
+  {
+    if(rt_profile_set_policy(thread, tid) != 0)
+    {
+      return -1;
+    }
+  }
+
+  /* nice value can only be set for time-sharing policies */
+  if(thread->flags & RT_PROFILE_NICE)
+  {
+    if(task_set_priority(tid, thread->nice) != 0)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int rt_profile_load(const char* path, struct rt_profile* profile)
+{
+  struct rt_profile_thread* thread = NULL;
+  char line[512];
+  unsigned int nb_line = 0;
+  FILE* f = NULL;
+
+  if(!path || !profile)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  memset(profile, 0x00, sizeof(struct rt_profile));
+
+  f = fopen(path, "r");
+  if(!f)
+  {
+    return -1;
+  }
+
+  while(fgets(line, sizeof(line), f))
+  {
+    char* str = NULL;
+    char* comment = NULL;
+    char* sep = NULL;
+
+    nb_line++;
+
+    comment = strpbrk(line, "#;");
+    if(comment)
+    {
+      *comment = 0x00;
+    }
+
+    str = rt_profile_trim(line);
+    if(*str == 0x00)
+    {
+      continue;
+    }
+
+    if(*str == '[')
+    {
+      struct rt_profile_thread* threads = NULL;
+      size_t len = strlen(str);
+
+      /* validate previous section */
+      if(thread && rt_profile_validate(thread) != 0)
+      {
+        goto error;
+      }
+
+      if(str[len - 1] != ']')
+      {
+        goto error;
+      }
+      str[len - 1] = 0x00;
+      str = rt_profile_trim(str + 1);
+
+      if(*str == 0x00 || strlen(str) >= THREAD_REGISTRY_NAME_SIZE ||
+          rt_profile_get(profile, str))
+      {
+        goto error;
+      }
+
+      threads = realloc(profile->threads,
+          (profile->nb_threads + 1) * sizeof(struct rt_profile_thread));
+      if(!threads)
+      {
+        fclose(f);
+        rt_profile_free(profile);
+        errno = ENOMEM;
+        return -1;
+      }
+
+      profile->threads = threads;
+      thread = &profile->threads[profile->nb_threads++];
+      memset(thread, 0x00, sizeof(struct rt_profile_thread));
+      strcpy(thread->name, str);
+      thread->priority.policy = SCHED_OTHER;
+      thread->uclamp.util_max = RT_UCLAMP_MAX;
+      continue;
+    }
+
+    sep = strchr(str, '=');
+    if(!thread || !sep)
+    {
+      goto error;
+    }
+
+    *sep = 0x00;
+    if(rt_profile_parse_key(thread, rt_profile_trim(str),
+          rt_profile_trim(sep + 1)) != 0)
+    {
+      goto error;
+    }
+  }
+
+  if(thread && rt_profile_validate(thread) != 0)
+  {
+    goto error;
+  }
+
+  fclose(f);
+  return 0;
+
+error:
+  fclose(f);
+  rt_profile_free(profile);
+  profile->error_line = nb_line;
+  errno = EINVAL;
+  return -1;
+}
+
+void rt_profile_free(struct rt_profile* profile)
+{
+  if(profile)
+  {
+    free(profile->threads);
+    profile->threads = NULL;
+    profile->nb_threads = 0;
+  }
+}
+
+const struct rt_profile_thread* rt_profile_get(
+    const struct rt_profile* profile, const char* name)
+{
+  if(!profile || !name)
+  {
+    return NULL;
+  }
+
+  for(size_t i = 0 ; i < profile->nb_threads ; i++)
+  {
+    if(!strcmp(profile->threads[i].name, name))
+    {
+      return &profile->threads[i];
+    }
+  }
+
+  return NULL;
+}
+
+int rt_profile_apply_self(const struct rt_profile* profile, const char* name)
+{
+  const struct rt_profile_thread* thread = rt_profile_get(profile, name);
+
+  if(!thread)
+  {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if(thread_registry_add(name) != 0)
+  {
+    return -1;
+  }
+
+  return rt_profile_apply_thread(thread,
+      thread_registry_get_tid(pthread_self()), 1);
+}
+
+int rt_profile_apply_registered(const struct rt_profile* profile)
+{
+  struct thread_info info;
+  int updated = 0;
+  int err = 0;
+
+  if(!profile)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for(size_t i = 0 ; i < profile->nb_threads ; i++)
+  {
+    const struct rt_profile_thread* thread = &profile->threads[i];
+
+    if(thread_registry_find(thread->name, &info) != 0)
+    {
+      continue;
+    }
+
+    if(rt_profile_apply_thread(thread, info.tid,
+          pthread_equal(info.th, pthread_self())) == 0)
+    {
+      updated++;
+    }
+    else
+    {
+      err = errno;
+    }
+  }
+
+  if(err)
+  {
+    errno = err;
+    return -1;
+  }
+
+  return updated;
+}
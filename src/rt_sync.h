@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file rt_sync.h
+ * \brief Internal synchronization helpers shared by the queues.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_RT_SYNC_H
+#define RTVSUTILS_RT_SYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/**
+ * \brief Size of a cache line.
+ */
+#define RT_CACHE_LINE 64
+
+/**
+ * \struct rt_ring
+ * \brief Bounded ring of slots with sequence numbers (Vyukov).
+ *
+ * Each slot starts with an _Atomic uint64_t sequence number: position when
+ * free, position + 1 when full. Head and tail are kept by the caller so
+ * that they can live in shared memory or in their own cache line.
+ */
+struct rt_ring
+{
+  /**
+   * \brief First slot.
+   */
+  unsigned char* slots;
+
+  /**
+   * \brief Size of a slot.
+   */
+  size_t slot_size;
+
+  /**
+   * \brief Number of slots minus one (power of two minus one).
+   */
+  uint64_t mask;
+};
+
+/**
+ * \brief Calls the futex system call.
+ * \param uaddr futex word.
+ * \param op operation.
+ * \param val value (depends on operation).
+ * \param timeout timeout (depends on operation).
+ * \param val3 value (depends on operation).
+ * \return result of the system call.
+ */
+long rt_futex(_Atomic uint32_t* uaddr, int op, uint32_t val,
+    const struct timespec* timeout, uint32_t val3);
+
+/**
+ * \brief Hints the CPU that the thread is spinning.
+ */
+static inline void rt_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#else
+  atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+/**
+ * \brief Returns the sequence number of the slot at a position.
+ * \param ring ring.
+ * \param pos position.
+ * \return sequence number, also the start of the slot.
+ */
+static inline _Atomic uint64_t* rt_ring_seq(const struct rt_ring* ring,
+    uint64_t pos)
+{
+  return (_Atomic uint64_t*)(ring->slots + (pos & ring->mask) *
+      ring->slot_size);
+}
+
+/**
+ * \brief Reserves the slot at head.
+ * \param ring ring.
+ * \param head next position to fill.
+ * \param shared if not 0, several producers may reserve concurrently.
+ * \param pos receives the position of the slot.
+ * \return slot or NULL if ring is full.
+ */
+static inline void* rt_ring_reserve(const struct rt_ring* ring,
+    _Atomic uint64_t* head, int shared, uint64_t* pos)
+{
+  uint64_t cur = atomic_load_explicit(head, memory_order_relaxed);
+
+  for(;;)
+  {
+    _Atomic uint64_t* seq = rt_ring_seq(ring, cur);
+    int64_t diff = (int64_t)(atomic_load_explicit(seq, memory_order_acquire) -
+        cur);
+
+    if(diff < 0)
+    {
+      /* slot still holds the entry of the previous lap */
+      return NULL;
+    }
+    else if(diff == 0)
+    {
+      if(!shared)
+      {
+        atomic_store_explicit(head, cur + 1, memory_order_relaxed);
+        *pos = cur;
+        return seq;
+      }
+
+      if(atomic_compare_exchange_weak_explicit(head, &cur, cur + 1,
+            memory_order_relaxed, memory_order_relaxed))
+      {
+        *pos = cur;
+        return seq;
+      }
+    }
+    else
+    {
+      /* another producer took this position */
+      cur = atomic_load_explicit(head, memory_order_relaxed);
+    }
+  }
+}
+
+/**
+ * \brief Publishes a slot filled after rt_ring_reserve().
+ * \param slot slot.
+ */
+static inline void rt_ring_commit(void* slot)
+{
+  _Atomic uint64_t* seq = slot;
+
+  /* only the reserving producer writes the sequence until it is published */
+  atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) +
+      1, memory_order_release);
+}
+
+/**
+ * \brief Takes the slot at tail.
+ *
+ * With several consumers the slot is claimed and tail moves past it. With a
+ * single consumer tail is left as is so that the slot can be peeked: the
+ * consumer moves it after rt_ring_free().
+ * \param ring ring.
+ * \param tail next position to take.
+ * \param shared if not 0, several consumers may take concurrently.
+ * \param pos receives the position of the slot.
+ * \return slot or NULL if ring is empty.
+ */
+static inline void* rt_ring_take(const struct rt_ring* ring,
+    _Atomic uint64_t* tail, int shared, uint64_t* pos)
+{
+  uint64_t cur = atomic_load_explicit(tail, memory_order_relaxed);
+
+  for(;;)
+  {
+    _Atomic uint64_t* seq = rt_ring_seq(ring, cur);
+    int64_t diff = (int64_t)(atomic_load_explicit(seq, memory_order_acquire) -
+        (cur + 1));
+
+    if(diff < 0)
+    {
+      return NULL;
+    }
+    else if(diff == 0)
+    {
+      if(!shared)
+      {
+        *pos = cur;
+        return seq;
+      }
+
+      if(atomic_compare_exchange_weak_explicit(tail, &cur, cur + 1,
+            memory_order_relaxed, memory_order_relaxed))
+      {
+        *pos = cur;
+        return seq;
+      }
+    }
+    else if(!shared)
+    {
+      /* only a corrupted shared ring gets there */
+      return NULL;
+    }
+    else
+    {
+      /* another consumer took this position */
+      cur = atomic_load_explicit(tail, memory_order_relaxed);
+    }
+  }
+}
+
+/**
+ * \brief Frees a slot taken with rt_ring_take() for the next lap.
+ * \param ring ring.
+ * \param slot slot.
+ * \param pos position of the slot.
+ */
+static inline void rt_ring_free(const struct rt_ring* ring, void* slot,
+    uint64_t pos)
+{
+  atomic_store_explicit((_Atomic uint64_t*)slot, pos + ring->mask + 1,
+      memory_order_release);
+}
+
+#endif /* RTVSUTILS_RT_SYNC_H */
@@ -24,6 +24,7 @@
 #define _GNU_SOURCE
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <signal.h>
 #include <sched.h>
@@ -38,49 +39,364 @@
 #include <syscall.h>
 
 #include "rtutils.h"
+#include "percpu.h"
+#include "thread_registry.h"
+#include "sched_attr.h"
+#include "sysfs.h"
+#include "tuning.h"
+#include "tsc.h"
+#include "trace.h"
+#include "sysinfo.h"
+#include "watchdog.h"
+#include "stack_probe.h"
 
 /**
- * \brief Path to configure the governor via /sys.
+ * \brief Path of the cpufreq files of a CPU via /sys.
  */
-static const char* const CPUFREQ_GOVERNOR_PATH = 
-  "/sys/devices/system/cpu/cpu%u/cpufreq/scaling_governor";
+static const char* const CPUFREQ_PATH =
+  "/sys/devices/system/cpu/cpu%u/cpufreq/%s";
+
+/**
+ * \brief Path of the system-wide RT runtime.
+ */
+static const char* const RT_RUNTIME_PATH =
+  "/proc/sys/kernel/sched_rt_runtime_us";
+
+/**
+ * \brief Path of the system-wide RT period.
+ */
+static const char* const RT_PERIOD_PATH =
+  "/proc/sys/kernel/sched_rt_period_us";
+
+/**
+ * \brief Paths of the scheduler debug statistics.
+ */
+static const char* const RT_SCHED_DEBUG_PATHS[] =
+{
+  "/sys/kernel/debug/sched/debug",
+  "/proc/sched_debug",
+};
+
+/**
+ * \brief Names of the governors of enum cpufreq_governor.
+ */
+static const char* const CPUFREQ_GOVERNOR_NAMES[] =
+{
+  "powersave",
+  "performance",
+  "ondemand",
+  "conservative",
+  "schedutil",
+  "userspace",
+};
+
+/**
+ * \brief Makes sure a real-time priority can be used by the process.
+ *
+ * Without CAP_SYS_NICE, the soft RLIMIT_RTPRIO is raised up to the hard
+ * limit if needed.
+ * \param priority real-time priority information.
+ * \return 0 if priority can be used, -1 otherwise (errno is set to EPERM).
+ */
+static int rt_allow_priority(const struct rt_prio* priority)
+{
+  const struct rt_caps* caps = rt_caps_get();
+  rlim_t wanted = priority->priority;
+  struct rlimit lim;
+
+  if((priority->policy != SCHED_FIFO && priority->policy != SCHED_RR) ||
+      caps->cap_sys_nice || getrlimit(RLIMIT_RTPRIO, &lim) != 0 ||
+      lim.rlim_cur == RLIM_INFINITY || lim.rlim_cur >= wanted)
+  {
+    return 0;
+  }
+
+  if(lim.rlim_max != RLIM_INFINITY && lim.rlim_max < wanted)
+  {
+    errno = EPERM;
+    return -1;
+  }
+
+  lim.rlim_cur = wanted;
+  return setrlimit(RLIMIT_RTPRIO, &lim);
+}
 
 int mem_lock_reserve(size_t stack_size)
 {
+  const struct rt_caps* caps = rt_caps_get();
   char stack[stack_size];
+  struct rlimit lim;
 
   memset(stack, 0x00, sizeof(stack));
 
+  /* without CAP_IPC_LOCK, locked memory is bounded by the soft limit */
+  if(!caps->cap_ipc_lock)
+  {
+    if(caps->memlock_max == 0)
+    {
+      errno = EPERM;
+      return -1;
+    }
+
+    if(getrlimit(RLIMIT_MEMLOCK, &lim) == 0 && lim.rlim_cur != lim.rlim_max)
+    {
+      lim.rlim_cur = lim.rlim_max;
+
+      if(setrlimit(RLIMIT_MEMLOCK, &lim) != 0)
+      {
+        return -1;
+      }
+    }
+  }
+
+  /* errno is ENOMEM if the process does not fit in the limit */
   return mlockall(MCL_CURRENT | MCL_FUTURE);
 }
 
 int rt_disable_watchdog(void)
 {
-  int fd = open("/proc/sys/kernel/sched_rt_runtime_us", O_WRONLY);
-  const char* const disable_value = "-1";
+  if(tuning_record(RT_RUNTIME_PATH) != 0)
+  {
+    return -1;
+  }
 
-  if(fd == -1)
+  return sysfs_write_str(RT_RUNTIME_PATH, "-1");
+}
+
+/**
+ * \brief Writes a RT runtime/period pair.
+ *
+ * Kernel refuses a runtime greater than the period so if the new period is
+ * lower than the current runtime, runtime is written first. The same rule
+ * applies on restore, tuning_restore() retries the knob refused first.
+ * \param runtime_path path of the runtime file.
+ * \param period_path path of the period file.
+ * \param runtime_us runtime in microseconds.
+ * \param period_us period in microseconds.
+ * \return 0 if success, -1 otherwise.
+ */
+static int rt_write_budget(const char* runtime_path, const char* period_path,
+    long runtime_us, long period_us)
+{
+  long current = 0;
+
+  if(period_us <= 0 || runtime_us < -1 || runtime_us > period_us)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(sysfs_read_long(runtime_path, &current) != 0 ||
+      tuning_record(runtime_path) != 0 || tuning_record(period_path) != 0)
+  {
+    return -1;
+  }
+
+  if(period_us >= current)
+  {
+    if(sysfs_write_long(period_path, period_us) != 0 ||
+        sysfs_write_long(runtime_path, runtime_us) != 0)
+    {
+      return -1;
+    }
+  }
+  else if(sysfs_write_long(runtime_path, runtime_us) != 0 ||
+      sysfs_write_long(period_path, period_us) != 0)
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
+int rt_set_throttling(long runtime_us, long period_us)
+{
+  return rt_write_budget(RT_RUNTIME_PATH, RT_PERIOD_PATH, runtime_us,
+      period_us);
+}
+
+int rt_get_throttling(long* runtime_us, long* period_us)
+{
+  if(!runtime_us || !period_us)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(sysfs_read_long(RT_RUNTIME_PATH, runtime_us) != 0 ||
+      sysfs_read_long(RT_PERIOD_PATH, period_us) != 0)
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
+int rt_cgroup_set_throttling(const char* path, long runtime_us,
+    long period_us)
+{
+  char runtime_path[256];
+  char period_path[256];
+
+  if(!path || runtime_us < 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(snprintf(runtime_path, sizeof(runtime_path), "%s/cpu.rt_runtime_us",
+        path) >= (int)sizeof(runtime_path) ||
+      snprintf(period_path, sizeof(period_path), "%s/cpu.rt_period_us",
+        path) >= (int)sizeof(period_path))
+  {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  return rt_write_budget(runtime_path, period_path, runtime_us, period_us);
+}
+
+int rt_cgroup_get_throttling(const char* path, long* runtime_us,
+    long* period_us)
+{
+  char buf[256];
+
+  if(!path || !runtime_us || !period_us)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  snprintf(buf, sizeof(buf), "%s/cpu.rt_runtime_us", path);
+  if(sysfs_read_long(buf, runtime_us) != 0)
   {
     return -1;
   }
 
-  if(write(fd, disable_value, strlen(disable_value)) == -1)
+  snprintf(buf, sizeof(buf), "%s/cpu.rt_period_us", path);
+  return sysfs_read_long(buf, period_us);
+}
+
+/**
+ * \brief Searches the kernel log for the RT throttling message.
+ * \return 1 if found, 0 if not found, -1 if log cannot be read.
+ */
+static int rt_throttling_logged(void)
+{
+  char record[8192];
+  int fd = open("/dev/kmsg", O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  int found = 0;
+
+  if(fd == -1)
   {
     return -1;
   }
 
+  /* one record per read, stops at the end of the buffer (EAGAIN) */
+  for(;;)
+  {
+    ssize_t ret = read(fd, record, sizeof(record) - 1);
+
+    if(ret == -1)
+    {
+      /* record overwritten while reading, continue with the next one */
+      if(errno == EPIPE || errno == EINTR)
+      {
+        continue;
+      }
+      break;
+    }
+    else if(ret == 0)
+    {
+      break;
+    }
+
+    record[ret] = 0x00;
+    if(strstr(record, "RT throttling activated"))
+    {
+      found = 1;
+      break;
+    }
+  }
+
   close(fd);
+  return found;
+}
+
+/**
+ * \brief Counts the RT runqueues currently throttled.
+ * \return number of RT runqueues throttled, -1 if statistics are not
+ * available.
+ */
+static int rt_throttling_count(void)
+{
+  size_t nb = sizeof(RT_SCHED_DEBUG_PATHS) / sizeof(const char*);
+
+  for(size_t i = 0 ; i < nb ; i++)
+  {
+    char line[256];
+    FILE* f = fopen(RT_SCHED_DEBUG_PATHS[i], "r");
+    int count = 0;
+
+    if(!f)
+    {
+      continue;
+    }
+
+    /* lines look like "  .rt_throttled                  : 0" */
+    while(fgets(line, sizeof(line), f))
+    {
+      char* field = strstr(line, ".rt_throttled");
+      char* colon = NULL;
+
+      if(!field || !(colon = strchr(field, ':')))
+      {
+        continue;
+      }
+
+      if(atoi(colon + 1) != 0)
+      {
+        count++;
+      }
+    }
+
+    fclose(f);
+    return count;
+  }
+
+  return -1;
+}
+
+int rt_get_throttling_status(struct rt_throttling_status* status)
+{
+  int logged = 0;
+
+  if(!status)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  logged = rt_throttling_logged();
+  status->logged = logged > 0;
+  status->throttled = rt_throttling_count();
+
+  if(logged == -1 && status->throttled == -1)
+  {
+    return -1;
+  }
+
   return 0;
 }
 
 int process_get_current_cpu()
 {
-  return sched_getcpu();
+  return percpu_get_cpu();
 }
 
 int thread_get_current_cpu()
 {
-  return sched_getcpu();
+  return percpu_get_cpu();
 }
 
 int process_set_affinity(pid_t pid, int* cpus, size_t cpus_size)
@@ -229,11 +545,17 @@ int process_get_priority(pid_t pid)
 
 int thread_set_priority(pthread_t th, int priority)
 {
-  pid_t tid = syscall(SYS_gettid);
+  pid_t tid = thread_registry_get_tid(th);
   struct sched_param param;
   int policy = 0;
   int ret = 0;
 
+  /* thread is neither the caller nor registered */
+  if(tid == -1)
+  {
+    return -1;
+  }
+
   ret = pthread_getschedparam(th, &policy, &param);
   if(ret != 0)
   {
@@ -253,11 +575,16 @@ int thread_set_priority(pthread_t th, int priority)
 
 int thread_get_priority(pthread_t th)
 {
-  pid_t tid = syscall(SYS_gettid);
+  pid_t tid = thread_registry_get_tid(th);
   struct sched_param param;
   int policy = 0;
   int ret = 0;
 
+  if(tid == -1)
+  {
+    return -1;
+  }
+
   ret = pthread_getschedparam(th, &policy, &param);
   if(ret != 0)
   {
@@ -275,6 +602,32 @@ int thread_get_priority(pthread_t th)
   return getpriority(PRIO_PROCESS, tid);
 }
 
+int thread_attr_init_timesharing(pthread_attr_t* attr)
+{
+  struct sched_param param;
+  int ret = 0;
+
+  ret = pthread_attr_init(attr);
+  if(ret != 0)
+  {
+    errno = ret;
+    return -1;
+  }
+
+  /* by default a thread inherits the real-time policy of its creator */
+  memset(&param, 0x00, sizeof(struct sched_param));
+  if(pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED) != 0 ||
+      pthread_attr_setschedpolicy(attr, SCHED_OTHER) != 0 ||
+      pthread_attr_setschedparam(attr, &param) != 0)
+  {
+    pthread_attr_destroy(attr);
+    errno = EINVAL;
+    return -1;
+  }
+
+  return 0;
+}
+
 int process_set_rt_priority(pid_t pid, struct rt_prio* priority)
 {
   struct sched_param param;
@@ -285,6 +638,11 @@ int process_set_rt_priority(pid_t pid, struct rt_prio* priority)
     return -1;
   }
 
+  if(rt_allow_priority(priority) != 0)
+  {
+    return -1;
+  }
+
   memset(&param, 0x00, sizeof(struct sched_param));
   param.sched_priority = priority->priority;
 
@@ -331,13 +689,19 @@ int thread_set_rt_priority(pthread_t th, struct rt_prio* priority)
     return -1;
   }
 
+  if(rt_allow_priority(priority) != 0)
+  {
+    return -1;
+  }
+
   memset(&param, 0x00, sizeof(struct sched_param));
   param.sched_priority = priority->priority;
 
   ret = pthread_setschedparam(th, priority->policy, &param);
   if(ret != 0)
   {
-    return ret;
+    errno = ret;
+    return -1;
   }
 
   return 0;
@@ -367,154 +731,783 @@ int thread_get_rt_priority(pthread_t th, struct rt_prio* priority)
   return 0;
 }
 
-int cpufreq_set_governor_all(enum cpufreq_governor mode)
+int process_set_uclamp(pid_t pid, struct rt_prio* priority,
+    struct rt_uclamp* uclamp)
 {
-  long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  struct rt_sched_attr attr;
 
-  for(long i = 0 ; i < nb_cpus ; i++)
+  if(!uclamp || uclamp->util_min > uclamp->util_max ||
+      uclamp->util_max > RT_UCLAMP_MAX)
   {
-    if(cpufreq_set_governor(mode, i) == -1)
-    {
-      return -1;
-    }
+    errno = EINVAL;
+    return -1;
   }
 
-  return 0;
-}
-
-int cpufreq_set_governor(enum cpufreq_governor mode, unsigned int cpu)
-{
-  long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
-  char path[256];
-  const char* governor = NULL;
-  int ret = 0;
-  int fd = -1;
+  if(!rt_caps_get()->uclamp)
+  {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
 
-  if(cpu >= nb_cpus)
+  /* start from current attributes to keep the nice value */
+  memset(&attr, 0x00, sizeof(struct rt_sched_attr));
+  if(rt_sched_getattr(pid, &attr) != 0)
   {
     return -1;
   }
 
-  snprintf(path, sizeof(path), CPUFREQ_GOVERNOR_PATH, cpu);
-  path[sizeof(path) - 1] = 0x00;
+  attr.size = sizeof(struct rt_sched_attr);
+  attr.sched_flags = (attr.sched_flags & RT_SCHED_FLAG_RESET_ON_FORK) |
+    RT_SCHED_FLAG_UTIL_CLAMP_MIN | RT_SCHED_FLAG_UTIL_CLAMP_MAX;
+  attr.sched_util_min = uclamp->util_min;
+  attr.sched_util_max = uclamp->util_max;
 
-  fd = open(path, O_WRONLY);
+  if(priority)
+  {
+    attr.sched_policy = priority->policy;
+    attr.sched_priority = priority->priority;
+  }
+  else
+  {
+    attr.sched_flags |= RT_SCHED_FLAG_KEEP_POLICY |
+      RT_SCHED_FLAG_KEEP_PARAMS;
+  }
 
-  if(fd == -1)
+  return rt_sched_setattr(pid, &attr);
+}
+
+int process_get_uclamp(pid_t pid, struct rt_uclamp* uclamp)
+{
+  struct rt_sched_attr attr;
+
+  if(!uclamp)
   {
+    errno = EINVAL;
     return -1;
   }
 
-  switch(mode)
+  if(!rt_caps_get()->uclamp)
   {
-    case CPUFREQ_POWERSAVE:
-      governor = "powersave";
-      break;
-    case CPUFREQ_PERFORMANCE:
-      governor = "performance";
-      break;
-    case CPUFREQ_ONDEMAND:
-      governor = "ondemand";
-      break;
-    case CPUFREQ_CONSERVATIVE:
-      governor = "conservative";
-      break;
-    default:
-      governor = NULL;
-      break;
+    errno = EOPNOTSUPP;
+    return -1;
   }
 
-  if(!governor)
+  memset(&attr, 0x00, sizeof(struct rt_sched_attr));
+  if(rt_sched_getattr(pid, &attr) != 0)
   {
     return -1;
   }
 
-  ret = write(fd, governor, strlen(governor));
-  close(fd);
-
-  if(ret == -1)
+  /* kernel without utilization clamping returns a smaller structure */
+  if(attr.size < sizeof(struct rt_sched_attr))
   {
+    errno = EOPNOTSUPP;
     return -1;
   }
 
+  uclamp->util_min = attr.sched_util_min;
+  uclamp->util_max = attr.sched_util_max;
+
   return 0;
 }
 
-enum cpufreq_governor cpufreq_get_governor(unsigned int cpu)
+int thread_set_uclamp(pthread_t th, struct rt_prio* priority,
+    struct rt_uclamp* uclamp)
 {
-  long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
-  char path[256];
-  char value[256];
-  int ret = 0;
-  int fd = -1;
+  pid_t tid = thread_registry_get_tid(th);
 
-  if(cpu >= nb_cpus)
+  if(tid == -1)
   {
     return -1;
   }
 
-  snprintf(path, sizeof(path), CPUFREQ_GOVERNOR_PATH, cpu);
-  path[sizeof(path) - 1] = 0x00;
+  /* WARNING non-portable: on Linux, scheduling attributes are per-thread */
+  return process_set_uclamp(tid, priority, uclamp);
+}
 
-  fd = open(path, O_WRONLY);
+int thread_get_uclamp(pthread_t th, struct rt_uclamp* uclamp)
+{
+  pid_t tid = thread_registry_get_tid(th);
 
-  if(fd == -1)
+  if(tid == -1)
   {
-    return CPUFREQ_OTHER;
+    return -1;
   }
 
-  ret = read(fd, value, sizeof(value));
-  value[sizeof(value) - 1] = 0x00;
-  close(fd);
+  return process_get_uclamp(tid, uclamp);
+}
 
-  if(ret == -1)
+/**
+ * \brief Builds the path of a cpufreq file of a CPU.
+ * \param buf buffer that will receive the path.
+ * \param size size of the buffer.
+ * \param cpu CPU id.
+ * \param file name of the file.
+ * \return 0 if success, -1 otherwise.
+ */
+static int cpufreq_path(char* buf, size_t size, unsigned int cpu,
+    const char* file)
+{
+  long nb_cpus = sysconf(_SC_NPROCESSORS_CONF);
+
+  if(nb_cpus <= 0 || cpu >= (unsigned long)nb_cpus)
   {
-    return CPUFREQ_OTHER;
+    errno = EINVAL;
+    return -1;
   }
 
-  if(!strcmp(value, "powersave"))
+  snprintf(buf, size, CPUFREQ_PATH, cpu, file);
+  buf[size - 1] = 0x00;
+  return 0;
+}
+
+/**
+ * \brief Reads a frequency (or any unsigned value) of a CPU.
+ * \param cpu CPU id.
+ * \param file name of the file.
+ * \param value pointer that will receive the value.
+ * \return 0 if success, -1 otherwise.
+ */
+static int cpufreq_read(unsigned int cpu, const char* file,
+    unsigned long* value)
+{
+  char path[256];
+  long ret = 0;
+
+  if(cpufreq_path(path, sizeof(path), cpu, file) != 0 ||
+      sysfs_read_long(path, &ret) != 0)
   {
-    return CPUFREQ_POWERSAVE;
+    return -1;
   }
-  else if(!strcmp(value, "performance"))
+
+  *value = (unsigned long)ret;
+  return 0;
+}
+
+/**
+ * \brief Writes a frequency (or any unsigned value) of a CPU.
+ * \param cpu CPU id.
+ * \param file name of the file.
+ * \param value value to write.
+ * \return 0 if success, -1 otherwise.
+ */
+static int cpufreq_write(unsigned int cpu, const char* file,
+    unsigned long value)
+{
+  char path[256];
+
+  if(cpufreq_path(path, sizeof(path), cpu, file) != 0 ||
+      tuning_record(path) != 0)
   {
-    return CPUFREQ_PERFORMANCE;
+    return -1;
   }
-  else if(!strcmp(value, "ondemand")) 
+
+  return sysfs_write_long(path, (long)value);
+}
+
+int cpufreq_set_governor_all(enum cpufreq_governor mode)
+{
+  long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  for(long i = 0 ; i < nb_cpus ; i++)
   {
-    return CPUFREQ_ONDEMAND;
+    if(cpufreq_set_governor(mode, i) == -1)
+    {
+      return -1;
+    }
   }
-  else if(!strcmp(value, "conservative"))
+
+  return 0;
+}
+
+int cpufreq_set_governor(enum cpufreq_governor mode, unsigned int cpu)
+{
+  size_t nb = sizeof(CPUFREQ_GOVERNOR_NAMES) / sizeof(const char*);
+
+  if(mode < 0 || (size_t)mode >= nb)
   {
-    return CPUFREQ_CONSERVATIVE;
+    errno = EINVAL;
+    return -1;
   }
-  else
+
+  return cpufreq_set_governor_name(CPUFREQ_GOVERNOR_NAMES[mode], cpu);
+}
+
+enum cpufreq_governor cpufreq_get_governor(unsigned int cpu)
+{
+  size_t nb = sizeof(CPUFREQ_GOVERNOR_NAMES) / sizeof(const char*);
+  char value[CPUFREQ_NAME_SIZE];
+
+  if(cpufreq_get_governor_name(cpu, value, sizeof(value)) != 0)
   {
     return CPUFREQ_OTHER;
   }
+
+  for(size_t i = 0 ; i < nb ; i++)
+  {
+    if(!strcmp(value, CPUFREQ_GOVERNOR_NAMES[i]))
+    {
+      return (enum cpufreq_governor)i;
+    }
+  }
+
+  return CPUFREQ_OTHER;
 }
 
-int thread_periodic_task(void (*fcn)(void*), void* data, unsigned long period)
+int cpufreq_set_governor_name(const char* name, unsigned int cpu)
 {
-    struct timespec time;
-    sigset_t mask;
+  char path[256];
 
-    sigfillset(&mask);
-    sigdelset(&mask, SIGTERM);
-    if(pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0)
+  if(!name || name[0] == 0x00 || strlen(name) >= CPUFREQ_NAME_SIZE)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(cpufreq_path(path, sizeof(path), cpu, "scaling_governor") != 0 ||
+      tuning_record(path) != 0)
+  {
+    return -1;
+  }
+
+  return sysfs_write_str(path, name);
+}
+
+int cpufreq_get_governor_name(unsigned int cpu, char* name, size_t size)
+{
+  char path[256];
+
+  if(cpufreq_path(path, sizeof(path), cpu, "scaling_governor") != 0)
+  {
+    return -1;
+  }
+
+  return sysfs_read_str(path, name, size) == -1 ? -1 : 0;
+}
+
+int cpufreq_get_available_governors(unsigned int cpu,
+    char names[][CPUFREQ_NAME_SIZE], size_t size)
+{
+  char path[256];
+  char value[512];
+  char* saveptr = NULL;
+  char* token = NULL;
+  int nb = 0;
+
+  if(cpufreq_path(path, sizeof(path), cpu,
+        "scaling_available_governors") != 0 ||
+      sysfs_read_str(path, value, sizeof(value)) == -1)
+  {
+    return -1;
+  }
+
+  for(token = strtok_r(value, " \n", &saveptr) ; token ;
+      token = strtok_r(NULL, " \n", &saveptr))
+  {
+    if(names)
     {
+      if((size_t)nb >= size)
+      {
+        break;
+      }
+
+      snprintf(names[nb], CPUFREQ_NAME_SIZE, "%s", token);
+    }
+    nb++;
+  }
+
+  return nb;
+}
+
+int cpufreq_get_available_frequencies(unsigned int cpu, unsigned long* freqs,
+    size_t size)
+{
+  char path[256];
+  char value[1024];
+  char* p = value;
+  int nb = 0;
+
+  if(cpufreq_path(path, sizeof(path), cpu,
+        "scaling_available_frequencies") != 0 ||
+      sysfs_read_str(path, value, sizeof(value)) == -1)
+  {
+    return -1;
+  }
+
+  while(*p)
+  {
+    char* end = NULL;
+    unsigned long freq = strtoul(p, &end, 10);
+
+    if(end == p)
+    {
+      break;
+    }
+    p = end;
+
+    if(freqs)
+    {
+      if((size_t)nb >= size)
+      {
+        break;
+      }
+      freqs[nb] = freq;
+    }
+    nb++;
+  }
+
+  return nb;
+}
+
+int cpufreq_get_hw_limits(unsigned int cpu, unsigned long* min,
+    unsigned long* max)
+{
+  if(!min || !max)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(cpufreq_read(cpu, "cpuinfo_min_freq", min) != 0 ||
+      cpufreq_read(cpu, "cpuinfo_max_freq", max) != 0)
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
+int cpufreq_get_limits(unsigned int cpu, unsigned long* min,
+    unsigned long* max)
+{
+  if(!min || !max)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(cpufreq_read(cpu, "scaling_min_freq", min) != 0 ||
+      cpufreq_read(cpu, "scaling_max_freq", max) != 0)
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
+int cpufreq_set_limits(unsigned int cpu, unsigned long min,
+    unsigned long max)
+{
+  unsigned long cur_max = 0;
+
+  if(min > max)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(cpufreq_read(cpu, "scaling_max_freq", &cur_max) != 0)
+  {
+    return -1;
+  }
+
+  /* kernel refuses a minimum above the current maximum */
+  if(min > cur_max)
+  {
+    if(cpufreq_write(cpu, "scaling_max_freq", max) != 0 ||
+        cpufreq_write(cpu, "scaling_min_freq", min) != 0)
+    {
+      return -1;
+    }
+  }
+  else if(cpufreq_write(cpu, "scaling_min_freq", min) != 0 ||
+      cpufreq_write(cpu, "scaling_max_freq", max) != 0)
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
+int cpufreq_set_frequency(unsigned int cpu, unsigned long freq)
+{
+  char names[16][CPUFREQ_NAME_SIZE];
+  int nb = cpufreq_get_available_governors(cpu, names, 16);
+
+  for(int i = 0 ; i < nb ; i++)
+  {
+    if(!strcmp(names[i], CPUFREQ_GOVERNOR_NAMES[CPUFREQ_USERSPACE]))
+    {
+      if(cpufreq_set_governor(CPUFREQ_USERSPACE, cpu) != 0)
+      {
         return -1;
+      }
+
+      return cpufreq_write(cpu, "scaling_setspeed", freq);
     }
+  }
 
-    clock_gettime(CLOCK_MONOTONIC, &time);
+  /* no userspace governor (i.e. intel_pstate), pin the limits */
+  return cpufreq_set_limits(cpu, freq, freq);
+}
+
+unsigned long cpufreq_get_frequency(unsigned int cpu)
+{
+  unsigned long freq = 0;
 
-    while(1)
+  if(cpufreq_read(cpu, "scaling_cur_freq", &freq) != 0)
+  {
+    return 0;
+  }
+
+  return freq;
+}
+
+int cpufreq_get_policy_cpus(unsigned int cpu, int* cpus, size_t cpus_size)
+{
+  char path[256];
+  char value[1024];
+
+  if(cpufreq_path(path, sizeof(path), cpu, "related_cpus") != 0 ||
+      sysfs_read_str(path, value, sizeof(value)) == -1)
+  {
+    return -1;
+  }
+
+  /* related_cpus is a list of CPUs separated by spaces */
+  for(char* p = value ; *p ; p++)
+  {
+    if(*p == ' ')
     {
-        unsigned long nano = 0;
-        unsigned long second = 0;
+      *p = ',';
+    }
+  }
+
+  return cpulist_parse(value, cpus, cpus_size);
+}
+
+void rt_hist_init(struct rt_hist* hist)
+{
+  for(size_t i = 0 ; i < RT_HIST_BUCKETS ; i++)
+  {
+    atomic_init(&hist->counts[i], 0);
+  }
+
+  atomic_init(&hist->total, 0);
+  atomic_init(&hist->sum, 0);
+  atomic_init(&hist->min, UINT64_MAX);
+  atomic_init(&hist->max, 0);
+}
+
+size_t rt_hist_bucket_index(uint64_t value)
+{
+  unsigned int msb = 0;
+
+  if(value < (1 << RT_HIST_SUB_BITS))
+  {
+    return (size_t)value;
+  }
+
+  /* range [2^msb, 2^(msb+1)[ is split in 2^RT_HIST_SUB_BITS buckets */
+  msb = 63 - __builtin_clzll(value);
+  return ((size_t)(msb - RT_HIST_SUB_BITS + 1) << RT_HIST_SUB_BITS) +
+    (size_t)((value >> (msb - RT_HIST_SUB_BITS)) - (1 << RT_HIST_SUB_BITS));
+}
+
+uint64_t rt_hist_bucket_lower(size_t index)
+{
+  size_t group = index >> RT_HIST_SUB_BITS;
+  uint64_t sub = index & ((1 << RT_HIST_SUB_BITS) - 1);
+
+  if(group == 0)
+  {
+    return (uint64_t)index;
+  }
+
+  return ((1 << RT_HIST_SUB_BITS) + sub) << (group - 1);
+}
+
+uint64_t rt_hist_bucket_upper(size_t index)
+{
+  size_t group = index >> RT_HIST_SUB_BITS;
+
+  if(group == 0)
+  {
+    return (uint64_t)index;
+  }
+
+  return rt_hist_bucket_lower(index) + (((uint64_t)1 << (group - 1)) - 1);
+}
+
+void rt_hist_record(struct rt_hist* hist, uint64_t value)
+{
+  _Atomic uint64_t* count = &hist->counts[rt_hist_bucket_index(value)];
+
+  /* single writer: plain load/store, atomic only for concurrent readers */
+  atomic_store_explicit(count,
+      atomic_load_explicit(count, memory_order_relaxed) + 1,
+      memory_order_relaxed);
+  atomic_store_explicit(&hist->sum,
+      atomic_load_explicit(&hist->sum, memory_order_relaxed) + value,
+      memory_order_relaxed);
+
+  if(value < atomic_load_explicit(&hist->min, memory_order_relaxed))
+  {
+    atomic_store_explicit(&hist->min, value, memory_order_relaxed);
+  }
+
+  if(value > atomic_load_explicit(&hist->max, memory_order_relaxed))
+  {
+    atomic_store_explicit(&hist->max, value, memory_order_relaxed);
+  }
+
+  atomic_store_explicit(&hist->total,
+      atomic_load_explicit(&hist->total, memory_order_relaxed) + 1,
+      memory_order_release);
+}
+
+void rt_hist_record_shared(struct rt_hist* hist, uint64_t value)
+{
+  uint64_t current = 0;
+
+  atomic_fetch_add_explicit(&hist->counts[rt_hist_bucket_index(value)], 1,
+      memory_order_relaxed);
+  atomic_fetch_add_explicit(&hist->sum, value, memory_order_relaxed);
+
+  current = atomic_load_explicit(&hist->min, memory_order_relaxed);
+  while(value < current && !atomic_compare_exchange_weak_explicit(&hist->min,
+        &current, value, memory_order_relaxed, memory_order_relaxed))
+  {
+  }
+
+  current = atomic_load_explicit(&hist->max, memory_order_relaxed);
+  while(value > current && !atomic_compare_exchange_weak_explicit(&hist->max,
+        &current, value, memory_order_relaxed, memory_order_relaxed))
+  {
+  }
+
+  atomic_fetch_add_explicit(&hist->total, 1, memory_order_release);
+}
+
+void rt_hist_merge(struct rt_hist* dst, const struct rt_hist* src)
+{
+  uint64_t min = atomic_load_explicit(&src->min, memory_order_relaxed);
+  uint64_t max = atomic_load_explicit(&src->max, memory_order_relaxed);
+
+  for(size_t i = 0 ; i < RT_HIST_BUCKETS ; i++)
+  {
+    uint64_t count = atomic_load_explicit(&src->counts[i],
+        memory_order_relaxed);
+
+    if(count)
+    {
+      atomic_fetch_add_explicit(&dst->counts[i], count, memory_order_relaxed);
+    }
+  }
+
+  atomic_fetch_add_explicit(&dst->sum,
+      atomic_load_explicit(&src->sum, memory_order_relaxed),
+      memory_order_relaxed);
+
+  if(min < atomic_load_explicit(&dst->min, memory_order_relaxed))
+  {
+    atomic_store_explicit(&dst->min, min, memory_order_relaxed);
+  }
+
+  if(max > atomic_load_explicit(&dst->max, memory_order_relaxed))
+  {
+    atomic_store_explicit(&dst->max, max, memory_order_relaxed);
+  }
+
+  atomic_fetch_add_explicit(&dst->total,
+      atomic_load_explicit(&src->total, memory_order_acquire),
+      memory_order_release);
+}
+
+uint64_t rt_hist_get_count(const struct rt_hist* hist)
+{
+  return atomic_load_explicit(&hist->total, memory_order_acquire);
+}
+
+uint64_t rt_hist_get_min(const struct rt_hist* hist)
+{
+  if(rt_hist_get_count(hist) == 0)
+  {
+    return 0;
+  }
+
+  return atomic_load_explicit(&hist->min, memory_order_relaxed);
+}
+
+uint64_t rt_hist_get_max(const struct rt_hist* hist)
+{
+  return atomic_load_explicit(&hist->max, memory_order_relaxed);
+}
+
+double rt_hist_get_mean(const struct rt_hist* hist)
+{
+  uint64_t total = rt_hist_get_count(hist);
+
+  if(total == 0)
+  {
+    return 0.0;
+  }
+
+  return (double)atomic_load_explicit(&hist->sum, memory_order_relaxed) /
+    (double)total;
+}
+
+uint64_t rt_hist_get_percentile(const struct rt_hist* hist,
+    double percentile)
+{
+  uint64_t total = 0;
+  uint64_t target = 0;
+  uint64_t cumul = 0;
+  uint64_t max = rt_hist_get_max(hist);
+
+  /* counts are summed instead of using total that can be updated later */
+  for(size_t i = 0 ; i < RT_HIST_BUCKETS ; i++)
+  {
+    total += atomic_load_explicit(&hist->counts[i], memory_order_relaxed);
+  }
+
+  if(total == 0)
+  {
+    return 0;
+  }
+
+  if(percentile < 0.0)
+  {
+    percentile = 0.0;
+  }
+  else if(percentile > 100.0)
+  {
+    percentile = 100.0;
+  }
+
+  target = (uint64_t)((percentile / 100.0) * (double)total + 0.5);
+  if(target == 0)
+  {
+    target = 1;
+  }
+
+  for(size_t i = 0 ; i < RT_HIST_BUCKETS ; i++)
+  {
+    cumul += atomic_load_explicit(&hist->counts[i], memory_order_relaxed);
+
+    if(cumul >= target)
+    {
+      uint64_t upper = rt_hist_bucket_upper(i);
+
+      return upper < max ? upper : max;
+    }
+  }
+
+  return max;
+}
+
+int rt_hist_export(const struct rt_hist* hist, FILE* f)
+{
+  if(!hist || !f)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for(size_t i = 0 ; i < RT_HIST_BUCKETS ; i++)
+  {
+    uint64_t count = atomic_load_explicit(&hist->counts[i],
+        memory_order_relaxed);
+
+    if(count == 0)
+    {
+      continue;
+    }
+
+    if(fprintf(f, "%llu,%llu,%llu\n",
+          (unsigned long long)rt_hist_bucket_lower(i),
+          (unsigned long long)rt_hist_bucket_upper(i),
+          (unsigned long long)count) < 0)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * \struct periodic_task_ctx
+ * \brief Resources of a periodic task released when it is canceled.
+ */
+struct periodic_task_ctx
+{
+    /**
+     * \brief Performance counters (valid is 0 if not used).
+     */
+    struct perfcnt pc;
+
+    /**
+     * \brief Painted stack.
+     */
+    struct stack_probe probe;
+
+    /**
+     * \brief Receives the stack high-water mark, NULL if not measured.
+     */
+    size_t* stack_peak;
+};
+
+/**
+ * \brief Releases the resources of a periodic task.
+ * \param arg context of the task.
+ */
+static void periodic_task_cleanup(void* arg)
+{
+    struct periodic_task_ctx* ctx = arg;
+
+    perfcnt_close(&ctx->pc);
+
+    if(ctx->stack_peak)
+    {
+        *ctx->stack_peak = stack_probe_get_peak(&ctx->probe);
+    }
+}
+
+int thread_periodic_task(void (*fcn)(void*), void* data, unsigned long period)
+{
+    return thread_periodic_task_attr(fcn, data, period, NULL);
+}
+
+/**
+ * \brief Runs the cycles of a periodic task.
+ * \param fcn function to call periodically.
+ * \param data data to pass to the function.
+ * \param period period in nanoseconds.
+ * \param attr attributes.
+ * \param pc performance counters (valid is 0 if not used).
+ * \note This function never returns, the thread leaves it when canceled.
+ */
+static void periodic_task_loop(void (*fcn)(void*), void* data,
+    unsigned long period, const struct periodic_task_attr* attr,
+    struct perfcnt* pc)
+{
+    struct timespec time;
+    unsigned long nano = period % 1000000000;
+    unsigned long second = period / 1000000000;
+    int trace_stopped = 0;
+    int timed = attr->wakeup_hist || attr->exec_hist || attr->trace ||
+        attr->trace_stop_latency || attr->cycle_stats;
 
-        second = period / 1000000000;
-        nano = period % 1000000000;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    for(unsigned long long cycle = 0 ; ; cycle++)
+    {
+        struct periodic_cycle_stats stats;
+        struct perfcnt_values before;
+        uint64_t expected = 0;
+        uint64_t wakeup = 0;
+        uint64_t start = 0;
 
         time.tv_sec += second;
         time.tv_nsec += nano;
@@ -522,18 +1515,154 @@ int thread_periodic_task(void (*fcn)(void*), void* data, unsigned long period)
         if(time.tv_nsec >= 1000000000)
         {
             time.tv_sec++;
-            nano -= 1000000000;
+            time.tv_nsec -= 1000000000;
         }
-        
+
         pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
-        /* thread can be terminated here if pthread_cancel is used! */
         clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, NULL);
         pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
 
+        /* pending pthread_cancel is honored even if fcn never reaches a
+         * cancellation point
+         */
+        pthread_testcancel();
+
+        memset(&stats, 0x00, sizeof(struct periodic_cycle_stats));
+        stats.cycle = cycle;
+
+        if(timed)
+        {
+            struct timespec now;
+
+            /* deadline is on CLOCK_MONOTONIC, TSC only measures deltas */
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            start = tsc_now_ns();
+            expected = (uint64_t)time.tv_sec * 1000000000 +
+                (uint64_t)time.tv_nsec;
+            wakeup = (uint64_t)now.tv_sec * 1000000000 +
+                (uint64_t)now.tv_nsec;
+            stats.latency = wakeup > expected ? wakeup - expected : 0;
+
+            if(attr->wakeup_hist)
+            {
+                rt_hist_record(attr->wakeup_hist, stats.latency);
+            }
+
+            if(attr->trace)
+            {
+                trace_marker("cycle %llu start latency %llu ns", cycle,
+                    (unsigned long long)stats.latency);
+            }
+
+            if(attr->trace_stop_latency && !trace_stopped &&
+                stats.latency > attr->trace_stop_latency)
+            {
+                trace_marker("cycle %llu latency %llu ns exceeds %lu ns",
+                    cycle, (unsigned long long)stats.latency,
+                    attr->trace_stop_latency);
+                trace_stop();
+                trace_stopped = 1;
+            }
+        }
+
+        if(pc->valid && perfcnt_read(pc, &before) != 0)
+        {
+            before.valid = 0;
+        }
+
         /* task to execute */
         fcn(data);
+
+        if(pc->valid)
+        {
+            struct perfcnt_values after;
+
+            if(before.valid && perfcnt_read(pc, &after) == 0)
+            {
+                perfcnt_delta(&before, &after, &stats.perf);
+            }
+        }
+
+        if(attr->heartbeat)
+        {
+            watchdog_feed(attr->heartbeat);
+        }
+
+        if(timed)
+        {
+            uint64_t end = tsc_now_ns();
+
+            stats.exec_time = end - start;
+
+            if(attr->exec_hist)
+            {
+                rt_hist_record(attr->exec_hist, stats.exec_time);
+            }
+
+            if(attr->trace)
+            {
+                trace_marker("cycle %llu end", cycle);
+
+                if(wakeup + stats.exec_time > expected + period)
+                {
+                    trace_marker("cycle %llu overrun %llu ns", cycle,
+                        (unsigned long long)(wakeup + stats.exec_time -
+                            expected - period));
+                }
+            }
+
+            if(attr->cycle_stats)
+            {
+                attr->cycle_stats(&stats, data);
+            }
+        }
+    }
+}
+
+int thread_periodic_task_attr(void (*fcn)(void*), void* data,
+    unsigned long period, const struct periodic_task_attr* attr)
+{
+    struct periodic_task_attr cfg;
+    struct periodic_task_ctx ctx;
+    sigset_t mask;
+
+    memset(&cfg, 0x00, sizeof(struct periodic_task_attr));
+    if(attr)
+    {
+        cfg = *attr;
     }
 
+    sigfillset(&mask);
+    sigdelset(&mask, SIGTERM);
+    if(pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0)
+    {
+        return -1;
+    }
+
+    memset(&ctx, 0x00, sizeof(struct periodic_task_ctx));
+    for(int i = 0 ; i < PERFCNT_NB ; i++)
+    {
+        ctx.pc.fds[i] = -1;
+    }
+
+    if(cfg.perf)
+    {
+        perfcnt_open(&ctx.pc, 0);
+    }
+
+    /* everything below this frame is used by the cycles */
+    if(cfg.stack_paint && cfg.stack_peak &&
+        stack_probe_init(&ctx.probe, cfg.stack_paint) == 0)
+    {
+        ctx.stack_peak = cfg.stack_peak;
+    }
+
+    /* counters are closed and stack peak reported when the thread is
+     * canceled
+     */
+    pthread_cleanup_push(periodic_task_cleanup, &ctx);
+    periodic_task_loop(fcn, data, period, &cfg, &ctx.pc);
+    pthread_cleanup_pop(1);
+
     return 0;
 }
-
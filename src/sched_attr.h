@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file sched_attr.h
+ * \brief Internal wrappers for sched_setattr/sched_getattr system calls.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_SCHED_ATTR_H
+#define RTVSUTILS_SCHED_ATTR_H
+
+#include <stdint.h>
+
+#include <unistd.h>
+#include <syscall.h>
+
+#ifndef SCHED_DEADLINE
+/**
+ * \brief Deadline scheduling policy (not always exported by the C library).
+ */
+#define SCHED_DEADLINE 6
+#endif
+
+/**
+ * \brief Children do not inherit privileged policies.
+ */
+#define RT_SCHED_FLAG_RESET_ON_FORK 0x01
+
+/**
+ * \brief Keep the current policy (Linux 5.3).
+ */
+#define RT_SCHED_FLAG_KEEP_POLICY 0x08
+
+/**
+ * \brief Keep the current parameters (Linux 5.3).
+ */
+#define RT_SCHED_FLAG_KEEP_PARAMS 0x10
+
+/**
+ * \brief Utilization clamp minimum is set (Linux 5.3).
+ */
+#define RT_SCHED_FLAG_UTIL_CLAMP_MIN 0x20
+
+/**
+ * \brief Utilization clamp maximum is set (Linux 5.3).
+ */
+#define RT_SCHED_FLAG_UTIL_CLAMP_MAX 0x40
+
+/**
+ * \struct rt_sched_attr
+ * \brief Kernel struct sched_attr (size 56 with utilization clamping).
+ */
+struct rt_sched_attr
+{
+  uint32_t size;
+  uint32_t sched_policy;
+  uint64_t sched_flags;
+  int32_t sched_nice;
+  uint32_t sched_priority;
+  uint64_t sched_runtime;
+  uint64_t sched_deadline;
+  uint64_t sched_period;
+  uint32_t sched_util_min;
+  uint32_t sched_util_max;
+};
+
+/**
+ * \brief Sets scheduling attributes of a kernel thread.
+ * \param tid kernel thread identifier (0 for the calling thread).
+ * \param attr attributes.
+ * \return 0 if success, -1 otherwise.
+ */
+static inline int rt_sched_setattr(pid_t tid, struct rt_sched_attr* attr)
+{
+  return (int)syscall(SYS_sched_setattr, tid, attr, 0);
+}
+
+/**
+ * \brief Returns scheduling attributes of a kernel thread.
+ * \param tid kernel thread identifier (0 for the calling thread).
+ * \param attr attributes.
+ * \return 0 if success, -1 otherwise.
+ */
+static inline int rt_sched_getattr(pid_t tid, struct rt_sched_attr* attr)
+{
+  return (int)syscall(SYS_sched_getattr, tid, attr,
+      (unsigned int)sizeof(struct rt_sched_attr), 0);
+}
+
+#endif /* RTVSUTILS_SCHED_ATTR_H */
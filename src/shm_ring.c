@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file shm_ring.c
+ * \brief Lock-free shared-memory message ring between processes.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm_ring.h"
+#include "rt_event.h"
+#include "rt_sync.h"
+
+/**
+ * \brief Magic number of the shared header ("RTRG").
+ */
+#define SHM_RING_MAGIC 0x52545247
+
+/**
+ * \brief Version of the shared layout.
+ */
+#define SHM_RING_VERSION 1
+
+/**
+ * \brief Offset of the message in a slot (keeps maximum alignment).
+ */
+#define SHM_RING_MSG_OFFSET 16
+
+/**
+ * \struct shm_ring_header
+ * \brief Shared header, each index has its own cache line.
+ */
+struct shm_ring_header
+{
+  /**
+   * \brief SHM_RING_MAGIC.
+   */
+  uint32_t magic;
+
+  /**
+   * \brief SHM_RING_VERSION.
+   */
+  uint32_t version;
+
+  /**
+   * \brief Flags of the ring (SHM_RING_*).
+   */
+  uint32_t flags;
+
+  /**
+   * \brief Size of a message.
+   */
+  uint32_t msg_size;
+
+  /**
+   * \brief Size of a slot.
+   */
+  uint64_t slot_size;
+
+  /**
+   * \brief Number of slots.
+   */
+  uint64_t capacity;
+
+  /**
+   * \brief Next position to reserve (producers).
+   */
+  _Alignas(RT_CACHE_LINE) _Atomic uint64_t head;
+
+  /**
+   * \brief Next position to read (consumer).
+   */
+  _Alignas(RT_CACHE_LINE) _Atomic uint64_t tail;
+
+  /**
+   * \brief Signaled on commit if SHM_RING_WAKEUP.
+   */
+  _Alignas(RT_CACHE_LINE) struct rt_event event;
+};
+
+/**
+ * \brief Size of the header rounded to a cache line.
+ */
+#define SHM_RING_HEADER_SIZE \
+  ((sizeof(struct shm_ring_header) + RT_CACHE_LINE - 1) & \
+   ~(size_t)(RT_CACHE_LINE - 1))
+
+/**
+ * \brief Describes the slots of a mapped ring.
+ *
+ * Each slot starts with its sequence number, the message follows at
+ * SHM_RING_MSG_OFFSET.
+ * \param ring ring.
+ * \return description of the slots.
+ */
+static inline struct rt_ring shm_ring_slots(const struct shm_ring* ring)
+{
+  struct rt_ring slots = {ring->slots, ring->slot_size, ring->mask};
+
+  return slots;
+}
+
+/**
+ * \brief Maps the shared memory and fills the ring structure.
+ * \param ring ring with fd set.
+ * \param size size of the mapping.
+ * \return 0 if success, negative value otherwise.
+ */
+static int shm_ring_map(struct shm_ring* ring, size_t size)
+{
+  void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring->fd, 0);
+
+  if(addr == MAP_FAILED)
+  {
+    return -1;
+  }
+
+  /* no page fault on the real-time path */
+  if(mlock(addr, size) != 0)
+  {
+    int err = errno;
+
+    munmap(addr, size);
+    errno = err;
+    return -1;
+  }
+
+  ring->header = addr;
+  ring->slots = (unsigned char*)addr + SHM_RING_HEADER_SIZE;
+  ring->map_size = size;
+  return 0;
+}
+
+/**
+ * \brief Reads the layout from a mapped header.
+ * \param ring ring.
+ */
+static void shm_ring_load(struct shm_ring* ring)
+{
+  ring->flags = ring->header->flags;
+  ring->msg_size = ring->header->msg_size;
+  ring->slot_size = ring->header->slot_size;
+  ring->mask = ring->header->capacity - 1;
+}
+
+int shm_ring_create(struct shm_ring* ring, const char* name, size_t msg_size,
+    size_t capacity, unsigned int flags)
+{
+  struct shm_ring_header* header = NULL;
+  struct rt_ring slots;
+  size_t slot_size = 0;
+  size_t size = 0;
+
+  if(msg_size == 0 || msg_size > UINT32_MAX || capacity < 2 ||
+      (capacity & (capacity - 1)) != 0 ||
+      (flags & ~(unsigned int)(SHM_RING_MPSC | SHM_RING_WAKEUP)) != 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  slot_size = (SHM_RING_MSG_OFFSET + msg_size + RT_CACHE_LINE - 1) &
+    ~(size_t)(RT_CACHE_LINE - 1);
+
+  if(capacity > (SIZE_MAX - SHM_RING_HEADER_SIZE) / slot_size)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  size = SHM_RING_HEADER_SIZE + capacity * slot_size;
+
+  if(name)
+  {
+    ring->fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  }
+  else
+  {
+    ring->fd = memfd_create("shm_ring", MFD_CLOEXEC);
+  }
+
+  if(ring->fd == -1)
+  {
+    return -1;
+  }
+
+  if(ftruncate(ring->fd, size) != 0 || shm_ring_map(ring, size) != 0)
+  {
+    int err = errno;
+
+    close(ring->fd);
+    if(name)
+    {
+      shm_unlink(name);
+    }
+    errno = err;
+    return -1;
+  }
+
+  header = ring->header;
+  header->msg_size = msg_size;
+  header->slot_size = slot_size;
+  header->capacity = capacity;
+  header->flags = flags;
+  atomic_init(&header->head, 0);
+  atomic_init(&header->tail, 0);
+  rt_event_init(&header->event, 1, 0);
+  shm_ring_load(ring);
+  slots = shm_ring_slots(ring);
+
+  for(uint64_t i = 0 ; i < capacity ; i++)
+  {
+    atomic_init(rt_ring_seq(&slots, i), i);
+  }
+
+  /* magic last: a ring is valid only once fully initialized */
+  header->version = SHM_RING_VERSION;
+  atomic_thread_fence(memory_order_release);
+  header->magic = SHM_RING_MAGIC;
+  return 0;
+}
+
+int shm_ring_open_fd(struct shm_ring* ring, int fd)
+{
+  const struct shm_ring_header* header = NULL;
+  struct stat st;
+
+  errno = 0;
+  ring->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+
+  if(ring->fd == -1)
+  {
+    return -1;
+  }
+
+  if(fstat(ring->fd, &st) != 0 ||
+      (size_t)st.st_size < SHM_RING_HEADER_SIZE ||
+      shm_ring_map(ring, st.st_size) != 0)
+  {
+    /* too small to hold a header */
+    int err = (errno == 0) ? EINVAL : errno;
+
+    close(ring->fd);
+    errno = err;
+    return -1;
+  }
+
+  header = ring->header;
+  atomic_thread_fence(memory_order_acquire);
+
+  if(header->magic != SHM_RING_MAGIC || header->version != SHM_RING_VERSION ||
+      header->capacity < 2 || (header->capacity & (header->capacity - 1)) ||
+      header->slot_size < SHM_RING_MSG_OFFSET + header->msg_size ||
+      (uint64_t)st.st_size != SHM_RING_HEADER_SIZE +
+      header->capacity * header->slot_size)
+  {
+    shm_ring_close(ring);
+    errno = EINVAL;
+    return -1;
+  }
+
+  shm_ring_load(ring);
+  return 0;
+}
+
+int shm_ring_open(struct shm_ring* ring, const char* name)
+{
+  int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+  int ret = 0;
+
+  if(fd == -1)
+  {
+    return -1;
+  }
+
+  ret = shm_ring_open_fd(ring, fd);
+  close(fd);
+  return ret;
+}
+
+int shm_ring_get_fd(const struct shm_ring* ring)
+{
+  return ring->fd;
+}
+
+void shm_ring_close(struct shm_ring* ring)
+{
+  if(ring->header)
+  {
+    munmap(ring->header, ring->map_size);
+    ring->header = NULL;
+    ring->slots = NULL;
+  }
+
+  if(ring->fd != -1)
+  {
+    close(ring->fd);
+    ring->fd = -1;
+  }
+}
+
+int shm_ring_unlink(const char* name)
+{
+  return shm_unlink(name);
+}
+
+void* shm_ring_reserve(struct shm_ring* ring)
+{
+  struct rt_ring slots = shm_ring_slots(ring);
+  uint64_t pos = 0;
+  unsigned char* slot = rt_ring_reserve(&slots, &ring->header->head,
+      ring->flags & SHM_RING_MPSC, &pos);
+
+  if(!slot)
+  {
+    /* slot still holds the message of the previous lap */
+    errno = EAGAIN;
+    return NULL;
+  }
+
+  return slot + SHM_RING_MSG_OFFSET;
+}
+
+int shm_ring_commit(struct shm_ring* ring, void* msg)
+{
+  rt_ring_commit((unsigned char*)msg - SHM_RING_MSG_OFFSET);
+
+  if(ring->flags & SHM_RING_WAKEUP)
+  {
+    return rt_event_signal(&ring->header->event);
+  }
+
+  return 0;
+}
+
+int shm_ring_send(struct shm_ring* ring, const void* msg, size_t size)
+{
+  void* slot = NULL;
+
+  if(size > ring->msg_size)
+  {
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  slot = shm_ring_reserve(ring);
+
+  if(!slot)
+  {
+    return -1;
+  }
+
+  memcpy(slot, msg, size);
+  return shm_ring_commit(ring, slot);
+}
+
+const void* shm_ring_peek(struct shm_ring* ring)
+{
+  struct rt_ring slots = shm_ring_slots(ring);
+  uint64_t pos = 0;
+  const unsigned char* slot = rt_ring_take(&slots, &ring->header->tail, 0,
+      &pos);
+
+  return slot ? slot + SHM_RING_MSG_OFFSET : NULL;
+}
+
+void shm_ring_release(struct shm_ring* ring)
+{
+  struct rt_ring slots = shm_ring_slots(ring);
+  uint64_t pos = atomic_load_explicit(&ring->header->tail,
+      memory_order_relaxed);
+
+  /* slot becomes free for the producer of the next lap */
+  rt_ring_free(&slots, rt_ring_seq(&slots, pos), pos);
+  atomic_store_explicit(&ring->header->tail, pos + 1, memory_order_relaxed);
+}
+
+int shm_ring_receive(struct shm_ring* ring, void* msg, size_t size)
+{
+  const void* slot = shm_ring_peek(ring);
+
+  if(!slot)
+  {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  memcpy(msg, slot, size < ring->msg_size ? size : ring->msg_size);
+  shm_ring_release(ring);
+  return 0;
+}
+
+int shm_ring_wait(struct shm_ring* ring, const struct timespec* abstime)
+{
+  if(!(ring->flags & SHM_RING_WAKEUP))
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* a stale signal only costs one more check */
+  while(!shm_ring_peek(ring))
+  {
+    if(rt_event_timedwait(&ring->header->event, abstime) != 0 &&
+        errno != EINTR)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
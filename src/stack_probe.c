@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file stack_probe.c
+ * \brief Stack high-water mark measurement.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <pthread.h>
+
+#include "stack_probe.h"
+
+/**
+ * \brief Pattern of a painted word.
+ */
+#define STACK_PROBE_PATTERN ((uintptr_t)0xa5a5a5a5a5a5a5a5ULL)
+
+int stack_probe_init(struct stack_probe* probe, size_t size)
+{
+  volatile uintptr_t* word = NULL;
+  pthread_attr_t attr;
+  void* addr = NULL;
+  size_t stack_size = 0;
+  size_t guard = 0;
+  uintptr_t low = 0;
+  uintptr_t high = 0;
+  int ret = 0;
+
+  ret = pthread_getattr_np(pthread_self(), &attr);
+  if(ret == 0)
+  {
+    ret = pthread_attr_getstack(&attr, &addr, &stack_size);
+    pthread_attr_getguardsize(&attr, &guard);
+    pthread_attr_destroy(&attr);
+  }
+
+  if(ret != 0)
+  {
+    errno = ret;
+    return -1;
+  }
+
+  /* the frame of this function and its callees stay unpainted */
+  high = ((uintptr_t)&word - STACK_PROBE_MARGIN) &
+    ~(uintptr_t)(sizeof(uintptr_t) - 1);
+
+  /* skip guard and one more page, whether or not addr includes it */
+  low = (uintptr_t)addr + guard + sysconf(_SC_PAGESIZE);
+
+  if(high <= low)
+  {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  if(size > 0 && size < high - low)
+  {
+    low = (high - size) & ~(uintptr_t)(sizeof(uintptr_t) - 1);
+  }
+
+  for(word = (uintptr_t*)low ; (uintptr_t)word < high ; word++)
+  {
+    *word = STACK_PROBE_PATTERN;
+  }
+
+  probe->low = low;
+  probe->high = high;
+  probe->end = (uintptr_t)addr + stack_size;
+  return 0;
+}
+
+size_t stack_probe_get_peak(const struct stack_probe* probe)
+{
+  const volatile uintptr_t* word = (const uintptr_t*)probe->low;
+
+  /* stack grows down: the lowest overwritten word is the peak */
+  while((uintptr_t)word < probe->high && *word == STACK_PROBE_PATTERN)
+  {
+    word++;
+  }
+
+  return probe->end - (uintptr_t)word;
+}
+
+size_t stack_probe_get_capacity(const struct stack_probe* probe)
+{
+  return probe->end - probe->low;
+}
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file sysfs.c
+ * \brief Internal helpers to access sysfs, procfs and cgroupfs files.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "sysfs.h"
+
+int sysfs_write_str(const char* path, const char* value)
+{
+  size_t len = strlen(value);
+  ssize_t ret = 0;
+  int fd = open(path, O_WRONLY | O_TRUNC);
+
+  if(fd == -1)
+  {
+    return -1;
+  }
+
+  ret = write(fd, value, len);
+
+  if(ret == -1)
+  {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+
+  close(fd);
+
+  if((size_t)ret != len)
+  {
+    errno = EIO;
+    return -1;
+  }
+
+  return 0;
+}
+
+int sysfs_read_str(const char* path, char* buf, size_t size)
+{
+  ssize_t ret = 0;
+  int fd = -1;
+
+  if(!buf || size == 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  fd = open(path, O_RDONLY);
+
+  if(fd == -1)
+  {
+    return -1;
+  }
+
+  ret = read(fd, buf, size - 1);
+
+  if(ret == -1)
+  {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+
+  close(fd);
+
+  while(ret > 0 && (buf[ret - 1] == '\n' || buf[ret - 1] == ' '))
+  {
+    ret--;
+  }
+  buf[ret] = 0x00;
+
+  return (int)ret;
+}
+
+int sysfs_write_long(const char* path, long value)
+{
+  char buf[32];
+
+  snprintf(buf, sizeof(buf), "%ld", value);
+  return sysfs_write_str(path, buf);
+}
+
+int sysfs_read_long(const char* path, long* value)
+{
+  char buf[32];
+  char* end = NULL;
+  long ret = 0;
+
+  if(!value)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  ret = sysfs_read_str(path, buf, sizeof(buf));
+  if(ret == -1)
+  {
+    return -1;
+  }
+
+  errno = 0;
+  ret = strtol(buf, &end, 10);
+  if(errno != 0 || end == buf)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *value = ret;
+  return 0;
+}
+
+int cpulist_format(const int* cpus, size_t cpus_size, char* buf, size_t size)
+{
+  size_t len = 0;
+  int prev = -2;
+  int start = -1;
+
+  if(!buf || size == 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  buf[0] = 0x00;
+
+  /* cpus may not be sorted, walk up to the highest index */
+  for(int cpu = 0 ; ; cpu++)
+  {
+    int present = 0;
+    int more = 0;
+
+    for(size_t i = 0 ; i < cpus_size ; i++)
+    {
+      if(cpus[i] == cpu)
+      {
+        present = 1;
+      }
+      else if(cpus[i] > cpu)
+      {
+        more = 1;
+      }
+    }
+
+    if(present)
+    {
+      if(prev != cpu - 1)
+      {
+        start = cpu;
+      }
+      prev = cpu;
+    }
+
+    if((!present || !more) && start != -1)
+    {
+      int ret = 0;
+
+      /* close current range */
+      if(start == prev)
+      {
+        ret = snprintf(buf + len, size - len, "%s%d", len ? "," : "", start);
+      }
+      else
+      {
+        ret = snprintf(buf + len, size - len, "%s%d-%d", len ? "," : "",
+            start, prev);
+      }
+
+      if(ret < 0 || (size_t)ret >= size - len)
+      {
+        errno = ENOSPC;
+        return -1;
+      }
+
+      len += ret;
+      start = -1;
+    }
+
+    if(!more)
+    {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+int cpulist_parse(const char* str, int* cpus, size_t cpus_size)
+{
+  const char* p = str;
+  int nb = 0;
+
+  if(!str)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  while(*p)
+  {
+    char* end = NULL;
+    long first = 0;
+    long last = 0;
+
+    while(isspace((unsigned char)*p) || *p == ',')
+    {
+      p++;
+    }
+
+    if(*p == 0x00)
+    {
+      break;
+    }
+
+    first = strtol(p, &end, 10);
+    if(end == p || first < 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+    p = end;
+    last = first;
+
+    if(*p == '-')
+    {
+      p++;
+      last = strtol(p, &end, 10);
+      if(end == p || last < first)
+      {
+        errno = EINVAL;
+        return -1;
+      }
+      p = end;
+    }
+
+    if(*p && *p != ',' && !isspace((unsigned char)*p))
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+    for(long i = first ; i <= last ; i++)
+    {
+      if(cpus)
+      {
+        if((size_t)nb >= cpus_size)
+        {
+          errno = ENOSPC;
+          return -1;
+        }
+        cpus[nb] = (int)i;
+      }
+      nb++;
+    }
+  }
+
+  return nb;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file sysfs.h
+ * \brief Internal helpers to access sysfs, procfs and cgroupfs files.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef RTVSUTILS_SYSFS_H
+#define RTVSUTILS_SYSFS_H
+
+#include <stddef.h>
+
+/* cpulist_parse() and cpulist_format() are public */
+#include "sysinfo.h"
+
+/**
+ * \brief Writes a string to a pseudo-file.
+ * \param path path of the file.
+ * \param value NULL-terminated string to write.
+ * \return 0 if success, -1 otherwise (errno is set).
+ */
+int sysfs_write_str(const char* path, const char* value);
+
+/**
+ * \brief Reads a pseudo-file into a buffer.
+ *
+ * Trailing newline characters are removed.
+ * \param path path of the file.
+ * \param buf buffer that will receive the NULL-terminated content.
+ * \param size size of the buffer.
+ * \return number of characters stored if success, -1 otherwise.
+ */
+int sysfs_read_str(const char* path, char* buf, size_t size);
+
+/**
+ * \brief Writes an integer value to a pseudo-file.
+ * \param path path of the file.
+ * \param value value to write.
+ * \return 0 if success, -1 otherwise.
+ */
+int sysfs_write_long(const char* path, long value);
+
+/**
+ * \brief Reads an integer value from a pseudo-file.
+ * \param path path of the file.
+ * \param value pointer that will receive the value.
+ * \return 0 if success, -1 otherwise.
+ */
+int sysfs_read_long(const char* path, long* value);
+
+#endif /* RTVSUTILS_SYSFS_H */
@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file sysinfo.c
+ * \brief Queries of the system real-time configuration.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/utsname.h>
+
+#include "sysinfo.h"
+#include "sysfs.h"
+#include "percpu.h"
+#include "sched_attr.h"
+
+/**
+ * \brief Bit of CAP_IPC_LOCK in capability sets.
+ */
+#define SYSINFO_CAP_IPC_LOCK 14
+
+/**
+ * \brief Bit of CAP_SYS_NICE in capability sets.
+ */
+#define SYSINFO_CAP_SYS_NICE 23
+
+/**
+ * \brief Cached capabilities.
+ */
+static struct rt_caps sysinfo_caps;
+
+/**
+ * \brief Guard of the cached capabilities.
+ */
+static pthread_once_t sysinfo_caps_once = PTHREAD_ONCE_INIT;
+
+/**
+ * \brief Path of the CPU topology files via /sys.
+ */
+static const char* const SYSINFO_CPU_PATH = "/sys/devices/system/cpu";
+
+/**
+ * \brief Reads a CPU list file of /sys/devices/system/cpu.
+ * \param file name of the file.
+ * \param cpus array that will receive the CPU indexes (can be NULL).
+ * \param cpus_size size of the array.
+ * \return number of CPUs, negative value otherwise.
+ */
+static int sysinfo_read_cpulist(const char* file, int* cpus,
+    size_t cpus_size)
+{
+  char path[256];
+  char value[1024];
+
+  snprintf(path, sizeof(path), "%s/%s", SYSINFO_CPU_PATH, file);
+  if(sysfs_read_str(path, value, sizeof(value)) == -1)
+  {
+    return -1;
+  }
+
+  /* empty file means no CPU */
+  if(value[0] == 0x00)
+  {
+    return 0;
+  }
+
+  return cpulist_parse(value, cpus, cpus_size);
+}
+
+int sysinfo_get_isolated_cpus(int* cpus, size_t cpus_size)
+{
+  return sysinfo_read_cpulist("isolated", cpus, cpus_size);
+}
+
+int sysinfo_get_nohz_full_cpus(int* cpus, size_t cpus_size)
+{
+  char path[256];
+  char value[1024];
+
+  snprintf(path, sizeof(path), "%s/nohz_full", SYSINFO_CPU_PATH);
+  if(sysfs_read_str(path, value, sizeof(value)) == -1)
+  {
+    /* kernel without adaptive-tick support */
+    return errno == ENOENT ? 0 : -1;
+  }
+
+  /* "(null)" if nohz_full is not set on the command line */
+  if(value[0] == 0x00 || value[0] == '(')
+  {
+    return 0;
+  }
+
+  return cpulist_parse(value, cpus, cpus_size);
+}
+
+int sysinfo_count_irqs_on_cpus(const int* cpus, size_t cpus_size)
+{
+  DIR* dir = NULL;
+  struct dirent* entry = NULL;
+  int count = 0;
+
+  if(!cpus || cpus_size == 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  dir = opendir("/proc/irq");
+  if(!dir)
+  {
+    return -1;
+  }
+
+  while((entry = readdir(dir)))
+  {
+    char path[300];
+    char value[1024];
+    int irq_cpus[1024];
+    int nb = 0;
+
+    if(entry->d_name[0] < '0' || entry->d_name[0] > '9')
+    {
+      continue;
+    }
+
+    /* effective affinity is what the interrupt controller really uses */
+    snprintf(path, sizeof(path), "/proc/irq/%s/effective_affinity_list",
+        entry->d_name);
+    if(sysfs_read_str(path, value, sizeof(value)) == -1 || value[0] == 0x00)
+    {
+      snprintf(path, sizeof(path), "/proc/irq/%s/smp_affinity_list",
+          entry->d_name);
+      if(sysfs_read_str(path, value, sizeof(value)) == -1)
+      {
+        continue;
+      }
+    }
+
+    nb = cpulist_parse(value, irq_cpus, sizeof(irq_cpus) / sizeof(int));
+    for(int i = 0 ; i < nb ; i++)
+    {
+      int found = 0;
+
+      for(size_t j = 0 ; j < cpus_size ; j++)
+      {
+        if(irq_cpus[i] == cpus[j])
+        {
+          found = 1;
+          break;
+        }
+      }
+
+      if(found)
+      {
+        count++;
+        break;
+      }
+    }
+  }
+
+  closedir(dir);
+  return count;
+}
+
+int sysinfo_get_smt_active(void)
+{
+  char path[256];
+  long value = 0;
+
+  snprintf(path, sizeof(path), "%s/smt/active", SYSINFO_CPU_PATH);
+  if(sysfs_read_long(path, &value) != 0)
+  {
+    return -1;
+  }
+
+  return value != 0;
+}
+
+int sysinfo_get_clocksource(char* name, size_t size)
+{
+  char path[256];
+
+  snprintf(path, sizeof(path),
+      "%s/../clocksource/clocksource0/current_clocksource", SYSINFO_CPU_PATH);
+  return sysfs_read_str(path, name, size) == -1 ? -1 : 0;
+}
+
+enum sysinfo_preempt sysinfo_get_preempt(void)
+{
+  struct utsname name;
+  long realtime = 0;
+
+  /* only exists on PREEMPT_RT kernels */
+  if(sysfs_read_long("/sys/kernel/realtime", &realtime) == 0 && realtime == 1)
+  {
+    return SYSINFO_PREEMPT_RT;
+  }
+
+  if(uname(&name) != 0)
+  {
+    return SYSINFO_PREEMPT_UNKNOWN;
+  }
+
+  /* i.e. "#1 SMP PREEMPT_DYNAMIC ..." or "#1 SMP PREEMPT_RT ..." */
+  if(strstr(name.version, "PREEMPT_RT") || strstr(name.version, "PREEMPT RT"))
+  {
+    return SYSINFO_PREEMPT_RT;
+  }
+  else if(strstr(name.version, "PREEMPT_DYNAMIC"))
+  {
+    char value[128];
+    char* current = NULL;
+
+    /* model is chosen at boot, current one is in parenthesis (i.e.
+     * "none voluntary (full)")
+     */
+    if(sysfs_read_str("/sys/kernel/debug/sched/preempt", value,
+          sizeof(value)) == -1 || !(current = strchr(value, '(')))
+    {
+      return SYSINFO_PREEMPT_UNKNOWN;
+    }
+
+    return (!strncmp(current, "(full)", 6) ||
+        !strncmp(current, "(lazy)", 6)) ? SYSINFO_PREEMPT_FULL :
+      SYSINFO_PREEMPT_NONE;
+  }
+  else if(strstr(name.version, "PREEMPT"))
+  {
+    return SYSINFO_PREEMPT_FULL;
+  }
+
+  return SYSINFO_PREEMPT_NONE;
+}
+
+/**
+ * \brief Reads the effective capabilities of the process.
+ * \return capability set, 0 if unknown.
+ */
+static unsigned long long sysinfo_read_cap_eff(void)
+{
+  char line[256];
+  unsigned long long caps = 0;
+  FILE* f = fopen("/proc/self/status", "r");
+
+  if(!f)
+  {
+    return 0;
+  }
+
+  while(fgets(line, sizeof(line), f))
+  {
+    if(!strncmp(line, "CapEff:", 7))
+    {
+      caps = strtoull(line + 7, NULL, 16);
+      break;
+    }
+  }
+
+  fclose(f);
+  return caps;
+}
+
+/**
+ * \brief Registers restartable sequences in a throwaway thread.
+ *
+ * Registration is dropped when the thread exits so that probing does not
+ * leave the caller of rt_caps_get() registered.
+ * \param arg unused.
+ * \return non-NULL if registration succeeded.
+ */
+static void* sysinfo_rseq_probe(void* arg)
+{
+  (void)arg;
+  return percpu_thread_init() == 0 ? (void*)1 : NULL;
+}
+
+/**
+ * \brief Queries the capabilities.
+ */
+static void sysinfo_caps_init(void)
+{
+  struct rt_caps* caps = &sysinfo_caps;
+  struct timespec res;
+  struct rlimit lim;
+  pthread_t probe;
+  void* rseq = NULL;
+  unsigned long long cap_eff = sysinfo_read_cap_eff();
+
+  memset(caps, 0x00, sizeof(struct rt_caps));
+
+  caps->preempt = sysinfo_get_preempt();
+  sysinfo_get_clocksource(caps->clocksource, sizeof(caps->clocksource));
+
+  /* coarse clocks are updated each tick */
+  if(clock_getres(CLOCK_MONOTONIC_COARSE, &res) == 0 && res.tv_sec == 0 &&
+      res.tv_nsec > 0)
+  {
+    caps->tick_rate = (1000000000 + res.tv_nsec / 2) / res.tv_nsec;
+  }
+
+  caps->deadline = sched_get_priority_max(SCHED_DEADLINE) != -1;
+  caps->uclamp = access("/proc/sys/kernel/sched_util_clamp_max", F_OK) == 0;
+  if(pthread_create(&probe, NULL, sysinfo_rseq_probe, NULL) == 0 &&
+      pthread_join(probe, &rseq) == 0)
+  {
+    caps->rseq = rseq != NULL;
+  }
+
+  caps->cap_ipc_lock = (cap_eff >> SYSINFO_CAP_IPC_LOCK) & 1;
+  caps->cap_sys_nice = (cap_eff >> SYSINFO_CAP_SYS_NICE) & 1;
+
+  if(getrlimit(RLIMIT_RTPRIO, &lim) == 0)
+  {
+    caps->rtprio_max = lim.rlim_max;
+  }
+
+  if(getrlimit(RLIMIT_MEMLOCK, &lim) == 0)
+  {
+    caps->memlock_max = lim.rlim_max;
+  }
+}
+
+const struct rt_caps* rt_caps_get(void)
+{
+  pthread_once(&sysinfo_caps_once, sysinfo_caps_init);
+  return &sysinfo_caps;
+}
@@ -0,0 +1,555 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file telemetry.c
+ * \brief Background frequency and thermal telemetry sampler.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "telemetry.h"
+#include "rtutils.h"
+#include "rt_event.h"
+#include "sysfs.h"
+
+/**
+ * \brief Path of the files of a CPU via /sys.
+ */
+static const char* const TELEMETRY_CPU_PATH =
+  "/sys/devices/system/cpu/cpu%d/%s";
+
+/**
+ * \brief Path of the thermal zones via /sys.
+ */
+static const char* const TELEMETRY_ZONE_PATH =
+  "/sys/class/thermal/thermal_zone%d/%s";
+
+/**
+ * \struct telemetry_cpu
+ * \brief Descriptors kept open for a CPU.
+ */
+struct telemetry_cpu
+{
+  /**
+   * \brief CPU id.
+   */
+  int cpu;
+
+  /**
+   * \brief scaling_cur_freq.
+   */
+  int freq_fd;
+
+  /**
+   * \brief thermal_throttle/core_throttle_count.
+   */
+  int core_fd;
+
+  /**
+   * \brief thermal_throttle/package_throttle_count.
+   */
+  int package_fd;
+};
+
+/**
+ * \struct telemetry_slot
+ * \brief Sample of the ring buffer and its version.
+ */
+struct telemetry_slot
+{
+  /**
+   * \brief Version, odd while the sampler writes the slot.
+   */
+  atomic_uint version;
+
+  /**
+   * \brief Sample.
+   */
+  struct telemetry_sample sample;
+};
+
+/**
+ * \struct telemetry
+ * \brief Sampler.
+ */
+struct telemetry
+{
+  /**
+   * \brief Sampler thread.
+   */
+  pthread_t th;
+
+  /**
+   * \brief Flag to stop the thread.
+   */
+  atomic_int stop;
+
+  /**
+   * \brief Setup error (errno value) of the thread, 0 if none.
+   */
+  int error;
+
+  /**
+   * \brief Signaled by the thread after setup.
+   */
+  struct rt_event ready_event;
+
+  /**
+   * \brief Sampling period in nanoseconds.
+   */
+  unsigned long period;
+
+  /**
+   * \brief Sampled CPUs.
+   */
+  struct telemetry_cpu* cpus;
+
+  /**
+   * \brief Number of sampled CPUs.
+   */
+  size_t cpus_size;
+
+  /**
+   * \brief Package temperature descriptor.
+   */
+  int temp_fd;
+
+  /**
+   * \brief Ring buffer, each slot is a seqlock so that readers (possibly
+   * real-time threads) never wait for the nice 19 sampler.
+   */
+  struct telemetry_slot* ring;
+
+  /**
+   * \brief Capacity of the ring buffer.
+   */
+  size_t capacity;
+
+  /**
+   * \brief Sequence number of the next sample, published after the slot.
+   */
+  _Atomic uint64_t seq;
+};
+
+/**
+ * \brief Returns current time in nanoseconds.
+ * \return CLOCK_MONOTONIC time in nanoseconds.
+ */
+static uint64_t telemetry_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * \brief Re-reads an integer value from an open pseudo-file.
+ * \param fd descriptor (-1 if not available).
+ * \return value, 0 if not available.
+ */
+static long telemetry_pread(int fd)
+{
+  char buf[32];
+  ssize_t ret = 0;
+
+  if(fd == -1)
+  {
+    return 0;
+  }
+
+  ret = pread(fd, buf, sizeof(buf) - 1, 0);
+  if(ret <= 0)
+  {
+    return 0;
+  }
+
+  buf[ret] = 0x00;
+  return strtol(buf, NULL, 10);
+}
+
+/**
+ * \brief Opens a file of a CPU.
+ * \param cpu CPU id.
+ * \param file name of the file.
+ * \return descriptor, -1 if not available.
+ */
+static int telemetry_open_cpu(int cpu, const char* file)
+{
+  char path[256];
+
+  snprintf(path, sizeof(path), TELEMETRY_CPU_PATH, cpu, file);
+  return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+/**
+ * \brief Opens the package temperature.
+ *
+ * The x86_pkg_temp thermal zone is used if it exists, otherwise the first
+ * thermal zone.
+ * \return descriptor, -1 if not available.
+ */
+static int telemetry_open_temperature(void)
+{
+  char path[256];
+  char type[64];
+  int zone = -1;
+
+  for(int i = 0 ; ; i++)
+  {
+    snprintf(path, sizeof(path), TELEMETRY_ZONE_PATH, i, "type");
+    if(sysfs_read_str(path, type, sizeof(type)) == -1)
+    {
+      break;
+    }
+
+    if(zone == -1 || !strcmp(type, "x86_pkg_temp"))
+    {
+      zone = i;
+    }
+
+    if(!strcmp(type, "x86_pkg_temp"))
+    {
+      break;
+    }
+  }
+
+  if(zone == -1)
+  {
+    return -1;
+  }
+
+  snprintf(path, sizeof(path), TELEMETRY_ZONE_PATH, zone, "temp");
+  return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+/**
+ * \brief Samples all the CPUs and stores the samples in the ring buffer.
+ * \param telemetry the sampler.
+ */
+static void telemetry_sample(struct telemetry* telemetry)
+{
+  long temperature = telemetry_pread(telemetry->temp_fd);
+  struct telemetry_slot* slot = NULL;
+  unsigned int version = 0;
+  uint64_t seq = 0;
+
+  for(size_t i = 0 ; i < telemetry->cpus_size ; i++)
+  {
+    struct telemetry_cpu* cpu = &telemetry->cpus[i];
+    struct telemetry_sample sample;
+
+    sample.cpu = (unsigned int)cpu->cpu;
+    sample.freq = (unsigned long)telemetry_pread(cpu->freq_fd);
+    sample.core_throttle_count = (unsigned long)telemetry_pread(cpu->core_fd);
+    sample.package_throttle_count =
+      (unsigned long)telemetry_pread(cpu->package_fd);
+    sample.temperature = temperature;
+    sample.timestamp = telemetry_now();
+
+    /* single writer */
+    seq = atomic_load_explicit(&telemetry->seq, memory_order_relaxed);
+    slot = &telemetry->ring[seq % telemetry->capacity];
+    version = atomic_load_explicit(&slot->version, memory_order_relaxed);
+    sample.seq = seq;
+
+    atomic_store_explicit(&slot->version, version + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->sample = sample;
+    atomic_store_explicit(&slot->version, version + 2, memory_order_release);
+    atomic_store_explicit(&telemetry->seq, seq + 1, memory_order_release);
+  }
+}
+
+/**
+ * \brief Copies a sample of the ring buffer without waiting for the
+ * sampler.
+ * \param telemetry the sampler.
+ * \param seq sequence number of the sample.
+ * \param sample pointer that will receive the sample.
+ * \return 0 if success, -1 if the sample is being or has been overwritten.
+ */
+static int telemetry_copy(struct telemetry* telemetry, uint64_t seq,
+    struct telemetry_sample* sample)
+{
+  struct telemetry_slot* slot = &telemetry->ring[seq % telemetry->capacity];
+  unsigned int version = atomic_load_explicit(&slot->version,
+      memory_order_acquire);
+
+  if(version & 1)
+  {
+    return -1;
+  }
+
+  *sample = slot->sample;
+  atomic_thread_fence(memory_order_acquire);
+
+  if(atomic_load_explicit(&slot->version, memory_order_relaxed) != version ||
+      sample->seq != seq)
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Sampler thread.
+ * \param data the sampler.
+ * \return NULL.
+ */
+static void* telemetry_thread(void* data)
+{
+  struct telemetry* telemetry = data;
+  struct timespec next;
+
+  /* keep sampling out of the way of real-time threads */
+  if(thread_set_priority(pthread_self(), 19) != 0)
+  {
+    telemetry->error = errno;
+  }
+
+  rt_event_signal(&telemetry->ready_event);
+  if(telemetry->error != 0)
+  {
+    return NULL;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  while(!atomic_load(&telemetry->stop))
+  {
+    telemetry_sample(telemetry);
+
+    next.tv_sec += telemetry->period / 1000000000;
+    next.tv_nsec += telemetry->period % 1000000000;
+    if(next.tv_nsec >= 1000000000)
+    {
+      next.tv_sec++;
+      next.tv_nsec -= 1000000000;
+    }
+
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+
+  return NULL;
+}
+
+/**
+ * \brief Releases the resources of a sampler.
+ * \param telemetry the sampler.
+ */
+static void telemetry_free(struct telemetry* telemetry)
+{
+  for(size_t i = 0 ; i < telemetry->cpus_size ; i++)
+  {
+    struct telemetry_cpu* cpu = &telemetry->cpus[i];
+
+    if(cpu->freq_fd != -1)
+    {
+      close(cpu->freq_fd);
+    }
+    if(cpu->core_fd != -1)
+    {
+      close(cpu->core_fd);
+    }
+    if(cpu->package_fd != -1)
+    {
+      close(cpu->package_fd);
+    }
+  }
+
+  if(telemetry->temp_fd != -1)
+  {
+    close(telemetry->temp_fd);
+  }
+
+  free(telemetry->cpus);
+  free(telemetry->ring);
+  free(telemetry);
+}
+
+struct telemetry* telemetry_start(const struct telemetry_config* config)
+{
+  struct telemetry* telemetry = NULL;
+  pthread_attr_t attr;
+  int ret = 0;
+
+  if(!config || !config->cpus || config->cpus_size == 0 ||
+      config->period == 0 || config->capacity == 0)
+  {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  telemetry = calloc(1, sizeof(struct telemetry));
+  if(!telemetry)
+  {
+    return NULL;
+  }
+
+  telemetry->cpus = calloc(config->cpus_size, sizeof(struct telemetry_cpu));
+  telemetry->ring = calloc(config->capacity, sizeof(struct telemetry_slot));
+  if(!telemetry->cpus || !telemetry->ring)
+  {
+    free(telemetry->cpus);
+    free(telemetry->ring);
+    free(telemetry);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  atomic_init(&telemetry->seq, 0);
+  atomic_init(&telemetry->stop, 0);
+  telemetry->period = config->period;
+  telemetry->capacity = config->capacity;
+  telemetry->cpus_size = config->cpus_size;
+  telemetry->temp_fd = telemetry_open_temperature();
+
+  for(size_t i = 0 ; i < config->cpus_size ; i++)
+  {
+    struct telemetry_cpu* cpu = &telemetry->cpus[i];
+
+    cpu->cpu = config->cpus[i];
+    cpu->freq_fd = telemetry_open_cpu(cpu->cpu, "cpufreq/scaling_cur_freq");
+    cpu->core_fd = telemetry_open_cpu(cpu->cpu,
+        "thermal_throttle/core_throttle_count");
+    cpu->package_fd = telemetry_open_cpu(cpu->cpu,
+        "thermal_throttle/package_throttle_count");
+  }
+
+  rt_event_init(&telemetry->ready_event, 0, 0);
+
+  if(thread_attr_init_timesharing(&attr) != 0)
+  {
+    telemetry_free(telemetry);
+    return NULL;
+  }
+
+  ret = pthread_create(&telemetry->th, &attr, telemetry_thread, telemetry);
+  pthread_attr_destroy(&attr);
+  if(ret != 0)
+  {
+    telemetry_free(telemetry);
+    errno = EAGAIN;
+    return NULL;
+  }
+
+  while(rt_event_wait(&telemetry->ready_event) != 0 && errno == EINTR)
+  {
+  }
+
+  if(telemetry->error != 0)
+  {
+    ret = telemetry->error;
+    pthread_join(telemetry->th, NULL);
+    telemetry_free(telemetry);
+    errno = ret;
+    return NULL;
+  }
+
+  return telemetry;
+}
+
+void telemetry_stop(struct telemetry* telemetry)
+{
+  if(!telemetry)
+  {
+    return;
+  }
+
+  atomic_store(&telemetry->stop, 1);
+  pthread_join(telemetry->th, NULL);
+  telemetry_free(telemetry);
+}
+
+size_t telemetry_read(struct telemetry* telemetry, uint64_t* seq,
+    struct telemetry_sample* samples, size_t size)
+{
+  uint64_t head = 0;
+  uint64_t next = 0;
+  size_t nb = 0;
+
+  if(!telemetry || !seq || !samples)
+  {
+    return 0;
+  }
+
+  head = atomic_load_explicit(&telemetry->seq, memory_order_acquire);
+  next = *seq;
+
+  /* samples overwritten, restart at the oldest one */
+  if(head > telemetry->capacity && next < head - telemetry->capacity)
+  {
+    next = head - telemetry->capacity;
+  }
+
+  for( ; next < head && nb < size ; next++)
+  {
+    /* sample overwritten while reading is skipped */
+    if(telemetry_copy(telemetry, next, &samples[nb]) == 0)
+    {
+      nb++;
+    }
+  }
+
+  *seq = next;
+  return nb;
+}
+
+size_t telemetry_find(struct telemetry* telemetry, uint64_t from, uint64_t to,
+    struct telemetry_sample* samples, size_t size)
+{
+  uint64_t head = 0;
+  uint64_t first = 0;
+  size_t nb = 0;
+
+  if(!telemetry || !samples)
+  {
+    return 0;
+  }
+
+  head = atomic_load_explicit(&telemetry->seq, memory_order_acquire);
+  if(head > telemetry->capacity)
+  {
+    first = head - telemetry->capacity;
+  }
+
+  for(uint64_t i = first ; i < head && nb < size ; i++)
+  {
+    if(telemetry_copy(telemetry, i, &samples[nb]) == 0 &&
+        samples[nb].timestamp >= from && samples[nb].timestamp <= to)
+    {
+      nb++;
+    }
+  }
+
+  return nb;
+}
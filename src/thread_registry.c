@@ -0,0 +1,438 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file thread_registry.c
+ * \brief Registry of threads and remote per-thread operations.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <errno.h>
+#include <fnmatch.h>
+
+#include <sys/prctl.h>
+#include <syscall.h>
+
+#include "thread_registry.h"
+#include "sysfs.h"
+
+/**
+ * \brief Registered threads.
+ */
+static struct thread_info registry[THREAD_REGISTRY_MAX];
+
+/**
+ * \brief If an entry of the registry is used.
+ */
+static int registry_used[THREAD_REGISTRY_MAX];
+
+/**
+ * \brief Mutex to protect the registry.
+ */
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * \brief Key to remove threads from the registry when they exit.
+ */
+static pthread_key_t registry_key;
+
+/**
+ * \brief Control to create the key once.
+ */
+static pthread_once_t registry_once = PTHREAD_ONCE_INIT;
+
+/**
+ * \brief Called when a registered thread exits.
+ * \param data not used.
+ */
+static void registry_destructor(void* data)
+{
+  (void)data;
+  thread_registry_remove(pthread_self());
+}
+
+/**
+ * \brief Creates the thread exit key.
+ */
+static void registry_init(void)
+{
+  pthread_key_create(&registry_key, registry_destructor);
+}
+
+/**
+ * \brief Returns the kernel thread identifier of the calling thread.
+ * \return kernel thread identifier.
+ */
+static pid_t registry_gettid(void)
+{
+  return (pid_t)syscall(SYS_gettid);
+}
+
+/**
+ * \brief Returns the index of a thread in the registry.
+ * \param th ID of the thread.
+ * \return index or -1 if not found.
+ * \note Must be called with the mutex held.
+ */
+static int registry_index(pthread_t th)
+{
+  for(size_t i = 0 ; i < THREAD_REGISTRY_MAX ; i++)
+  {
+    if(registry_used[i] && pthread_equal(registry[i].th, th))
+    {
+      return (int)i;
+    }
+  }
+
+  return -1;
+}
+
+int thread_registry_add(const char* name)
+{
+  char sys_name[16];
+  int idx = -1;
+
+  if(!name || strlen(name) >= THREAD_REGISTRY_NAME_SIZE)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pthread_once(&registry_once, registry_init);
+
+  pthread_mutex_lock(&registry_mutex);
+
+  idx = registry_index(pthread_self());
+  for(size_t i = 0 ; idx == -1 && i < THREAD_REGISTRY_MAX ; i++)
+  {
+    if(!registry_used[i])
+    {
+      idx = (int)i;
+    }
+  }
+
+  if(idx == -1)
+  {
+    pthread_mutex_unlock(&registry_mutex);
+    errno = ENOSPC;
+    return -1;
+  }
+
+  registry_used[idx] = 1;
+  registry[idx].th = pthread_self();
+  registry[idx].tid = registry_gettid();
+  strcpy(registry[idx].name, name);
+
+  pthread_mutex_unlock(&registry_mutex);
+
+  pthread_setspecific(registry_key, (void*)1);
+
+  /* system name is limited to 15 characters */
+  snprintf(sys_name, sizeof(sys_name), "%s", name);
+  pthread_setname_np(pthread_self(), sys_name);
+
+  return 0;
+}
+
+int thread_registry_remove(pthread_t th)
+{
+  int idx = -1;
+
+  pthread_mutex_lock(&registry_mutex);
+
+  idx = registry_index(th);
+  if(idx != -1)
+  {
+    registry_used[idx] = 0;
+  }
+
+  pthread_mutex_unlock(&registry_mutex);
+
+  if(idx == -1)
+  {
+    errno = ESRCH;
+    return -1;
+  }
+
+  return 0;
+}
+
+pid_t thread_registry_get_tid(pthread_t th)
+{
+  pid_t tid = -1;
+  int idx = -1;
+
+  if(pthread_equal(th, pthread_self()))
+  {
+    return registry_gettid();
+  }
+
+  pthread_mutex_lock(&registry_mutex);
+
+  idx = registry_index(th);
+  if(idx != -1)
+  {
+    tid = registry[idx].tid;
+  }
+
+  pthread_mutex_unlock(&registry_mutex);
+
+  if(tid == -1)
+  {
+    errno = ESRCH;
+  }
+
+  return tid;
+}
+
+int thread_registry_find(const char* name, struct thread_info* info)
+{
+  int ret = -1;
+
+  if(!name || !info)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pthread_mutex_lock(&registry_mutex);
+
+  for(size_t i = 0 ; i < THREAD_REGISTRY_MAX ; i++)
+  {
+    if(registry_used[i] && !strcmp(registry[i].name, name))
+    {
+      *info = registry[i];
+      ret = 0;
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&registry_mutex);
+
+  if(ret != 0)
+  {
+    errno = ESRCH;
+  }
+
+  return ret;
+}
+
+int thread_registry_list(struct thread_info* infos, size_t size)
+{
+  size_t nb = 0;
+
+  pthread_mutex_lock(&registry_mutex);
+
+  for(size_t i = 0 ; i < THREAD_REGISTRY_MAX ; i++)
+  {
+    if(!registry_used[i])
+    {
+      continue;
+    }
+
+    if(infos)
+    {
+      if(nb >= size)
+      {
+        break;
+      }
+      infos[nb] = registry[i];
+    }
+    nb++;
+  }
+
+  pthread_mutex_unlock(&registry_mutex);
+
+  return (int)nb;
+}
+
+int thread_registry_apply(const char* pattern,
+    const struct thread_settings* settings)
+{
+  struct thread_info infos[THREAD_REGISTRY_MAX];
+  int nb = 0;
+  int updated = 0;
+  int err = 0;
+
+  if(!pattern || !settings)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* nice value only applies to time-sharing policies */
+  if((settings->flags & THREAD_SETTINGS_PRIORITY) &&
+      (settings->flags & THREAD_SETTINGS_RT_PRIORITY) &&
+      (settings->rt_priority.policy == SCHED_FIFO ||
+       settings->rt_priority.policy == SCHED_RR ||
+       settings->rt_priority.policy == SCHED_DEADLINE))
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* work on a copy so that no system call is done with the mutex held */
+  nb = thread_registry_list(infos, THREAD_REGISTRY_MAX);
+
+  for(int i = 0 ; i < nb ; i++)
+  {
+    pid_t tid = infos[i].tid;
+    int ret = 0;
+
+    if(fnmatch(pattern, infos[i].name, 0) != 0)
+    {
+      continue;
+    }
+
+    /* pin first, then change priorities */
+    if(ret == 0 && (settings->flags & THREAD_SETTINGS_AFFINITY))
+    {
+      ret = task_set_affinity(tid, settings->cpus, settings->cpus_size);
+    }
+
+    if(ret == 0 && (settings->flags & THREAD_SETTINGS_TIMER_SLACK))
+    {
+      ret = task_set_timer_slack(tid, settings->timer_slack);
+    }
+
+    if(ret == 0 && (settings->flags & THREAD_SETTINGS_RT_PRIORITY))
+    {
+      struct rt_prio prio = settings->rt_priority;
+
+      ret = task_set_rt_priority(tid, &prio);
+    }
+
+    if(ret == 0 && (settings->flags & THREAD_SETTINGS_PRIORITY))
+    {
+      ret = task_set_priority(tid, settings->priority);
+    }
+
+    if(ret == 0)
+    {
+      updated++;
+    }
+    else
+    {
+      err = errno;
+    }
+  }
+
+  if(err)
+  {
+    errno = err;
+    return -1;
+  }
+
+  return updated;
+}
+
+int task_set_priority(pid_t tid, int priority)
+{
+  /* WARNING non-portable: on Linux, the nice() priority is per-thread */
+  return process_set_priority(tid, priority);
+}
+
+int task_get_priority(pid_t tid)
+{
+  return process_get_priority(tid);
+}
+
+int task_set_rt_priority(pid_t tid, struct rt_prio* priority)
+{
+  /* on Linux, scheduling parameters are per-thread */
+  return process_set_rt_priority(tid, priority);
+}
+
+int task_get_rt_priority(pid_t tid, struct rt_prio* priority)
+{
+  return process_get_rt_priority(tid, priority);
+}
+
+int task_set_affinity(pid_t tid, const int* cpus, size_t cpus_size)
+{
+  cpu_set_t mask;
+
+  if(!cpus)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  CPU_ZERO(&mask);
+
+  for(size_t i = 0 ; i < cpus_size ; i++)
+  {
+    if(cpus[i] >= 0)
+    {
+      CPU_SET(cpus[i], &mask);
+    }
+  }
+
+  return sched_setaffinity(tid, sizeof(cpu_set_t), &mask);
+}
+
+int task_set_timer_slack(pid_t tid, unsigned long slack)
+{
+  char path[64];
+
+  if(tid == 0 || tid == registry_gettid())
+  {
+    return prctl(PR_SET_TIMERSLACK, slack, 0, 0, 0);
+  }
+
+  snprintf(path, sizeof(path), "/proc/%d/timerslack_ns", (int)tid);
+  return sysfs_write_long(path, (long)slack);
+}
+
+int task_get_timer_slack(pid_t tid, unsigned long* slack)
+{
+  char path[64];
+  long value = 0;
+
+  if(!slack)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(tid == 0 || tid == registry_gettid())
+  {
+    int ret = prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0);
+
+    if(ret == -1)
+    {
+      return -1;
+    }
+
+    *slack = (unsigned long)ret;
+    return 0;
+  }
+
+  snprintf(path, sizeof(path), "/proc/%d/timerslack_ns", (int)tid);
+  if(sysfs_read_long(path, &value) != 0)
+  {
+    return -1;
+  }
+
+  *slack = (unsigned long)value;
+  return 0;
+}
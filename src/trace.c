@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file trace.c
+ * \brief ftrace trace_marker integration.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "trace.h"
+
+/**
+ * \brief Mount points of tracefs.
+ */
+static const char* const TRACE_PATHS[] =
+{
+  "/sys/kernel/tracing",
+  "/sys/kernel/debug/tracing",
+};
+
+/**
+ * \brief Descriptor of trace_marker.
+ */
+static int trace_marker_fd = -1;
+
+/**
+ * \brief Descriptor of tracing_on.
+ */
+static int trace_on_fd = -1;
+
+/**
+ * \brief Writes a string to a descriptor.
+ * \param fd descriptor.
+ * \param str string to write.
+ * \param len length of the string.
+ * \return 0 if success, -1 otherwise.
+ */
+static int trace_write(int fd, const char* str, size_t len)
+{
+  if(fd == -1)
+  {
+    errno = EBADF;
+    return -1;
+  }
+
+  return write(fd, str, len) == (ssize_t)len ? 0 : -1;
+}
+
+int trace_open(void)
+{
+  size_t nb = sizeof(TRACE_PATHS) / sizeof(const char*);
+
+  if(trace_marker_fd != -1)
+  {
+    return 0;
+  }
+
+  for(size_t i = 0 ; i < nb ; i++)
+  {
+    char path[256];
+
+    snprintf(path, sizeof(path), "%s/trace_marker", TRACE_PATHS[i]);
+    trace_marker_fd = open(path, O_WRONLY | O_CLOEXEC);
+    if(trace_marker_fd == -1)
+    {
+      continue;
+    }
+
+    /* optional, trace_stop() fails without it */
+    snprintf(path, sizeof(path), "%s/tracing_on", TRACE_PATHS[i]);
+    trace_on_fd = open(path, O_WRONLY | O_CLOEXEC);
+    return 0;
+  }
+
+  return -1;
+}
+
+void trace_close(void)
+{
+  if(trace_marker_fd != -1)
+  {
+    close(trace_marker_fd);
+    trace_marker_fd = -1;
+  }
+
+  if(trace_on_fd != -1)
+  {
+    close(trace_on_fd);
+    trace_on_fd = -1;
+  }
+}
+
+int trace_is_open(void)
+{
+  return trace_marker_fd != -1;
+}
+
+int trace_marker(const char* fmt, ...)
+{
+  char buf[TRACE_MARKER_SIZE];
+  va_list args;
+  int len = 0;
+
+  if(trace_marker_fd == -1)
+  {
+    errno = EBADF;
+    return -1;
+  }
+
+  va_start(args, fmt);
+  len = vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+
+  if(len < 0)
+  {
+    return -1;
+  }
+  else if((size_t)len >= sizeof(buf))
+  {
+    len = sizeof(buf) - 1;
+  }
+
+  return trace_write(trace_marker_fd, buf, (size_t)len);
+}
+
+int trace_span_begin(const char* name)
+{
+  return trace_marker("span_begin: %s", name);
+}
+
+int trace_span_end(const char* name)
+{
+  return trace_marker("span_end: %s", name);
+}
+
+int trace_start(void)
+{
+  return trace_write(trace_on_fd, "1", 1);
+}
+
+int trace_stop(void)
+{
+  return trace_write(trace_on_fd, "0", 1);
+}
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file tsc.c
+ * \brief Calibrated TSC timestamp clock.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <errno.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "tsc.h"
+#include "sysfs.h"
+
+/**
+ * \brief Path of the clocksources available for the kernel.
+ */
+static const char* const TSC_CLOCKSOURCE_PATH =
+  "/sys/devices/system/clocksource/clocksource0/available_clocksource";
+
+/**
+ * \brief Default calibration duration in milliseconds.
+ */
+#define TSC_CALIBRATION_MS 20
+
+/**
+ * \brief Number of migrations rounds for the synchronization check.
+ */
+#define TSC_SYNC_ROUNDS 3
+
+/**
+ * \brief Maximum difference with CLOCK_MONOTONIC tolerated on a CPU (ns).
+ */
+#define TSC_SYNC_TOLERANCE 50000
+
+/**
+ * \brief Shift of the fixed-point conversion.
+ */
+#define TSC_SHIFT 32
+
+struct tsc_clock tsc_clock =
+{
+  .usable = 0,
+  .mult = (uint64_t)1 << TSC_SHIFT,
+  .shift = TSC_SHIFT,
+  .base_ticks = 0,
+  .base_ns = 0,
+  .frequency = 1000000000,
+};
+
+/**
+ * \brief Sets the conversion parameters of the fallback.
+ */
+static void tsc_reset(void)
+{
+  tsc_clock.usable = 0;
+  tsc_clock.mult = (uint64_t)1 << TSC_SHIFT;
+  tsc_clock.base_ticks = 0;
+  tsc_clock.base_ns = 0;
+  tsc_clock.frequency = 1000000000;
+}
+
+/**
+ * \brief Returns CLOCK_MONOTONIC time in nanoseconds.
+ * \return time in nanoseconds.
+ */
+static uint64_t tsc_monotonic_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * \brief Checks that the CPU has an invariant TSC.
+ * \return 1 if TSC is invariant, 0 otherwise.
+ */
+static int tsc_check_invariant(void)
+{
+  unsigned int eax = 0;
+  unsigned int ebx = 0;
+  unsigned int ecx = 0;
+  unsigned int edx = 0;
+
+  if(!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+  {
+    return 0;
+  }
+
+  /* "Invariant TSC" is bit 8 of EDX of the advanced power management leaf */
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  return (edx & (1 << 8)) != 0;
+}
+
+#endif
+
+/**
+ * \brief Checks that the kernel did not mark the TSC as unstable.
+ * \return 1 if TSC is a valid clocksource (or if it cannot be checked), 0
+ * otherwise.
+ */
+static int tsc_check_clocksource(void)
+{
+  char buf[256];
+
+  if(sysfs_read_str(TSC_CLOCKSOURCE_PATH, buf, sizeof(buf)) == -1)
+  {
+    return 1;
+  }
+
+  /* unstable TSC is removed from the available clocksources */
+  for(char* tok = strtok(buf, " ") ; tok ; tok = strtok(NULL, " "))
+  {
+    if(!strcmp(tok, "tsc"))
+    {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Reads ticks and CLOCK_MONOTONIC time as close as possible.
+ *
+ * The read with the smallest window of a few attempts is kept.
+ * \param ticks pointer that will receive the ticks.
+ * \param ns pointer that will receive the time in nanoseconds.
+ */
+static void tsc_sample(uint64_t* ticks, uint64_t* ns)
+{
+  uint64_t best = UINT64_MAX;
+
+  for(int i = 0 ; i < 5 ; i++)
+  {
+    uint64_t t1 = tsc_read();
+    uint64_t now = tsc_monotonic_ns();
+    uint64_t t2 = tsc_read();
+
+    if(t2 - t1 < best)
+    {
+      best = t2 - t1;
+      *ticks = t1 + (t2 - t1) / 2;
+      *ns = now;
+    }
+  }
+}
+
+/**
+ * \brief Checks the TSC is synchronized across the CPUs of the calling
+ * thread affinity.
+ *
+ * The thread is migrated from CPU to CPU: the TSC must never go backward
+ * and must agree with CLOCK_MONOTONIC on each CPU.
+ * \return 1 if synchronized, 0 otherwise.
+ */
+static int tsc_check_sync(void)
+{
+  cpu_set_t orig;
+  uint64_t last = 0;
+  int ret = 1;
+
+  if(sched_getaffinity(0, sizeof(cpu_set_t), &orig) != 0)
+  {
+    return 0;
+  }
+
+  for(int round = 0 ; round < TSC_SYNC_ROUNDS && ret ; round++)
+  {
+    for(int cpu = 0 ; cpu < CPU_SETSIZE && ret ; cpu++)
+    {
+      cpu_set_t mask;
+      uint64_t ticks = 0;
+      uint64_t ns = 0;
+      uint64_t conv = 0;
+
+      if(!CPU_ISSET(cpu, &orig))
+      {
+        continue;
+      }
+
+      CPU_ZERO(&mask);
+      CPU_SET(cpu, &mask);
+      if(sched_setaffinity(0, sizeof(cpu_set_t), &mask) != 0)
+      {
+        continue;
+      }
+
+      tsc_sample(&ticks, &ns);
+      conv = tsc_clock.base_ns + tsc_to_ns(ticks - tsc_clock.base_ticks);
+
+      if(ticks < last || (conv > ns ? conv - ns : ns - conv) >
+          TSC_SYNC_TOLERANCE)
+      {
+        ret = 0;
+      }
+      last = ticks;
+    }
+  }
+
+  sched_setaffinity(0, sizeof(cpu_set_t), &orig);
+  return ret;
+}
+
+int tsc_init(unsigned int calibration_ms)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  struct timespec ts;
+  uint64_t ticks0 = 0;
+  uint64_t ticks1 = 0;
+  uint64_t ns0 = 0;
+  uint64_t ns1 = 0;
+  uint64_t freq = 0;
+
+  /* back to fallback during the checks */
+  tsc_reset();
+
+  if(!tsc_check_invariant() || !tsc_check_clocksource())
+  {
+    errno = ENOTSUP;
+    return -1;
+  }
+
+  if(calibration_ms == 0)
+  {
+    calibration_ms = TSC_CALIBRATION_MS;
+  }
+
+  ts.tv_sec = calibration_ms / 1000;
+  ts.tv_nsec = (calibration_ms % 1000) * 1000000;
+
+  tsc_clock.usable = 1;
+  tsc_sample(&ticks0, &ns0);
+  clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+  tsc_sample(&ticks1, &ns1);
+
+  if(ticks1 <= ticks0 || ns1 <= ns0)
+  {
+    tsc_clock.usable = 0;
+    errno = EIO;
+    return -1;
+  }
+
+  freq = (uint64_t)(((tsc_uint128)(ticks1 - ticks0) * 1000000000) /
+      (ns1 - ns0));
+
+  tsc_clock.frequency = freq;
+  tsc_clock.mult = (uint64_t)(((tsc_uint128)1000000000 << TSC_SHIFT) / freq);
+  tsc_clock.base_ticks = ticks1;
+  tsc_clock.base_ns = ns1;
+
+  if(!tsc_check_sync())
+  {
+    tsc_reset();
+    errno = ENOTSUP;
+    return -1;
+  }
+
+  return 0;
+#else
+  (void)calibration_ms;
+  (void)tsc_check_clocksource;
+  (void)tsc_check_sync;
+  tsc_reset();
+  errno = ENOTSUP;
+  return -1;
+#endif
+}
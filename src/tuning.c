@@ -0,0 +1,420 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file tuning.c
+ * \brief Snapshot and restore of the system knobs changed by the library.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "tuning.h"
+#include "sysfs.h"
+
+/**
+ * \brief Maximum size of a knob path.
+ */
+#define TUNING_PATH_SIZE 256
+
+/**
+ * \brief Maximum size of a knob value.
+ */
+#define TUNING_VALUE_SIZE 128
+
+/**
+ * \struct tuning_knob
+ * \brief Recorded knob.
+ */
+struct tuning_knob
+{
+  /**
+   * \brief Path of the knob.
+   */
+  char path[TUNING_PATH_SIZE];
+
+  /**
+   * \brief Value before the first change.
+   */
+  char value[TUNING_VALUE_SIZE];
+};
+
+/**
+ * \brief Recorded knobs (static so that restore is async-signal-safe).
+ */
+static struct tuning_knob tuning_knobs[TUNING_MAX];
+
+/**
+ * \brief Number of recorded knobs, published after the knob is written.
+ */
+static atomic_size_t tuning_nb = 0;
+
+/**
+ * \brief Path of the state file (empty if not persisted).
+ */
+static char tuning_state_file[TUNING_PATH_SIZE];
+
+/**
+ * \brief Mutex to protect recording.
+ */
+static pthread_mutex_t tuning_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * \brief Signals handled by tuning_install_handlers().
+ */
+static const int tuning_signals[] =
+{
+  SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT,
+};
+
+/**
+ * \brief Writes a value to a knob with async-signal-safe functions only.
+ * \param path path of the knob.
+ * \param value value to write.
+ * \return 0 if success, -1 otherwise.
+ */
+static int tuning_write(const char* path, const char* value)
+{
+  size_t len = strlen(value);
+  int fd = open(path, O_WRONLY | O_TRUNC);
+  ssize_t ret = 0;
+
+  if(fd == -1)
+  {
+    return -1;
+  }
+
+  ret = write(fd, value, len);
+  close(fd);
+
+  return ret == (ssize_t)len ? 0 : -1;
+}
+
+/**
+ * \brief Writes back knobs in reverse order of recording.
+ *
+ * Some knobs depend on each other (i.e. RT runtime cannot exceed RT period)
+ * so the right order depends on the values to restore. A knob refused by
+ * the kernel is retried once the others are written.
+ * \param knobs knobs.
+ * \param nb number of knobs.
+ * \return 0 if success, -1 otherwise.
+ * \note This function is async-signal-safe.
+ */
+static int tuning_write_knobs(const struct tuning_knob* knobs, size_t nb)
+{
+  unsigned char failed[TUNING_MAX];
+  size_t nb_failed = 0;
+  int ret = 0;
+
+  for(size_t i = nb ; i > 0 ; i--)
+  {
+    failed[i - 1] = tuning_write(knobs[i - 1].path, knobs[i - 1].value) != 0;
+    nb_failed += failed[i - 1];
+  }
+
+  for(size_t i = nb ; i > 0 && nb_failed > 0 ; i--)
+  {
+    if(failed[i - 1] &&
+        tuning_write(knobs[i - 1].path, knobs[i - 1].value) != 0)
+    {
+      ret = -1;
+    }
+  }
+
+  return ret;
+}
+
+/**
+ * \brief Persists the recorded knobs in the state file.
+ * \return 0 if success, -1 otherwise.
+ * \note Must be called with the mutex held.
+ */
+static int tuning_persist(void)
+{
+  char tmp[TUNING_PATH_SIZE + 8];
+  size_t nb = atomic_load(&tuning_nb);
+  FILE* f = NULL;
+
+  if(tuning_state_file[0] == 0x00)
+  {
+    return 0;
+  }
+
+  /* write and rename so that the file is never partially written */
+  snprintf(tmp, sizeof(tmp), "%s.tmp", tuning_state_file);
+  f = fopen(tmp, "w");
+  if(!f)
+  {
+    return -1;
+  }
+
+  for(size_t i = 0 ; i < nb ; i++)
+  {
+    fprintf(f, "%s\t%s\n", tuning_knobs[i].path, tuning_knobs[i].value);
+  }
+
+  if(fflush(f) != 0 || fsync(fileno(f)) != 0)
+  {
+    fclose(f);
+    unlink(tmp);
+    return -1;
+  }
+
+  fclose(f);
+  return rename(tmp, tuning_state_file);
+}
+
+/**
+ * \brief Restores the knobs on exit.
+ */
+static void tuning_atexit(void)
+{
+  tuning_restore();
+}
+
+/**
+ * \brief Restores the knobs on fatal signal and raises it again.
+ * \param sig signal number.
+ */
+static void tuning_signal_handler(int sig)
+{
+  int err = errno;
+
+  tuning_restore();
+
+  /* handler was installed with SA_RESETHAND, default action now */
+  raise(sig);
+  errno = err;
+}
+
+int tuning_record(const char* path)
+{
+  char value[TUNING_VALUE_SIZE];
+  size_t nb = 0;
+  int ret = 0;
+
+  if(!path || strlen(path) >= TUNING_PATH_SIZE)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pthread_mutex_lock(&tuning_mutex);
+
+  nb = atomic_load(&tuning_nb);
+  for(size_t i = 0 ; i < nb ; i++)
+  {
+    if(!strcmp(tuning_knobs[i].path, path))
+    {
+      /* only the first value matters */
+      pthread_mutex_unlock(&tuning_mutex);
+      return 0;
+    }
+  }
+
+  /* knob that cannot be read back (i.e. "<unsupported>") is not recorded */
+  if(sysfs_read_str(path, value, sizeof(value)) == -1 || value[0] == '<' ||
+      strchr(value, '\n'))
+  {
+    pthread_mutex_unlock(&tuning_mutex);
+    return 0;
+  }
+
+  if(nb >= TUNING_MAX)
+  {
+    pthread_mutex_unlock(&tuning_mutex);
+    errno = ENOSPC;
+    return -1;
+  }
+
+  strcpy(tuning_knobs[nb].path, path);
+  strcpy(tuning_knobs[nb].value, value);
+  atomic_store(&tuning_nb, nb + 1);
+
+  ret = tuning_persist();
+
+  pthread_mutex_unlock(&tuning_mutex);
+
+  return ret;
+}
+
+int tuning_set_state_file(const char* path)
+{
+  int ret = 0;
+
+  if(!path)
+  {
+    path = TUNING_STATE_FILE;
+  }
+
+  if(strlen(path) >= TUNING_PATH_SIZE)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pthread_mutex_lock(&tuning_mutex);
+  strcpy(tuning_state_file, path);
+  ret = tuning_persist();
+  pthread_mutex_unlock(&tuning_mutex);
+
+  return ret;
+}
+
+size_t tuning_count(void)
+{
+  return atomic_load(&tuning_nb);
+}
+
+int tuning_restore(void)
+{
+  /* take ownership of all knobs, a concurrent restore will see 0 */
+  size_t nb = atomic_exchange(&tuning_nb, 0);
+  int ret = tuning_write_knobs(tuning_knobs, nb);
+
+  if(nb > 0 && ret == 0 && tuning_state_file[0] != 0x00)
+  {
+    unlink(tuning_state_file);
+  }
+
+  return ret;
+}
+
+int tuning_restore_file(const char* path)
+{
+  struct tuning_knob* knobs = NULL;
+  char line[TUNING_PATH_SIZE + TUNING_VALUE_SIZE + 2];
+  size_t nb = 0;
+  FILE* f = NULL;
+  int ret = 0;
+
+  if(!path)
+  {
+    path = TUNING_STATE_FILE;
+  }
+
+  f = fopen(path, "r");
+  if(!f)
+  {
+    return -1;
+  }
+
+  knobs = calloc(TUNING_MAX, sizeof(struct tuning_knob));
+  if(!knobs)
+  {
+    fclose(f);
+    return -1;
+  }
+
+  while(nb < TUNING_MAX && fgets(line, sizeof(line), f))
+  {
+    char* tab = strchr(line, '\t');
+    size_t len = strlen(line);
+
+    if(len > 0 && line[len - 1] == '\n')
+    {
+      line[len - 1] = 0x00;
+    }
+
+    if(!tab || (size_t)(tab - line) >= TUNING_PATH_SIZE ||
+        strlen(tab + 1) >= TUNING_VALUE_SIZE)
+    {
+      ret = -1;
+      continue;
+    }
+
+    *tab = 0x00;
+    strcpy(knobs[nb].path, line);
+    strcpy(knobs[nb].value, tab + 1);
+    nb++;
+  }
+
+  fclose(f);
+
+  if(tuning_write_knobs(knobs, nb) != 0)
+  {
+    ret = -1;
+  }
+
+  free(knobs);
+
+  if(ret == 0)
+  {
+    unlink(path);
+  }
+
+  return ret;
+}
+
+int tuning_install_handlers(void)
+{
+  static int installed = 0;
+
+  pthread_mutex_lock(&tuning_mutex);
+
+  if(installed)
+  {
+    pthread_mutex_unlock(&tuning_mutex);
+    return 0;
+  }
+
+  if(atexit(tuning_atexit) != 0)
+  {
+    pthread_mutex_unlock(&tuning_mutex);
+    return -1;
+  }
+
+  for(size_t i = 0 ; i < sizeof(tuning_signals) / sizeof(int) ; i++)
+  {
+    struct sigaction sa;
+    struct sigaction old;
+
+    if(sigaction(tuning_signals[i], NULL, &old) != 0)
+    {
+      continue;
+    }
+
+    /* keep handlers of the application */
+    if((old.sa_flags & SA_SIGINFO) || old.sa_handler != SIG_DFL)
+    {
+      continue;
+    }
+
+    memset(&sa, 0x00, sizeof(struct sigaction));
+    sa.sa_handler = tuning_signal_handler;
+    sa.sa_flags = SA_RESETHAND | SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+    sigaction(tuning_signals[i], &sa, NULL);
+  }
+
+  installed = 1;
+  pthread_mutex_unlock(&tuning_mutex);
+
+  return 0;
+}
@@ -0,0 +1,453 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file watchdog.c
+ * \brief Software watchdog for stalled real-time tasks.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "watchdog.h"
+#include "thread_registry.h"
+#include "rt_event.h"
+#include "trace.h"
+#include "tsc.h"
+
+/**
+ * \struct watchdog
+ * \brief Supervisor.
+ */
+struct watchdog
+{
+  /**
+   * \brief Monitored tasks.
+   */
+  struct watchdog_heartbeat tasks[WATCHDOG_MAX_TASKS];
+
+  /**
+   * \brief Protects registration and checks.
+   */
+  struct rt_pi_mutex mutex;
+
+  /**
+   * \brief Configuration.
+   */
+  struct watchdog_config config;
+
+  /**
+   * \brief Supervisor thread.
+   */
+  pthread_t th;
+
+  /**
+   * \brief If not 0, supervisor exits.
+   */
+  atomic_int stop;
+
+  /**
+   * \brief Setup of the supervisor done.
+   */
+  struct rt_event ready;
+
+  /**
+   * \brief errno of the setup of the supervisor, 0 if success.
+   */
+  int error;
+};
+
+/**
+ * \struct watchdog_stall
+ * \brief Stall detected under the mutex, handled once it is released.
+ */
+struct watchdog_stall
+{
+  /**
+   * \brief Heartbeat of the task (may be unregistered meanwhile).
+   */
+  const struct watchdog_heartbeat* heartbeat;
+
+  /**
+   * \brief Name of the task.
+   */
+  char name[WATCHDOG_NAME_SIZE];
+
+  /**
+   * \brief TID of the task.
+   */
+  pid_t tid;
+
+  /**
+   * \brief Actions (WATCHDOG_*).
+   */
+  unsigned int actions;
+
+  /**
+   * \brief Callback for WATCHDOG_CALLBACK.
+   */
+  void (*callback)(const struct watchdog_heartbeat* heartbeat,
+      uint64_t stalled, void* data);
+
+  /**
+   * \brief Data of the callback.
+   */
+  void* data;
+
+  /**
+   * \brief Time since last beat in nanoseconds.
+   */
+  uint64_t stalled;
+};
+
+/**
+ * \brief Logs diagnostics of a stalled task.
+ * \param stall the stall.
+ */
+static void watchdog_dump(const struct watchdog_stall* stall)
+{
+  char path[64];
+  char buf[1024];
+  char wchan[64] = "?";
+  const char* fields = NULL;
+  FILE* f = NULL;
+  char state = '?';
+  unsigned long utime = 0;
+  unsigned long stime = 0;
+  int cpu = -1;
+  unsigned int rt_priority = 0;
+  unsigned int policy = 0;
+
+  snprintf(path, sizeof(path), "/proc/self/task/%d/stat", stall->tid);
+  f = fopen(path, "r");
+  if(f)
+  {
+    if(fgets(buf, sizeof(buf), f) && (fields = strrchr(buf, ')')))
+    {
+      /* fields 3 (state) to 41 (policy) of proc(5) */
+      sscanf(fields + 1, " %c %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s "
+          "%lu %lu %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s "
+          "%*s %*s %*s %*s %*s %*s %*s %*s %*s %d %u %u", &state, &utime,
+          &stime, &cpu, &rt_priority, &policy);
+    }
+    fclose(f);
+  }
+
+  snprintf(path, sizeof(path), "/proc/self/task/%d/wchan", stall->tid);
+  f = fopen(path, "r");
+  if(f)
+  {
+    if(!fgets(wchan, sizeof(wchan), f) || wchan[0] == '\0')
+    {
+      strcpy(wchan, "?");
+    }
+    fclose(f);
+  }
+
+  fprintf(stderr, "watchdog: task %s (tid %d) stalled for %llu us: state %c "
+      "cpu %d policy %u rt_priority %u utime %lu stime %lu wchan %s\n",
+      stall->name, stall->tid,
+      (unsigned long long)(stall->stalled / 1000), state, cpu, policy,
+      rt_priority, utime, stime, wchan);
+
+  /* keep the trace of the stall for post-mortem analysis */
+  if(trace_is_open())
+  {
+    trace_marker("watchdog: task %s (tid %d) stalled for %llu us",
+        stall->name, stall->tid,
+        (unsigned long long)(stall->stalled / 1000));
+    trace_stop();
+  }
+}
+
+/**
+ * \brief Runs the actions of a stalled task.
+ * \param stall the stall.
+ * \note Called without the mutex: actions may block or unregister tasks.
+ */
+static void watchdog_trip(const struct watchdog_stall* stall)
+{
+  if(stall->actions & WATCHDOG_DUMP)
+  {
+    watchdog_dump(stall);
+  }
+
+  if((stall->actions & WATCHDOG_CALLBACK) && stall->callback)
+  {
+    stall->callback(stall->heartbeat, stall->stalled, stall->data);
+  }
+
+  if(stall->actions & WATCHDOG_DEMOTE)
+  {
+    struct rt_prio prio = {.policy = SCHED_OTHER, .priority = 0};
+
+    task_set_rt_priority(stall->tid, &prio);
+  }
+
+  if(stall->actions & WATCHDOG_ABORT)
+  {
+    abort();
+  }
+}
+
+/**
+ * \brief Checks every monitored task.
+ * \param watchdog supervisor.
+ * \param now current time in nanoseconds.
+ */
+static void watchdog_check(struct watchdog* watchdog, uint64_t now)
+{
+  struct watchdog_stall stalls[WATCHDOG_MAX_TASKS];
+  size_t nb = 0;
+
+  rt_pi_mutex_lock(&watchdog->mutex);
+
+  for(size_t i = 0 ; i < WATCHDOG_MAX_TASKS ; i++)
+  {
+    struct watchdog_heartbeat* heartbeat = &watchdog->tasks[i];
+    uint64_t beats = 0;
+
+    if(!atomic_load_explicit(&heartbeat->active, memory_order_acquire))
+    {
+      continue;
+    }
+
+    beats = atomic_load_explicit(&heartbeat->beats, memory_order_relaxed);
+
+    if(beats != heartbeat->last_beats)
+    {
+      heartbeat->last_beats = beats;
+      heartbeat->last_change = now;
+      heartbeat->tripped = 0;
+    }
+    else if(!heartbeat->tripped &&
+        now - heartbeat->last_change >= heartbeat->timeout)
+    {
+      struct watchdog_stall* stall = &stalls[nb++];
+
+      /* once per stall, a new beat rearms it */
+      heartbeat->tripped = 1;
+      atomic_fetch_add(&heartbeat->stalls, 1);
+
+      stall->heartbeat = heartbeat;
+      memcpy(stall->name, heartbeat->name, WATCHDOG_NAME_SIZE);
+      stall->tid = heartbeat->tid;
+      stall->actions = heartbeat->actions;
+      stall->callback = heartbeat->callback;
+      stall->data = heartbeat->data;
+      stall->stalled = now - heartbeat->last_change;
+    }
+  }
+
+  rt_pi_mutex_unlock(&watchdog->mutex);
+
+  for(size_t i = 0 ; i < nb ; i++)
+  {
+    watchdog_trip(&stalls[i]);
+  }
+}
+
+/**
+ * \brief Supervisor thread.
+ * \param data the supervisor.
+ * \return NULL.
+ */
+static void* watchdog_thread(void* data)
+{
+  struct watchdog* watchdog = data;
+  unsigned long nano = watchdog->config.interval % 1000000000;
+  unsigned long second = watchdog->config.interval / 1000000000;
+  struct timespec next;
+
+  if(watchdog->config.cpu >= 0)
+  {
+    watchdog->error = thread_set_affinity(pthread_self(),
+        &watchdog->config.cpu, 1);
+  }
+
+  if(watchdog->error == 0 &&
+      thread_set_rt_priority(pthread_self(), &watchdog->config.priority) != 0)
+  {
+    watchdog->error = errno;
+  }
+
+  rt_event_signal(&watchdog->ready);
+  if(watchdog->error)
+  {
+    return NULL;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  while(!atomic_load(&watchdog->stop))
+  {
+    next.tv_sec += second;
+    next.tv_nsec += nano;
+    if(next.tv_nsec >= 1000000000)
+    {
+      next.tv_sec++;
+      next.tv_nsec -= 1000000000;
+    }
+
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    watchdog_check(watchdog, tsc_now_ns());
+  }
+
+  return NULL;
+}
+
+struct watchdog* watchdog_start(const struct watchdog_config* config)
+{
+  struct watchdog* watchdog = NULL;
+  int error = 0;
+
+  if(!config || config->interval == 0)
+  {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  watchdog = aligned_alloc(64, sizeof(struct watchdog));
+  if(!watchdog)
+  {
+    return NULL;
+  }
+
+  memset(watchdog, 0x00, sizeof(struct watchdog));
+  watchdog->config = *config;
+  atomic_init(&watchdog->stop, 0);
+  rt_pi_mutex_init(&watchdog->mutex, 0);
+  rt_event_init(&watchdog->ready, 0, 0);
+
+  for(size_t i = 0 ; i < WATCHDOG_MAX_TASKS ; i++)
+  {
+    atomic_init(&watchdog->tasks[i].beats, 0);
+    atomic_init(&watchdog->tasks[i].active, 0);
+    atomic_init(&watchdog->tasks[i].stalls, 0);
+  }
+
+  if(pthread_create(&watchdog->th, NULL, watchdog_thread, watchdog) != 0)
+  {
+    free(watchdog);
+    errno = EAGAIN;
+    return NULL;
+  }
+
+  rt_event_wait(&watchdog->ready);
+  error = watchdog->error;
+
+  if(error)
+  {
+    pthread_join(watchdog->th, NULL);
+    free(watchdog);
+    errno = error;
+    return NULL;
+  }
+
+  return watchdog;
+}
+
+void watchdog_stop(struct watchdog* watchdog)
+{
+  if(!watchdog)
+  {
+    return;
+  }
+
+  atomic_store(&watchdog->stop, 1);
+  pthread_join(watchdog->th, NULL);
+  free(watchdog);
+}
+
+struct watchdog_heartbeat* watchdog_register(struct watchdog* watchdog,
+    const char* name, unsigned long period, unsigned int misses,
+    unsigned int actions,
+    void (*callback)(const struct watchdog_heartbeat*, uint64_t, void*),
+    void* data)
+{
+  struct watchdog_heartbeat* heartbeat = NULL;
+
+  if(!watchdog || !name || period == 0 || misses == 0)
+  {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  rt_pi_mutex_lock(&watchdog->mutex);
+
+  for(size_t i = 0 ; i < WATCHDOG_MAX_TASKS ; i++)
+  {
+    if(!atomic_load(&watchdog->tasks[i].active))
+    {
+      heartbeat = &watchdog->tasks[i];
+      break;
+    }
+  }
+
+  if(heartbeat)
+  {
+    strncpy(heartbeat->name, name, WATCHDOG_NAME_SIZE - 1);
+    heartbeat->name[WATCHDOG_NAME_SIZE - 1] = '\0';
+    heartbeat->tid = syscall(SYS_gettid);
+    heartbeat->timeout = (uint64_t)period * misses;
+    heartbeat->actions = actions;
+    heartbeat->callback = callback;
+    heartbeat->data = data;
+    heartbeat->last_beats = atomic_load(&heartbeat->beats);
+    heartbeat->last_change = tsc_now_ns();
+    heartbeat->tripped = 0;
+    atomic_store(&heartbeat->stalls, 0);
+    atomic_store_explicit(&heartbeat->active, 1, memory_order_release);
+  }
+
+  rt_pi_mutex_unlock(&watchdog->mutex);
+
+  if(!heartbeat)
+  {
+    errno = ENOSPC;
+  }
+
+  return heartbeat;
+}
+
+void watchdog_unregister(struct watchdog* watchdog,
+    struct watchdog_heartbeat* heartbeat)
+{
+  if(!watchdog || !heartbeat)
+  {
+    return;
+  }
+
+  /* supervisor is not using the slot once the mutex is held */
+  rt_pi_mutex_lock(&watchdog->mutex);
+  atomic_store(&heartbeat->active, 0);
+  rt_pi_mutex_unlock(&watchdog->mutex);
+}
+
+uint64_t watchdog_get_stalls(const struct watchdog_heartbeat* heartbeat)
+{
+  return atomic_load(&heartbeat->stalls);
+}
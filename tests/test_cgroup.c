@@ -0,0 +1,125 @@
+/**
+ * \file test_cgroup.
+ * \brief Tests for cgroup v2 cpuset partition.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "cgroup.h"
+
+/**
+ * \brief Creates a file in the fake cgroup tree.
+ * \param root root of the fake tree.
+ * \param file name of the file.
+ * \param content initial content.
+ * \return 0 if success, -1 otherwise.
+ */
+static int fake_file(const char* root, const char* file, const char* content)
+{
+  char path[1024];
+  FILE* f = NULL;
+
+  snprintf(path, sizeof(path), "%s/%s", root, file);
+  f = fopen(path, "w");
+  if(!f)
+  {
+    perror("fopen");
+    return -1;
+  }
+
+  fputs(content, f);
+  fclose(f);
+  return 0;
+}
+
+/**
+ * \brief Main entry point.
+ *
+ * Without argument, a fake cgroup tree is built in /tmp. With an argument,
+ * the real cgroup v2 hierarchy mounted at argv[1] is used.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  char root[] = "/tmp/rtvsutils-cgroup-XXXXXX";
+  char path[1024];
+  int cpus[1] = {0};
+  int fake = argc < 2;
+
+  if(fake)
+  {
+    if(!mkdtemp(root))
+    {
+      perror("mkdtemp");
+      exit(EXIT_FAILURE);
+    }
+
+    snprintf(path, sizeof(path), "%s/rt", root);
+    mkdir(path, 0755);
+
+    if(fake_file(root, "cgroup.subtree_control", "") != 0 ||
+        fake_file(root, "cgroup.procs", "") != 0 ||
+        fake_file(root, "rt/cpuset.cpus", "") != 0 ||
+        fake_file(root, "rt/cpuset.cpus.partition", "member\n") != 0 ||
+        fake_file(root, "rt/cgroup.type", "domain\n") != 0 ||
+        fake_file(root, "rt/cgroup.procs", "") != 0)
+    {
+      exit(EXIT_FAILURE);
+    }
+
+    cgroup_set_root(root);
+  }
+  else
+  {
+    cgroup_set_root(argv[1]);
+  }
+
+  fprintf(stdout, "cgroup root: %s\n", cgroup_get_root());
+
+  if(cpuset_partition_create("rt", cpus, 1, CPUSET_PARTITION_ISOLATED, 0)
+      != 0)
+  {
+    perror("cpuset_partition_create");
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stdout, "Partition type: %d\n", cpuset_partition_get_type("rt"));
+
+  if(cpuset_partition_move_process("rt", getpid()) != 0)
+  {
+    perror("cpuset_partition_move_process");
+    exit(EXIT_FAILURE);
+  }
+
+  if(cpuset_partition_destroy("rt") != 0)
+  {
+    /* rmdir of the fake tree fails as files are not virtual */
+    perror("cpuset_partition_destroy");
+  }
+
+  if(fake)
+  {
+    const char* files[] = {"cgroup.subtree_control", "cgroup.procs",
+      "rt/cpuset.cpus", "rt/cpuset.cpus.partition", "rt/cgroup.type",
+      "rt/cgroup.procs", "rt", NULL};
+
+    for(size_t i = 0 ; files[i] ; i++)
+    {
+      snprintf(path, sizeof(path), "%s/%s", root, files[i]);
+      remove(path);
+    }
+    rmdir(root);
+  }
+
+  fprintf(stdout, "cpuset partition success\n");
+  return EXIT_SUCCESS;
+}
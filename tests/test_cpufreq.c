@@ -1,6 +1,6 @@
 /**
- * \file test_priority.
- * \brief Tests for process/thread priority.
+ * \file test_cpufreq.
+ * \brief Tests for CPU frequency.
  * \author Sebastien Vincent
  * \date 2017
  */
@@ -20,44 +20,79 @@
 int main(int argc, char** argv)
 {
   enum cpufreq_governor governor = cpufreq_get_governor(0);
+  char governors[16][CPUFREQ_NAME_SIZE];
+  char name[CPUFREQ_NAME_SIZE];
+  unsigned long freqs[64];
+  unsigned long min = 0;
+  unsigned long max = 0;
+  int cpus[1024];
+  int nb = 0;
 
   (void)argc;
   (void)argv;
 
   fprintf(stdout, "CPU frequency governor: %d\n", governor);
 
-  if(cpufreq_set_governor(CPUFREQ_PERFORMANCE, 0) != 0)
+  if(cpufreq_get_governor_name(0, name, sizeof(name)) != 0)
   {
-    perror("cpufreq_set_governor performance");
+    perror("cpufreq_get_governor_name");
+    exit(EXIT_FAILURE);
   }
-  sleep(5);
-  
-  if(cpufreq_set_governor(CPUFREQ_POWERSAVE, 0) != 0)
+  fprintf(stdout, "CPU frequency governor name: %s\n", name);
+
+  nb = cpufreq_get_policy_cpus(0, cpus, 1024);
+  fprintf(stdout, "CPUs in policy group: ");
+  for(int i = 0 ; i < nb ; i++)
   {
-    perror("cpufreq_set_governor powersave");
+    fprintf(stdout, "%d ", cpus[i]);
   }
-  sleep(5);
+  fprintf(stdout, "\n");
 
-  if(cpufreq_set_governor(CPUFREQ_ONDEMAND, 0) != 0)
+  if(cpufreq_get_hw_limits(0, &min, &max) == 0)
   {
-    perror("cpufreq_set_governor ondemand");
+    fprintf(stdout, "Hardware limits: %lu - %lu kHz\n", min, max);
   }
-  sleep(5);
 
-  if(cpufreq_set_governor(CPUFREQ_CONSERVATIVE, 0) != 0)
+  nb = cpufreq_get_available_frequencies(0, freqs, 64);
+  fprintf(stdout, "Available frequencies: ");
+  for(int i = 0 ; i < nb ; i++)
   {
-    perror("cpufreq_set_governor conservative");
+    fprintf(stdout, "%lu ", freqs[i]);
   }
-  sleep(5);
+  fprintf(stdout, "\n");
 
-  if(governor != -1)
+  nb = cpufreq_get_available_governors(0, governors, 16);
+  for(int i = 0 ; i < nb ; i++)
   {
-    if(cpufreq_set_governor(governor, 0) != 0)
+    fprintf(stdout, "Set governor %s\n", governors[i]);
+    if(cpufreq_set_governor_name(governors[i], 0) != 0)
     {
-      perror("cpufreq_set_governor");
-      exit(EXIT_FAILURE);
+      perror("cpufreq_set_governor_name");
     }
+    sleep(5);
+    fprintf(stdout, "Frequency: %lu kHz\n", cpufreq_get_frequency(0));
+  }
+
+  /* pin at the lowest frequency */
+  if(cpufreq_get_hw_limits(0, &min, &max) == 0)
+  {
+    if(cpufreq_set_frequency(0, min) != 0)
+    {
+      perror("cpufreq_set_frequency");
+    }
+    sleep(5);
+    fprintf(stdout, "Frequency: %lu kHz\n", cpufreq_get_frequency(0));
+
+    if(cpufreq_set_limits(0, min, max) != 0)
+    {
+      perror("cpufreq_set_limits");
+    }
+  }
+
+  if(cpufreq_set_governor_name(name, 0) != 0)
+  {
+    perror("cpufreq_set_governor_name");
+    exit(EXIT_FAILURE);
   }
   return EXIT_SUCCESS;
 }
-
@@ -0,0 +1,77 @@
+/**
+ * \file test_cpuidle.
+ * \brief Tests for CPU idle states and PM QoS.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cpuidle.h"
+#include "tuning.h"
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  struct cpuidle_state states[32];
+  int nb = 0;
+
+  (void)argc;
+  (void)argv;
+
+  nb = cpuidle_get_states(0, states, 32);
+  if(nb < 0)
+  {
+    perror("cpuidle_get_states");
+  }
+
+  for(int i = 0 ; i < nb ; i++)
+  {
+    fprintf(stdout, "state%u %s (%s): latency %lu us residency %lu us%s\n",
+        states[i].index, states[i].name, states[i].desc, states[i].latency,
+        states[i].residency, states[i].disabled ? " disabled" : "");
+  }
+
+  if(nb > 0)
+  {
+    /* only keep states with exit latency below 10 us on CPU 0 */
+    fprintf(stdout, "Disabled states: %d\n", cpuidle_limit_latency(0, 10));
+
+    if(tuning_restore() != 0)
+    {
+      perror("tuning_restore");
+    }
+  }
+
+  fprintf(stdout, "PM QoS latency: %d us\n", (int)pm_qos_get_latency());
+
+  if(pm_qos_set_latency(0) != 0)
+  {
+    perror("pm_qos_set_latency");
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stdout, "PM QoS latency: %d us\n", (int)pm_qos_get_latency());
+
+  if(pm_qos_release() != 0)
+  {
+    perror("pm_qos_release");
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stdout, "PM QoS latency: %d us\n", (int)pm_qos_get_latency());
+
+  if(cpuidle_set_resume_latency(0, 20) != 0)
+  {
+    perror("cpuidle_set_resume_latency");
+  }
+  cpuidle_set_resume_latency(0, -1);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+/**
+ * \file test_hist.c
+ * \brief Tests for latency histogram.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "rtutils.h"
+
+/**
+ * \brief Histograms of the periodic task.
+ */
+static struct rt_hist wakeup_hist;
+
+/**
+ * \brief Execution histogram of the periodic task.
+ */
+static struct rt_hist exec_hist;
+
+/**
+ * \brief Task to execute periodically (no cancellation point).
+ * \param data data for the task.
+ */
+static void th_task(void* data)
+{
+  volatile unsigned long* counter = data;
+
+  for(int i = 0 ; i < 1000 ; i++)
+  {
+    (*counter)++;
+  }
+}
+
+/**
+ * \brief Dedicated thread to execute a periodic task.
+ * \param data data for the task.
+ * \return NULL.
+ */
+static void* th_periodic(void* data)
+{
+  struct periodic_task_attr attr;
+
+  memset(&attr, 0x00, sizeof(struct periodic_task_attr));
+  attr.wakeup_hist = &wakeup_hist;
+  attr.exec_hist = &exec_hist;
+
+  if(thread_periodic_task_attr(th_task, data, 1000000, &attr) != 0)
+  {
+    fprintf(stderr, "Failed to launch periodic task\n");
+  }
+
+  return NULL;
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  static struct rt_hist hist1;
+  static struct rt_hist hist2;
+  struct timespec ts = {0, 200000000};
+  volatile unsigned long counter = 0;
+  pthread_t th;
+
+  (void)argc;
+  (void)argv;
+
+  /* buckets are contiguous and cover the values they contain */
+  for(size_t i = 0 ; i < RT_HIST_BUCKETS ; i++)
+  {
+    uint64_t lower = rt_hist_bucket_lower(i);
+    uint64_t upper = rt_hist_bucket_upper(i);
+
+    if(rt_hist_bucket_index(lower) != i || rt_hist_bucket_index(upper) != i ||
+        (i > 0 && rt_hist_bucket_upper(i - 1) + 1 != lower))
+    {
+      fprintf(stderr, "Bad bucket %zu [%llu, %llu]\n", i,
+          (unsigned long long)lower, (unsigned long long)upper);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if(rt_hist_bucket_upper(RT_HIST_BUCKETS - 1) != UINT64_MAX)
+  {
+    fprintf(stderr, "Histogram does not cover 64-bit range\n");
+    exit(EXIT_FAILURE);
+  }
+
+  rt_hist_init(&hist1);
+  rt_hist_init(&hist2);
+
+  for(uint64_t i = 1 ; i <= 50000 ; i++)
+  {
+    rt_hist_record(&hist1, i);
+    rt_hist_record_shared(&hist2, i + 50000);
+  }
+
+  rt_hist_merge(&hist1, &hist2);
+
+  fprintf(stdout, "count %llu min %llu max %llu mean %.1f p50 %llu "
+      "p99 %llu p99.99 %llu\n",
+      (unsigned long long)rt_hist_get_count(&hist1),
+      (unsigned long long)rt_hist_get_min(&hist1),
+      (unsigned long long)rt_hist_get_max(&hist1), rt_hist_get_mean(&hist1),
+      (unsigned long long)rt_hist_get_percentile(&hist1, 50.0),
+      (unsigned long long)rt_hist_get_percentile(&hist1, 99.0),
+      (unsigned long long)rt_hist_get_percentile(&hist1, 99.99));
+
+  if(rt_hist_get_count(&hist1) != 100000 || rt_hist_get_min(&hist1) != 1 ||
+      rt_hist_get_max(&hist1) != 100000 ||
+      llabs((long long)rt_hist_get_percentile(&hist1, 99.0) - 99000) >
+      99000 / 32)
+  {
+    fprintf(stderr, "Bad histogram statistics\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* periodic task statistics */
+  rt_hist_init(&wakeup_hist);
+  rt_hist_init(&exec_hist);
+
+  if(pthread_create(&th, NULL, th_periodic, (void*)&counter) != 0)
+  {
+    fprintf(stderr, "Failed to launch thread\n");
+    exit(EXIT_FAILURE);
+  }
+
+  clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+  pthread_cancel(th);
+  pthread_join(th, NULL);
+
+  fprintf(stdout, "Wakeup latency: count %llu p99 %llu ns max %llu ns\n",
+      (unsigned long long)rt_hist_get_count(&wakeup_hist),
+      (unsigned long long)rt_hist_get_percentile(&wakeup_hist, 99.0),
+      (unsigned long long)rt_hist_get_max(&wakeup_hist));
+  fprintf(stdout, "Execution time: p99 %llu ns\n",
+      (unsigned long long)rt_hist_get_percentile(&exec_hist, 99.0));
+
+  rt_hist_export(&exec_hist, stdout);
+
+  return EXIT_SUCCESS;
+}
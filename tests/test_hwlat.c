@@ -0,0 +1,76 @@
+/**
+ * \file test_hwlat.c
+ * \brief Tests for hardware latency detector.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hwlat.h"
+#include "tsc.h"
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  struct timespec ts = {0, 500000000};
+  struct hwlat_config config;
+  struct hwlat_stats stats;
+  struct hwlat* hwlat = NULL;
+  int cpus[] = {0};
+
+  (void)argc;
+  (void)argv;
+
+  tsc_init(0);
+
+  config.cpus = cpus;
+  config.cpus_size = 1;
+  config.priority = 80;
+  config.threshold = 10000;
+  /* 50% duty cycle */
+  config.window = 100000000;
+  config.width = 50000000;
+
+  hwlat = hwlat_start(&config);
+  if(!hwlat)
+  {
+    perror("hwlat_start");
+    exit(EXIT_FAILURE);
+  }
+
+  clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+
+  if(hwlat_get_stats(hwlat, 0, &stats) != 0)
+  {
+    perror("hwlat_get_stats");
+    hwlat_stop(hwlat);
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stdout, "CPU %d (pinned: %d SCHED_FIFO: %d): samples %llu "
+      "gaps > %llu ns: %llu max %llu ns p99 %llu ns\n", stats.cpu,
+      stats.pinned, stats.rt,
+      (unsigned long long)stats.samples,
+      (unsigned long long)config.threshold, (unsigned long long)stats.gaps,
+      (unsigned long long)stats.max,
+      (unsigned long long)rt_hist_get_percentile(hwlat_get_hist(hwlat, 0),
+        99.0));
+
+  hwlat_stop(hwlat);
+
+  if(stats.samples == 0)
+  {
+    fprintf(stderr, "No sample\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,245 @@
+/**
+ * \file test_memres.c
+ * \brief Tests for memory residency verification and locked mappings.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "memres.h"
+#include "tuning.h"
+
+/**
+ * \brief Size of the test file.
+ */
+#define FILE_SIZE (1024 * 1024 + 123)
+
+/**
+ * \brief Number of reserved hugetlb pages.
+ */
+#define NR_HUGEPAGES_PATH "/proc/sys/vm/nr_hugepages"
+
+/**
+ * \brief Address whose mapping is looked for by the callback.
+ */
+static uintptr_t watched = 0;
+
+/**
+ * \brief Set if the watched address is reported.
+ */
+static int reported = 0;
+
+/**
+ * \brief Scan callback.
+ * \param range mapping not fully locked or resident.
+ * \param data unused.
+ */
+static void on_range(const struct mem_range* range, void* data)
+{
+  (void)data;
+
+  if(watched >= range->start && watched < range->end)
+  {
+    reported = 1;
+  }
+}
+
+/**
+ * \brief Checks a mapping of the test file.
+ * \param flags flags of mem_map_file().
+ * \param path path of the test file.
+ * \param content expected content.
+ * \param hugetlb if not 0, the mapping must use hugetlb pages.
+ * \return 0 if success, -1 otherwise.
+ */
+static int check_map(unsigned int flags, const char* path,
+    const unsigned char* content, int hugetlb)
+{
+  struct mem_map map;
+
+  if(mem_map_file(&map, path, flags) != 0)
+  {
+    int err = errno;
+
+    perror("mem_map_file");
+    /* locking memory is not allowed here */
+    return (err == EPERM || err == ENOMEM) ? 0 : -1;
+  }
+
+  fprintf(stdout, "Mapped %zu bytes (length %zu, hugetlb %d)\n", map.size,
+      map.length, map.hugetlb);
+
+  if(hugetlb && !map.hugetlb)
+  {
+    fprintf(stderr, "Reserved hugetlb pages not used\n");
+    mem_unmap_file(&map);
+    return -1;
+  }
+
+  if(map.size != FILE_SIZE || memcmp(map.addr, content, FILE_SIZE) != 0)
+  {
+    fprintf(stderr, "Bad content\n");
+    mem_unmap_file(&map);
+    return -1;
+  }
+
+  watched = (uintptr_t)map.addr;
+  reported = 0;
+  mem_residency_scan(NULL, on_range, NULL);
+  mem_unmap_file(&map);
+
+  if(reported)
+  {
+    fprintf(stderr, "Locked mapping reported\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Reserves one more hugetlb page, restored by tuning_restore().
+ * \return 0 if success, -1 otherwise.
+ */
+static int reserve_huge_page(void)
+{
+  unsigned long nb = 0;
+  unsigned long reserved = 0;
+  FILE* f = fopen(NR_HUGEPAGES_PATH, "r");
+
+  if(!f)
+  {
+    return -1;
+  }
+
+  if(fscanf(f, "%lu", &nb) != 1)
+  {
+    nb = 0;
+  }
+  fclose(f);
+
+  if(tuning_record(NR_HUGEPAGES_PATH) != 0 ||
+      !(f = fopen(NR_HUGEPAGES_PATH, "w")))
+  {
+    return -1;
+  }
+  fprintf(f, "%lu", nb + 1);
+  fclose(f);
+
+  /* kernel may not find a free huge page */
+  f = fopen(NR_HUGEPAGES_PATH, "r");
+  if(!f || fscanf(f, "%lu", &reserved) != 1)
+  {
+    reserved = 0;
+  }
+  if(f)
+  {
+    fclose(f);
+  }
+
+  return reserved > nb ? 0 : -1;
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  char path[] = "/tmp/test_memres.XXXXXX";
+  struct mem_residency report;
+  unsigned char* content = malloc(FILE_SIZE);
+  void* lazy = NULL;
+  int fd = -1;
+  int zero = -1;
+  int nb = 0;
+
+  (void)argc;
+  (void)argv;
+
+  if(!content)
+  {
+    exit(EXIT_FAILURE);
+  }
+
+  for(size_t i = 0 ; i < FILE_SIZE ; i++)
+  {
+    content[i] = (unsigned char)(i * 7);
+  }
+
+  fd = mkstemp(path);
+  if(fd == -1 || write(fd, content, FILE_SIZE) != FILE_SIZE)
+  {
+    perror("mkstemp");
+    exit(EXIT_FAILURE);
+  }
+
+  /* lazily mapped anonymous memory is neither locked nor resident */
+  zero = open("/dev/zero", O_RDWR);
+  lazy = mmap(NULL, 1024 * 1024, PROT_READ | PROT_WRITE, MAP_PRIVATE, zero,
+      0);
+  close(zero);
+  if(lazy == MAP_FAILED)
+  {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+
+  watched = (uintptr_t)lazy;
+  nb = mem_residency_scan(&report, on_range, NULL);
+
+  fprintf(stdout, "%zu mappings, %zu kB, locked %zu kB, resident %zu kB, "
+      "%zu unlocked, %zu not resident\n", report.mappings, report.size / 1024,
+      report.locked / 1024, report.resident / 1024, report.unlocked_ranges,
+      report.nonresident_ranges);
+
+  if(nb <= 0 || !reported || report.mappings == 0 ||
+      report.unlocked_ranges == 0 || report.nonresident_ranges == 0)
+  {
+    fprintf(stderr, "Lazy mapping not reported\n");
+    exit(EXIT_FAILURE);
+  }
+  munmap(lazy, 1024 * 1024);
+
+  if(check_map(0, path, content, 0) != 0 ||
+      check_map(MEM_MAP_WRITE, path, content, 0) != 0 ||
+      check_map(MEM_MAP_HUGE, path, content, 0) != 0)
+  {
+    unlink(path);
+    exit(EXIT_FAILURE);
+  }
+
+  /* hugetlb mappings are never VM_LOCKED, the scan must not report them */
+  if(reserve_huge_page() == 0)
+  {
+    if(check_map(MEM_MAP_HUGE, path, content, 1) != 0)
+    {
+      tuning_restore();
+      unlink(path);
+      exit(EXIT_FAILURE);
+    }
+  }
+  else
+  {
+    fprintf(stdout, "No hugetlb page can be reserved\n");
+  }
+  tuning_restore();
+
+  unlink(path);
+  close(fd);
+  free(content);
+
+  fprintf(stdout, "Memory residency OK\n");
+  return EXIT_SUCCESS;
+}
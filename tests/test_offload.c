@@ -0,0 +1,200 @@
+/**
+ * \file test_offload.c
+ * \brief Tests for deferred-work queue.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+
+#include "offload.h"
+
+/**
+ * \brief Number of jobs.
+ */
+#define NB_JOBS 10000
+
+/**
+ * \brief Sum of the job payloads.
+ */
+static atomic_ulong sum;
+
+/**
+ * \brief If not 0, slow_job() blocks.
+ */
+static atomic_int blocked;
+
+/**
+ * \brief Scheduling policy seen by policy_job().
+ */
+static atomic_int policy;
+
+/**
+ * \brief Job that adds its payload to the sum.
+ * \param payload unsigned long value.
+ */
+static void add_job(void* payload)
+{
+  atomic_fetch_add(&sum, *(unsigned long*)payload);
+}
+
+/**
+ * \brief Job that blocks until released (non real-time work).
+ * \param payload unused.
+ */
+static void slow_job(void* payload)
+{
+  struct timespec delay = {.tv_sec = 0, .tv_nsec = 1000000};
+
+  (void)payload;
+
+  while(atomic_load(&blocked))
+  {
+    nanosleep(&delay, NULL);
+  }
+}
+
+/**
+ * \brief Job that records the scheduling policy of the helper.
+ * \param payload unused.
+ */
+static void policy_job(void* payload)
+{
+  (void)payload;
+
+  atomic_store(&policy, sched_getscheduler(0));
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  struct offload_config config = {.capacity = 64, .helpers = 2, .nice = 10,
+    .cpus = NULL, .cpus_size = 0, .batch = 16};
+  struct offload_stats stats;
+  struct sched_param param;
+  struct offload* offload = NULL;
+  unsigned long expected = 0;
+  char big[OFFLOAD_PAYLOAD_SIZE + 1];
+  int rejected = 0;
+
+  (void)argc;
+  (void)argv;
+
+  atomic_init(&sum, 0);
+  atomic_init(&blocked, 0);
+
+  config.capacity = 48;
+  if(offload_create(&config) != NULL || errno != EINVAL)
+  {
+    fprintf(stderr, "Capacity must be a power of two\n");
+    exit(EXIT_FAILURE);
+  }
+  config.capacity = 64;
+
+  offload = offload_create(&config);
+  if(!offload)
+  {
+    perror("offload_create");
+    exit(EXIT_FAILURE);
+  }
+
+  if(offload_post(offload, add_job, big, sizeof(big)) == 0 ||
+      errno != EMSGSIZE)
+  {
+    fprintf(stderr, "Oversized payload accepted\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for(unsigned long i = 1 ; i <= NB_JOBS ; i++)
+  {
+    while(offload_post(offload, add_job, &i, sizeof(i)) != 0)
+    {
+      if(errno != EAGAIN)
+      {
+        perror("offload_post");
+        exit(EXIT_FAILURE);
+      }
+      sched_yield();
+    }
+    expected += i;
+  }
+
+  offload_flush(offload);
+
+  if(atomic_load(&sum) != expected)
+  {
+    fprintf(stderr, "Bad sum: %lu (expected %lu)\n", atomic_load(&sum),
+        expected);
+    exit(EXIT_FAILURE);
+  }
+
+  /* backpressure: helpers are blocked, queue fills up */
+  atomic_store(&blocked, 1);
+  for(unsigned int i = 0 ; i < config.capacity + config.helpers + 1 ; i++)
+  {
+    if(offload_post(offload, slow_job, NULL, 0) != 0)
+    {
+      if(errno != EAGAIN)
+      {
+        perror("offload_post");
+        exit(EXIT_FAILURE);
+      }
+      rejected++;
+    }
+  }
+  atomic_store(&blocked, 0);
+
+  offload_get_stats(offload, &stats);
+  fprintf(stdout, "Posted %lu executed %lu rejected %lu batches %lu "
+      "max depth %lu\n", (unsigned long)stats.posted,
+      (unsigned long)stats.executed, (unsigned long)stats.rejected,
+      (unsigned long)stats.batches, (unsigned long)stats.max_depth);
+
+  if(rejected == 0 || stats.rejected < (uint64_t)rejected ||
+      stats.max_depth == 0 || stats.max_depth > config.capacity)
+  {
+    fprintf(stderr, "Bad backpressure statistics\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* pending jobs are run before the helpers stop */
+  offload_destroy(offload);
+
+  /* helpers created by a real-time thread still get their nice value */
+  param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+  if(sched_setscheduler(0, SCHED_FIFO, &param) == 0)
+  {
+    offload = offload_create(&config);
+    param.sched_priority = 0;
+    sched_setscheduler(0, SCHED_OTHER, &param);
+
+    if(!offload)
+    {
+      perror("offload_create from SCHED_FIFO");
+      exit(EXIT_FAILURE);
+    }
+
+    atomic_store(&policy, -1);
+    offload_post(offload, policy_job, NULL, 0);
+    offload_destroy(offload);
+
+    if(atomic_load(&policy) != SCHED_OTHER)
+    {
+      fprintf(stderr, "Helper inherited the policy of its creator\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  fprintf(stdout, "Offload queue OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,132 @@
+/**
+ * \file test_percpu.
+ * \brief Tests for fast CPU lookup and per-CPU data structures.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "percpu.h"
+
+/**
+ * \brief Number of threads.
+ */
+#define NB_THREADS 4
+
+/**
+ * \brief Number of increments per thread.
+ */
+#define NB_LOOPS 1000000
+
+/**
+ * \brief Shared counter.
+ */
+static struct percpu_counter counter;
+
+/**
+ * \brief Shared buffers.
+ */
+static struct percpu_buffer buffer;
+
+/**
+ * \brief Thread function.
+ * \param data not used.
+ * \return NULL.
+ */
+static void* thread_function(void* data)
+{
+  (void)data;
+
+  for(int i = 0 ; i < NB_LOOPS ; i++)
+  {
+    percpu_counter_add(&counter, 1);
+
+    if(percpu_buffer_push(&buffer, &counter) == 0 &&
+        percpu_buffer_pop(&buffer) == NULL)
+    {
+      /* item may have been popped by another thread of the same CPU */
+      continue;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  pthread_t th[NB_THREADS];
+  struct timespec start;
+  struct timespec end;
+  long sum = 0;
+  int cpu = 0;
+  int count = 0;
+
+  (void)argc;
+  (void)argv;
+
+  fprintf(stdout, "rseq available: %s\n",
+      percpu_thread_init() == 0 ? "yes" : "no");
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(int i = 0 ; i < NB_LOOPS ; i++)
+  {
+    cpu += percpu_get_cpu();
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  fprintf(stdout, "percpu_get_cpu: %.2f ns/call (CPU %d)\n",
+      ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) /
+      NB_LOOPS, cpu / NB_LOOPS);
+
+  if(percpu_counter_init(&counter) != 0 ||
+      percpu_buffer_init(&buffer, 16) != 0)
+  {
+    perror("percpu init");
+    exit(EXIT_FAILURE);
+  }
+
+  for(int i = 0 ; i < NB_THREADS ; i++)
+  {
+    if(pthread_create(&th[i], NULL, thread_function, NULL) != 0)
+    {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for(int i = 0 ; i < NB_THREADS ; i++)
+  {
+    pthread_join(th[i], NULL);
+  }
+
+  sum = percpu_counter_sum(&counter);
+  fprintf(stdout, "Counter: %ld (expected %d)\n", sum, NB_THREADS * NB_LOOPS);
+
+  /* buffer has to be empty */
+  while(percpu_buffer_pop(&buffer))
+  {
+    count++;
+  }
+
+  percpu_buffer_destroy(&buffer);
+  percpu_counter_destroy(&counter);
+
+  if(sum != NB_THREADS * NB_LOOPS)
+  {
+    fprintf(stderr, "per-CPU counter failure\n");
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stdout, "per-CPU success (%d items left)\n", count);
+  return EXIT_SUCCESS;
+}
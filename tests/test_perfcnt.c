@@ -0,0 +1,145 @@
+/**
+ * \file test_perfcnt.c
+ * \brief Tests for performance counters.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "rtutils.h"
+#include "perfcnt.h"
+
+/**
+ * \brief Task to execute periodically.
+ * \param data data for the task.
+ */
+static void th_task(void* data)
+{
+  volatile unsigned long* counter = data;
+
+  for(int i = 0 ; i < 10000 ; i++)
+  {
+    (*counter)++;
+  }
+}
+
+/**
+ * \brief Prints the statistics of some cycles.
+ * \param stats statistics of the cycle.
+ * \param data data of the task.
+ */
+static void th_stats(const struct periodic_cycle_stats* stats, void* data)
+{
+  (void)data;
+
+  if(stats->cycle % 20 != 0)
+  {
+    return;
+  }
+
+  fprintf(stdout, "cycle %llu: latency %llu ns exec %llu ns",
+      stats->cycle, (unsigned long long)stats->latency,
+      (unsigned long long)stats->exec_time);
+
+  for(int i = 0 ; i < PERFCNT_NB ; i++)
+  {
+    if(stats->perf.valid & (1 << i))
+    {
+      fprintf(stdout, " %s %llu", perfcnt_event_name(i),
+          (unsigned long long)stats->perf.values[i]);
+    }
+  }
+
+  fprintf(stdout, "\n");
+}
+
+/**
+ * \brief Dedicated thread to execute a periodic task.
+ * \param data data for the task.
+ * \return NULL.
+ */
+static void* th_periodic(void* data)
+{
+  struct periodic_task_attr attr;
+
+  memset(&attr, 0x00, sizeof(struct periodic_task_attr));
+  attr.perf = 1;
+  attr.cycle_stats = th_stats;
+
+  if(thread_periodic_task_attr(th_task, data, 1000000, &attr) != 0)
+  {
+    fprintf(stderr, "Failed to launch periodic task\n");
+  }
+
+  return NULL;
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  struct timespec ts = {0, 100000000};
+  struct perfcnt_values before;
+  struct perfcnt_values after;
+  struct perfcnt_values delta;
+  struct perfcnt pc;
+  volatile unsigned long counter = 0;
+  pthread_t th;
+
+  (void)argc;
+  (void)argv;
+
+  if(perfcnt_open(&pc, 0) != 0)
+  {
+    perror("perfcnt_open");
+  }
+  else
+  {
+    fprintf(stdout, "Counters opened (software fallback: %d)\n",
+        pc.software);
+
+    perfcnt_read(&pc, &before);
+    th_task((void*)&counter);
+    perfcnt_read(&pc, &after);
+    perfcnt_delta(&before, &after, &delta);
+
+    for(int i = 0 ; i < PERFCNT_NB ; i++)
+    {
+      fprintf(stdout, "%s: %s\n", perfcnt_event_name(i),
+          (delta.valid & (1 << i)) ? "available" : "not available");
+    }
+
+    fprintf(stdout, "time enabled %llu ns running %llu ns\n",
+        (unsigned long long)delta.time_enabled,
+        (unsigned long long)delta.time_running);
+
+    if(delta.time_running > delta.time_enabled)
+    {
+      fprintf(stderr, "Time running beyond time enabled\n");
+      exit(EXIT_FAILURE);
+    }
+
+    perfcnt_close(&pc);
+  }
+
+  if(pthread_create(&th, NULL, th_periodic, (void*)&counter) != 0)
+  {
+    fprintf(stderr, "Failed to launch thread\n");
+    exit(EXIT_FAILURE);
+  }
+
+  clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+  pthread_cancel(th);
+  pthread_join(th, NULL);
+
+  return EXIT_SUCCESS;
+}
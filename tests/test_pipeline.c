@@ -0,0 +1,229 @@
+/**
+ * \file test_pipeline.c
+ * \brief Tests for periodic multi-stage pipeline.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+
+#include "pipeline.h"
+#include "tsc.h"
+
+/**
+ * \brief Number of stages.
+ */
+#define NB_STAGES 3
+
+/**
+ * \struct frame
+ * \brief Test frame.
+ */
+struct frame
+{
+  /**
+   * \brief Sequence number written by the source.
+   */
+  uint64_t seq;
+
+  /**
+   * \brief Value written by each stage.
+   */
+  uint64_t values[NB_STAGES];
+};
+
+/**
+ * \brief Number of bad frames seen by the stages.
+ */
+static atomic_int errors;
+
+/**
+ * \brief Next sequence number expected by the last stage.
+ */
+static uint64_t next_seq = 0;
+
+/**
+ * \brief Source: starts a frame.
+ * \param data frame.
+ * \param seq sequence number.
+ * \param arg unused.
+ */
+static void source(void* data, uint64_t seq, void* arg)
+{
+  struct frame* frame = data;
+
+  (void)arg;
+
+  frame->seq = seq;
+  for(unsigned int i = 0 ; i < NB_STAGES ; i++)
+  {
+    frame->values[i] = 0;
+  }
+}
+
+/**
+ * \brief Stage: checks the work of the previous stages and does its own.
+ * \param data frame.
+ * \param seq sequence number.
+ * \param arg index of the stage.
+ */
+static void stage(void* data, uint64_t seq, void* arg)
+{
+  struct frame* frame = data;
+  uintptr_t index = (uintptr_t)arg;
+
+  if(frame->seq != seq)
+  {
+    atomic_fetch_add(&errors, 1);
+  }
+
+  for(uintptr_t i = 0 ; i < NB_STAGES ; i++)
+  {
+    uint64_t expected = i < index ? seq * (i + 1) : 0;
+
+    if(frame->values[i] != expected)
+    {
+      atomic_fetch_add(&errors, 1);
+    }
+  }
+
+  frame->values[index] = seq * (index + 1);
+
+  if(index == NB_STAGES - 1)
+  {
+    if(seq != next_seq)
+    {
+      atomic_fetch_add(&errors, 1);
+    }
+    next_seq = seq + 1;
+  }
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  struct pipeline_stage stages[NB_STAGES];
+  struct pipeline_config config;
+  struct pipeline_stats stats;
+  struct pipeline* pipeline = NULL;
+  struct timespec duration = {.tv_sec = 0, .tv_nsec = 200000000};
+  const struct rt_hist* latency = NULL;
+  uint64_t frames = 0;
+
+  (void)argc;
+  (void)argv;
+
+  tsc_init(0);
+  atomic_init(&errors, 0);
+
+  /* SCHED_OTHER on CPU 0 so that the test runs everywhere */
+  for(uintptr_t i = 0 ; i < NB_STAGES ; i++)
+  {
+    stages[i].fcn = stage;
+    stages[i].data = (void*)i;
+    stages[i].cpu = 0;
+    stages[i].priority.policy = SCHED_OTHER;
+    stages[i].priority.priority = 0;
+  }
+
+  config.stages = stages;
+  config.nb_stages = NB_STAGES;
+  config.frame_size = sizeof(struct frame);
+  config.nb_frames = 3;
+  config.period = 1000000;
+  config.source = stages[0];
+  config.source.fcn = source;
+
+  if(pipeline_start(&config) != NULL || errno != EINVAL)
+  {
+    fprintf(stderr, "Number of frames must be a power of two\n");
+    exit(EXIT_FAILURE);
+  }
+
+  config.nb_frames = 4;
+  pipeline = pipeline_start(&config);
+  if(!pipeline)
+  {
+    perror("pipeline_start");
+    exit(EXIT_FAILURE);
+  }
+
+  nanosleep(&duration, NULL);
+  pipeline_stop(pipeline);
+  pipeline = NULL;
+
+  if(atomic_load(&errors) != 0 || next_seq == 0)
+  {
+    fprintf(stderr, "Bad frames: %d errors, %lu frames\n",
+        atomic_load(&errors), (unsigned long)next_seq);
+    exit(EXIT_FAILURE);
+  }
+
+  /* statistics are read on a running pipeline */
+  next_seq = 0;
+  pipeline = pipeline_start(&config);
+  if(!pipeline)
+  {
+    perror("pipeline_start");
+    exit(EXIT_FAILURE);
+  }
+  nanosleep(&duration, NULL);
+
+  for(size_t i = 0 ; i < NB_STAGES ; i++)
+  {
+    const struct rt_hist* wait = pipeline_get_hist(pipeline, i,
+        PIPELINE_HIST_WAIT);
+    const struct rt_hist* exec = pipeline_get_hist(pipeline, i,
+        PIPELINE_HIST_EXEC);
+
+    pipeline_get_stats(pipeline, i, &stats);
+    fprintf(stdout, "Stage %zu: frames %lu max depth %lu wait p99 %lu ns "
+        "exec p99 %lu ns\n", i, (unsigned long)stats.frames,
+        (unsigned long)stats.max_depth,
+        (unsigned long)rt_hist_get_percentile(wait, 99.0),
+        (unsigned long)rt_hist_get_percentile(exec, 99.0));
+
+    if(stats.frames == 0 || stats.max_depth > config.nb_frames)
+    {
+      fprintf(stderr, "Bad statistics for stage %zu\n", i);
+      exit(EXIT_FAILURE);
+    }
+    frames = stats.frames;
+  }
+
+  latency = pipeline_get_latency_hist(pipeline);
+  fprintf(stdout, "End-to-end: %lu frames p50 %lu ns max %lu ns, "
+      "dropped %lu\n", (unsigned long)rt_hist_get_count(latency),
+      (unsigned long)rt_hist_get_percentile(latency, 50.0),
+      (unsigned long)rt_hist_get_max(latency),
+      (unsigned long)pipeline_get_dropped(pipeline));
+
+  if(rt_hist_get_count(latency) < frames ||
+      rt_hist_get_count(pipeline_get_source_hist(pipeline)) == 0 ||
+      pipeline_get_hist(pipeline, NB_STAGES, PIPELINE_HIST_WAIT) != NULL)
+  {
+    fprintf(stderr, "Bad histograms\n");
+    exit(EXIT_FAILURE);
+  }
+
+  pipeline_stop(pipeline);
+
+  if(atomic_load(&errors) != 0)
+  {
+    fprintf(stderr, "Bad frames: %d errors\n", atomic_load(&errors));
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stdout, "Pipeline OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,44 @@
+/**
+ * \file test_rt_caps.c
+ * \brief Tests for real-time capabilities detection.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sysinfo.h"
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  const struct rt_caps* caps = rt_caps_get();
+
+  (void)argc;
+  (void)argv;
+
+  if(!caps || caps != rt_caps_get())
+  {
+    fprintf(stderr, "Capabilities not cached\n");
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stdout, "preempt: %d\n", caps->preempt);
+  fprintf(stdout, "tick rate: %ld Hz\n", caps->tick_rate);
+  fprintf(stdout, "clocksource: %s\n", caps->clocksource);
+  fprintf(stdout, "SCHED_DEADLINE: %d\n", caps->deadline);
+  fprintf(stdout, "uclamp: %d\n", caps->uclamp);
+  fprintf(stdout, "rseq: %d\n", caps->rseq);
+  fprintf(stdout, "CAP_SYS_NICE: %d\n", caps->cap_sys_nice);
+  fprintf(stdout, "CAP_IPC_LOCK: %d\n", caps->cap_ipc_lock);
+  fprintf(stdout, "RLIMIT_RTPRIO max: %lld\n", (long long)caps->rtprio_max);
+  fprintf(stdout, "RLIMIT_MEMLOCK max: %lld\n", (long long)caps->memlock_max);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+/**
+ * \file test_rt_event.c
+ * \brief Tests for futex-based events and PI mutex.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "rt_event.h"
+#include "tsc.h"
+
+/**
+ * \brief Number of round trips.
+ */
+#define NB_ROUNDS 10000
+
+/**
+ * \brief Event from main thread to worker.
+ */
+static struct rt_event ping;
+
+/**
+ * \brief Event from worker to main thread.
+ */
+static struct rt_event pong;
+
+/**
+ * \brief Mutex shared by the threads.
+ */
+static struct rt_pi_mutex mutex;
+
+/**
+ * \brief Counter protected by the mutex.
+ */
+static unsigned long counter = 0;
+
+/**
+ * \brief Worker thread: answers each ping and increments the counter.
+ * \param data unused.
+ * \return NULL.
+ */
+static void* th_worker(void* data)
+{
+  (void)data;
+
+  for(int i = 0 ; i < NB_ROUNDS ; i++)
+  {
+    if(rt_event_wait(&ping) != 0)
+    {
+      perror("rt_event_wait");
+      return NULL;
+    }
+
+    rt_pi_mutex_lock(&mutex);
+    counter++;
+    rt_pi_mutex_unlock(&mutex);
+
+    rt_event_signal(&pong);
+  }
+
+  return NULL;
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  struct timespec deadline;
+  uint64_t start = 0;
+  pthread_t th;
+
+  (void)argc;
+  (void)argv;
+
+  tsc_init(0);
+  rt_event_init(&ping, 0, 0);
+  rt_event_init(&pong, 0, 100);
+  rt_pi_mutex_init(&mutex, 0);
+
+  /* timeout */
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_nsec += 10000000;
+  if(deadline.tv_nsec >= 1000000000)
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  if(rt_event_timedwait(&ping, &deadline) == 0 || errno != ETIMEDOUT)
+  {
+    fprintf(stderr, "rt_event_timedwait did not time out\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* signal kept until next wait */
+  rt_event_signal(&ping);
+  if(rt_event_trywait(&ping) != 0 || rt_event_trywait(&ping) == 0)
+  {
+    fprintf(stderr, "rt_event_trywait failure\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if(pthread_create(&th, NULL, th_worker, NULL) != 0)
+  {
+    fprintf(stderr, "Failed to launch thread\n");
+    exit(EXIT_FAILURE);
+  }
+
+  start = tsc_read();
+  for(int i = 0 ; i < NB_ROUNDS ; i++)
+  {
+    rt_event_signal(&ping);
+
+    rt_pi_mutex_lock(&mutex);
+    counter++;
+    rt_pi_mutex_unlock(&mutex);
+
+    rt_event_wait(&pong);
+  }
+
+  fprintf(stdout, "Round trip: %.0f ns\n",
+      (double)tsc_to_ns(tsc_read() - start) / NB_ROUNDS);
+
+  pthread_join(th, NULL);
+
+  if(counter != 2 * NB_ROUNDS)
+  {
+    fprintf(stderr, "Bad counter: %lu\n", counter);
+    exit(EXIT_FAILURE);
+  }
+
+  if(rt_pi_mutex_unlock(&mutex) == 0 || errno != EPERM)
+  {
+    fprintf(stderr, "rt_pi_mutex_unlock without owning the mutex\n");
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stdout, "Events and PI mutex OK\n");
+  return EXIT_SUCCESS;
+}
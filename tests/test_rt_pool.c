@@ -0,0 +1,355 @@
+/**
+ * \file test_rt_pool.c
+ * \brief Tests for real-time worker thread pool.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include "rt_pool.h"
+
+/**
+ * \brief Number of parallel chunks.
+ */
+#define NB_CHUNKS 8
+
+/**
+ * \brief Size of a chunk.
+ */
+#define CHUNK_SIZE 100000
+
+/**
+ * \brief Maximum number of workers.
+ */
+#define MAX_WORKERS 8
+
+/**
+ * \struct chunk
+ * \brief Part of a parallel sum.
+ */
+struct chunk
+{
+  /**
+   * \brief First value.
+   */
+  unsigned long start;
+
+  /**
+   * \brief Result.
+   */
+  unsigned long sum;
+};
+
+/**
+ * \brief The pool used by nested tasks.
+ */
+static struct rt_pool* pool = NULL;
+
+/**
+ * \brief Chunks.
+ */
+static struct chunk chunks[NB_CHUNKS];
+
+/**
+ * \brief Tasks of the chunks.
+ */
+static struct rt_pool_task tasks[NB_CHUNKS];
+
+/**
+ * \brief Set by the blocking task when it runs.
+ */
+static atomic_int started;
+
+/**
+ * \brief Blocking task runs while not 0.
+ */
+static atomic_int blocked;
+
+/**
+ * \brief Order of execution of the priority test.
+ */
+static char order[4];
+
+/**
+ * \brief Number of entries in order.
+ */
+static atomic_int nb_order;
+
+/**
+ * \brief Sums a chunk.
+ * \param data the chunk.
+ */
+static void sum_chunk(void* data)
+{
+  struct chunk* chunk = data;
+
+  chunk->sum = 0;
+  for(unsigned long i = 0 ; i < CHUNK_SIZE ; i++)
+  {
+    chunk->sum += chunk->start + i;
+  }
+}
+
+/**
+ * \brief Fans out the chunks from a worker and waits for them.
+ * \param data unused.
+ */
+static void fan_out(void* data)
+{
+  struct rt_pool_group group;
+
+  (void)data;
+
+  rt_pool_group_init(&group);
+
+  for(unsigned int i = 0 ; i < NB_CHUNKS ; i++)
+  {
+    chunks[i].start = i * CHUNK_SIZE;
+    tasks[i].fcn = sum_chunk;
+    tasks[i].data = &chunks[i];
+    rt_pool_submit(pool, &tasks[i], 1, &group);
+  }
+
+  rt_pool_group_wait(pool, &group);
+}
+
+/**
+ * \brief Blocks the worker until released.
+ * \param data unused.
+ */
+static void block(void* data)
+{
+  struct timespec delay = {.tv_sec = 0, .tv_nsec = 1000000};
+
+  (void)data;
+
+  atomic_store(&started, 1);
+  while(atomic_load(&blocked))
+  {
+    nanosleep(&delay, NULL);
+  }
+}
+
+/**
+ * \brief Child task of steal_parent().
+ * \param data unused.
+ */
+static void steal_child(void* data)
+{
+  (void)data;
+  atomic_store(&started, 1);
+}
+
+/**
+ * \brief Queues a child in its own deque and blocks until another worker
+ * steals and runs it.
+ * \param data child task.
+ */
+static void steal_parent(void* data)
+{
+  struct timespec delay = {.tv_sec = 0, .tv_nsec = 1000000};
+
+  rt_pool_submit(pool, data, 0, NULL);
+  while(!atomic_load(&started))
+  {
+    nanosleep(&delay, NULL);
+  }
+}
+
+/**
+ * \brief Records its name in the execution order.
+ * \param data name.
+ */
+static void record(void* data)
+{
+  order[atomic_fetch_add(&nb_order, 1)] = *(char*)data;
+}
+
+/**
+ * \brief Returns the sum of all chunks.
+ * \return sum.
+ */
+static unsigned long total(void)
+{
+  unsigned long sum = 0;
+
+  for(unsigned int i = 0 ; i < NB_CHUNKS ; i++)
+  {
+    sum += chunks[i].sum;
+  }
+
+  return sum;
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  const unsigned long n = NB_CHUNKS * CHUNK_SIZE;
+  const unsigned long expected = n * (n - 1) / 2;
+  struct rt_pool_config config;
+  struct rt_pool_stats stats;
+  struct rt_pool_group group;
+  struct rt_pool_task task;
+  struct rt_pool_task low;
+  struct rt_pool_task high;
+  int cpus[MAX_WORKERS];
+  long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  char name_low = 'L';
+  char name_high = 'H';
+  uint64_t executed = 0;
+  uint64_t stolen = 0;
+
+  (void)argc;
+  (void)argv;
+
+  /* at least two workers, even on a single CPU */
+  for(int i = 0 ; i < MAX_WORKERS ; i++)
+  {
+    cpus[i] = i % nb_cpus;
+  }
+
+  /* SCHED_OTHER so that spinning workers cannot starve the test */
+  config.cpus = cpus;
+  config.cpus_size = nb_cpus < 2 ? 2 : (nb_cpus > 4 ? 4 : nb_cpus);
+  config.domains = NULL;
+  config.priority.policy = SCHED_OTHER;
+  config.priority.priority = 0;
+  config.capacity = 16;
+  config.spin = 1000;
+
+  pool = rt_pool_create(&config);
+  if(!pool)
+  {
+    perror("rt_pool_create");
+    exit(EXIT_FAILURE);
+  }
+
+  task.fcn = fan_out;
+  task.data = NULL;
+  if(rt_pool_submit(pool, &task, RT_POOL_LEVELS, NULL) == 0 ||
+      errno != EINVAL)
+  {
+    fprintf(stderr, "Bad level accepted\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* fan out from the caller */
+  rt_pool_group_init(&group);
+  for(unsigned int i = 0 ; i < NB_CHUNKS ; i++)
+  {
+    chunks[i].start = i * CHUNK_SIZE;
+    chunks[i].sum = 0;
+    tasks[i].fcn = sum_chunk;
+    tasks[i].data = &chunks[i];
+
+    if(rt_pool_submit(pool, &tasks[i], 0, &group) != 0)
+    {
+      perror("rt_pool_submit");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if(rt_pool_group_wait(pool, &group) != 0 || total() != expected)
+  {
+    fprintf(stderr, "Bad parallel sum: %lu\n", total());
+    exit(EXIT_FAILURE);
+  }
+
+  /* fan out from a worker, the chunks are stolen from its deque */
+  for(unsigned int i = 0 ; i < NB_CHUNKS ; i++)
+  {
+    chunks[i].sum = 0;
+  }
+
+  rt_pool_group_init(&group);
+  rt_pool_submit(pool, &task, 0, &group);
+  rt_pool_group_wait(pool, &group);
+
+  if(total() != expected)
+  {
+    fprintf(stderr, "Bad nested parallel sum: %lu\n", total());
+    exit(EXIT_FAILURE);
+  }
+
+  /* a task blocked on its own child needs a thief */
+  atomic_init(&started, 0);
+  low.fcn = steal_child;
+  low.data = NULL;
+  task.fcn = steal_parent;
+  task.data = &low;
+  rt_pool_group_init(&group);
+  rt_pool_submit(pool, &task, 0, &group);
+  rt_pool_group_wait(pool, &group);
+
+  for(size_t i = 0 ; i < rt_pool_get_size(pool) ; i++)
+  {
+    rt_pool_get_stats(pool, i, &stats);
+    stolen += stats.stolen;
+    fprintf(stdout, "Worker %zu (CPU %d): executed %lu stolen %lu "
+        "sleeps %lu\n", i, stats.cpu, (unsigned long)stats.executed,
+        (unsigned long)stats.stolen, (unsigned long)stats.sleeps);
+    executed += stats.executed;
+  }
+
+  if(executed != 2 * NB_CHUNKS + 3 || stolen == 0)
+  {
+    fprintf(stderr, "Bad number of executed/stolen tasks: %lu/%lu\n",
+        (unsigned long)executed, (unsigned long)stolen);
+    exit(EXIT_FAILURE);
+  }
+
+  rt_pool_destroy(pool);
+
+  /* a single worker runs the most urgent level first */
+  config.cpus_size = 1;
+  pool = rt_pool_create(&config);
+  if(!pool)
+  {
+    perror("rt_pool_create");
+    exit(EXIT_FAILURE);
+  }
+
+  atomic_init(&started, 0);
+  atomic_init(&blocked, 1);
+  atomic_init(&nb_order, 0);
+
+  rt_pool_group_init(&group);
+  task.fcn = block;
+  rt_pool_submit(pool, &task, 0, &group);
+  while(!atomic_load(&started))
+  {
+    sched_yield();
+  }
+
+  low.fcn = record;
+  low.data = &name_low;
+  high.fcn = record;
+  high.data = &name_high;
+  rt_pool_submit(pool, &low, RT_POOL_LEVELS - 1, &group);
+  rt_pool_submit(pool, &high, 0, &group);
+  atomic_store(&blocked, 0);
+  rt_pool_group_wait(pool, &group);
+  rt_pool_destroy(pool);
+
+  if(atomic_load(&nb_order) != 2 || order[0] != 'H' || order[1] != 'L')
+  {
+    fprintf(stderr, "Priority levels not respected\n");
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stdout, "RT pool OK\n");
+  return EXIT_SUCCESS;
+}
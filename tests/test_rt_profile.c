@@ -0,0 +1,158 @@
+/**
+ * \file test_rt_profile.
+ * \brief Tests for declarative real-time profile.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "rt_profile.h"
+
+/**
+ * \brief Valid profile.
+ */
+static const char* const valid_profile =
+  "# test profile\n"
+  "[control]\n"
+  "policy = fifo\n"
+  "priority = 80\n"
+  "cpus = 0\n"
+  "memlock = 65536\n"
+  "\n"
+  "[planner]\n"
+  "policy = deadline\n"
+  "runtime = 200000\n"
+  "deadline = 1000000\n"
+  "period = 1000000\n"
+  "\n"
+  "[main]\n"
+  "policy = other ; time-sharing\n"
+  "cpus = 0\n"
+  "nice = 5\n";
+
+/**
+ * \brief Invalid profile (nice value with real-time policy).
+ */
+static const char* const invalid_profile =
+  "[control]\n"
+  "policy = rr\n"
+  "priority = 10\n"
+  "nice = 5\n";
+
+/**
+ * \brief Invalid profile (deadline thread pinned on CPUs).
+ */
+static const char* const deadline_profile =
+  "[planner]\n"
+  "policy = deadline\n"
+  "runtime = 200000\n"
+  "deadline = 1000000\n"
+  "cpus = 0\n";
+
+/**
+ * \brief Writes a profile in a temporary file.
+ * \param path template of the path, replaced by the real path.
+ * \param content content of the profile.
+ * \return 0 if success, -1 otherwise.
+ */
+static int write_profile(char* path, const char* content)
+{
+  int fd = mkstemp(path);
+  FILE* f = NULL;
+
+  if(fd == -1)
+  {
+    return -1;
+  }
+
+  f = fdopen(fd, "w");
+  if(!f)
+  {
+    close(fd);
+    return -1;
+  }
+
+  fputs(content, f);
+  fclose(f);
+  return 0;
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  char valid_path[] = "/tmp/rtvsutils-profile-XXXXXX";
+  char invalid_path[] = "/tmp/rtvsutils-profile-XXXXXX";
+  char deadline_path[] = "/tmp/rtvsutils-profile-XXXXXX";
+  struct rt_profile profile;
+  int ret = EXIT_SUCCESS;
+
+  (void)argc;
+  (void)argv;
+
+  if(write_profile(valid_path, valid_profile) != 0 ||
+      write_profile(invalid_path, invalid_profile) != 0 ||
+      write_profile(deadline_path, deadline_profile) != 0)
+  {
+    perror("write_profile");
+    exit(EXIT_FAILURE);
+  }
+
+  if(rt_profile_load(invalid_path, &profile) == 0)
+  {
+    fprintf(stderr, "Invalid profile accepted\n");
+    ret = EXIT_FAILURE;
+  }
+  else
+  {
+    fprintf(stdout, "Invalid profile rejected at line %u\n",
+        profile.error_line);
+  }
+
+  if(rt_profile_load(deadline_path, &profile) == 0)
+  {
+    fprintf(stderr, "Deadline profile with cpus accepted\n");
+    ret = EXIT_FAILURE;
+  }
+
+  if(rt_profile_load(valid_path, &profile) != 0)
+  {
+    fprintf(stderr, "Valid profile rejected at line %u\n",
+        profile.error_line);
+    ret = EXIT_FAILURE;
+  }
+  else
+  {
+    for(size_t i = 0 ; i < profile.nb_threads ; i++)
+    {
+      fprintf(stdout, "Thread %s: flags 0x%x policy %d priority %u\n",
+          profile.threads[i].name, profile.threads[i].flags,
+          profile.threads[i].priority.policy,
+          profile.threads[i].priority.priority);
+    }
+
+    if(rt_profile_apply_self(&profile, "main") != 0)
+    {
+      perror("rt_profile_apply_self");
+      ret = EXIT_FAILURE;
+    }
+    else
+    {
+      fprintf(stdout, "Profile \"main\" applied\n");
+    }
+
+    rt_profile_free(&profile);
+  }
+
+  unlink(valid_path);
+  unlink(invalid_path);
+  unlink(deadline_path);
+  return ret;
+}
@@ -0,0 +1,80 @@
+/**
+ * \file test_rt_throttling.c
+ * \brief Tests for RT throttling budget.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rtutils.h"
+#include "tuning.h"
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  struct rt_throttling_status status;
+  long runtime = 0;
+  long period = 0;
+
+  (void)argc;
+  (void)argv;
+
+  if(rt_get_throttling(&runtime, &period) != 0)
+  {
+    perror("rt_get_throttling");
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stdout, "RT budget: %ld/%ld us\n", runtime, period);
+
+  if(rt_set_throttling(2000, 1000) == 0)
+  {
+    fprintf(stderr, "rt_set_throttling accepted runtime > period\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* 98% with a shorter period */
+  if(rt_set_throttling(490000, 500000) != 0)
+  {
+    perror("rt_set_throttling");
+  }
+  else if(rt_get_throttling(&runtime, &period) == 0)
+  {
+    fprintf(stdout, "RT budget: %ld/%ld us\n", runtime, period);
+  }
+
+  if(rt_cgroup_get_throttling("/sys/fs/cgroup/cpu", &runtime, &period) == 0)
+  {
+    fprintf(stdout, "Root cgroup RT budget: %ld/%ld us\n", runtime, period);
+  }
+
+  if(rt_get_throttling_status(&status) != 0)
+  {
+    perror("rt_get_throttling_status");
+  }
+  else
+  {
+    fprintf(stdout, "Throttling logged: %d, throttled runqueues: %d\n",
+        status.logged, status.throttled);
+  }
+
+  if(tuning_restore() != 0)
+  {
+    perror("tuning_restore");
+    exit(EXIT_FAILURE);
+  }
+
+  if(rt_get_throttling(&runtime, &period) == 0)
+  {
+    fprintf(stdout, "RT budget restored: %ld/%ld us\n", runtime, period);
+  }
+
+  return EXIT_SUCCESS;
+}
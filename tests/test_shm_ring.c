@@ -0,0 +1,304 @@
+/**
+ * \file test_shm_ring.c
+ * \brief Tests for shared-memory message ring.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "shm_ring.h"
+
+/**
+ * \brief Number of messages per producer.
+ */
+#define NB_MESSAGES 100000
+
+/**
+ * \brief Number of producer threads for MPSC test.
+ */
+#define NB_PRODUCERS 3
+
+/**
+ * \struct message
+ * \brief Test message.
+ */
+struct message
+{
+  /**
+   * \brief Producer identifier.
+   */
+  unsigned int producer;
+
+  /**
+   * \brief Sequence number in the producer.
+   */
+  unsigned int seq;
+
+  /**
+   * \brief Payload.
+   */
+  char payload[48];
+};
+
+/**
+ * \brief Ring for MPSC test.
+ */
+static struct shm_ring mpsc;
+
+/**
+ * \brief Sends NB_MESSAGES, retrying when the ring is full.
+ * \param ring ring.
+ * \param producer producer identifier.
+ * \return 0 if success, -1 otherwise.
+ */
+static int produce(struct shm_ring* ring, unsigned int producer)
+{
+  for(unsigned int i = 0 ; i < NB_MESSAGES ; i++)
+  {
+    struct message* msg = NULL;
+
+    while(!(msg = shm_ring_reserve(ring)))
+    {
+      if(errno != EAGAIN)
+      {
+        return -1;
+      }
+      sched_yield();
+    }
+
+    /* zero-copy: written in place */
+    msg->producer = producer;
+    msg->seq = i;
+    snprintf(msg->payload, sizeof(msg->payload), "message %u", i);
+
+    if(shm_ring_commit(ring, msg) != 0)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Producer thread for MPSC test.
+ * \param data producer identifier.
+ * \return NULL.
+ */
+static void* th_producer(void* data)
+{
+  produce(&mpsc, (unsigned int)(uintptr_t)data);
+  return NULL;
+}
+
+/**
+ * \brief Receives messages of several producers and checks their order.
+ * \param ring ring.
+ * \param nb number of producers.
+ * \return 0 if success, -1 otherwise.
+ */
+static int consume(struct shm_ring* ring, unsigned int nb)
+{
+  unsigned int next[NB_PRODUCERS] = {0};
+
+  for(unsigned int i = 0 ; i < nb * NB_MESSAGES ; i++)
+  {
+    const struct message* msg = NULL;
+
+    while(!(msg = shm_ring_peek(ring)))
+    {
+      if(ring->flags & SHM_RING_WAKEUP)
+      {
+        if(shm_ring_wait(ring, NULL) != 0)
+        {
+          perror("shm_ring_wait");
+          return -1;
+        }
+      }
+      else
+      {
+        sched_yield();
+      }
+    }
+
+    if(msg->producer >= nb || msg->seq != next[msg->producer])
+    {
+      fprintf(stderr, "Bad message %u/%u\n", msg->producer, msg->seq);
+      return -1;
+    }
+
+    next[msg->producer]++;
+    shm_ring_release(ring);
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  struct shm_ring ring;
+  struct shm_ring peer;
+  struct message msg;
+  struct timespec deadline;
+  char name[64];
+  pthread_t th[NB_PRODUCERS];
+  pid_t pid = 0;
+  int status = 0;
+
+  (void)argc;
+  (void)argv;
+
+  if(shm_ring_create(&ring, NULL, sizeof(msg), 3, 0) == 0 || errno != EINVAL)
+  {
+    fprintf(stderr, "Capacity must be a power of two\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* named ring */
+  snprintf(name, sizeof(name), "/test_shm_ring.%d", getpid());
+  if(shm_ring_create(&ring, name, sizeof(msg), 4, 0) != 0)
+  {
+    perror("shm_ring_create");
+    exit(EXIT_FAILURE);
+  }
+
+  if(shm_ring_open(&peer, name) != 0)
+  {
+    perror("shm_ring_open");
+    exit(EXIT_FAILURE);
+  }
+  shm_ring_unlink(name);
+
+  memset(&msg, 0x00, sizeof(msg));
+  for(unsigned int i = 0 ; i < 4 ; i++)
+  {
+    msg.seq = i;
+    if(shm_ring_send(&ring, &msg, sizeof(msg)) != 0)
+    {
+      perror("shm_ring_send");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if(shm_ring_send(&ring, &msg, sizeof(msg)) == 0 || errno != EAGAIN)
+  {
+    fprintf(stderr, "Full ring accepted a message\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for(unsigned int i = 0 ; i < 4 ; i++)
+  {
+    if(shm_ring_receive(&peer, &msg, sizeof(msg)) != 0 || msg.seq != i)
+    {
+      fprintf(stderr, "Bad message from named ring\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if(shm_ring_receive(&peer, &msg, sizeof(msg)) == 0 || errno != EAGAIN)
+  {
+    fprintf(stderr, "Empty ring returned a message\n");
+    exit(EXIT_FAILURE);
+  }
+
+  shm_ring_close(&peer);
+  shm_ring_close(&ring);
+
+  /* anonymous ring between two processes with wakeup */
+  if(shm_ring_create(&ring, NULL, sizeof(msg), 64, SHM_RING_WAKEUP) != 0)
+  {
+    perror("shm_ring_create");
+    exit(EXIT_FAILURE);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_nsec += 10000000;
+  if(deadline.tv_nsec >= 1000000000)
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  if(shm_ring_wait(&ring, &deadline) == 0 || errno != ETIMEDOUT)
+  {
+    fprintf(stderr, "shm_ring_wait did not time out\n");
+    exit(EXIT_FAILURE);
+  }
+
+  pid = fork();
+  if(pid == -1)
+  {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+  else if(pid == 0)
+  {
+    /* child maps the ring again as an unrelated process would */
+    if(shm_ring_open_fd(&peer, shm_ring_get_fd(&ring)) != 0)
+    {
+      _exit(EXIT_FAILURE);
+    }
+    shm_ring_close(&ring);
+    _exit(produce(&peer, 0) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  if(consume(&ring, 1) != 0)
+  {
+    exit(EXIT_FAILURE);
+  }
+
+  if(waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != EXIT_SUCCESS)
+  {
+    fprintf(stderr, "Producer process failed\n");
+    exit(EXIT_FAILURE);
+  }
+  shm_ring_close(&ring);
+
+  /* several producers */
+  if(shm_ring_create(&mpsc, NULL, sizeof(msg), 256, SHM_RING_MPSC) != 0)
+  {
+    perror("shm_ring_create");
+    exit(EXIT_FAILURE);
+  }
+
+  for(uintptr_t i = 0 ; i < NB_PRODUCERS ; i++)
+  {
+    if(pthread_create(&th[i], NULL, th_producer, (void*)i) != 0)
+    {
+      fprintf(stderr, "Failed to launch thread\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  status = consume(&mpsc, NB_PRODUCERS);
+
+  for(unsigned int i = 0 ; i < NB_PRODUCERS ; i++)
+  {
+    pthread_join(th[i], NULL);
+  }
+  shm_ring_close(&mpsc);
+
+  if(status != 0)
+  {
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stdout, "Shared-memory ring OK\n");
+  return EXIT_SUCCESS;
+}
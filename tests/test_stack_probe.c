@@ -0,0 +1,161 @@
+/**
+ * \file test_stack_probe.c
+ * \brief Tests for stack high-water mark measurement.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "rtutils.h"
+#include "stack_probe.h"
+
+/**
+ * \brief Stack used by the workload.
+ */
+#define WORKLOAD_SIZE 16384
+
+/**
+ * \brief Stack painted.
+ */
+#define PAINT_SIZE 131072
+
+/**
+ * \brief Uses stack.
+ * \param size number of bytes.
+ * \return a byte of the buffer.
+ */
+static char use_stack(size_t size)
+{
+  char buf[size];
+  volatile char* v = buf;
+
+  for(size_t i = 0 ; i < size ; i++)
+  {
+    v[i] = (char)i;
+  }
+
+  return v[size / 2];
+}
+
+/**
+ * \brief Periodic task.
+ * \param data unused.
+ */
+static void task(void* data)
+{
+  (void)data;
+  use_stack(WORKLOAD_SIZE);
+}
+
+/**
+ * \brief Thread measuring its own stack.
+ * \param data result (0 if success).
+ * \return NULL.
+ */
+static void* th_probe(void* data)
+{
+  int* result = data;
+  struct stack_probe probe;
+  size_t before = 0;
+  size_t after = 0;
+
+  *result = -1;
+
+  if(stack_probe_init(&probe, PAINT_SIZE) != 0)
+  {
+    perror("stack_probe_init");
+    return NULL;
+  }
+
+  before = stack_probe_get_peak(&probe);
+  use_stack(WORKLOAD_SIZE);
+  after = stack_probe_get_peak(&probe);
+
+  fprintf(stdout, "Peak before %zu after %zu capacity %zu\n", before, after,
+      stack_probe_get_capacity(&probe));
+
+  /* workload frame starts above the painted area (caller frames, margin) */
+  if(after < WORKLOAD_SIZE || after < before + WORKLOAD_SIZE - 2048 ||
+      after >= stack_probe_get_capacity(&probe))
+  {
+    fprintf(stderr, "Bad stack peak\n");
+    return NULL;
+  }
+
+  *result = 0;
+  return NULL;
+}
+
+/**
+ * \brief Thread running a periodic task.
+ * \param data peak.
+ * \return NULL.
+ */
+static void* th_periodic(void* data)
+{
+  struct periodic_task_attr attr;
+
+  memset(&attr, 0x00, sizeof(struct periodic_task_attr));
+  attr.stack_paint = PAINT_SIZE;
+  attr.stack_peak = data;
+
+  thread_periodic_task_attr(task, NULL, 1000000, &attr);
+  return NULL;
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  struct timespec delay = {.tv_sec = 0, .tv_nsec = 20000000};
+  pthread_t th;
+  size_t peak = 0;
+  int result = -1;
+
+  (void)argc;
+  (void)argv;
+
+  if(pthread_create(&th, NULL, th_probe, &result) != 0)
+  {
+    fprintf(stderr, "Failed to launch thread\n");
+    exit(EXIT_FAILURE);
+  }
+  pthread_join(th, NULL);
+
+  if(result != 0)
+  {
+    exit(EXIT_FAILURE);
+  }
+
+  /* peak is reported when the periodic task is canceled */
+  if(pthread_create(&th, NULL, th_periodic, &peak) != 0)
+  {
+    fprintf(stderr, "Failed to launch thread\n");
+    exit(EXIT_FAILURE);
+  }
+
+  nanosleep(&delay, NULL);
+  pthread_cancel(th);
+  pthread_join(th, NULL);
+
+  fprintf(stdout, "Periodic task stack peak %zu\n", peak);
+
+  if(peak < WORKLOAD_SIZE || peak > PAINT_SIZE + WORKLOAD_SIZE)
+  {
+    fprintf(stderr, "Bad periodic task stack peak\n");
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stdout, "Stack probe OK\n");
+  return EXIT_SUCCESS;
+}
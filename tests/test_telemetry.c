@@ -0,0 +1,75 @@
+/**
+ * \file test_telemetry.
+ * \brief Tests for frequency and thermal telemetry.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "telemetry.h"
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  struct telemetry_config config;
+  struct telemetry_sample samples[64];
+  struct telemetry* telemetry = NULL;
+  struct timespec now;
+  uint64_t seq = 0;
+  uint64_t spike = 0;
+  size_t nb = 0;
+  int cpus[1] = {0};
+
+  (void)argc;
+  (void)argv;
+
+  config.cpus = cpus;
+  config.cpus_size = 1;
+  config.period = 100000000;
+  config.capacity = 32;
+
+  telemetry = telemetry_start(&config);
+  if(!telemetry)
+  {
+    perror("telemetry_start");
+    exit(EXIT_FAILURE);
+  }
+
+  sleep(1);
+  /* pretend a latency spike occured now */
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  spike = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+  sleep(1);
+
+  nb = telemetry_read(telemetry, &seq, samples, 64);
+  for(size_t i = 0 ; i < nb ; i++)
+  {
+    fprintf(stdout, "%llu: CPU %u %lu kHz throttle %lu/%lu temp %ld\n",
+        (unsigned long long)samples[i].timestamp, samples[i].cpu,
+        samples[i].freq, samples[i].core_throttle_count,
+        samples[i].package_throttle_count, samples[i].temperature);
+  }
+
+  nb = telemetry_find(telemetry, spike - 250000000, spike + 250000000,
+      samples, 64);
+  fprintf(stdout, "Samples around spike: %zu\n", nb);
+
+  telemetry_stop(telemetry);
+
+  if(nb == 0)
+  {
+    fprintf(stderr, "No sample around spike\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+/**
+ * \file test_thread_registry.
+ * \brief Tests for thread registry and remote per-thread operations.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "rtutils.h"
+#include "thread_registry.h"
+
+/**
+ * \brief Number of worker threads.
+ */
+#define NB_WORKERS 2
+
+/**
+ * \brief Barrier to wait for registration of workers.
+ */
+static pthread_barrier_t barrier;
+
+/**
+ * \brief Worker thread function.
+ * \param data index of the worker.
+ * \return NULL.
+ */
+static void* worker_function(void* data)
+{
+  char name[THREAD_REGISTRY_NAME_SIZE];
+
+  snprintf(name, sizeof(name), "worker-%ld", (long)data);
+
+  if(thread_registry_add(name) != 0)
+  {
+    perror("thread_registry_add");
+  }
+
+  /* registered */
+  pthread_barrier_wait(&barrier);
+  /* wait for the tests of the main thread */
+  pthread_barrier_wait(&barrier);
+
+  return NULL;
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  pthread_t th[NB_WORKERS];
+  struct thread_info info;
+  struct thread_settings settings;
+  unsigned long slack = 0;
+  int ret = 0;
+
+  (void)argc;
+  (void)argv;
+
+  pthread_barrier_init(&barrier, NULL, NB_WORKERS + 1);
+
+  for(long i = 0 ; i < NB_WORKERS ; i++)
+  {
+    if(pthread_create(&th[i], NULL, worker_function, (void*)i) != 0)
+    {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  pthread_barrier_wait(&barrier);
+
+  fprintf(stdout, "Registered threads: %d\n", thread_registry_list(NULL, 0));
+
+  if(thread_registry_find("worker-1", &info) != 0)
+  {
+    perror("thread_registry_find");
+    exit(EXIT_FAILURE);
+  }
+  fprintf(stdout, "worker-1 TID: %d\n", (int)info.tid);
+
+  /* act on another thread than the caller */
+  if(thread_set_priority(info.th, 10) != 0)
+  {
+    perror("thread_set_priority");
+    exit(EXIT_FAILURE);
+  }
+
+  errno = 0;
+  ret = thread_get_priority(info.th);
+  fprintf(stdout, "worker-1 priority: %d (main: %d)\n", ret,
+      thread_get_priority(pthread_self()));
+
+  if(ret != 10)
+  {
+    fprintf(stderr, "Priority not applied to worker-1\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* nice value with a real-time policy can never be applied */
+  settings.flags = THREAD_SETTINGS_PRIORITY | THREAD_SETTINGS_RT_PRIORITY;
+  settings.priority = 15;
+  settings.rt_priority.policy = SCHED_FIFO;
+  settings.rt_priority.priority = 1;
+  if(thread_registry_apply("worker-*", &settings) != -1 || errno != EINVAL)
+  {
+    fprintf(stderr, "Nice value with SCHED_FIFO accepted\n");
+    exit(EXIT_FAILURE);
+  }
+
+  settings.flags = THREAD_SETTINGS_PRIORITY | THREAD_SETTINGS_TIMER_SLACK;
+  settings.priority = 15;
+  settings.timer_slack = 1000;
+  ret = thread_registry_apply("worker-*", &settings);
+  if(ret < 0)
+  {
+    perror("thread_registry_apply");
+  }
+  fprintf(stdout, "Threads updated: %d\n", ret);
+
+  if(task_get_timer_slack(info.tid, &slack) == 0)
+  {
+    fprintf(stdout, "worker-1 timer slack: %lu\n", slack);
+  }
+  fprintf(stdout, "worker-1 priority: %d\n", task_get_priority(info.tid));
+
+  pthread_barrier_wait(&barrier);
+
+  for(int i = 0 ; i < NB_WORKERS ; i++)
+  {
+    pthread_join(th[i], NULL);
+  }
+
+  fprintf(stdout, "Registered threads after exit: %d\n",
+      thread_registry_list(NULL, 0));
+
+  pthread_barrier_destroy(&barrier);
+  return EXIT_SUCCESS;
+}
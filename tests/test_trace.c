@@ -0,0 +1,95 @@
+/**
+ * \file test_trace.c
+ * \brief Tests for ftrace markers.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "rtutils.h"
+#include "trace.h"
+
+/**
+ * \brief Task to execute periodically.
+ * \param data data for the task.
+ */
+static void th_task(void* data)
+{
+  (void)data;
+
+  trace_span_begin("compute");
+  trace_span_end("compute");
+}
+
+/**
+ * \brief Dedicated thread to execute a periodic task.
+ * \param data data for the task.
+ * \return NULL.
+ */
+static void* th_periodic(void* data)
+{
+  struct periodic_task_attr attr;
+
+  memset(&attr, 0x00, sizeof(struct periodic_task_attr));
+  attr.trace = 1;
+  /* stop tracing on the first cycle late by more than 500 us */
+  attr.trace_stop_latency = 500000;
+
+  if(thread_periodic_task_attr(th_task, data, 1000000, &attr) != 0)
+  {
+    fprintf(stderr, "Failed to launch periodic task\n");
+  }
+
+  return NULL;
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  struct timespec ts = {0, 100000000};
+  pthread_t th;
+
+  (void)argc;
+  (void)argv;
+
+  if(trace_open() != 0)
+  {
+    perror("trace_open");
+  }
+
+  fprintf(stdout, "Tracing available: %d\n", trace_is_open());
+
+  if(trace_is_open() && trace_marker("test marker %d", 42) != 0)
+  {
+    perror("trace_marker");
+    exit(EXIT_FAILURE);
+  }
+
+  if(pthread_create(&th, NULL, th_periodic, NULL) != 0)
+  {
+    fprintf(stderr, "Failed to launch thread\n");
+    exit(EXIT_FAILURE);
+  }
+
+  clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+  pthread_cancel(th);
+  pthread_join(th, NULL);
+
+  if(trace_is_open())
+  {
+    trace_start();
+  }
+
+  trace_close();
+  return EXIT_SUCCESS;
+}
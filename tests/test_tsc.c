@@ -0,0 +1,86 @@
+/**
+ * \file test_tsc.c
+ * \brief Tests for TSC timestamp clock.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "tsc.h"
+
+/**
+ * \brief Number of reads to measure the overhead.
+ */
+#define NB_READS 1000000
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  struct timespec ts = {0, 100000000};
+  struct timespec mono0;
+  struct timespec mono1;
+  uint64_t start = 0;
+  uint64_t end = 0;
+  uint64_t last = 0;
+  int64_t elapsed = 0;
+  int64_t ref = 0;
+
+  (void)argc;
+  (void)argv;
+
+  if(tsc_init(0) != 0)
+  {
+    perror("tsc_init (fallback to clock_gettime)");
+  }
+
+  fprintf(stdout, "TSC usable: %d, frequency: %llu Hz\n", tsc_is_usable(),
+      (unsigned long long)tsc_get_frequency());
+
+  /* overhead and monotonicity */
+  start = tsc_read();
+  for(int i = 0 ; i < NB_READS ; i++)
+  {
+    uint64_t now = tsc_now_ns();
+
+    if(now < last)
+    {
+      fprintf(stderr, "Time goes backward\n");
+      exit(EXIT_FAILURE);
+    }
+    last = now;
+  }
+  end = tsc_read();
+
+  fprintf(stdout, "tsc_now_ns() overhead: %.1f ns\n",
+      (double)tsc_to_ns(end - start) / NB_READS);
+
+  /* accuracy against CLOCK_MONOTONIC */
+  clock_gettime(CLOCK_MONOTONIC, &mono0);
+  start = tsc_read();
+  clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+  end = tsc_read();
+  clock_gettime(CLOCK_MONOTONIC, &mono1);
+
+  elapsed = (int64_t)tsc_to_ns(end - start);
+  ref = (mono1.tv_sec - mono0.tv_sec) * 1000000000 +
+    (mono1.tv_nsec - mono0.tv_nsec);
+
+  fprintf(stdout, "Elapsed: %lld ns (CLOCK_MONOTONIC: %lld ns)\n",
+      (long long)elapsed, (long long)ref);
+
+  if(llabs(elapsed - ref) > ref / 100)
+  {
+    fprintf(stderr, "Conversion error > 1%%\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+/**
+ * \file test_tuning.c
+ * \brief Tests for snapshot and restore of system knobs.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "tuning.h"
+
+/**
+ * \brief Writes a string to a file.
+ * \param path path of the file.
+ * \param value string to write.
+ * \return 0 if success, -1 otherwise.
+ */
+static int write_file(const char* path, const char* value)
+{
+  FILE* f = fopen(path, "w");
+
+  if(!f)
+  {
+    return -1;
+  }
+
+  fprintf(f, "%s\n", value);
+  fclose(f);
+  return 0;
+}
+
+/**
+ * \brief Checks the content of a file.
+ * \param path path of the file.
+ * \param value expected content.
+ * \return 1 if content matches, 0 otherwise.
+ */
+static int check_file(const char* path, const char* value)
+{
+  char buf[128];
+  FILE* f = fopen(path, "r");
+  int ret = 0;
+
+  if(!f)
+  {
+    return 0;
+  }
+
+  if(fgets(buf, sizeof(buf), f))
+  {
+    buf[strcspn(buf, "\n")] = 0x00;
+    ret = !strcmp(buf, value);
+  }
+
+  fclose(f);
+  return ret;
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  const char* const knob1 = "/tmp/rt-vsutils-knob1";
+  const char* const knob2 = "/tmp/rt-vsutils-knob2";
+  const char* const state = "/tmp/rt-vsutils.state";
+
+  (void)argc;
+  (void)argv;
+
+  if(write_file(knob1, "performance") != 0 || write_file(knob2, "950000") != 0)
+  {
+    perror("write_file");
+    exit(EXIT_FAILURE);
+  }
+
+  if(tuning_set_state_file(state) != 0 || tuning_install_handlers() != 0)
+  {
+    perror("tuning_set_state_file");
+    exit(EXIT_FAILURE);
+  }
+
+  /* second record of the same knob must keep first value */
+  if(tuning_record(knob1) != 0 || tuning_record(knob2) != 0)
+  {
+    perror("tuning_record");
+    exit(EXIT_FAILURE);
+  }
+  write_file(knob1, "powersave");
+  tuning_record(knob1);
+  write_file(knob2, "-1");
+
+  fprintf(stdout, "Recorded knobs: %zu\n", tuning_count());
+  if(tuning_count() != 2 || access(state, F_OK) != 0)
+  {
+    fprintf(stderr, "Bad snapshot\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if(tuning_restore() != 0 || !check_file(knob1, "performance") ||
+      !check_file(knob2, "950000") || tuning_count() != 0)
+  {
+    fprintf(stderr, "Bad restore\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* restore from a state file left by a crashed process */
+  write_file(state, "/tmp/rt-vsutils-knob1\tondemand");
+  if(tuning_restore_file(state) != 0 || !check_file(knob1, "ondemand") ||
+      access(state, F_OK) == 0)
+  {
+    fprintf(stderr, "Bad restore from file\n");
+    exit(EXIT_FAILURE);
+  }
+
+  unlink(knob1);
+  unlink(knob2);
+
+  fprintf(stdout, "Restore OK\n");
+  return EXIT_SUCCESS;
+}
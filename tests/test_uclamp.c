@@ -0,0 +1,100 @@
+/**
+ * \file test_uclamp.
+ * \brief Tests for utilization clamping.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "rtutils.h"
+
+/**
+ * \brief Thread function.
+ * \param data not used.
+ * \return NULL.
+ */
+static void* thread_function(void* data)
+{
+  struct rt_uclamp uclamp;
+  struct rt_prio prio;
+
+  (void)data;
+
+  /* boost the thread and raise it in the same call */
+  prio.policy = SCHED_FIFO;
+  prio.priority = 50;
+  uclamp.util_min = RT_UCLAMP_MAX;
+  uclamp.util_max = RT_UCLAMP_MAX;
+
+  if(thread_set_uclamp(pthread_self(), &prio, &uclamp) != 0)
+  {
+    perror("thread_set_uclamp");
+    return NULL;
+  }
+
+  if(thread_get_uclamp(pthread_self(), &uclamp) != 0 ||
+      thread_get_rt_priority(pthread_self(), &prio) != 0)
+  {
+    perror("thread_get_uclamp");
+    return NULL;
+  }
+
+  fprintf(stdout, "Thread policy %d priority %u uclamp [%u, %u]\n",
+      prio.policy, prio.priority, uclamp.util_min, uclamp.util_max);
+
+  return NULL;
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  struct rt_uclamp uclamp;
+  pthread_t th;
+
+  (void)argc;
+  (void)argv;
+
+  if(process_get_uclamp(getpid(), &uclamp) != 0)
+  {
+    int err = errno;
+
+    perror("process_get_uclamp");
+
+    /* kernel without utilization clamping */
+    exit(err == EOPNOTSUPP ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+  fprintf(stdout, "Process uclamp [%u, %u]\n", uclamp.util_min,
+      uclamp.util_max);
+
+  /* cap housekeeping process without changing its policy */
+  uclamp.util_min = 0;
+  uclamp.util_max = 512;
+  if(process_set_uclamp(getpid(), NULL, &uclamp) != 0)
+  {
+    perror("process_set_uclamp");
+  }
+  else if(process_get_uclamp(getpid(), &uclamp) == 0)
+  {
+    fprintf(stdout, "Process uclamp [%u, %u]\n", uclamp.util_min,
+        uclamp.util_max);
+  }
+
+  if(pthread_create(&th, NULL, thread_function, NULL) != 0)
+  {
+    perror("pthread_create");
+    exit(EXIT_FAILURE);
+  }
+
+  pthread_join(th, NULL);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,201 @@
+/**
+ * \file test_watchdog.c
+ * \brief Tests for software watchdog.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "rtutils.h"
+#include "watchdog.h"
+#include "tsc.h"
+
+/**
+ * \brief Period of the task in nanoseconds.
+ */
+#define PERIOD 1000000
+
+/**
+ * \brief Cycle that stalls.
+ */
+#define STALL_CYCLE 50
+
+/**
+ * \brief The supervisor.
+ */
+static struct watchdog* watchdog = NULL;
+
+/**
+ * \brief Heartbeat of the task.
+ */
+static struct watchdog_heartbeat* heartbeat = NULL;
+
+/**
+ * \brief Number of cycles.
+ */
+static atomic_int cycles;
+
+/**
+ * \brief Number of callbacks.
+ */
+static atomic_int callbacks;
+
+/**
+ * \brief Task setup result (1 success, -1 failure).
+ */
+static atomic_int setup;
+
+/**
+ * \brief Periodic task, spins like a runaway loop at one cycle until
+ * demoted.
+ * \param data unused.
+ */
+static void task(void* data)
+{
+  (void)data;
+
+  if(atomic_fetch_add(&cycles, 1) == STALL_CYCLE)
+  {
+    while(sched_getscheduler(0) != SCHED_OTHER)
+    {
+    }
+  }
+}
+
+/**
+ * \brief Stall callback.
+ * \param hb heartbeat of the stalled task.
+ * \param stalled time since last beat in nanoseconds.
+ * \param data unused.
+ */
+static void on_stall(const struct watchdog_heartbeat* hb, uint64_t stalled,
+    void* data)
+{
+  (void)data;
+
+  if(hb == heartbeat && stalled >= 5 * PERIOD)
+  {
+    atomic_fetch_add(&callbacks, 1);
+  }
+}
+
+/**
+ * \brief Thread running the periodic task.
+ * \param data unused.
+ * \return NULL.
+ */
+static void* th_task(void* data)
+{
+  struct rt_prio prio = {.policy = SCHED_FIFO, .priority = 10};
+  struct periodic_task_attr attr;
+
+  (void)data;
+
+  heartbeat = watchdog_register(watchdog, "control", PERIOD, 5,
+      WATCHDOG_DUMP | WATCHDOG_CALLBACK | WATCHDOG_DEMOTE, on_stall, NULL);
+
+  if(!heartbeat || thread_set_rt_priority(pthread_self(), &prio) != 0)
+  {
+    atomic_store(&setup, -1);
+    return NULL;
+  }
+  atomic_store(&setup, 1);
+
+  memset(&attr, 0x00, sizeof(struct periodic_task_attr));
+  attr.heartbeat = heartbeat;
+  thread_periodic_task_attr(task, NULL, PERIOD, &attr);
+  return NULL;
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  struct watchdog_config config;
+  struct timespec delay = {.tv_sec = 0, .tv_nsec = 10000000};
+  pthread_t th;
+  int ret = EXIT_SUCCESS;
+
+  (void)argc;
+  (void)argv;
+
+  tsc_init(0);
+  atomic_init(&cycles, 0);
+  atomic_init(&callbacks, 0);
+  atomic_init(&setup, 0);
+
+  config.cpu = -1;
+  config.priority.policy = SCHED_FIFO;
+  config.priority.priority = 50;
+  config.interval = PERIOD;
+
+  watchdog = watchdog_start(&config);
+  if(!watchdog)
+  {
+    int err = errno;
+
+    perror("watchdog_start");
+    /* not allowed to use real-time priorities here */
+    exit(err == EPERM ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  if(pthread_create(&th, NULL, th_task, NULL) != 0)
+  {
+    fprintf(stderr, "Failed to launch thread\n");
+    exit(EXIT_FAILURE);
+  }
+
+  while(atomic_load(&setup) == 0)
+  {
+    nanosleep(&delay, NULL);
+  }
+
+  if(atomic_load(&setup) != 1)
+  {
+    fprintf(stderr, "Failed to setup task\n");
+    pthread_join(th, NULL);
+    watchdog_stop(watchdog);
+    exit(EXIT_FAILURE);
+  }
+
+  /* stall detected, task demoted and beating again */
+  for(int i = 0 ; i < 300 && atomic_load(&cycles) < 2 * STALL_CYCLE ; i++)
+  {
+    nanosleep(&delay, NULL);
+  }
+
+  fprintf(stdout, "Cycles %d stalls %lu callbacks %d\n",
+      atomic_load(&cycles), (unsigned long)watchdog_get_stalls(heartbeat),
+      atomic_load(&callbacks));
+
+  if(atomic_load(&cycles) < 2 * STALL_CYCLE ||
+      watchdog_get_stalls(heartbeat) != 1 || atomic_load(&callbacks) != 1)
+  {
+    fprintf(stderr, "Stall not handled\n");
+    ret = EXIT_FAILURE;
+  }
+
+  pthread_cancel(th);
+  pthread_join(th, NULL);
+  watchdog_unregister(watchdog, heartbeat);
+  watchdog_stop(watchdog);
+
+  if(ret == EXIT_SUCCESS)
+  {
+    fprintf(stdout, "Watchdog OK\n");
+  }
+  return ret;
+}
@@ -0,0 +1,590 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file rtcheck.c
+ * \brief Audit of the real-time readiness of the system.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sched.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "rtutils.h"
+#include "cpuidle.h"
+#include "sysinfo.h"
+
+/**
+ * \brief Maximum number of CPUs handled.
+ */
+#define RTCHECK_MAX_CPUS 1024
+
+/**
+ * \enum check_result
+ * \brief Result of a check.
+ */
+enum check_result
+{
+  /**
+   * \brief Information only, not scored.
+   */
+  CHECK_INFO,
+
+  /**
+   * \brief Check not applicable on this system, not scored.
+   */
+  CHECK_SKIP,
+
+  /**
+   * \brief Check passed (full weight).
+   */
+  CHECK_PASS,
+
+  /**
+   * \brief Check passed with a warning (half weight).
+   */
+  CHECK_WARN,
+
+  /**
+   * \brief Check failed (no weight).
+   */
+  CHECK_FAIL,
+};
+
+/**
+ * \struct report
+ * \brief Scored report.
+ */
+struct report
+{
+  /**
+   * \brief Points obtained.
+   */
+  unsigned int score;
+
+  /**
+   * \brief Maximum points.
+   */
+  unsigned int total;
+
+  /**
+   * \brief Number of failed checks.
+   */
+  unsigned int fails;
+
+  /**
+   * \brief Number of warnings.
+   */
+  unsigned int warns;
+
+  /**
+   * \brief If not 0, only the summary is printed.
+   */
+  int quiet;
+};
+
+/**
+ * \brief Labels of the results.
+ */
+static const char* const CHECK_LABELS[] =
+{
+  "INFO",
+  "SKIP",
+  "PASS",
+  "WARN",
+  "FAIL",
+};
+
+/**
+ * \brief Adds the result of a check to the report.
+ * \param report the report.
+ * \param result result of the check.
+ * \param weight weight of the check.
+ * \param name name of the check.
+ * \param fmt printf-like format of the details.
+ */
+static void report_add(struct report* report, enum check_result result,
+    unsigned int weight, const char* name, const char* fmt, ...)
+  __attribute__((format(printf, 5, 6)));
+
+static void report_add(struct report* report, enum check_result result,
+    unsigned int weight, const char* name, const char* fmt, ...)
+{
+  va_list args;
+
+  switch(result)
+  {
+    case CHECK_PASS:
+      report->score += weight * 2;
+      report->total += weight * 2;
+      break;
+    case CHECK_WARN:
+      report->score += weight;
+      report->total += weight * 2;
+      report->warns++;
+      break;
+    case CHECK_FAIL:
+      report->total += weight * 2;
+      report->fails++;
+      break;
+    default:
+      break;
+  }
+
+  if(report->quiet)
+  {
+    return;
+  }
+
+  fprintf(stdout, "[%s] %-24s ", CHECK_LABELS[result], name);
+  va_start(args, fmt);
+  vfprintf(stdout, fmt, args);
+  va_end(args);
+  fprintf(stdout, "\n");
+}
+
+/**
+ * \brief Returns if all the CPUs are in a set.
+ * \param cpus CPUs to look for.
+ * \param nb number of CPUs to look for.
+ * \param set set of CPUs.
+ * \param set_nb size of the set.
+ * \return number of CPUs found in the set.
+ */
+static int count_in_set(const int* cpus, int nb, const int* set, int set_nb)
+{
+  int found = 0;
+
+  for(int i = 0 ; i < nb ; i++)
+  {
+    for(int j = 0 ; j < set_nb ; j++)
+    {
+      if(cpus[i] == set[j])
+      {
+        found++;
+        break;
+      }
+    }
+  }
+
+  return found;
+}
+
+/**
+ * \brief Checks the kernel.
+ * \param report the report.
+ */
+static void check_kernel(struct report* report)
+{
+  static const char* const models[] = {"none/voluntary", "full", "RT"};
+  enum sysinfo_preempt preempt = sysinfo_get_preempt();
+  char clocksource[64];
+
+  if(preempt == SYSINFO_PREEMPT_UNKNOWN)
+  {
+    report_add(report, CHECK_WARN, 3, "Preemption model", "unknown");
+  }
+  else
+  {
+    report_add(report, preempt == SYSINFO_PREEMPT_RT ? CHECK_PASS :
+        preempt == SYSINFO_PREEMPT_FULL ? CHECK_WARN : CHECK_FAIL, 3,
+        "Preemption model", "%s", models[preempt]);
+  }
+
+  if(sysinfo_get_clocksource(clocksource, sizeof(clocksource)) != 0)
+  {
+    report_add(report, CHECK_SKIP, 1, "Clocksource", "unknown");
+  }
+  else
+  {
+    report_add(report, !strcmp(clocksource, "tsc") ? CHECK_PASS : CHECK_WARN,
+        1, "Clocksource", "%s", clocksource);
+  }
+}
+
+/**
+ * \brief Checks RT throttling.
+ * \param report the report.
+ */
+static void check_throttling(struct report* report)
+{
+  struct rt_throttling_status status;
+  long runtime = 0;
+  long period = 0;
+
+  if(rt_get_throttling(&runtime, &period) != 0)
+  {
+    report_add(report, CHECK_SKIP, 2, "RT throttling", "%s",
+        strerror(errno));
+  }
+  else if(runtime == -1)
+  {
+    report_add(report, CHECK_PASS, 2, "RT throttling", "disabled");
+  }
+  else
+  {
+    report_add(report, runtime * 100 >= period * 95 ? CHECK_PASS : CHECK_WARN,
+        2, "RT throttling", "%ld/%ld us", runtime, period);
+  }
+
+  if(rt_get_throttling_status(&status) != 0)
+  {
+    report_add(report, CHECK_SKIP, 2, "RT throttling events",
+        "kernel log not readable");
+  }
+  else
+  {
+    /* a past event may predate the tuning, only current one is fatal */
+    report_add(report, status.throttled > 0 ? CHECK_FAIL :
+        status.logged ? CHECK_WARN : CHECK_PASS, 2, "RT throttling events",
+        "%s", status.throttled > 0 ? "RT runqueue currently throttled" :
+        status.logged ? "throttling activated since boot" : "none");
+  }
+}
+
+/**
+ * \brief Checks the resource limits.
+ *
+ * Capabilities bypass the limits whatever the user, a finite memory lock
+ * limit is only judged against the size required by the application.
+ * \param report the report.
+ * \param min_memlock memory the application locks in bytes, 0 if unknown.
+ */
+static void check_limits(struct report* report, unsigned long min_memlock)
+{
+  const struct rt_caps* caps = rt_caps_get();
+  struct rlimit lim;
+
+  if(caps->cap_ipc_lock)
+  {
+    report_add(report, CHECK_PASS, 2, "Memory lock limit", "CAP_IPC_LOCK");
+  }
+  else if(getrlimit(RLIMIT_MEMLOCK, &lim) == 0)
+  {
+    if(lim.rlim_cur == RLIM_INFINITY)
+    {
+      report_add(report, CHECK_PASS, 2, "Memory lock limit", "unlimited");
+    }
+    else
+    {
+      report_add(report, min_memlock == 0 ? CHECK_WARN :
+          lim.rlim_cur >= min_memlock ? CHECK_PASS : CHECK_FAIL, 2,
+          "Memory lock limit", "%llu bytes", (unsigned long long)lim.rlim_cur);
+    }
+  }
+
+  if(caps->cap_sys_nice)
+  {
+    report_add(report, CHECK_PASS, 2, "RT priority limit", "CAP_SYS_NICE");
+  }
+  else if(getrlimit(RLIMIT_RTPRIO, &lim) == 0)
+  {
+    report_add(report, lim.rlim_cur > 0 ? CHECK_PASS : CHECK_FAIL, 2,
+        "RT priority limit", "%llu", (unsigned long long)lim.rlim_cur);
+  }
+}
+
+/**
+ * \brief Checks the isolation of the RT CPUs.
+ * \param report the report.
+ * \param cpus RT CPUs.
+ * \param nb number of RT CPUs.
+ * \param all 1 if RT CPUs are all the online CPUs.
+ */
+static void check_isolation(struct report* report, const int* cpus, int nb,
+    int all)
+{
+  static int set[RTCHECK_MAX_CPUS];
+  int set_nb = 0;
+  int smt = sysinfo_get_smt_active();
+
+  set_nb = sysinfo_get_isolated_cpus(set, RTCHECK_MAX_CPUS);
+  if(set_nb < 0)
+  {
+    report_add(report, CHECK_SKIP, 2, "Isolated CPUs", "unknown");
+  }
+  else
+  {
+    int found = count_in_set(cpus, nb, set, set_nb);
+
+    report_add(report, found == nb ? CHECK_PASS : CHECK_WARN, 2,
+        "Isolated CPUs", "%d/%d RT CPUs isolated", found, nb);
+  }
+
+  set_nb = sysinfo_get_nohz_full_cpus(set, RTCHECK_MAX_CPUS);
+  if(set_nb < 0)
+  {
+    report_add(report, CHECK_SKIP, 1, "nohz_full CPUs", "unknown");
+  }
+  else
+  {
+    int found = count_in_set(cpus, nb, set, set_nb);
+
+    report_add(report, found == nb ? CHECK_PASS : CHECK_WARN, 1,
+        "nohz_full CPUs", "%d/%d RT CPUs without tick", found, nb);
+  }
+
+  if(all)
+  {
+    report_add(report, CHECK_SKIP, 2, "IRQ placement",
+        "no dedicated RT CPU");
+  }
+  else
+  {
+    int irqs = sysinfo_count_irqs_on_cpus(cpus, nb);
+
+    if(irqs < 0)
+    {
+      report_add(report, CHECK_SKIP, 2, "IRQ placement", "%s",
+          strerror(errno));
+    }
+    else
+    {
+      report_add(report, irqs == 0 ? CHECK_PASS : CHECK_WARN, 2,
+          "IRQ placement", "%d IRQs can target RT CPUs", irqs);
+    }
+  }
+
+  if(smt < 0)
+  {
+    report_add(report, CHECK_SKIP, 1, "SMT", "unknown");
+  }
+  else
+  {
+    report_add(report, smt ? CHECK_WARN : CHECK_PASS, 1, "SMT", "%s",
+        smt ? "active" : "inactive");
+  }
+}
+
+/**
+ * \brief Checks frequency and idle states of a CPU.
+ * \param report the report.
+ * \param cpu CPU id.
+ * \param max_latency maximum exit latency of enabled C-states (us).
+ */
+static void check_cpu(struct report* report, int cpu,
+    unsigned long max_latency)
+{
+  static struct cpuidle_state states[64];
+  char governor[CPUFREQ_NAME_SIZE];
+  char name[32];
+  unsigned long min = 0;
+  unsigned long max = 0;
+  unsigned long hw_min = 0;
+  unsigned long hw_max = 0;
+  int nb = 0;
+
+  snprintf(name, sizeof(name), "Governor cpu%d", cpu);
+  if(cpufreq_get_governor_name(cpu, governor, sizeof(governor)) != 0)
+  {
+    report_add(report, CHECK_SKIP, 2, name, "no cpufreq");
+  }
+  else
+  {
+    enum cpufreq_governor mode = cpufreq_get_governor(cpu);
+
+    report_add(report, mode == CPUFREQ_PERFORMANCE ||
+        mode == CPUFREQ_USERSPACE ? CHECK_PASS : CHECK_FAIL, 2, name, "%s",
+        governor);
+  }
+
+  snprintf(name, sizeof(name), "Frequency cpu%d", cpu);
+  if(cpufreq_get_limits(cpu, &min, &max) != 0 ||
+      cpufreq_get_hw_limits(cpu, &hw_min, &hw_max) != 0)
+  {
+    report_add(report, CHECK_SKIP, 1, name, "no cpufreq");
+  }
+  else
+  {
+    report_add(report, min == max ? CHECK_PASS : CHECK_WARN, 1, name,
+        "%lu kHz (limits %lu-%lu, hardware %lu-%lu)",
+        cpufreq_get_frequency(cpu), min, max, hw_min, hw_max);
+  }
+
+  snprintf(name, sizeof(name), "C-states cpu%d", cpu);
+  nb = cpuidle_get_states(cpu, states, sizeof(states) /
+      sizeof(struct cpuidle_state));
+  if(nb < 0)
+  {
+    report_add(report, CHECK_SKIP, 2, name, "no cpuidle");
+  }
+  else
+  {
+    unsigned long worst = 0;
+    int32_t qos = pm_qos_get_latency();
+
+    for(int i = 0 ; i < nb ; i++)
+    {
+      if(!states[i].disabled && states[i].latency > worst)
+      {
+        worst = states[i].latency;
+      }
+    }
+
+    /* a PM QoS request of another process also limits the states */
+    report_add(report, worst <= max_latency ||
+        (qos >= 0 && (unsigned long)qos <= max_latency) ? CHECK_PASS :
+        CHECK_WARN, 2, name, "worst exit latency %lu us (PM QoS %d us)",
+        worst, (int)qos);
+  }
+}
+
+/**
+ * \brief Prints the scheduling settings of the calling process.
+ * \param report the report.
+ */
+static void info_process(struct report* report)
+{
+  static int cpus[RTCHECK_MAX_CPUS];
+  struct rt_prio prio;
+  struct rt_uclamp uclamp;
+  int nb = 0;
+
+  if(process_get_rt_priority(0, &prio) == 0)
+  {
+    report_add(report, CHECK_INFO, 0, "Process policy", "%s priority %u "
+        "nice %d", prio.policy == SCHED_FIFO ? "fifo" :
+        prio.policy == SCHED_RR ? "rr" : "other", prio.priority,
+        process_get_priority(0));
+  }
+
+  nb = process_get_affinity(0, cpus, RTCHECK_MAX_CPUS);
+  if(nb >= 0)
+  {
+    report_add(report, CHECK_INFO, 0, "Process affinity", "%d CPUs, "
+        "running on cpu%d", nb, process_get_current_cpu());
+  }
+
+  if(process_get_uclamp(0, &uclamp) == 0)
+  {
+    report_add(report, CHECK_INFO, 0, "Process uclamp", "%u-%u",
+        uclamp.util_min, uclamp.util_max);
+  }
+}
+
+/**
+ * \brief Prints usage.
+ * \param program name of the program.
+ */
+static void usage(const char* program)
+{
+  fprintf(stdout, "Usage: %s [-c cpus] [-l latency] [-m bytes] [-s score] "
+      "[-q]\n"
+      "  -c cpus: RT CPUs (i.e. 2-3,6), default isolated or all CPUs\n"
+      "  -l latency: maximum C-state exit latency in us (default 10)\n"
+      "  -m bytes: memory locked by the application, a lower memory lock\n"
+      "     limit fails (default unknown, a finite limit is a warning)\n"
+      "  -s score: minimum score in percent to succeed (default 0)\n"
+      "  -q: only print the summary\n"
+      "Exit code is 0 if no check fails and score is reached, 1 otherwise.\n",
+      program);
+}
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return 0 if system is ready, 1 if not ready, 2 if bad usage.
+ */
+int main(int argc, char** argv)
+{
+  static int cpus[RTCHECK_MAX_CPUS];
+  struct report report;
+  unsigned long max_latency = 10;
+  unsigned long min_memlock = 0;
+  unsigned int min_score = 0;
+  unsigned int score = 0;
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  int nb = -1;
+  int opt = 0;
+
+  memset(&report, 0x00, sizeof(struct report));
+
+  while((opt = getopt(argc, argv, "c:l:m:s:qh")) != -1)
+  {
+    switch(opt)
+    {
+      case 'c':
+        nb = cpulist_parse(optarg, cpus, RTCHECK_MAX_CPUS);
+        if(nb <= 0)
+        {
+          fprintf(stderr, "Invalid CPU list: %s\n", optarg);
+          exit(2);
+        }
+        break;
+      case 'l':
+        max_latency = strtoul(optarg, NULL, 10);
+        break;
+      case 'm':
+        min_memlock = strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        min_score = strtoul(optarg, NULL, 10);
+        break;
+      case 'q':
+        report.quiet = 1;
+        break;
+      case 'h':
+        usage(argv[0]);
+        exit(0);
+      default:
+        usage(argv[0]);
+        exit(2);
+    }
+  }
+
+  /* default RT CPUs: isolated ones, otherwise all */
+  if(nb == -1)
+  {
+    nb = sysinfo_get_isolated_cpus(cpus, RTCHECK_MAX_CPUS);
+  }
+  if(nb <= 0)
+  {
+    nb = online < RTCHECK_MAX_CPUS ? (int)online : RTCHECK_MAX_CPUS;
+    for(int i = 0 ; i < nb ; i++)
+    {
+      cpus[i] = i;
+    }
+  }
+
+  check_kernel(&report);
+  check_throttling(&report);
+  check_limits(&report, min_memlock);
+  check_isolation(&report, cpus, nb, nb >= online);
+
+  for(int i = 0 ; i < nb ; i++)
+  {
+    check_cpu(&report, cpus[i], max_latency);
+  }
+
+  info_process(&report);
+
+  score = report.total ? report.score * 100 / report.total : 100;
+  fprintf(stdout, "Score: %u%% (%u failed, %u warnings)\n", score,
+      report.fails, report.warns);
+
+  return report.fails == 0 && score >= min_score ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2017 Sebastien Vincent.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file rtrestore.c
+ * \brief Restores the system knobs persisted by a crashed RT application.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tuning.h"
+
+/**
+ * \brief Main entry point.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS if success, EXIT_FAILURE otherwise.
+ */
+int main(int argc, char** argv)
+{
+  const char* path = TUNING_STATE_FILE;
+
+  if(argc > 2)
+  {
+    fprintf(stderr, "Usage: %s [state_file]\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  else if(argc == 2)
+  {
+    path = argv[1];
+  }
+
+  if(tuning_restore_file(path) != 0)
+  {
+    perror("tuning_restore_file");
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stdout, "Restored knobs from %s\n", path);
+  return EXIT_SUCCESS;
+}